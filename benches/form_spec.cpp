@@ -0,0 +1,86 @@
+// How long writing a form spec takes: the stream-based formatting helpers
+// used to do, util::writeFormSpec, and a lookup in a per-form memo like the
+// one makeFormSpecString keeps. Standalone, like the header it measures, so
+// it runs anywhere: `just bench-cpp`.
+//
+// The old code went through rlog::formatAsHex, a std::stringstream, and then
+// fmt::format. fmt isn't available outside the plugin build, so here string
+// concatenation stands in for the final fmt::format call.
+
+#include "form_spec.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using util::FormSpecBuffer;
+using util::writeFormSpec;
+
+// Keeps the compiler from optimizing the work away.
+static volatile size_t SINK = 0;
+
+struct Form
+{
+	std::string plugin;
+	uint32_t id;
+};
+
+static std::string streamedFormSpec(const Form& form)
+{
+	std::stringstream stream;
+	stream << "0x" << std::setfill('0') << std::setw(8) << std::hex << form.id;
+	const auto hexified = stream.str();
+	return form.plugin + "|" + hexified;
+}
+
+static std::string writtenFormSpec(const Form& form)
+{
+	FormSpecBuffer buffer;
+	return std::string(writeFormSpec(buffer, form.plugin, form.id));
+}
+
+template <typename F>
+static void measure(const char* name, const std::vector<Form>& forms, F&& spec)
+{
+	constexpr int ROUNDS = 200;
+	const auto started   = std::chrono::steady_clock::now();
+	for (int round = 0; round < ROUNDS; round++)
+	{
+		for (const auto& form : forms) { SINK = SINK + spec(form).size(); }
+	}
+	const auto elapsed =
+		std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started);
+	const auto calls = static_cast<double>(ROUNDS) * static_cast<double>(forms.size());
+	std::printf("%-10s %8.1f ns per spec\n", name, static_cast<double>(elapsed.count()) / calls);
+}
+
+int main()
+{
+	// A few plugins, as an equip event sees: mostly the base game, some mods.
+	const std::string plugins[] = {
+		"Skyrim.esm", "Dawnguard.esm", "Update.esm", "Unofficial Skyrim Special Edition Patch.esp"
+	};
+	std::vector<Form> forms;
+	for (uint32_t i = 0; i < 4096; i++) { forms.push_back(Form{ plugins[i % 4], 0x12eb7 + i * 0x101 }); }
+
+	std::unordered_map<const Form*, std::string> memo;
+	for (const auto& form : forms) { memo.emplace(&form, writtenFormSpec(form)); }
+
+	for (const auto& form : forms)
+	{
+		if (streamedFormSpec(form) != writtenFormSpec(form))
+		{
+			std::fprintf(stderr, "the two ways disagree about %s\n", streamedFormSpec(form).c_str());
+			return 1;
+		}
+	}
+
+	measure("stream", forms, streamedFormSpec);
+	measure("write", forms, writtenFormSpec);
+	measure("memo", forms, [&memo](const Form& form) { return memo.find(&form)->second; });
+	return 0;
+}
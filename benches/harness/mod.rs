@@ -0,0 +1,113 @@
+//! A small timing harness shared by the benches, so they need nothing the
+//! plugin doesn't already depend on. Each case is warmed up, then timed over
+//! a number of samples; we print the median time per call, with the fastest
+//! and slowest samples beside it.
+// Each bench uses only some of this.
+#![allow(dead_code)]
+
+use std::hint::black_box;
+use std::time::{Duration, Instant};
+
+/// Roughly how long one sample of a fast routine runs.
+const SAMPLE_TIME: Duration = Duration::from_millis(10);
+const WARM_UP: Duration = Duration::from_millis(500);
+
+/// Related cases, printed as `group/case`.
+pub struct Group {
+    name: String,
+    samples: usize,
+    elements: Option<u64>,
+}
+
+impl Group {
+    pub fn new(name: &str) -> Self {
+        Self {
+            name: name.to_string(),
+            samples: 50,
+            elements: None,
+        }
+    }
+
+    /// How many samples to take. Slow routines want fewer.
+    pub fn sample_size(mut self, samples: usize) -> Self {
+        self.samples = samples.max(1);
+        self
+    }
+
+    /// Each call handles this many elements; report a rate as well.
+    pub fn throughput(mut self, elements: u64) -> Self {
+        self.elements = Some(elements);
+        self
+    }
+
+    /// Time `routine`, called as many times per sample as fit in a few milliseconds.
+    pub fn bench<T>(&self, case: &str, mut routine: impl FnMut() -> T) {
+        let started = Instant::now();
+        let mut calls: u64 = 0;
+        while started.elapsed() < WARM_UP {
+            black_box(routine());
+            calls += 1;
+        }
+        let per_call = started.elapsed() / calls.max(1) as u32;
+        let batch = (SAMPLE_TIME.as_nanos() / per_call.as_nanos().max(1)).max(1) as u32;
+
+        let times = (0..self.samples)
+            .map(|_| {
+                let started = Instant::now();
+                for _ in 0..batch {
+                    black_box(routine());
+                }
+                started.elapsed().as_secs_f64() * 1e9 / f64::from(batch)
+            })
+            .collect();
+        self.report(case, times);
+    }
+
+    /// Time `routine` alone, one call per sample, with `setup` run untimed
+    /// before each call. For routines that must start from a known state.
+    pub fn bench_with_setup<S, T>(
+        &self,
+        case: &str,
+        mut setup: impl FnMut() -> S,
+        mut routine: impl FnMut(S) -> T,
+    ) {
+        black_box(routine(setup()));
+        let times = (0..self.samples)
+            .map(|_| {
+                let input = setup();
+                let started = Instant::now();
+                black_box(routine(input));
+                started.elapsed().as_secs_f64() * 1e9
+            })
+            .collect();
+        self.report(case, times);
+    }
+
+    /// Print a case's line. Times are nanoseconds per call.
+    fn report(&self, case: &str, mut times: Vec<f64>) {
+        times.sort_by(f64::total_cmp);
+        let median = times[times.len() / 2];
+        let mut line = format!(
+            "{}/{case:<24} {:>10} [{} .. {}]",
+            self.name,
+            show(median),
+            show(times[0]),
+            show(times[times.len() - 1])
+        );
+        if let Some(elements) = self.elements {
+            let rate = elements as f64 * 1e9 / median.max(f64::EPSILON);
+            line.push_str(&format!("  {rate:.0} elements/s"));
+        }
+        println!("{line}");
+    }
+}
+
+fn show(nanos: f64) -> String {
+    if nanos < 10_000.0 {
+        format!("{nanos:.1} ns")
+    } else if nanos < 10_000_000.0 {
+        format!("{:.1} µs", nanos / 1e3)
+    } else {
+        format!("{:.1} ms", nanos / 1e6)
+    }
+}
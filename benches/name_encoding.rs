@@ -0,0 +1,53 @@
+//! What decoding an item name costs, for the three kinds of names we see:
+//! plain ascii, which is nearly all of them, and legacy-encoded names from
+//! Cyrillic and Japanese plugins. Each legacy name is timed both through the
+//! per-plugin cache and through detection on its own, as every name used to
+//! be. Run with `cargo bench --bench name_encoding`.
+
+mod harness;
+
+use encoding::{EncoderTrap, EncodingRef};
+use harness::Group;
+use soulsy::controller::strings::{convert_to_utf8, name_to_utf8};
+
+/// A long name from each plugin is decoded first, so its encoding is learned.
+const CASES: &[(&str, &str, &str)] = &[
+    ("ascii", "Skyrim.esm", "Steel Dagger of Frost"),
+    (
+        "cp1251",
+        "bench-cp1251.esp",
+        "Стальной кинжал с рукоятью из драконьей кости, выкованный кузнецом Вайтрана",
+    ),
+    (
+        "shift_jis",
+        "bench-shiftjis.esp",
+        "ドラゴンの骨で作られた弓は、ホワイトランの鍛冶屋が鍛えたものです",
+    ),
+];
+
+fn encoder(case: &str) -> Option<EncodingRef> {
+    match case {
+        "cp1251" => Some(encoding::all::WINDOWS_1251),
+        "shift_jis" => Some(encoding::all::WINDOWS_31J),
+        _ => None,
+    }
+}
+
+fn main() {
+    let group = Group::new("name_to_utf8");
+    for (case, plugin, name) in CASES {
+        let bytes = match encoder(case) {
+            Some(coder) => coder
+                .encode(name, EncoderTrap::Strict)
+                .expect("the bench encoding can encode this"),
+            None => name.as_bytes().to_vec(),
+        };
+        let plugin = plugin.as_bytes();
+        assert_eq!(name_to_utf8(plugin, &bytes), *name);
+
+        group.bench(&format!("by_plugin/{case}"), || {
+            name_to_utf8(plugin, &bytes)
+        });
+        group.bench(&format!("detected/{case}"), || convert_to_utf8(&bytes));
+    }
+}
@@ -0,0 +1,47 @@
+//! How startup rasterization scales with the number of worker threads. Every
+//! svg the installer ships with the core files is rasterized once per batch,
+//! with the parsed-svg cache emptied first so each batch starts cold, as the
+//! game does. Run with `cargo bench --bench rasterize_batch` from the repo root.
+
+mod harness;
+
+use std::path::Path;
+
+use harness::Group;
+use soulsy::images::batch::rasterize_with_workers;
+use soulsy::images::forget_parsed_svgs;
+use soulsy::plugin::RasterRequest;
+
+const INSTALLER_CORE: &str = "installer/core";
+
+fn svgs_under(dir: &Path, found: &mut Vec<RasterRequest>) {
+    let Ok(entries) = std::fs::read_dir(dir) else {
+        return;
+    };
+    for path in entries.filter_map(|entry| entry.ok().map(|entry| entry.path())) {
+        if path.is_dir() {
+            svgs_under(&path, found);
+        } else if path.extension().is_some_and(|ext| ext == "svg") {
+            found.push(RasterRequest {
+                path: path.to_string_lossy().to_string(),
+                maxdim: 0,
+            });
+        }
+    }
+}
+
+fn main() {
+    let mut requests = Vec::new();
+    svgs_under(Path::new(INSTALLER_CORE), &mut requests);
+    assert!(!requests.is_empty(), "run this from the repo root");
+
+    let cores = std::thread::available_parallelism().map_or(1, |n| n.get());
+    let group = Group::new("startup_batch")
+        .sample_size(10)
+        .throughput(requests.len() as u64);
+    for workers in [1, 2, 4, 8].into_iter().filter(|&w| w == 1 || w <= cores) {
+        group.bench_with_setup(&workers.to_string(), forget_parsed_svgs, |_| {
+            rasterize_with_workers(&requests, workers)
+        });
+    }
+}
@@ -0,0 +1,38 @@
+//! How much the parsed-svg cache saves when an icon is rasterized again at a
+//! new size. Run with `cargo bench --bench svg_cache`, from the repo root so
+//! the installer's icons are where this expects them.
+
+mod harness;
+
+use std::path::PathBuf;
+
+use harness::Group;
+use soulsy::images::{forget_parsed_svgs, load_and_rasterize};
+
+/// A spread of what the HUD draws: a simple icon, a busy one, and a key image.
+const SVGS: &[&str] = &[
+    "installer/core/SKSE/plugins/resources/icons/food.svg",
+    "installer/core/SKSE/plugins/resources/icons/potion_resist_frost.svg",
+    "installer/core/SKSE/plugins/resources/buttons/0_Key_Dark.svg",
+];
+
+fn main() {
+    let group = Group::new("rasterize");
+    for svg in SVGS {
+        let path = PathBuf::from(svg);
+        let name = path
+            .file_stem()
+            .map(|stem| stem.to_string_lossy().to_string())
+            .unwrap_or_default();
+
+        // Every timed run has to start from an empty cache.
+        group.bench_with_setup(&format!("first_time/{name}"), forget_parsed_svgs, |_| {
+            load_and_rasterize(&path, Some(128)).expect("the svg should load")
+        });
+
+        load_and_rasterize(&path, Some(128)).expect("the svg should load");
+        group.bench(&format!("cached/{name}"), || {
+            load_and_rasterize(&path, Some(96)).expect("the svg should load")
+        });
+    }
+}
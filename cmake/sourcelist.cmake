@@ -13,11 +13,11 @@ set(headers ${headers}
     src/plugin/menus.h
     src/plugin/papyrus.h
     src/plugin/sinks.h
-    src/renderer/animation_handler.h
     src/renderer/image_path.h
     src/renderer/ui_renderer.h
     src/soulsy.h
     src/util/constant.h
+    src/util/form_spec.h
     src/util/helpers.h
     src/util/key_path.h
     src/util/offset.h
@@ -9,6 +9,7 @@
 
 #include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <d3d11.h>
 #include <dxgi.h>
 #include <imgui.h>
@@ -16,6 +17,8 @@
 #include <imgui_impl_win32.h>
 #include <imgui_internal.h>
 #include <locale>
+#include <mutex>
+#include <thread>
 #include <windows.h>
 #include <winuser.h>
 
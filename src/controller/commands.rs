@@ -0,0 +1,227 @@
+//! Work for the controller that doesn't need an answer right away.
+//!
+//! The render thread and the game's event sinks tell the controller about
+//! things without waiting for a response. Rather than make them wait for the
+//! controller lock, they push a `Command` onto a queue and move on. Whoever
+//! holds the controller next runs the queued commands, in the order they
+//! were pushed, before doing anything else and again before letting go.
+//!
+//! Readers that only need to know what to draw look at the most recently
+//! published `HudSnapshot` and never touch the controller at all.
+
+use std::collections::HashMap;
+use std::ptr;
+use std::sync::atomic::{AtomicPtr, Ordering};
+
+use super::control::Controller;
+use crate::data::HudItem;
+use crate::plugin::{Action, ExtraDataEvent, HudElement};
+
+/// Something the controller should do when it next gets a chance.
+#[derive(Debug, Clone, PartialEq)]
+pub enum Command {
+    /// Refresh extra data for every visible item.
+    RefreshHudItems,
+    /// An inventory count changed.
+    InventoryChanged { form_spec: String, count: u32 },
+    /// A game event changed an item's charge, poison, or cooldown.
+    ExtraData { event: ExtraDataEvent, form_spec: String },
+    /// CGO's alternate grip was toggled.
+    GripChange(bool),
+    /// An equip delay timer ran out.
+    TimerExpired(Action),
+}
+
+impl Command {
+    pub fn apply(self, ctrl: &mut Controller) {
+        match self {
+            Command::RefreshHudItems => {
+                ctrl.refresh_hud_items();
+            }
+            Command::InventoryChanged { form_spec, count } => {
+                ctrl.handle_inventory_changed(&form_spec, count);
+            }
+            Command::ExtraData { event, form_spec } => {
+                ctrl.handle_extra_data_event(event, &form_spec);
+            }
+            Command::GripChange(use_alt_grip) => ctrl.handle_grip_change(use_alt_grip),
+            Command::TimerExpired(which) => ctrl.timer_expired(which),
+        }
+    }
+}
+
+struct Node<T> {
+    item: T,
+    next: *mut Node<T>,
+}
+
+/// A multi-producer, single-consumer queue that never blocks. Producers push
+/// onto an atomic linked stack; the consumer takes the whole stack in one swap
+/// and reverses it. Producers never look inside a node once it's pushed, so
+/// there's no ABA problem to worry about.
+pub struct CommandQueue<T> {
+    head: AtomicPtr<Node<T>>,
+}
+
+// The queue owns its nodes, and items only ever move from one thread to another.
+unsafe impl<T: Send> Send for CommandQueue<T> {}
+unsafe impl<T: Send> Sync for CommandQueue<T> {}
+
+impl<T> CommandQueue<T> {
+    pub const fn new() -> Self {
+        Self {
+            head: AtomicPtr::new(ptr::null_mut()),
+        }
+    }
+
+    /// Add an item to the queue. Safe to call from any thread.
+    pub fn push(&self, item: T) {
+        let node = Box::into_raw(Box::new(Node {
+            item,
+            next: ptr::null_mut(),
+        }));
+        let mut head = self.head.load(Ordering::Relaxed);
+        loop {
+            // SAFETY: nobody else can see this node until the exchange succeeds.
+            unsafe { (*node).next = head };
+            match self
+                .head
+                .compare_exchange_weak(head, node, Ordering::Release, Ordering::Relaxed)
+            {
+                Ok(_) => return,
+                Err(current) => head = current,
+            }
+        }
+    }
+
+    /// True if nothing is waiting. A cheap check before taking any locks.
+    pub fn is_empty(&self) -> bool {
+        self.head.load(Ordering::Acquire).is_null()
+    }
+
+    /// Take everything pushed so far, oldest first. Items pushed by any one
+    /// thread come out in the order that thread pushed them.
+    pub fn take_all(&self) -> Vec<T> {
+        let mut node = self.head.swap(ptr::null_mut(), Ordering::Acquire);
+        let mut items = Vec::new();
+        while !node.is_null() {
+            // SAFETY: the swap gave us sole ownership of every node in the list.
+            let boxed = unsafe { Box::from_raw(node) };
+            node = boxed.next;
+            items.push(boxed.item);
+        }
+        items.reverse();
+        items
+    }
+}
+
+impl<T> Default for CommandQueue<T> {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl<T> Drop for CommandQueue<T> {
+    fn drop(&mut self) {
+        self.take_all();
+    }
+}
+
+impl<T> std::fmt::Debug for CommandQueue<T> {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        write!(f, "CommandQueue {{ empty: {} }}", self.is_empty())
+    }
+}
+
+/// What the HUD looked like the last time the controller let go of its lock.
+/// Never changes once published; the controller publishes a new one instead.
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct HudSnapshot {
+    pub visible: HashMap<HudElement, HudItem>,
+    pub hud_visible: bool,
+}
+
+impl HudSnapshot {
+    /// The item to draw in the given slot, or an empty item if there isn't one.
+    pub fn entry(&self, slot: HudElement) -> Box<HudItem> {
+        match self.visible.get(&slot) {
+            Some(item) => Box::new(item.clone()),
+            None => Box::<HudItem>::default(),
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::sync::Arc;
+    use std::thread;
+
+    use super::*;
+
+    #[test]
+    fn single_thread_is_fifo() {
+        let queue = CommandQueue::new();
+        assert!(queue.is_empty());
+        for i in 0..100 {
+            queue.push(i);
+        }
+        assert!(!queue.is_empty());
+        assert_eq!(queue.take_all(), (0..100).collect::<Vec<_>>());
+        assert!(queue.is_empty());
+        assert!(queue.take_all().is_empty());
+    }
+
+    #[test]
+    fn many_producers_keep_their_own_order() {
+        const PRODUCERS: usize = 8;
+        const PER_PRODUCER: usize = 5_000;
+
+        let queue = Arc::new(CommandQueue::new());
+        let mut received: Vec<(usize, usize)> = Vec::new();
+        let handles: Vec<_> = (0..PRODUCERS)
+            .map(|producer| {
+                let queue = Arc::clone(&queue);
+                thread::spawn(move || {
+                    for seq in 0..PER_PRODUCER {
+                        queue.push((producer, seq));
+                    }
+                })
+            })
+            .collect();
+
+        // Consume while the producers are still going.
+        while received.len() < PRODUCERS * PER_PRODUCER {
+            received.extend(queue.take_all());
+            thread::yield_now();
+        }
+        for handle in handles {
+            handle.join().expect("producer finished");
+        }
+        assert!(queue.take_all().is_empty());
+
+        let mut next = [0usize; PRODUCERS];
+        for (producer, seq) in received {
+            assert_eq!(seq, next[producer], "producer {producer} out of order");
+            next[producer] += 1;
+        }
+        assert!(next.iter().all(|xs| *xs == PER_PRODUCER));
+    }
+
+    #[test]
+    fn dropping_a_queue_frees_what_is_left() {
+        let counter = Arc::new(());
+        let queue = CommandQueue::new();
+        for _ in 0..10 {
+            queue.push(Arc::clone(&counter));
+        }
+        assert_eq!(Arc::strong_count(&counter), 11);
+        drop(queue);
+        assert_eq!(Arc::strong_count(&counter), 1);
+    }
+
+    #[test]
+    fn snapshots_hand_out_empty_items_for_empty_slots() {
+        let snapshot = HudSnapshot::default();
+        assert_eq!(*snapshot.entry(HudElement::Left), HudItem::default());
+    }
+}
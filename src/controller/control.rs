@@ -12,16 +12,34 @@
 //! I apologize for what a mess this is. It grew organically and the feature
 //! set is itself complex.
 
-use std::collections::HashMap;
-use std::sync::Mutex;
+use std::collections::{HashMap, HashSet};
+use std::ops::{Deref, DerefMut};
+use std::sync::{Arc, Mutex, MutexGuard, RwLock, TryLockError};
 
 use cxx::let_cxx_string;
+use enumset::EnumSet;
 use once_cell::sync::Lazy;
 use strfmt::strfmt;
 
+use super::commands::{Command, CommandQueue, HudSnapshot};
 use super::cycles::*;
+use super::glyphs::note_glyphs;
+use super::inventory::InventorySnapshot;
 use super::keys::*;
-use super::settings::{settings, ActivationMethod, UnarmedMethod};
+use super::recorder;
+use super::settings::{settings, ActivationMethod, SettingsChange, UnarmedMethod, UserSettings};
+// Under test, these stand in for the game so controller logic can run end to end.
+#[cfg(test)]
+use super::simulated::{
+    chooseHealthPotion, chooseMagickaPotion, chooseStaminaPotion, consumePotion, equipAmmo,
+    equipArmor, equipShout, equipWeapon, getAmmoInventory, hasRangedEquipped, healthPotionCount,
+    honk, isVampireLord, isWerewolf, magickaPotionCount, reequipHand, setMaxAlpha, setMinAlpha,
+    showBriefly, specEquippedAmmo, specEquippedLeft, specEquippedPower, specEquippedRight,
+    staminaPotionCount, startAlphaTransition, start_timer, stop_timer, toggleArmor, unequipSlot,
+    unequipSlotByShift, useCGOAltGrip,
+};
+#[cfg(not(test))]
+use super::timers::{start_timer, stop_timer};
 use crate::cycleentries::*;
 use crate::data::item_cache::ItemCache;
 use crate::data::potion::PotionType;
@@ -31,11 +49,148 @@ use crate::plugin::*;
 
 /// There can be only one. Not public because we want access managed.
 static CONTROLLER: Lazy<Mutex<Controller>> = Lazy::new(|| Mutex::new(Controller::new()));
-
-pub fn get() -> std::sync::MutexGuard<'static, Controller> {
-    CONTROLLER
+/// Work waiting for whoever holds the controller next.
+static COMMANDS: CommandQueue<Command> = CommandQueue::new();
+/// What the HUD should show, as of the last time the controller was released.
+static SNAPSHOT: Lazy<RwLock<Arc<HudSnapshot>>> =
+    Lazy::new(|| RwLock::new(Arc::new(HudSnapshot::default())));
+
+/// Take the controller, waiting if we must. Queued commands run first.
+pub fn get() -> ControllerGuard {
+    let guard = CONTROLLER
         .lock()
-        .expect("Unrecoverable runtime problem: cannot acquire controller lock. Exiting.")
+        .expect("Unrecoverable runtime problem: cannot acquire controller lock. Exiting.");
+    ControllerGuard::new(guard, true)
+}
+
+/// Take the controller only if nobody else has it. This is for the render
+/// thread, so it never waits on a key or equip event being handled. Queued
+/// commands are left for `drain_commands()`.
+pub fn try_get() -> Option<ControllerGuard> {
+    match CONTROLLER.try_lock() {
+        Ok(guard) => Some(ControllerGuard::new(guard, false)),
+        Err(TryLockError::WouldBlock) => None,
+        Err(TryLockError::Poisoned(_)) => {
+            panic!("Unrecoverable runtime problem: cannot acquire controller lock. Exiting.")
+        }
+    }
+}
+
+/// Queue a command for the controller and return without waiting. If the
+/// controller is free, the command runs now; otherwise the current holder
+/// runs it after letting go.
+pub fn submit(command: Command) {
+    COMMANDS.push(command);
+    drain();
+}
+
+/// Queue a command without running anything. The render thread uses this
+/// while it's busy with the HUD; the commands run at its next
+/// `drain_commands()`, or sooner if another game thread takes the controller.
+pub fn post(command: Command) {
+    COMMANDS.push(command);
+}
+
+/// Run whatever is queued, if the controller is free. The renderer calls this
+/// once a frame, so queued game calls happen on a thread the game gave us.
+pub fn drain_commands() {
+    drain();
+}
+
+/// Run queued commands until there are none, or until someone else holds the
+/// controller. Whoever holds it checks the queue again after letting go, so a
+/// command pushed while we were busy is never stranded.
+fn drain() {
+    while !COMMANDS.is_empty() {
+        match CONTROLLER.try_lock() {
+            Ok(mut guard) => {
+                guard.run_commands(&COMMANDS);
+                publish(&mut guard);
+            }
+            Err(TryLockError::WouldBlock) => return,
+            Err(TryLockError::Poisoned(_)) => {
+                panic!("Unrecoverable runtime problem: cannot acquire controller lock. Exiting.")
+            }
+        }
+    }
+}
+
+/// Publish a new snapshot if what's visible changed since the last one.
+fn publish(controller: &mut Controller) {
+    let hud_visible = snapshot().hud_visible;
+    if let Some(fresh) = controller.changed_snapshot(hud_visible) {
+        let fresh = Arc::new(fresh);
+        match SNAPSHOT.write() {
+            Ok(mut published) => *published = fresh,
+            Err(poisoned) => *poisoned.into_inner() = fresh,
+        }
+    }
+}
+
+/// The most recently published view of the HUD. Cheap; never waits on the controller.
+pub fn snapshot() -> Arc<HudSnapshot> {
+    match SNAPSHOT.read() {
+        Ok(published) => Arc::clone(&published),
+        Err(poisoned) => Arc::clone(&poisoned.into_inner()),
+    }
+}
+
+/// Access to the controller. Publishes a new snapshot when dropped if what's
+/// visible changed. A guard from `get()` also runs queued commands when taken
+/// and once it has let go; one from `try_get()` leaves them for
+/// `drain_commands()`.
+pub struct ControllerGuard {
+    guard: Option<MutexGuard<'static, Controller>>,
+    runs_commands: bool,
+}
+
+impl ControllerGuard {
+    fn new(mut guard: MutexGuard<'static, Controller>, runs_commands: bool) -> Self {
+        if runs_commands {
+            guard.run_commands(&COMMANDS);
+        }
+        Self {
+            guard: Some(guard),
+            runs_commands,
+        }
+    }
+}
+
+impl Deref for ControllerGuard {
+    type Target = Controller;
+
+    fn deref(&self) -> &Self::Target {
+        self.guard
+            .as_ref()
+            .expect("the guard is held until dropped")
+    }
+}
+
+impl DerefMut for ControllerGuard {
+    fn deref_mut(&mut self) -> &mut Self::Target {
+        self.guard
+            .as_mut()
+            .expect("the guard is held until dropped")
+    }
+}
+
+impl Drop for ControllerGuard {
+    fn drop(&mut self) {
+        let Some(mut guard) = self.guard.take() else {
+            return;
+        };
+        if self.runs_commands {
+            guard.run_commands(&COMMANDS);
+        }
+        publish(&mut guard);
+        drop(guard);
+
+        // Anything pushed after we last looked would otherwise wait for
+        // whoever happens to take the controller next.
+        if self.runs_commands && !COMMANDS.is_empty() {
+            drain();
+        }
+    }
 }
 
 /// What, model/view/controller? In my UI application? oh no
@@ -55,10 +210,21 @@ pub struct Controller {
     right_hand_cached: String,
     /// We need to track keystate to implement modifier keys.
     tracked_keys: HashMap<u32, TrackedKey>,
+    /// What each key code means under the current settings.
+    keys: KeyMap,
+    /// The settings last applied, so the next apply can skip what didn't change.
+    applied_settings: Option<UserSettings>,
     /// True if we're using CGO's alternative grip.
     cgo_alt_grip: bool,
+    /// Visible slots whose charge, poison, or cooldown data is out of date.
+    stale_extra_data: HashSet<HudElement>,
+    /// True if `visible` may have changed since the last snapshot was made.
+    visible_changed: bool,
 }
 
+/// The slots that show items with extra data worth refreshing.
+const EXTRA_DATA_SLOTS: [HudElement; 3] = [HudElement::Power, HudElement::Left, HudElement::Right];
+
 impl Controller {
     /// Make a controller with no information in it.
     pub fn new() -> Self {
@@ -70,14 +236,80 @@ impl Controller {
             left_hand_cached: "".to_string(),
             right_hand_cached: "".to_string(),
             tracked_keys: HashMap::new(),
+            keys: KeyMap::new(&settings()),
+            applied_settings: None,
             cgo_alt_grip: false,
+            stale_extra_data: HashSet::new(),
+            visible_changed: false,
+        }
+    }
+
+    /// Run every queued command, oldest first.
+    pub fn run_commands(&mut self, queue: &CommandQueue<Command>) {
+        if queue.is_empty() {
+            return;
+        }
+        for command in queue.take_all() {
+            // Recorded once it has run, after any item lookups it made.
+            let recorded = recorder::is_recording().then(|| command.clone());
+            command.apply(self);
+            if let Some(command) = recorded {
+                recorder::record_command(&command);
+            }
+        }
+    }
+
+    /// A read-only copy of what the HUD should show right now.
+    pub fn make_snapshot(&self) -> HudSnapshot {
+        HudSnapshot {
+            visible: self.visible.clone(),
+            hud_visible: self.cycles.hud_visible,
         }
     }
 
+    /// A new snapshot, if anything has changed since the last one. The
+    /// caller says whether the last one had the HUD visible.
+    fn changed_snapshot(&mut self, hud_visible: bool) -> Option<HudSnapshot> {
+        if !self.visible_changed && hud_visible == self.cycles.hud_visible {
+            return None;
+        }
+        self.visible_changed = false;
+        Some(self.make_snapshot())
+    }
+
+    /// A visible item we're about to change. Marks the visible items as
+    /// changed, so the next snapshot picks it up.
+    fn visible_mut(&mut self, element: &HudElement) -> Option<&mut HudItem> {
+        let item = self.visible.get_mut(element)?;
+        self.visible_changed = true;
+        Some(item)
+    }
+
     /// Called after a save load to initialize state. The validate function logs out cycles.
     pub fn refresh_after_load(&mut self) {
-        self.cycles.validate(&mut self.cache);
+        // The loaded cycles were saved under whatever settings were current
+        // then, so bring them in line with the settings now.
+        let settings = settings();
+        self.apply_unarmed_setting(&settings);
+        self.apply_potion_grouping(&settings);
+        let inventory = InventorySnapshot::from_game();
+        self.cycles.validate(&mut self.cache, &inventory);
         self.update_hud();
+        self.note_cycle_glyphs();
+    }
+
+    /// Get the font ready for every name we might cycle to, all at once.
+    fn note_cycle_glyphs(&mut self) {
+        let mut names = self.cycles.equipset_names();
+        for which in [
+            CycleSlot::Power,
+            CycleSlot::Utility,
+            CycleSlot::Left,
+            CycleSlot::Right,
+        ] {
+            names.extend(self.cycles.names(&which, &mut self.cache));
+        }
+        note_glyphs(names.iter().map(String::as_str));
     }
 
     /// Called by the MCM cycle clear button.
@@ -109,10 +341,56 @@ impl Controller {
         }
     }
 
-    /// Called after any settings file read to enforce them.
-    pub fn apply_settings(&mut self) {
+    /// Tell the input sink which keys we care about under the current settings.
+    pub fn publish_keys(&self) {
+        self.keys.publish();
+    }
+
+    /// Called after any settings file read to enforce them. Only the work the
+    /// change calls for gets done; the first call does all of it. Returns
+    /// what changed.
+    pub fn apply_settings(&mut self) -> EnumSet<SettingsChange> {
         let settings = settings();
+        let changes = match &self.applied_settings {
+            Some(previous) => previous.changes_to(&settings),
+            None => EnumSet::all(),
+        };
+        log::debug!("settings changes to apply: {changes:?}");
+
+        if changes.contains(SettingsChange::Keys) {
+            self.keys = KeyMap::new(&settings);
+        }
+        if changes.contains(SettingsChange::Unarmed) {
+            self.apply_unarmed_setting(&settings);
+        }
+        if changes.contains(SettingsChange::PotionGrouping) {
+            self.apply_potion_grouping(&settings);
+        }
+        if changes.contains(SettingsChange::Alpha) {
+            setMaxAlpha(settings.max_alpha());
+            setMinAlpha(settings.min_alpha());
+
+            if !settings.autofade() {
+                if self.cycles.hud_visible() {
+                    startAlphaTransition(true, 1.0);
+                } else {
+                    startAlphaTransition(false, 0.0);
+                }
+            }
+        }
+        if changes.contains(SettingsChange::LayoutGeometry) {
+            // Apply any new anchor relocations to the current layout.
+            Layout::reflatten();
+        }
 
+        self.applied_settings = Some(settings);
+        if !changes.is_empty() {
+            self.cache.introspect();
+        }
+        changes
+    }
+
+    fn apply_unarmed_setting(&mut self, settings: &UserSettings) {
         match settings.unequip_method() {
             UnarmedMethod::AddToCycles => {
                 let h2h = HudItem::make_unarmed_proxy();
@@ -128,7 +406,9 @@ impl Controller {
                     .filter_kind(&CycleSlot::Right, &BaseType::HandToHand, &mut self.cache);
             }
         }
+    }
 
+    fn apply_potion_grouping(&mut self, settings: &UserSettings) {
         if settings.group_potions() {
             self.cycles.filter_kind(
                 &CycleSlot::Utility,
@@ -164,37 +444,87 @@ impl Controller {
             let proxy = make_magicka_proxy();
             self.cycles.remove_item(CycleSlot::Utility, &proxy);
         }
+    }
 
-        setMaxAlpha(settings.max_alpha());
-        setMinAlpha(settings.min_alpha());
-
-        if !settings.autofade() {
-            if self.cycles.hud_visible() {
-                startAlphaTransition(true, 1.0);
-            } else {
-                startAlphaTransition(false, 0.0);
+    /// For all visible items, refresh data used by the renderer. Events drive
+    /// most refreshes, so the renderer calls this only on a slow timer, as a
+    /// safety net for changes we never hear about. Returns how many items
+    /// were refreshed.
+    pub fn refresh_hud_items(&mut self) -> usize {
+        self.stale_extra_data.clear();
+        let mut refreshed = 0;
+        for element in EXTRA_DATA_SLOTS {
+            if let Some(item) = self.visible_mut(&element) {
+                item.refresh_extra_data();
+                refreshed += 1;
             }
         }
-
-        // Apply any new anchor relocations to the current layout.
-        Layout::refresh();
-
-        self.cache.introspect();
+        refreshed
     }
 
-    /// For all visible items, refresh data used by the renderer that might
-    /// have changed in the last N draw cycles, where N is a count controlled
-    /// by the renderer itself.
-    pub fn refresh_hud_items(&mut self) {
-        // The only relevant items are shouts, left, and right hand.
-        if let Some(power) = self.visible.get_mut(&HudElement::Power) {
-            power.refresh_extra_data();
+    /// Refresh extra data for the visible items some event marked as stale.
+    /// This does nothing when no events have arrived, so it's fine to call
+    /// every frame. Returns how many items were refreshed.
+    pub fn refresh_stale_hud_items(&mut self) -> usize {
+        // A shout cooldown that ran out is over; no need to wait for the game to say so.
+        let now = std::time::Instant::now();
+        if self
+            .visible
+            .get(&HudElement::Power)
+            .is_some_and(|item| item.cooldown_finished(now))
+        {
+            if let Some(item) = self.visible_mut(&HudElement::Power) {
+                item.end_finished_cooldown(now);
+            }
+        }
+        if self.stale_extra_data.is_empty() {
+            return 0;
         }
-        if let Some(left) = self.visible.get_mut(&HudElement::Left) {
-            left.refresh_extra_data();
+
+        let mut refreshed = 0;
+        for element in self.stale_extra_data.drain() {
+            let Some(item) = self.visible_mut(&element) else {
+                continue;
+            };
+            item.refresh_extra_data();
+            refreshed += 1;
         }
-        if let Some(right) = self.visible.get_mut(&HudElement::Right) {
-            right.refresh_extra_data();
+        refreshed
+    }
+
+    /// The game told us something that might change the charge, poison, or
+    /// cooldown status of an item. Mark any slots affected so the next frame
+    /// picks up the change. We don't refresh here because the game might not
+    /// have finished updating the item's extra data yet.
+    pub fn handle_extra_data_event(&mut self, event: ExtraDataEvent, form_spec: &str) {
+        match event {
+            ExtraDataEvent::ChargeUsed => {
+                // The form spec is the weapon used, so we can be precise.
+                for element in [HudElement::Left, HudElement::Right] {
+                    if let Some(item) = self.visible.get(&element) {
+                        if item.form_string() == form_spec {
+                            self.stale_extra_data.insert(element);
+                        }
+                    }
+                }
+            }
+            ExtraDataEvent::PoisonApplied | ExtraDataEvent::Recharged => {
+                // The form spec is the poison or soul gem used up, which doesn't
+                // tell us which weapon benefited. Check both hands.
+                for element in [HudElement::Left, HudElement::Right] {
+                    if self.visible.contains_key(&element) {
+                        self.stale_extra_data.insert(element);
+                    }
+                }
+            }
+            ExtraDataEvent::ShoutCooldownStarted => {
+                if let Some(item) = self.visible.get(&HudElement::Power) {
+                    if item.is_power() {
+                        self.stale_extra_data.insert(HudElement::Power);
+                    }
+                }
+            }
+            _ => {}
         }
     }
 
@@ -214,7 +544,7 @@ impl Controller {
         );
 
         if kind.is_ammo() {
-            if let Some(candidate) = self.visible.get_mut(&HudElement::Ammo) {
+            if let Some(candidate) = self.visible_mut(&HudElement::Ammo) {
                 if candidate.form_string() == *form_spec {
                     candidate.set_count(new_count);
                 }
@@ -233,7 +563,7 @@ impl Controller {
                 }
             }
 
-            if let Some(candidate) = self.visible.get_mut(&HudElement::Utility) {
+            if let Some(candidate) = self.visible_mut(&HudElement::Utility) {
                 let visible_spec = candidate.form_string();
                 if visible_spec == *form_spec {
                     candidate.set_count(new_count);
@@ -249,7 +579,7 @@ impl Controller {
             // This entire code block is unlikely to execute because we are
             // consistently getting the unequip message first. Unfortunately
             // we have no idea at that time *why* the unequip event happened.
-            if let Some(candidate) = self.visible.get_mut(&HudElement::Left) {
+            if let Some(candidate) = self.visible_mut(&HudElement::Left) {
                 if candidate.form_string() == *form_spec {
                     candidate.set_count(new_count);
                     if new_count == 0 {
@@ -257,7 +587,7 @@ impl Controller {
                     }
                 }
             }
-            if let Some(candidate) = self.visible.get_mut(&HudElement::Right) {
+            if let Some(candidate) = self.visible_mut(&HudElement::Right) {
                 if candidate.form_string() == *form_spec {
                     candidate.set_count(new_count);
                     if new_count == 0 {
@@ -309,18 +639,29 @@ impl Controller {
         }
     }
 
+    /// Handle all the button events from one input event list, in the order
+    /// the game sent them. Modifiers pressed earlier in a batch are seen as
+    /// held by the keys that follow them. Returns one response per event.
+    pub fn handle_key_events(&mut self, events: &[ButtonPress]) -> Vec<KeyEventResponse> {
+        events
+            .iter()
+            .map(|press| self.handle_key_event(press))
+            .collect()
+    }
+
     /// Handle a gameplay key-press event that the event system decided we need to know about.
     ///
     /// Returns an enum indicating what we did in response, so that the C++ layer can
     /// start a tick timer for cycle delay.
-    pub fn handle_key_event(&mut self, key: u32, button: &ButtonEvent) -> KeyEventResponse {
-        if matches!(Hotkey::from(key), Hotkey::None) {
+    pub fn handle_key_event(&mut self, press: &ButtonPress) -> KeyEventResponse {
+        let key = press.key;
+        if matches!(self.keys.hotkey(key), Hotkey::None) {
             return KeyEventResponse::default();
         }
 
         // This call starts and stops long-press timers as well.
         // It returns nothing if the handler should take no further action.
-        let Some(tracked) = self.create_or_update_tracked(key, button, false) else {
+        let Some(tracked) = self.create_or_update_tracked(key, press, false) else {
             return KeyEventResponse::default();
         };
 
@@ -484,7 +825,7 @@ impl Controller {
     /// Only used for right and left hand.
     fn requested_keyup_action(&self, tracked: TrackedKey) -> RequestedAction {
         let options = settings();
-        let is_long_press = tracked.is_long_press();
+        let is_long_press = tracked.is_long_press(self.keys.long_press());
 
         let unequip_requested = match options.unequip_method() {
             UnarmedMethod::LongPress => is_long_press,
@@ -908,35 +1249,35 @@ impl Controller {
                 let do_this = Hotkey::Left.long_press_action();
                 if !matches!(do_this, RequestedAction::None) {
                     self.do_hand_action(do_this, Action::Left, CycleSlot::Left);
-                    stopTimer(Action::Left);
+                    stop_timer(Action::Left);
                 }
             }
             Action::LongPressRight => {
                 let do_this = Hotkey::Right.long_press_action();
                 if !matches!(do_this, RequestedAction::None) {
                     self.do_hand_action(do_this, Action::Right, CycleSlot::Right);
-                    stopTimer(Action::Right);
+                    stop_timer(Action::Right);
                 }
             }
             Action::LongPressPower => match Hotkey::Power.long_press_action() {
                 RequestedAction::Advance => {
                     self.advance_cycle_power();
-                    stopTimer(Action::Power);
+                    stop_timer(Action::Power);
                 }
                 RequestedAction::Unequip => {
                     unequipSlot(Action::Power);
-                    stopTimer(Action::Power);
+                    stop_timer(Action::Power);
                 }
                 _ => {}
             },
             Action::LongPressUtility => match Hotkey::Utility.long_press_action() {
                 RequestedAction::Advance => {
                     self.handle_cycle_utility();
-                    stopTimer(Action::Utility);
+                    stop_timer(Action::Utility);
                 }
                 RequestedAction::Consume => {
                     self.use_utility_item();
-                    stopTimer(Action::Utility);
+                    stop_timer(Action::Utility);
                 }
                 _ => {}
             },
@@ -1269,17 +1610,6 @@ impl Controller {
         left_unexpected || right_unexpected
     }
 
-    /// Get the item equipped in a specific slot.
-    /// Called by the HUD rendering loop in the ImGui code.
-    pub fn entry_to_show_in_slot(&self, slot: HudElement) -> Box<HudItem> {
-        let Some(candidate) = self.visible.get(&slot) else {
-            // log::debug!("nothing to draw in slot {slot:?}");
-            return Box::<HudItem>::default();
-        };
-
-        Box::new(candidate.clone()) // this clone is in a hot path
-    }
-
     /// Call when loading or otherwise needing to reinitialize the HUD.
     ///
     /// Updates will only happen here if the player changed equipment
@@ -1354,6 +1684,11 @@ impl Controller {
     /// Update the displayed slot for the specified HUD element.
     fn update_slot(&mut self, slot: HudElement, new_item: &HudItem) -> bool {
         log::trace!("updating hud slot '{slot}'; visible: {new_item}");
+        // Cached items carry whatever extra data they had when last shown.
+        if EXTRA_DATA_SLOTS.contains(&slot) {
+            self.stale_extra_data.insert(slot);
+        }
+        self.visible_changed = true;
         if let Some(replaced) = self.visible.insert(slot, new_item.clone()) {
             replaced != *new_item
         } else {
@@ -1484,7 +1819,7 @@ impl Controller {
         }
     }
 
-    pub fn handle_menu_event(&mut self, key: u32, button: &ButtonEvent) -> bool {
+    pub fn handle_menu_event(&mut self, key: u32, button: &ButtonPress) -> bool {
         // Much simpler than the cycle loop. We care if the cycle modifier key
         // is down (if one is set), and we care if the cycle button itself has
         // been pressed.
@@ -1492,7 +1827,7 @@ impl Controller {
         let Some(tracked) = self.create_or_update_tracked(key, button, false) else {
             return false;
         };
-        if !tracked.is_cycle_key() || !button.IsDown() {
+        if !tracked.is_cycle_key() || !button.is_down() {
             return false;
         }
 
@@ -1503,7 +1838,7 @@ impl Controller {
             ActivationMethod::Hotkey => true,
             ActivationMethod::LongPress => {
                 log::debug!("checking for long press in menu");
-                tracked.is_long_press()
+                tracked.is_long_press(self.keys.long_press())
             }
             ActivationMethod::Modifier => {
                 let modkey = self.tracked_modifier(&Modifier::Menu);
@@ -1524,6 +1859,8 @@ impl Controller {
             return;
         };
 
+        let name = item.name();
+        note_glyphs([name.as_str()]);
         let result = self.cycles.toggle(&cycle_slot, item.clone());
 
         if matches!(result, MenuEventResponse::ItemRemoved) && matches!(action, Action::Utility) {
@@ -1567,18 +1904,20 @@ impl Controller {
     fn create_or_update_tracked(
         &mut self,
         key: u32,
-        button: &ButtonEvent,
+        button: &ButtonPress,
         in_menu: bool,
     ) -> Option<TrackedKey> {
         let mut return_the_key = true;
-        let should_start_timer = !in_menu && settings().should_start_long_press_timer(key);
+        let binding = self.keys.binding(key);
+        let should_start_timer = !in_menu && binding.long_press_timer;
+        let long_press = self.keys.long_press();
 
         let tracked = if let Some(previous) = self.tracked_keys.get_mut(&key) {
             // We have seen this key before.
             // Did this key just have a long-press event? if so, ignore a key-up.
             // We ask this question before we update the tracking data.
             if matches!(previous.state, KeyState::Pressed)
-                && previous.is_long_press()
+                && previous.is_long_press(long_press)
                 && should_start_timer
             {
                 return_the_key = false;
@@ -1587,7 +1926,7 @@ impl Controller {
             previous.update(button);
             previous.clone()
         } else {
-            let fresh = TrackedKey::new(key, button);
+            let fresh = TrackedKey::new(key, binding.hotkey.clone(), button);
             self.tracked_keys.insert(key, fresh.clone());
             fresh
         };
@@ -1596,20 +1935,20 @@ impl Controller {
         if should_start_timer {
             let action = tracked.action();
             if matches!(tracked.state, KeyState::Down) {
-                let duration = settings().long_press_ms();
+                let duration = self.keys.long_press_ms();
                 match action {
-                    Action::Power => startTimer(Action::LongPressPower, duration),
-                    Action::Utility => startTimer(Action::LongPressUtility, duration),
-                    Action::Left => startTimer(Action::LongPressLeft, duration),
-                    Action::Right => startTimer(Action::LongPressRight, duration),
+                    Action::Power => start_timer(Action::LongPressPower, duration),
+                    Action::Utility => start_timer(Action::LongPressUtility, duration),
+                    Action::Left => start_timer(Action::LongPressLeft, duration),
+                    Action::Right => start_timer(Action::LongPressRight, duration),
                     _ => {}
                 }
             } else if matches!(tracked.state, KeyState::Up) {
                 match action {
-                    Action::Power => stopTimer(Action::LongPressPower),
-                    Action::Utility => stopTimer(Action::LongPressUtility),
-                    Action::Left => stopTimer(Action::LongPressLeft),
-                    Action::Right => stopTimer(Action::LongPressRight),
+                    Action::Power => stop_timer(Action::LongPressPower),
+                    Action::Utility => stop_timer(Action::LongPressUtility),
+                    Action::Left => stop_timer(Action::LongPressLeft),
+                    Action::Right => stop_timer(Action::LongPressRight),
                     _ => {}
                 }
             }
@@ -1623,7 +1962,7 @@ impl Controller {
     }
 
     fn tracked_modifier(&self, modifier: &Modifier) -> TrackedKey {
-        let key = modifier.key_for();
+        let key = self.keys.modifier_key(modifier);
         if key < 0 {
             return TrackedKey::default();
         }
@@ -1635,7 +1974,7 @@ impl Controller {
     }
 
     fn tracked_key(&self, hotkey: &Hotkey) -> TrackedKey {
-        let key = hotkey.key_for();
+        let key = self.keys.key_for(hotkey);
         if key < 0 {
             return TrackedKey::default();
         }
@@ -1859,3 +2198,447 @@ pub enum RequestedAction {
     Unequip,
     None,
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::controller::settings::{use_settings_on_this_thread, UserSettings};
+    use crate::controller::simulated;
+    use crate::data::ammo::AmmoType;
+    use crate::data::color::InvColor;
+    use crate::data::power::PowerType;
+
+    fn hand_item(spec: &str) -> HudItem {
+        HudItem::preclassified(
+            format!("weapon {spec}"),
+            spec.to_string(),
+            1,
+            BaseType::HandToHand,
+        )
+    }
+
+    fn controller_with_visible_items() -> Controller {
+        let mut ctrl = Controller::new();
+        let power = HudItem::preclassified(
+            "Test Power".to_string(),
+            "Skyrim.esm|0x1234".to_string(),
+            1,
+            BaseType::Power(PowerType::default()),
+        );
+        ctrl.update_slot(HudElement::Power, &power);
+        ctrl.update_slot(HudElement::Left, &hand_item("Skyrim.esm|0x100"));
+        ctrl.update_slot(HudElement::Right, &hand_item("Skyrim.esm|0x200"));
+        ctrl.update_slot(HudElement::Utility, &hand_item("Skyrim.esm|0x300"));
+        // Newly-shown items need their extra data once.
+        ctrl.refresh_hud_items();
+        ctrl
+    }
+
+    #[test]
+    fn no_events_means_no_refreshes() {
+        let mut ctrl = controller_with_visible_items();
+        for _ in 0..1000 {
+            assert_eq!(ctrl.refresh_stale_hud_items(), 0);
+        }
+    }
+
+    #[test]
+    fn showing_an_item_marks_it_stale() {
+        let mut ctrl = Controller::new();
+        ctrl.update_slot(HudElement::Left, &hand_item("Skyrim.esm|0x100"));
+        ctrl.update_slot(HudElement::Utility, &hand_item("Skyrim.esm|0x300"));
+        assert_eq!(ctrl.refresh_stale_hud_items(), 1);
+        assert_eq!(ctrl.refresh_stale_hud_items(), 0);
+    }
+
+    #[test]
+    fn charge_use_refreshes_only_the_weapon_used() {
+        let mut ctrl = controller_with_visible_items();
+        ctrl.handle_extra_data_event(ExtraDataEvent::ChargeUsed, "Skyrim.esm|0x200");
+        assert_eq!(ctrl.refresh_stale_hud_items(), 1);
+        assert_eq!(ctrl.refresh_stale_hud_items(), 0);
+
+        // Several hits in one frame still mean one refresh.
+        for _ in 0..5 {
+            ctrl.handle_extra_data_event(ExtraDataEvent::ChargeUsed, "Skyrim.esm|0x100");
+        }
+        assert_eq!(ctrl.refresh_stale_hud_items(), 1);
+
+        ctrl.handle_extra_data_event(ExtraDataEvent::ChargeUsed, "Skyrim.esm|0x999");
+        assert_eq!(ctrl.refresh_stale_hud_items(), 0);
+    }
+
+    #[test]
+    fn poison_and_recharge_refresh_both_hands() {
+        let mut ctrl = controller_with_visible_items();
+        ctrl.handle_extra_data_event(ExtraDataEvent::PoisonApplied, "Skyrim.esm|0x65a63");
+        assert_eq!(ctrl.refresh_stale_hud_items(), 2);
+        assert_eq!(ctrl.refresh_stale_hud_items(), 0);
+
+        ctrl.handle_extra_data_event(ExtraDataEvent::Recharged, "Skyrim.esm|0x2e4e3");
+        assert_eq!(ctrl.refresh_stale_hud_items(), 2);
+        assert_eq!(ctrl.refresh_stale_hud_items(), 0);
+    }
+
+    #[test]
+    fn shout_refreshes_power_slot() {
+        let mut ctrl = controller_with_visible_items();
+        ctrl.handle_extra_data_event(ExtraDataEvent::ShoutCooldownStarted, "Skyrim.esm|0x13e09");
+        assert_eq!(ctrl.refresh_stale_hud_items(), 1);
+        // The cooldown is interpolated from here on, with no more refreshes.
+        assert_eq!(ctrl.refresh_stale_hud_items(), 0);
+    }
+
+    #[test]
+    fn safety_net_refreshes_everything_once() {
+        let mut ctrl = controller_with_visible_items();
+        ctrl.handle_extra_data_event(ExtraDataEvent::PoisonApplied, "Skyrim.esm|0x65a63");
+        assert_eq!(ctrl.refresh_hud_items(), 3);
+        assert_eq!(ctrl.refresh_stale_hud_items(), 0);
+    }
+
+    fn ammo_item(spec: &str, count: u32) -> HudItem {
+        HudItem::preclassified(
+            format!("arrows {spec}"),
+            spec.to_string(),
+            count,
+            BaseType::Ammo(AmmoType::Arrow(InvColor::default())),
+        )
+    }
+
+    // No extra data refreshes here: in tests they're random.
+    fn controller_with_ammo() -> Controller {
+        let mut ctrl = Controller::new();
+        ctrl.update_slot(HudElement::Left, &hand_item("Skyrim.esm|0x100"));
+        ctrl.update_slot(HudElement::Right, &hand_item("Skyrim.esm|0x200"));
+        let arrows = ammo_item("Skyrim.esm|0x1397d", 500);
+        ctrl.cache.record(arrows.clone());
+        ctrl.update_slot(HudElement::Ammo, &arrows);
+        ctrl.stale_extra_data.clear();
+        ctrl
+    }
+
+    fn assert_same_state(left: &Controller, right: &Controller) {
+        assert_eq!(left.make_snapshot(), right.make_snapshot());
+        assert_eq!(left.stale_extra_data, right.stale_extra_data);
+    }
+
+    #[test]
+    fn interleaved_commands_match_serialized_order() {
+        // Two producers, each touching its own part of the HUD, the way the
+        // inventory hook and the hit event sink do.
+        let arrows_fired: Vec<Command> = (0..300)
+            .map(|shot| Command::InventoryChanged {
+                form_spec: "Skyrim.esm|0x1397d".to_string(),
+                count: 499 - shot,
+            })
+            .collect();
+        let swings: Vec<Command> = (0..300)
+            .map(|swing| Command::ExtraData {
+                event: ExtraDataEvent::ChargeUsed,
+                form_spec: if swing % 3 == 0 {
+                    "Skyrim.esm|0x100".to_string()
+                } else {
+                    "Skyrim.esm|0x999".to_string()
+                },
+            })
+            .collect();
+
+        for _ in 0..20 {
+            let queue = Arc::new(CommandQueue::new());
+            let producers: Vec<_> = [arrows_fired.clone(), swings.clone()]
+                .into_iter()
+                .map(|commands| {
+                    let queue = Arc::clone(&queue);
+                    std::thread::spawn(move || {
+                        for command in commands {
+                            queue.push(command);
+                        }
+                    })
+                })
+                .collect();
+
+            // The owner drains while the producers are still going.
+            let mut live = controller_with_ammo();
+            let mut applied: Vec<Command> = Vec::new();
+            while applied.len() < arrows_fired.len() + swings.len() {
+                for command in queue.take_all() {
+                    applied.push(command.clone());
+                    command.apply(&mut live);
+                }
+                std::thread::yield_now();
+            }
+            for producer in producers {
+                producer.join().expect("producer finished");
+            }
+
+            // Replaying what the owner saw gives the same state...
+            let mut replayed = controller_with_ammo();
+            for command in applied {
+                command.apply(&mut replayed);
+            }
+            assert_same_state(&live, &replayed);
+
+            // ...and so does running each producer's commands one after the other.
+            let mut serialized = controller_with_ammo();
+            for command in arrows_fired.iter().chain(swings.iter()) {
+                command.clone().apply(&mut serialized);
+            }
+            assert_same_state(&live, &serialized);
+
+            let shown = live.make_snapshot().entry(HudElement::Ammo);
+            assert_eq!(shown.count(), 200);
+            assert_eq!(live.refresh_stale_hud_items(), 1);
+        }
+    }
+
+    #[test]
+    fn submitted_commands_show_up_in_the_snapshot() {
+        {
+            let mut ctrl = get();
+            let arrows = ammo_item("Skyrim.esm|0x1397d", 12);
+            ctrl.cache.record(arrows.clone());
+            ctrl.update_slot(HudElement::Ammo, &arrows);
+        }
+        assert_eq!(snapshot().entry(HudElement::Ammo).count(), 12);
+
+        submit(Command::InventoryChanged {
+            form_spec: "Skyrim.esm|0x1397d".to_string(),
+            count: 11,
+        });
+        assert_eq!(snapshot().entry(HudElement::Ammo).count(), 11);
+
+        // A command queued while the controller is busy runs before it's released.
+        {
+            let _ctrl = get();
+            submit(Command::InventoryChanged {
+                form_spec: "Skyrim.esm|0x1397d".to_string(),
+                count: 10,
+            });
+            assert_eq!(snapshot().entry(HudElement::Ammo).count(), 11);
+        }
+        assert_eq!(snapshot().entry(HudElement::Ammo).count(), 10);
+
+        // The render thread's commands, and any it finds queued, wait for
+        // its next drain.
+        post(Command::InventoryChanged {
+            form_spec: "Skyrim.esm|0x1397d".to_string(),
+            count: 9,
+        });
+        assert_eq!(snapshot().entry(HudElement::Ammo).count(), 10);
+        drain_commands();
+        assert_eq!(snapshot().entry(HudElement::Ammo).count(), 9);
+        {
+            let _frame = try_get().expect("nobody else has the controller");
+            submit(Command::InventoryChanged {
+                form_spec: "Skyrim.esm|0x1397d".to_string(),
+                count: 8,
+            });
+        }
+        assert_eq!(snapshot().entry(HudElement::Ammo).count(), 9);
+        drain_commands();
+        assert_eq!(snapshot().entry(HudElement::Ammo).count(), 8);
+
+        // Game calls from posted commands happen on the thread that drains.
+        // The simulated game is per thread, so a call made anywhere else
+        // would not show up here.
+        simulated::reset();
+        post(Command::TimerExpired(Action::Power));
+        std::thread::sleep(std::time::Duration::from_millis(50));
+        assert!(simulated::calls().is_empty(), "nothing runs until we drain");
+        drain_commands();
+        assert_eq!(simulated::calls(), vec!["unequipSlot Power".to_string()]);
+    }
+
+    #[test]
+    fn applying_settings_does_only_what_changed() {
+        simulated::reset();
+        let mut options = UserSettings::default();
+        options
+            .read_from_file("tests/fixtures/test-settings.ini")
+            .expect("fixture loads");
+        use_settings_on_this_thread(Some(options.clone()));
+        let mut ctrl = Controller::new();
+        assert_eq!(
+            ctrl.apply_settings(),
+            EnumSet::all(),
+            "the first apply does it all"
+        );
+        assert!(ctrl
+            .cycles
+            .formids(&CycleSlot::Utility)
+            .contains(&"health_proxy".to_string()));
+        assert!(simulated::calls().contains(&"setMaxAlpha 1".to_string()));
+
+        simulated::reset();
+        assert!(ctrl.apply_settings().is_empty());
+        assert!(
+            simulated::calls().is_empty(),
+            "unchanged settings cost nothing"
+        );
+
+        // Ungrouping potions changes the utility cycle and nothing else.
+        options
+            .read_from_str("[Options]\nbGroupPotions = 0\n")
+            .expect("ini text");
+        use_settings_on_this_thread(Some(options.clone()));
+        assert_eq!(ctrl.apply_settings(), SettingsChange::PotionGrouping);
+        assert!(ctrl.cycles.formids(&CycleSlot::Utility).is_empty());
+        assert!(simulated::calls().is_empty());
+
+        // New alpha limits go to the renderer; the cycles are left alone.
+        options
+            .read_from_str("[Options]\nfMaxAlpha = 0.5\n")
+            .expect("ini text");
+        use_settings_on_this_thread(Some(options.clone()));
+        assert_eq!(ctrl.apply_settings(), SettingsChange::Alpha);
+        assert_eq!(
+            simulated::calls(),
+            vec!["setMaxAlpha 0.5".to_string(), "setMinAlpha 0".to_string()]
+        );
+
+        // Adding fists to the cycles doesn't rebuild the keys or touch alpha.
+        simulated::reset();
+        options
+            .read_from_str("[Controls]\nuHowToUnequip = 3\n")
+            .expect("ini text");
+        use_settings_on_this_thread(Some(options.clone()));
+        assert_eq!(ctrl.apply_settings(), SettingsChange::Unarmed);
+        assert_eq!(
+            ctrl.cycles.formids(&CycleSlot::Left),
+            vec!["unarmed_proxy".to_string()]
+        );
+        assert!(simulated::calls().is_empty());
+
+        // A rebound key rebuilds the key map, and that's all.
+        options
+            .read_from_str("[Controls]\nuRightCycleKey = 44\n")
+            .expect("ini text");
+        use_settings_on_this_thread(Some(options.clone()));
+        assert_eq!(ctrl.apply_settings(), SettingsChange::Keys);
+        assert!(matches!(ctrl.keys.hotkey(44), Hotkey::Right));
+        assert!(matches!(ctrl.keys.hotkey(7), Hotkey::None));
+
+        use_settings_on_this_thread(None);
+    }
+
+    // In test-settings.ini, left is 5, right is 7, and the unequip modifier is 184.
+    // Long presses match hands, so the hand keys start long-press timers.
+    fn controller_with_test_keys() -> Controller {
+        let mut options = UserSettings::default();
+        options
+            .read_from_file("tests/fixtures/test-settings.ini")
+            .expect("fixture loads");
+        let mut ctrl = Controller::new();
+        ctrl.keys = KeyMap::new(&options);
+        simulated::reset();
+        ctrl
+    }
+
+    fn down(key: u32) -> ButtonPress {
+        ButtonPress {
+            key,
+            value: 1.0,
+            held_secs: 0.0,
+        }
+    }
+
+    fn held(key: u32) -> ButtonPress {
+        held_for(key, 0.25)
+    }
+
+    fn held_for(key: u32, held_secs: f32) -> ButtonPress {
+        ButtonPress {
+            key,
+            value: 1.0,
+            held_secs,
+        }
+    }
+
+    fn up(key: u32) -> ButtonPress {
+        ButtonPress {
+            key,
+            value: 0.0,
+            held_secs: 0.5,
+        }
+    }
+
+    fn timers() -> Vec<(bool, Action)> {
+        simulated::timers()
+            .into_iter()
+            .filter(|(_, which)| {
+                matches!(
+                    *which,
+                    Action::LongPressLeft
+                        | Action::LongPressRight
+                        | Action::LongPressPower
+                        | Action::LongPressUtility
+                )
+            })
+            .collect()
+    }
+
+    #[test]
+    fn batches_answer_each_event_in_order() {
+        let mut ctrl = controller_with_test_keys();
+        let batch = [down(184), down(5), down(99), held(184), held(5)];
+        let responses = ctrl.handle_key_events(&batch);
+
+        assert_eq!(responses.len(), batch.len());
+        assert!(!responses[0].handled, "modifiers are not consumed");
+        assert!(responses[1].handled);
+        assert!(!responses[2].handled, "unbound keys are not consumed");
+        assert!(!responses[3].handled);
+        assert!(responses[4].handled);
+    }
+
+    #[test]
+    fn chords_within_a_batch_see_earlier_keys() {
+        let mut ctrl = controller_with_test_keys();
+        ctrl.handle_key_events(&[down(184), down(5)]);
+        assert!(ctrl.tracked_modifier(&Modifier::Unequip).is_pressed());
+        assert!(ctrl.tracked_key(&Hotkey::Left).is_pressed());
+
+        // Releasing the modifier later in the same batch leaves it released.
+        let mut ctrl = controller_with_test_keys();
+        ctrl.handle_key_events(&[down(184), down(5), up(184)]);
+        assert!(!ctrl.tracked_modifier(&Modifier::Unequip).is_pressed());
+        assert!(ctrl.tracked_key(&Hotkey::Left).is_pressed());
+    }
+
+    #[test]
+    fn long_press_timers_follow_batch_order() {
+        let mut ctrl = controller_with_test_keys();
+        ctrl.handle_key_events(&[down(7), down(5), held(7), held(5), held(5)]);
+        // Only the initial presses start timers, and in the order they arrived.
+        assert_eq!(
+            timers(),
+            vec![
+                (true, Action::LongPressRight),
+                (true, Action::LongPressLeft)
+            ]
+        );
+
+        // Hold the left key past the long-press threshold, then let go: the
+        // timer stops, and the key-up is swallowed because the long press
+        // already acted.
+        let responses = ctrl.handle_key_events(&[
+            held_for(5, 10.0),
+            held_for(5, 10.1),
+            ButtonPress {
+                key: 5,
+                value: 0.0,
+                held_secs: 10.2,
+            },
+        ]);
+        assert!(responses[1..].iter().all(|xs| !xs.handled));
+        assert_eq!(
+            timers(),
+            vec![
+                (true, Action::LongPressRight),
+                (true, Action::LongPressLeft),
+                (false, Action::LongPressLeft)
+            ]
+        );
+    }
+}
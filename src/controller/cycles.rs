@@ -6,15 +6,17 @@ use cxx::CxxVector;
 
 use super::control::MenuEventResponse;
 use super::cycleentries::*;
+use super::inventory::InventorySnapshot;
 use super::keys::CycleSlot;
+#[cfg(test)]
+use super::simulated::startAlphaTransition;
 use super::user_settings;
-use crate::data::item_cache::ItemCache;
+use crate::data::item_cache::{fetch_game_item, ItemCache};
 use crate::data::{BaseType, HudItem};
 use crate::images::icons::Icon;
-use crate::plugin::{
-    hasItemOrSpell, healthPotionCount, itemCount, magickaPotionCount, staminaPotionCount,
-    startAlphaTransition, EquippedData,
-};
+#[cfg(not(test))]
+use crate::plugin::startAlphaTransition;
+use crate::plugin::EquippedData;
 
 /// Manage the player's configured item cycles. Track changes, persist data in
 /// files, and advance the cycle when the player presses a cycle button. This
@@ -244,8 +246,10 @@ impl CycleData {
 
     /// Remove any items that have vanished from the game or from the player's
     /// inventory. This is called rarely and at times where we can spend the
-    /// cycles to look up the answer.
-    pub fn validate(&mut self, cache: &mut ItemCache) {
+    /// cycles to look up the answer. Every check is made against the one
+    /// inventory snapshot, so validating costs one trip to the game no matter
+    /// how many items are in the cycles.
+    pub fn validate(&mut self, cache: &mut ItemCache, inventory: &InventorySnapshot) {
         let to_check = vec![
             (CycleSlot::Power, "power"),
             (CycleSlot::Utility, "utility"),
@@ -265,25 +269,13 @@ impl CycleData {
                 .iter()
                 .filter_map(|incoming| {
                     let spec = incoming.clone();
-                    let item = cache.get(&spec.identifier()); // works if vec of HudItem or vec<string>
-
-                    cxx::let_cxx_string!(form_spec = spec.clone());
-                    if hasItemOrSpell(&form_spec) {
+                    // Proxies stand for whatever potions the player has, even none.
+                    if spec.ends_with("_proxy") || inventory.has(&spec) {
+                        let item = cache.get(&spec.identifier()); // works if vec of HudItem or vec<string>
                         log::info!("    {item}");
-                        return Some(spec);
-                    }
-
-                    let count = match spec.as_str() {
-                        "health_proxy" => healthPotionCount(),
-                        "magicka_proxy" => magickaPotionCount(),
-                        "stamina_proxy" => staminaPotionCount(),
-                        "unarmed_proxy" => 1,
-                        _ => itemCount(&form_spec),
-                    };
-                    if count > 0 {
-                        log::info!("    {incoming}");
                         Some(spec)
                     } else {
+                        log::info!("    {incoming} is no longer in the inventory");
                         None
                     }
                 })
@@ -314,8 +306,12 @@ impl CycleData {
                     item.name()
                 })
                 .collect();
+            let missing = xs.items().iter().filter(|xs| !inventory.has(xs)).count();
             log::info!("{}: {}", xs.id(), xs.name());
             log::info!("    {}", names.join(", "));
+            if missing > 0 {
+                log::info!("    {missing} items not in the inventory");
+            }
             log::info!("    {} empty slots", xs.empty_slots().len());
         });
         //log::info!("hud_visible: {}", self.hud_visible);
@@ -391,13 +387,13 @@ impl CycleData {
     // bincode serialization to cosave
 
     pub fn serialize_version() -> u32 {
-        cosave_v2::VERSION
+        cosave_v3::VERSION
     }
 
+    /// Older cosaves are read with their own decoders and written back out in
+    /// this format the next time the player saves.
     pub fn serialize(&self) -> Vec<u8> {
-        let value = cosave_v2::CycleSerialized::from(self);
-        let config = bincode::config::standard();
-        let bytes: Vec<u8> = bincode::encode_to_vec(value, config).unwrap_or_default();
+        let bytes = cosave_v3::serialize(self);
         log::info!(
             "Writing SKSE cosave data. Format version {}; save data size={} bytes.",
             CycleData::serialize_version(),
@@ -407,11 +403,16 @@ impl CycleData {
     }
 
     pub fn deserialize(bytes: &CxxVector<u8>, version: u32) -> Option<CycleData> {
-        let bytes: Vec<u8> = bytes.iter().copied().collect();
+        CycleData::from_bytes(bytes.as_slice(), version)
+    }
+
+    /// Decode cosave data of any version we know how to read.
+    pub fn from_bytes(bytes: &[u8], version: u32) -> Option<CycleData> {
         match version {
             0 => cosave_v0::deserialize(bytes),
             1 => cosave_v1::deserialize(bytes),
             2 => cosave_v2::deserialize(bytes),
+            3 => cosave_v3::deserialize(bytes),
             _ => {
                 log::warn!(
                     "Cosave data is version {version}, which this plugin version cannot decode."
@@ -440,26 +441,427 @@ impl Display for CycleData {
     }
 }
 
+/// Decide whether a cycle entry read from a cosave should be kept. Proxies
+/// stay as they are; form specs are kept only if the game can still find
+/// the item, since the player might have uninstalled the mod it came from.
+fn loadable_entry(xs: &str) -> Option<String> {
+    match xs {
+        "health_proxy" | "magicka_proxy" | "stamina_proxy" | "unarmed_proxy" => Some(xs.to_owned()),
+        "" => None,
+        _ => {
+            // Noting here that we do not go through the cache at all
+            // while loading these items. We probably should. TODO
+            let found = fetch_game_item(xs);
+            if matches!(found.kind(), BaseType::Empty) {
+                None
+            } else {
+                Some(found.form_string())
+            }
+        }
+    }
+}
+
 // cosave version modules.
 
+/// Version 3 is laid out by hand instead of by bincode. Each cycle entry is a
+/// fixed-width pair of (plugin name index, local form id); the plugin names
+/// are stored once, in a table at the top. Because entries name their plugin
+/// rather than its load order position, reordering plugins between saves
+/// leaves the cycles alone. All numbers are little-endian:
+///
+/// ```text
+/// u32  FNV-1a checksum of every byte after this one
+/// u8   flags; bit 0 is hud_visible
+/// u16  name count, then for each name a u16 byte length and utf-8 bytes
+///      four cycles, in the order left, right, power, utility; each is a
+///      u16 entry count then 6-byte entries: u16 name index, u32 form id
+/// u16  equipset count, then for each set: u32 id, u16 name index for its
+///      name, u16 name index for its icon, entries as above, and a u16
+///      count of empty slots followed by one byte per slot
+/// ```
+///
+/// Entries that aren't form specs, like the potion proxies, have the name
+/// index 0xffff and keep the index of their full name in the id field.
+pub mod cosave_v3 {
+    use std::collections::HashMap;
+
+    use eyre::{eyre, Result};
+
+    use crate::controller::cycleentries::*;
+    use crate::controller::cycles::{loadable_entry, CycleData};
+    use crate::data::form_spec::FormSpec;
+
+    pub const VERSION: u32 = 3;
+
+    /// The name index used by entries that aren't form specs.
+    const NOT_A_FORM: u16 = u16::MAX;
+    const ENTRY_LEN: usize = 6;
+    const CHECKSUM_LEN: usize = 4;
+    const HUD_VISIBLE: u8 = 0x01;
+
+    pub fn serialize(cycles: &CycleData) -> Vec<u8> {
+        let mut writer = Writer::default();
+        for cycle in [&cycles.left, &cycles.right, &cycles.power, &cycles.utility] {
+            writer.entries(cycle);
+        }
+
+        // The count goes first, but sets we can't write are skipped, so it is
+        // filled in once we know it.
+        let count_at = writer.body.len();
+        writer.u16(0);
+        let mut sets: u16 = 0;
+        for set in cycles.equipsets.iter() {
+            if sets == u16::MAX {
+                break;
+            }
+            // The table refuses names once it is full, or if they are too long.
+            let (Some(name), Some(icon)) = (
+                writer.intern(&set.name()),
+                writer.intern(&set.icon.to_string()),
+            ) else {
+                log::warn!(
+                    "Not saving equipset {}: its name or icon doesn't fit in the cosave name table.",
+                    set.id()
+                );
+                continue;
+            };
+            writer.body.extend_from_slice(&set.id().to_le_bytes());
+            writer.u16(name);
+            writer.u16(icon);
+            writer.entries(&set.items);
+            let empty = &set.empty[..set.empty.len().min(u16::MAX as usize)];
+            writer.u16(empty.len() as u16);
+            writer.body.extend_from_slice(empty);
+            sets += 1;
+        }
+        writer.body[count_at..count_at + 2].copy_from_slice(&sets.to_le_bytes());
+
+        writer.finish(cycles.hud_visible)
+    }
+
+    pub fn deserialize(bytes: &[u8]) -> Option<CycleData> {
+        log::debug!(
+            "reading cosave format version {VERSION}; data len={};",
+            bytes.len()
+        );
+        match CosaveView::parse(bytes) {
+            Ok(view) => {
+                log::info!("Cycles successfully read from cosave data version {VERSION}. Save data was {} bytes.", bytes.len());
+                Some(view.into())
+            }
+            Err(e) => {
+                log::error!("Cannot decode the cosave data. len={}", bytes.len());
+                log::error!("{e:#}");
+                None
+            }
+        }
+    }
+
+    /// FNV-1a, 32 bits. This is here to notice damage, not tampering.
+    pub fn checksum(bytes: &[u8]) -> u32 {
+        bytes.iter().fold(0x811c9dc5, |hash: u32, byte| {
+            (hash ^ *byte as u32).wrapping_mul(0x01000193)
+        })
+    }
+
+    /// Builds the entry lists first, then puts the name table they refer to in
+    /// front of them.
+    #[derive(Default)]
+    struct Writer {
+        names: Vec<String>,
+        lookup: HashMap<String, u16>,
+        body: Vec<u8>,
+    }
+
+    impl Writer {
+        fn intern(&mut self, name: &str) -> Option<u16> {
+            if let Some(index) = self.lookup.get(name) {
+                return Some(*index);
+            }
+            if self.names.len() >= NOT_A_FORM as usize || name.len() > u16::MAX as usize {
+                return None;
+            }
+            let index = self.names.len() as u16;
+            self.names.push(name.to_owned());
+            self.lookup.insert(name.to_owned(), index);
+            Some(index)
+        }
+
+        fn entry(&mut self, spec: &str) -> Option<[u8; ENTRY_LEN]> {
+            let (plugin, id) = match FormSpec::parse(spec) {
+                Some(form) => (self.intern(form.plugin)?, form.id),
+                None => (NOT_A_FORM, self.intern(spec)? as u32),
+            };
+            let mut entry = [0u8; ENTRY_LEN];
+            entry[..2].copy_from_slice(&plugin.to_le_bytes());
+            entry[2..].copy_from_slice(&id.to_le_bytes());
+            Some(entry)
+        }
+
+        fn entries(&mut self, specs: &[String]) {
+            let entries: Vec<_> = specs
+                .iter()
+                .filter_map(|xs| self.entry(xs))
+                .take(u16::MAX as usize)
+                .collect();
+            self.u16(entries.len() as u16);
+            for entry in entries {
+                self.body.extend_from_slice(&entry);
+            }
+        }
+
+        fn u16(&mut self, value: u16) {
+            self.body.extend_from_slice(&value.to_le_bytes());
+        }
+
+        fn finish(self, hud_visible: bool) -> Vec<u8> {
+            let names_len: usize = self.names.iter().map(|xs| 2 + xs.len()).sum();
+            let mut bytes = Vec::with_capacity(CHECKSUM_LEN + 3 + names_len + self.body.len());
+            bytes.extend_from_slice(&[0u8; CHECKSUM_LEN]);
+            bytes.push(if hud_visible { HUD_VISIBLE } else { 0 });
+            bytes.extend_from_slice(&(self.names.len() as u16).to_le_bytes());
+            for name in self.names.iter() {
+                bytes.extend_from_slice(&(name.len() as u16).to_le_bytes());
+                bytes.extend_from_slice(name.as_bytes());
+            }
+            bytes.extend_from_slice(&self.body);
+
+            let sum = checksum(&bytes[CHECKSUM_LEN..]);
+            bytes[..CHECKSUM_LEN].copy_from_slice(&sum.to_le_bytes());
+            bytes
+        }
+    }
+
+    /// Reads from the cosave buffer in place. Every read is bounds-checked.
+    struct Reader<'a> {
+        bytes: &'a [u8],
+        pos: usize,
+    }
+
+    impl<'a> Reader<'a> {
+        fn take(&mut self, len: usize) -> Option<&'a [u8]> {
+            let end = self.pos.checked_add(len)?;
+            let taken = self.bytes.get(self.pos..end)?;
+            self.pos = end;
+            Some(taken)
+        }
+
+        fn u8(&mut self) -> Option<u8> {
+            self.take(1).map(|xs| xs[0])
+        }
+
+        fn u16(&mut self) -> Option<u16> {
+            self.take(2).map(|xs| u16::from_le_bytes([xs[0], xs[1]]))
+        }
+
+        fn u32(&mut self) -> Option<u32> {
+            self.take(4)
+                .map(|xs| u32::from_le_bytes([xs[0], xs[1], xs[2], xs[3]]))
+        }
+
+        fn entries(&mut self) -> Option<Entries<'a>> {
+            let count = self.u16()? as usize;
+            self.take(count * ENTRY_LEN).map(Entries)
+        }
+    }
+
+    /// A run of fixed-width entries, still in the cosave buffer.
+    #[derive(Debug, Clone, Copy)]
+    struct Entries<'a>(&'a [u8]);
+
+    impl<'a> Entries<'a> {
+        fn iter(&self) -> impl Iterator<Item = (u16, u32)> + 'a {
+            self.0.chunks_exact(ENTRY_LEN).map(|xs| {
+                (
+                    u16::from_le_bytes([xs[0], xs[1]]),
+                    u32::from_le_bytes([xs[2], xs[3], xs[4], xs[5]]),
+                )
+            })
+        }
+    }
+
+    #[derive(Debug, Clone)]
+    struct EquipSetView<'a> {
+        id: u32,
+        name: &'a str,
+        icon: &'a str,
+        items: Entries<'a>,
+        empty: &'a [u8],
+    }
+
+    /// Cosave data that has been checked but not copied: names and entries
+    /// still point into the buffer the game handed us.
+    #[derive(Debug, Clone)]
+    pub struct CosaveView<'a> {
+        pub hud_visible: bool,
+        names: Vec<&'a str>,
+        cycles: [Entries<'a>; 4],
+        equipsets: Vec<EquipSetView<'a>>,
+    }
+
+    impl<'a> CosaveView<'a> {
+        /// Check the data and find where everything in it is. Fails if the
+        /// checksum is wrong, if anything runs past the end of the buffer or
+        /// stops short of it, or if an entry refers to a name that isn't there.
+        pub fn parse(bytes: &'a [u8]) -> Result<Self> {
+            let mut reader = Reader { bytes, pos: 0 };
+            let expected = reader
+                .u32()
+                .ok_or_else(|| eyre!("cosave data is too short to have a checksum"))?;
+            let actual = checksum(&bytes[CHECKSUM_LEN..]);
+            if expected != actual {
+                return Err(eyre!(
+                    "cosave checksum mismatch; expected={expected:#010x}; actual={actual:#010x}"
+                ));
+            }
+
+            let view = Self::read(&mut reader)
+                .ok_or_else(|| eyre!("cosave data is truncated or malformed"))?;
+            if reader.pos != bytes.len() {
+                return Err(eyre!(
+                    "cosave data has {} unexpected bytes at the end",
+                    bytes.len() - reader.pos
+                ));
+            }
+            let dangling = view
+                .cycles
+                .iter()
+                .chain(view.equipsets.iter().map(|xs| &xs.items))
+                .flat_map(|xs| xs.iter())
+                .any(|(plugin, id)| !view.resolves(plugin, id));
+            if dangling {
+                return Err(eyre!(
+                    "cosave entry refers to a name that isn't in the table"
+                ));
+            }
+            Ok(view)
+        }
+
+        fn read(reader: &mut Reader<'a>) -> Option<Self> {
+            let hud_visible = reader.u8()? & HUD_VISIBLE != 0;
+            let name_count = reader.u16()?;
+            let names = (0..name_count)
+                .map(|_| {
+                    let len = reader.u16()? as usize;
+                    std::str::from_utf8(reader.take(len)?).ok()
+                })
+                .collect::<Option<Vec<_>>>()?;
+
+            let cycles = [
+                reader.entries()?,
+                reader.entries()?,
+                reader.entries()?,
+                reader.entries()?,
+            ];
+
+            let set_count = reader.u16()?;
+            let mut equipsets = Vec::with_capacity(set_count as usize);
+            for _ in 0..set_count {
+                let id = reader.u32()?;
+                let name = *names.get(reader.u16()? as usize)?;
+                let icon = *names.get(reader.u16()? as usize)?;
+                let items = reader.entries()?;
+                let empty_len = reader.u16()? as usize;
+                let empty = reader.take(empty_len)?;
+                equipsets.push(EquipSetView {
+                    id,
+                    name,
+                    icon,
+                    items,
+                    empty,
+                });
+            }
+
+            Some(Self {
+                hud_visible,
+                names,
+                cycles,
+                equipsets,
+            })
+        }
+
+        /// The plugin and string names in this save, in table order.
+        pub fn names(&self) -> &[&'a str] {
+            &self.names
+        }
+
+        fn resolves(&self, plugin: u16, id: u32) -> bool {
+            if plugin == NOT_A_FORM {
+                (id as usize) < self.names.len()
+            } else {
+                (plugin as usize) < self.names.len()
+            }
+        }
+
+        /// The form spec or proxy name an entry stands for.
+        fn spec(&self, plugin: u16, id: u32) -> Option<String> {
+            if plugin == NOT_A_FORM {
+                self.names.get(id as usize).map(|xs| xs.to_string())
+            } else {
+                let plugin = self.names.get(plugin as usize)?;
+                Some(FormSpec { plugin, id }.to_string())
+            }
+        }
+
+        fn specs(&self, entries: Entries<'a>) -> Vec<String> {
+            entries
+                .iter()
+                .filter_map(|(plugin, id)| self.spec(plugin, id))
+                .collect()
+        }
+    }
+
+    impl From<CosaveView<'_>> for CycleData {
+        fn from(view: CosaveView<'_>) -> Self {
+            let [left, right, power, utility] = view.cycles.map(|entries| {
+                view.specs(entries)
+                    .iter()
+                    .filter_map(|xs| loadable_entry(xs))
+                    .collect::<Vec<_>>()
+            });
+            let equipsets = view
+                .equipsets
+                .iter()
+                .map(|xs| {
+                    EquipSet::new(
+                        xs.id,
+                        xs.name.to_owned(),
+                        view.specs(xs.items),
+                        xs.empty.to_vec(),
+                        xs.icon.to_owned(),
+                    )
+                })
+                .collect();
+
+            Self {
+                left,
+                right,
+                power,
+                utility,
+                equipsets,
+                hud_visible: view.hud_visible,
+                loaded: true,
+            }
+        }
+    }
+}
+
 pub mod cosave_v2 {
     use bincode::{Decode, Encode};
 
     use crate::controller::cycleentries::*;
-    use crate::controller::cycles::CycleData;
-    use crate::data::base::BaseType;
-    use crate::data::item_cache::fetch_game_item;
+    use crate::controller::cycles::{loadable_entry, CycleData};
 
     pub const VERSION: u32 = 2;
 
-    pub fn deserialize(bytes: Vec<u8>) -> Option<CycleData> {
+    pub fn deserialize(bytes: &[u8]) -> Option<CycleData> {
         let config = bincode::config::standard();
         log::debug!(
             "reading cosave format version {VERSION}; data len={};",
             bytes.len()
         );
 
-        match bincode::decode_from_slice::<CycleSerialized, _>(&bytes[..], config) {
+        match bincode::decode_from_slice::<CycleSerialized, _>(bytes, config) {
             Ok((value, _len)) => {
                 log::info!("Cycles successfully read from cosave data version {VERSION}. Save data was {} bytes.", bytes.len());
                 Some(value.into())
@@ -516,46 +918,26 @@ pub mod cosave_v2 {
 
     impl From<CycleSerialized> for CycleData {
         fn from(value: CycleSerialized) -> Self {
-            fn filter_func(xs: &str) -> Option<String> {
-                match xs {
-                    "health_proxy" => Some(xs.to_owned()),
-                    "magicka_proxy" => Some(xs.to_owned()),
-                    "stamina_proxy" => Some(xs.to_owned()),
-                    "unarmed_proxy" => Some(xs.to_owned()),
-                    "" => None,
-                    _ => {
-                        // Noting here that we do not go through the cache at all
-                        // while loading these items. We probably should. TODO
-                        let found = fetch_game_item(xs);
-                        if matches!(found.kind(), BaseType::Empty) {
-                            None
-                        } else {
-                            Some(found.form_string())
-                        }
-                    }
-                }
-            }
-
             Self {
                 left: value
                     .left
                     .iter()
-                    .filter_map(|xs| filter_func(xs.as_str()))
+                    .filter_map(|xs| loadable_entry(xs.as_str()))
                     .collect(),
                 right: value
                     .right
                     .iter()
-                    .filter_map(|xs| filter_func(xs.as_str()))
+                    .filter_map(|xs| loadable_entry(xs.as_str()))
                     .collect(),
                 power: value
                     .power
                     .iter()
-                    .filter_map(|xs| filter_func(xs.as_str()))
+                    .filter_map(|xs| loadable_entry(xs.as_str()))
                     .collect(),
                 utility: value
                     .utility
                     .iter()
-                    .filter_map(|xs| filter_func(xs.as_str()))
+                    .filter_map(|xs| loadable_entry(xs.as_str()))
                     .collect(),
                 hud_visible: value.hud_visible,
                 equipsets: value
@@ -580,20 +962,18 @@ pub mod cosave_v2 {
 pub mod cosave_v1 {
     use bincode::{Decode, Encode};
 
-    use crate::controller::cycles::CycleData;
-    use crate::data::base::BaseType;
-    use crate::data::item_cache::fetch_game_item;
+    use crate::controller::cycles::{loadable_entry, CycleData};
 
     pub const VERSION: u32 = 1;
 
-    pub fn deserialize(bytes: Vec<u8>) -> Option<CycleData> {
+    pub fn deserialize(bytes: &[u8]) -> Option<CycleData> {
         let config = bincode::config::standard();
         log::debug!(
             "reading cosave format version {VERSION}; data len={};",
             bytes.len()
         );
 
-        match bincode::decode_from_slice::<CycleSerialized, _>(&bytes[..], config) {
+        match bincode::decode_from_slice::<CycleSerialized, _>(bytes, config) {
             Ok((value, _len)) => {
                 log::info!("Cycles successfully read from cosave data.");
                 Some(value.into())
@@ -630,46 +1010,26 @@ pub mod cosave_v1 {
 
     impl From<CycleSerialized> for CycleData {
         fn from(value: CycleSerialized) -> Self {
-            fn filter_func(xs: &str) -> Option<String> {
-                match xs {
-                    "health_proxy" => Some(xs.to_owned()),
-                    "magicka_proxy" => Some(xs.to_owned()),
-                    "stamina_proxy" => Some(xs.to_owned()),
-                    "unarmed_proxy" => Some(xs.to_owned()),
-                    "" => None,
-                    _ => {
-                        // Noting here that we do not go through the cache at all
-                        // while loading these items. We probably should. TODO
-                        let found = fetch_game_item(xs);
-                        if matches!(found.kind(), BaseType::Empty) {
-                            None
-                        } else {
-                            Some(found.form_string())
-                        }
-                    }
-                }
-            }
-
             Self {
                 left: value
                     .left
                     .iter()
-                    .filter_map(|xs| filter_func(xs.as_str()))
+                    .filter_map(|xs| loadable_entry(xs.as_str()))
                     .collect(),
                 right: value
                     .right
                     .iter()
-                    .filter_map(|xs| filter_func(xs.as_str()))
+                    .filter_map(|xs| loadable_entry(xs.as_str()))
                     .collect(),
                 power: value
                     .power
                     .iter()
-                    .filter_map(|xs| filter_func(xs.as_str()))
+                    .filter_map(|xs| loadable_entry(xs.as_str()))
                     .collect(),
                 utility: value
                     .utility
                     .iter()
-                    .filter_map(|xs| filter_func(xs.as_str()))
+                    .filter_map(|xs| loadable_entry(xs.as_str()))
                     .collect(),
                 hud_visible: value.hud_visible,
                 equipsets: Vec::new(),
@@ -682,19 +1042,17 @@ pub mod cosave_v1 {
 pub mod cosave_v0 {
     use bincode::{Decode, Encode};
 
-    use crate::controller::cycles::CycleData;
-    use crate::data::base::BaseType;
-    use crate::data::item_cache::fetch_game_item;
+    use crate::controller::cycles::{loadable_entry, CycleData};
 
     const VERSION: u8 = 0;
 
-    pub fn deserialize(bytes: Vec<u8>) -> Option<CycleData> {
+    pub fn deserialize(bytes: &[u8]) -> Option<CycleData> {
         let config = bincode::config::standard();
         log::debug!(
             "reading cosave format version {VERSION}; data len={};",
             bytes.len()
         );
-        match bincode::decode_from_slice::<CycleSerialized, _>(&bytes[..], config) {
+        match bincode::decode_from_slice::<CycleSerialized, _>(bytes, config) {
             Ok((value, _len)) => {
                 log::info!("Cycles successfully read from cosave data.");
                 Some(value.into())
@@ -729,22 +1087,7 @@ pub mod cosave_v0 {
     impl From<CycleSerialized> for CycleData {
         fn from(value: CycleSerialized) -> Self {
             fn filter_func(item: &ItemSerialized) -> Option<String> {
-                let formstr = item.form_string.clone();
-                match formstr.as_str() {
-                    "health_proxy" => Some(formstr.clone()),
-                    "magicka_proxy" => Some(formstr.clone()),
-                    "stamina_proxy" => Some(formstr.clone()),
-                    "unarmed_proxy" => Some(formstr.clone()),
-                    "" => None,
-                    _ => {
-                        let found = fetch_game_item(&formstr);
-                        if matches!(found.kind(), BaseType::Empty) {
-                            None
-                        } else {
-                            Some(found.form_string())
-                        }
-                    }
-                }
+                loadable_entry(&item.form_string)
             }
 
             Self {
@@ -787,7 +1130,7 @@ mod tests {
         let value = cosave_v2::CycleSerialized::from(&cycle);
         let config = bincode::config::standard();
         let bytes: Vec<u8> = bincode::encode_to_vec(value, config).unwrap_or_default();
-        let decoded = cosave_v2::deserialize(bytes).expect("data should be decodeable");
+        let decoded = cosave_v2::deserialize(&bytes).expect("data should be decodeable");
         assert_eq!(decoded.loaded, !cycle.loaded);
         assert_eq!(decoded.left.len(), cycle.left.len());
         assert_eq!(decoded.equipsets.len(), cycle.equipsets.len());
@@ -812,11 +1155,242 @@ mod tests {
         let value = cosave_v1::CycleSerialized::from(&cycle);
         let config = bincode::config::standard();
         let bytes: Vec<u8> = bincode::encode_to_vec(value, config).unwrap_or_default();
-        let decoded = cosave_v1::deserialize(bytes).expect("data should be decodeable");
+        let decoded = cosave_v1::deserialize(&bytes).expect("data should be decodeable");
         assert_eq!(decoded.loaded, !cycle.loaded);
         assert_eq!(decoded.left.len(), cycle.left.len());
     }
 
+    fn v3_sample() -> CycleData {
+        let mut cycle = CycleData::default();
+        cycle.left = vec![
+            "Skyrim.esm|0x00012eb7".to_string(),
+            "Dawnguard.esm|0x0001a3f5".to_string(),
+            "unarmed_proxy".to_string(),
+        ];
+        cycle.right = vec![
+            "Skyrim.esm|0x000139b9".to_string(),
+            "dynamic|0xff000d2a".to_string(),
+        ];
+        cycle.power = vec!["Skyrim.esm|0x00013e09".to_string()];
+        cycle.utility = vec![
+            "health_proxy".to_string(),
+            "magicka_proxy".to_string(),
+            "fake-one".to_string(),
+        ];
+        cycle.equipsets = vec![
+            EquipSet::new(
+                0,
+                "heavy".to_string(),
+                vec![
+                    "Skyrim.esm|0x00013952".to_string(),
+                    "Dawnguard.esm|0x0000f400".to_string(),
+                ],
+                vec![32, 33],
+                "armor_heavy".to_string(),
+            ),
+            EquipSet::new(
+                7,
+                "naked".to_string(),
+                Vec::new(),
+                Vec::new(),
+                String::new(),
+            ),
+        ];
+        cycle.hud_visible = false;
+        cycle
+    }
+
+    fn assert_same_cycles(left: &CycleData, right: &CycleData) {
+        assert_eq!(left.left, right.left);
+        assert_eq!(left.right, right.right);
+        assert_eq!(left.power, right.power);
+        assert_eq!(left.utility, right.utility);
+        assert_eq!(left.hud_visible, right.hud_visible);
+        assert_eq!(left.equipsets.len(), right.equipsets.len());
+        for (a, b) in left.equipsets.iter().zip(right.equipsets.iter()) {
+            assert_eq!(a.id(), b.id());
+            assert_eq!(a.name(), b.name());
+            assert_eq!(a.items, b.items);
+            assert_eq!(a.empty, b.empty);
+            assert_eq!(a.icon, b.icon);
+        }
+    }
+
+    #[test]
+    fn version_3_round_trip() {
+        let cycle = v3_sample();
+        let bytes = cycle.serialize();
+        let decoded = CycleData::from_bytes(&bytes, CycleData::serialize_version())
+            .expect("data should be decodeable");
+        assert!(decoded.loaded);
+        assert_same_cycles(&decoded, &cycle);
+
+        // Each plugin is named once no matter how many entries use it.
+        let view = cosave_v3::CosaveView::parse(&bytes).expect("a valid save");
+        let skyrim = view.names().iter().filter(|xs| **xs == "Skyrim.esm");
+        assert_eq!(skyrim.count(), 1);
+
+        let empty = CycleData::default();
+        let decoded = cosave_v3::deserialize(&empty.serialize()).expect("empty cycles decode");
+        assert_same_cycles(&decoded, &empty);
+    }
+
+    #[test]
+    fn version_3_migrates_older_saves() {
+        let cycle = v3_sample();
+
+        let v2 = cosave_v2::CycleSerialized::from(&cycle);
+        let v2 = bincode::encode_to_vec(v2, bincode::config::standard()).expect("v2 encodes");
+        let loaded = CycleData::from_bytes(&v2, 2).expect("v2 decodes");
+        let resaved = loaded.serialize();
+        let migrated = CycleData::from_bytes(&resaved, cosave_v3::VERSION).expect("v3 decodes");
+        assert_same_cycles(&migrated, &cycle);
+
+        let v1 = cosave_v1::CycleSerialized::from(&cycle);
+        let v1 = bincode::encode_to_vec(v1, bincode::config::standard()).expect("v1 encodes");
+        let loaded = CycleData::from_bytes(&v1, 1).expect("v1 decodes");
+        let migrated = cosave_v3::deserialize(&loaded.serialize()).expect("v3 decodes");
+        assert_eq!(migrated.left, cycle.left);
+        assert_eq!(migrated.utility, cycle.utility);
+        assert!(migrated.equipsets.is_empty());
+    }
+
+    /// Lay out a v3 save by hand, so the test doesn't lean on our writer.
+    fn v3_by_hand(names: &[&str], left: &[(u16, u32)]) -> Vec<u8> {
+        let mut bytes = vec![0u8; 4];
+        bytes.push(1);
+        bytes.extend_from_slice(&(names.len() as u16).to_le_bytes());
+        for name in names {
+            bytes.extend_from_slice(&(name.len() as u16).to_le_bytes());
+            bytes.extend_from_slice(name.as_bytes());
+        }
+        bytes.extend_from_slice(&(left.len() as u16).to_le_bytes());
+        for (plugin, id) in left {
+            bytes.extend_from_slice(&plugin.to_le_bytes());
+            bytes.extend_from_slice(&id.to_le_bytes());
+        }
+        // right, power, utility, equipsets
+        bytes.extend_from_slice(&[0u8; 8]);
+        let sum = cosave_v3::checksum(&bytes[4..]);
+        bytes[..4].copy_from_slice(&sum.to_le_bytes());
+        bytes
+    }
+
+    #[test]
+    fn version_3_entries_follow_plugin_names() {
+        let first = v3_by_hand(
+            &["Skyrim.esm", "Dawnguard.esm", "health_proxy"],
+            &[(0, 0x12eb7), (1, 0xf400), (u16::MAX, 2)],
+        );
+        let second = v3_by_hand(
+            &["health_proxy", "Dawnguard.esm", "Skyrim.esm"],
+            &[(2, 0x12eb7), (1, 0xf400), (u16::MAX, 0)],
+        );
+        let first = cosave_v3::deserialize(&first).expect("valid save");
+        let second = cosave_v3::deserialize(&second).expect("valid save");
+        assert_eq!(
+            first.left,
+            vec![
+                "Skyrim.esm|0x00012eb7".to_string(),
+                "Dawnguard.esm|0x0000f400".to_string(),
+                "health_proxy".to_string(),
+            ]
+        );
+        assert_eq!(first.left, second.left);
+
+        let dangling = v3_by_hand(&["Skyrim.esm"], &[(1, 0x12eb7)]);
+        assert!(cosave_v3::CosaveView::parse(&dangling).is_err());
+        let dangling = v3_by_hand(&["Skyrim.esm"], &[(u16::MAX, 1)]);
+        assert!(cosave_v3::CosaveView::parse(&dangling).is_err());
+    }
+
+    #[test]
+    fn version_3_skips_equipsets_it_cannot_name() {
+        let mut cycle = v3_sample();
+        let kept = cycle.equipsets.clone();
+        let long_name = "x".repeat(u16::MAX as usize + 1);
+        cycle.equipsets.insert(
+            1,
+            EquipSet::new(
+                3,
+                long_name,
+                Vec::new(),
+                Vec::new(),
+                "armor_heavy".to_string(),
+            ),
+        );
+
+        let decoded = cosave_v3::deserialize(&cycle.serialize()).expect("v3 decodes");
+        assert_eq!(decoded.equipsets.len(), kept.len());
+        for (ours, theirs) in decoded.equipsets.iter().zip(kept.iter()) {
+            assert_eq!(ours.id(), theirs.id());
+            assert_eq!(ours.name(), theirs.name());
+        }
+    }
+
+    #[test]
+    fn version_3_rejects_damage() {
+        use rand::Rng;
+
+        let mut rng = rand::thread_rng();
+        let bytes = v3_sample().serialize();
+        assert!(cosave_v3::CosaveView::parse(&bytes).is_ok());
+
+        for len in 0..bytes.len() {
+            assert!(
+                cosave_v3::CosaveView::parse(&bytes[..len]).is_err(),
+                "truncated to {len} bytes"
+            );
+        }
+
+        // FNV-1a changes its output for any change to a single byte.
+        for _ in 0..5_000 {
+            let mut damaged = bytes.clone();
+            let at = rng.gen_range(0..damaged.len());
+            damaged[at] ^= rng.gen_range(1..=255u8);
+            assert!(cosave_v3::CosaveView::parse(&damaged).is_err());
+        }
+    }
+
+    #[test]
+    fn version_3_fuzzed_input_never_panics() {
+        use rand::Rng;
+
+        fn fix_checksum(bytes: &mut [u8]) {
+            if bytes.len() >= 4 {
+                let sum = cosave_v3::checksum(&bytes[4..]);
+                bytes[..4].copy_from_slice(&sum.to_le_bytes());
+            }
+        }
+
+        let mut rng = rand::thread_rng();
+        let valid = v3_sample().serialize();
+
+        // Damage a real save, then make the checksum agree with the damage so
+        // the parser has to cope with it.
+        for _ in 0..10_000 {
+            let mut bytes = valid.clone();
+            for _ in 0..rng.gen_range(1..4) {
+                let at = rng.gen_range(4..bytes.len());
+                bytes[at] = rng.gen();
+            }
+            bytes.truncate(rng.gen_range(4..=bytes.len()));
+            fix_checksum(&mut bytes);
+            if let Ok(view) = cosave_v3::CosaveView::parse(&bytes) {
+                let _ = CycleData::from(view);
+            }
+        }
+
+        for _ in 0..10_000 {
+            let len = rng.gen_range(0..64);
+            let mut bytes: Vec<u8> = (0..len).map(|_| rng.gen()).collect();
+            fix_checksum(&mut bytes);
+            if let Ok(view) = cosave_v3::CosaveView::parse(&bytes) {
+                let _ = CycleData::from(view);
+            }
+        }
+    }
+
     #[test]
     fn version_0() {
         // lowest priority to write tests for;
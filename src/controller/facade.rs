@@ -6,12 +6,17 @@
 
 use cxx::CxxVector;
 
+use super::commands::Command;
 use super::cycles::*;
-use super::settings::{settings, UserSettings};
+use super::recorder;
+use super::redraw::{self, Published};
+use super::settings::{settings, SettingsChange, UserSettings};
+use super::timers::{start_timer, stop_timer};
 use crate::control;
 use crate::data::huditem::RelevantExtraData;
 use crate::data::*;
-use crate::layouts::{hud_layout, Layout};
+use crate::images::set_texture_budget;
+use crate::layouts::{hud_layout, watch_layout_file, Layout};
 use crate::plugin::*;
 
 // ---------- boxed user settings
@@ -44,9 +49,21 @@ pub fn initialize_hud() {
     log::info!("HUD location is: x={}; y={};", hud.anchor.x, hud.anchor.y);
 }
 
-/// Function for C++ to call to send a relevant button event to us.
-pub fn handle_key_event(key: u32, button: &ButtonEvent) -> KeyEventResponse {
-    control::get().handle_key_event(key, button)
+/// Function for C++ to call to send a batch of relevant button events to us.
+pub fn handle_key_events(events: &[ButtonPress]) -> Vec<KeyEventResponse> {
+    let mut ctrl = control::get();
+    let responses = ctrl.handle_key_events(events);
+    // Recorded before letting go, so commands run on release come after.
+    recorder::record_keys(events, &responses);
+    for response in responses.iter().filter(|response| response.handled) {
+        if response.stop_timer != Action::None {
+            stop_timer(response.stop_timer);
+        }
+        if response.start_timer != Action::None {
+            start_timer(response.start_timer, settings().equip_delay_ms());
+        }
+    }
+    responses
 }
 
 /// Function for C++ to call to send a relevant menu button-event to us.
@@ -61,17 +78,35 @@ pub fn toggle_item(key: u32, #[allow(clippy::boxed_local)] menu_item: Box<HudIte
 
 /// Pass along menu events to the controller.
 pub fn handle_menu_event(key: u32, button: &ButtonEvent) -> bool {
-    control::get().handle_menu_event(key, button)
+    let press = ButtonPress::from_button(key, button);
+    control::get().handle_menu_event(key, &press)
 }
 
-/// Get information about the item equipped in a specific slot.
+/// Get information about the item equipped in a specific slot. This reads
+/// the published snapshot, so the renderer never waits on the controller.
 pub fn entry_to_show_in_slot(element: HudElement) -> Box<HudItem> {
-    control::get().entry_to_show_in_slot(element)
+    control::snapshot().entry(element)
 }
 
-/// Refresh our view of what's needs to be in the HUD right now.
+/// Refresh our view of what's needs to be in the HUD right now. Called from
+/// the render thread, so the refresh is queued for its next `drain_commands()`
+/// rather than run in the middle of a frame.
 pub fn refresh_hud_items() {
-    control::get().refresh_hud_items();
+    control::post(Command::RefreshHudItems);
+}
+
+/// Run the commands the render thread queued. Called once a frame from the
+/// render thread, so equips and inventory scans stay on a game thread.
+pub fn drain_commands() {
+    control::drain_commands();
+}
+
+/// Refresh only the visible items a game event has told us about. Skipped
+/// for this frame if the controller is busy.
+pub fn refresh_stale_hud_items() {
+    if let Some(mut ctrl) = control::try_get() {
+        ctrl.refresh_stale_hud_items();
+    }
 }
 
 /// Fill out some extra data info.
@@ -95,9 +130,10 @@ pub fn relevant_extra_data(
     ))
 }
 
-// Handle an equip delay timer expiring.
+// Handle an equip delay or long-press timer expiring. Timers run out on the
+// render thread, so the work waits for its next `drain_commands()`.
 pub fn timer_expired(slot: Action) {
-    control::get().timer_expired(slot);
+    control::post(Command::TimerExpired(slot));
 }
 
 /// We know for sure the player just equipped this item.
@@ -107,17 +143,39 @@ pub fn handle_item_equipped(
     right: &String,
     left: &String,
 ) -> bool {
-    control::get().handle_item_equipped(equipped, form_spec, right, left)
+    let mut ctrl = control::get();
+    let changed = ctrl.handle_item_equipped(equipped, form_spec, right, left);
+    if recorder::is_recording() {
+        recorder::record(recorder::SessionEvent::Equipped {
+            equipped,
+            form_spec: form_spec.clone(),
+            right: right.clone(),
+            left: left.clone(),
+            changed,
+        });
+    }
+    changed
 }
 
 /// Pass along a CGO grip-change event to the controller.
 pub fn handle_grip_change(use_alt_grip: bool) {
-    control::get().handle_grip_change(use_alt_grip);
+    control::submit(Command::GripChange(use_alt_grip));
 }
 
 /// A consumable's count changed. Record if relevant.
 pub fn handle_inventory_changed(form_spec: &String, count: u32) {
-    control::get().handle_inventory_changed(form_spec, count);
+    control::submit(Command::InventoryChanged {
+        form_spec: form_spec.clone(),
+        count,
+    });
+}
+
+/// Something happened to change an item's charge, poison, or cooldown.
+pub fn handle_extra_data_event(event: ExtraDataEvent, form_spec: &String) {
+    control::submit(Command::ExtraData {
+        event,
+        form_spec: form_spec.clone(),
+    });
 }
 
 /// Handle an item being favorited.
@@ -135,7 +193,15 @@ pub fn refresh_user_settings() {
         log::warn!("Failed to read user settings! using defaults; {e:#}");
         return;
     }
-    control::get().apply_settings();
+    redraw::published(Published::Settings);
+    let mut ctrl = control::get();
+    let changes = ctrl.apply_settings();
+    if changes.contains(SettingsChange::Keys) {
+        ctrl.publish_keys();
+    }
+    recorder::settings_changed(settings().record_session(), &ctrl);
+    watch_layout_file(settings().watch_layout());
+    set_texture_budget(settings().texture_budget_mb());
 }
 
 /// Clear all cycles. MCM -> this function -> controller.
@@ -164,7 +230,9 @@ pub fn serialize_cycles() -> Vec<u8> {
 pub fn cycle_loaded_from_cosave(bytes: &CxxVector<u8>, version: u32) {
     refresh_user_settings();
     let mut ctrl = control::get();
+    recorder::record_player();
     if let Some(cosave_cycle) = CycleData::deserialize(bytes, version) {
+        recorder::record_cycles(&cosave_cycle);
         ctrl.cycles = cosave_cycle;
         ctrl.refresh_after_load();
         log::info!("Cycles loaded and ready to rock.");
@@ -0,0 +1,226 @@
+//! Which glyphs the HUD's font needs.
+//!
+//! ImGui bakes every glyph a font might draw into a texture when the font is
+//! built. Asking it for whole scripts at once, like all of Chinese, means tens
+//! of thousands of glyphs, a freeze of several seconds on the render thread,
+//! and a texture tens of megabytes large, to draw a few dozen item names.
+//!
+//! So instead we keep track of the characters the HUD actually draws: the
+//! text in the draw plan, plus the names of everything in the player's
+//! cycles, so most glyphs are ready before the item is first shown. The font
+//! is built with just those. When a string turns up with characters we
+//! haven't seen, the generation moves and the renderer builds the font again
+//! on a worker thread, swapping it in a frame or two later. Strings that are
+//! plain ASCII, which is most of them, never take the lock.
+
+use std::collections::BTreeSet;
+use std::sync::atomic::{AtomicU32, Ordering};
+use std::sync::Mutex;
+
+use once_cell::sync::Lazy;
+
+/// Always in the font: Basic Latin and Latin-1, as ImGui's default ranges.
+const DEFAULT_RANGE: (u32, u32) = (0x0020, 0x00FF);
+/// Our ImGui uses 16-bit characters, so it can't draw anything past this.
+const MAX_CODEPOINT: u32 = 0xFFFF;
+
+static GLYPHS: Lazy<Mutex<GlyphSet>> = Lazy::new(|| Mutex::new(GlyphSet::default()));
+static GENERATION: AtomicU32 = AtomicU32::new(0);
+
+/// The characters a font must have glyphs for, beyond the default range.
+#[derive(Debug, Default, Clone)]
+pub struct GlyphSet {
+    extra: BTreeSet<u32>,
+}
+
+impl GlyphSet {
+    /// Note every character in this string. Returns true if any were new.
+    pub fn add(&mut self, text: &str) -> bool {
+        if text.is_ascii() {
+            return false;
+        }
+        let mut added = false;
+        for codepoint in text.chars().map(u32::from) {
+            if Self::wanted(codepoint) {
+                added |= self.extra.insert(codepoint);
+            }
+        }
+        added
+    }
+
+    /// Characters we need to ask for: not already in the default range, and
+    /// small enough for ImGui. Control characters are all in Latin-1.
+    fn wanted(codepoint: u32) -> bool {
+        codepoint > DEFAULT_RANGE.1 && codepoint <= MAX_CODEPOINT
+    }
+
+    pub fn len(&self) -> usize {
+        self.extra.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.extra.is_empty()
+    }
+
+    /// Glyph ranges in the form ImGui wants: inclusive first and last
+    /// characters in pairs, in order, with neighbors merged into one range.
+    /// The caller adds ImGui's terminating zero.
+    pub fn ranges(&self) -> Vec<u32> {
+        let mut ranges = vec![DEFAULT_RANGE.0, DEFAULT_RANGE.1];
+        for &codepoint in self.extra.iter() {
+            let last = ranges.len() - 1;
+            if codepoint == ranges[last] + 1 {
+                ranges[last] = codepoint;
+            } else {
+                ranges.push(codepoint);
+                ranges.push(codepoint);
+            }
+        }
+        ranges
+    }
+}
+
+/// Note the characters in some strings the HUD draws or is about to.
+pub fn note_glyphs<'a>(texts: impl IntoIterator<Item = &'a str>) {
+    let mut texts = texts.into_iter().filter(|text| !text.is_ascii()).peekable();
+    if texts.peek().is_none() {
+        return;
+    }
+    let mut glyphs = GLYPHS
+        .lock()
+        .expect("Unrecoverable runtime problem: cannot acquire glyphs lock.");
+    let before = glyphs.len();
+    for text in texts {
+        glyphs.add(text);
+    }
+    if glyphs.len() > before {
+        log::debug!(
+            "The HUD font needs {} new glyphs; {} in all.",
+            glyphs.len() - before,
+            glyphs.len()
+        );
+        GENERATION.fetch_add(1, Ordering::Relaxed);
+    }
+}
+
+/// Moves whenever the font needs glyphs it was not built with. Cheap; the
+/// renderer checks it every frame.
+pub fn font_glyphs_generation() -> u32 {
+    GENERATION.load(Ordering::Relaxed)
+}
+
+/// The glyph ranges to build the HUD's font with, as of right now.
+pub fn font_glyph_ranges() -> Vec<u32> {
+    GLYPHS
+        .lock()
+        .expect("Unrecoverable runtime problem: cannot acquire glyphs lock.")
+        .ranges()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn names() -> Vec<&'static str> {
+        include_str!("../../tests/fixtures/item-names-i18n.txt")
+            .lines()
+            .collect()
+    }
+
+    /// Every character in the ranges, for checking what they cover.
+    fn covered(ranges: &[u32]) -> BTreeSet<u32> {
+        ranges
+            .chunks(2)
+            .flat_map(|pair| pair[0]..=pair[1])
+            .collect()
+    }
+
+    #[test]
+    fn western_names_need_nothing_extra() {
+        let mut glyphs = GlyphSet::default();
+        assert!(!glyphs.add("Iron Sword"));
+        assert!(!glyphs.add("Épée en acier"));
+        assert!(!glyphs.add("Stahlschwert der Flammen"));
+        assert!(glyphs.is_empty());
+        assert_eq!(glyphs.ranges(), vec![0x20, 0xFF]);
+    }
+
+    #[test]
+    fn every_displayed_character_is_covered() {
+        let mut glyphs = GlyphSet::default();
+        for name in names() {
+            glyphs.add(name);
+        }
+        let covered = covered(&glyphs.ranges());
+        for name in names() {
+            for c in name.chars() {
+                assert!(covered.contains(&u32::from(c)), "{c} in {name} has a glyph");
+            }
+        }
+        // Exactly the characters drawn, not the tens of thousands in whole scripts:
+        // the 224 defaults plus each distinct character past Latin-1.
+        let extras: BTreeSet<u32> = names()
+            .into_iter()
+            .flat_map(str::chars)
+            .map(u32::from)
+            .filter(|&c| c > 0xFF)
+            .collect();
+        assert_eq!(glyphs.len(), extras.len());
+        assert_eq!(covered.len(), 224 + extras.len());
+        // Each extra that follows the character before it joins that range.
+        let merges = extras
+            .iter()
+            .filter(|&&c| c - 1 == 0xFF || extras.contains(&(c - 1)))
+            .count();
+        assert_eq!(glyphs.ranges().len(), 2 * (1 + extras.len() - merges));
+        assert!(!covered.contains(&u32::from('死')));
+
+        // Seeing the same names again adds nothing.
+        assert!(!names().into_iter().any(|name| glyphs.add(name)));
+        assert!(glyphs.add("死霊術師の杖"));
+    }
+
+    #[test]
+    fn ranges_are_sorted_and_merged() {
+        let mut glyphs = GlyphSet::default();
+        // Cyrillic А Б В, out of order and repeated; then a lone Д, and the
+        // first character past Latin-1, which joins the default range.
+        glyphs.add("ВБАБ");
+        glyphs.add("Д\u{0100}");
+        assert_eq!(
+            glyphs.ranges(),
+            vec![0x20, 0x100, 0x410, 0x412, 0x414, 0x414]
+        );
+        let ranges = glyphs.ranges();
+        for pair in ranges.chunks(2).collect::<Vec<_>>().windows(2) {
+            assert!(
+                pair[0][1] + 1 < pair[1][0],
+                "ranges stay apart and in order"
+            );
+        }
+    }
+
+    #[test]
+    fn unusable_characters_are_skipped() {
+        let mut glyphs = GlyphSet::default();
+        // Emoji are past what 16-bit ImGui can draw.
+        assert!(!glyphs.add("Sword 🗡"));
+        assert!(glyphs.add("Sword 🗡 剣"));
+        assert_eq!(glyphs.len(), 1);
+    }
+
+    #[test]
+    fn new_glyphs_move_the_generation() {
+        let before = font_glyphs_generation();
+        note_glyphs(["Iron Sword", "Steel Dagger"]);
+        note_glyphs(names());
+        // Runes, which nothing else here uses, so they must be new.
+        note_glyphs(["ᚠᚢᚦ"]);
+        assert!(font_glyphs_generation() > before);
+        // Other tests may note glyphs too, so we only know these are covered.
+        let covered = covered(&font_glyph_ranges());
+        assert!(covered.contains(&u32::from('鋼')));
+        assert!(covered.contains(&u32::from('검')));
+        assert!(covered.contains(&u32::from('ᚦ')));
+    }
+}
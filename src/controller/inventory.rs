@@ -0,0 +1,134 @@
+//! Everything the player has, fetched from the game in one call.
+//!
+//! Asking the game whether the player has an item means walking the whole
+//! inventory in C++. Doing that once per cycle entry adds up when a save with
+//! a big loadout loads. Instead C++ hands over every inventory item, spell,
+//! and shout at once as a list of form specs with counts, sorted by spec, and
+//! the questions get answered here.
+
+#[cfg(test)]
+use super::simulated::inventorySnapshot;
+#[cfg(not(test))]
+use crate::plugin::inventorySnapshot;
+use crate::plugin::InventoryEntry;
+
+/// The player's inventory, spells, and shouts at one moment, sorted by form spec.
+#[derive(Debug, Clone, Default)]
+pub struct InventorySnapshot {
+    entries: Vec<InventoryEntry>,
+}
+
+impl InventorySnapshot {
+    /// Ask the game what the player has right now.
+    pub fn from_game() -> Self {
+        let snapshot = Self::new(inventorySnapshot());
+        log::debug!("inventory snapshot has {} entries", snapshot.len());
+        snapshot
+    }
+
+    /// Make a snapshot from entries. C++ sends them sorted already; anything
+    /// else gets sorted here.
+    pub fn new(mut entries: Vec<InventoryEntry>) -> Self {
+        if !entries
+            .windows(2)
+            .all(|xs| xs[0].form_spec <= xs[1].form_spec)
+        {
+            entries.sort_unstable_by(|left, right| left.form_spec.cmp(&right.form_spec));
+        }
+        Self { entries }
+    }
+
+    /// How many of this item the player has. Spells and shouts they know count as one.
+    pub fn count(&self, form_spec: &str) -> u32 {
+        self.entries
+            .binary_search_by(|xs| xs.form_spec.as_str().cmp(form_spec))
+            .map_or(0, |index| self.entries[index].count)
+    }
+
+    /// Does the player have at least one of this item, or know this spell or shout?
+    pub fn has(&self, form_spec: &str) -> bool {
+        self.count(form_spec) > 0
+    }
+
+    pub fn len(&self) -> usize {
+        self.entries.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.entries.is_empty()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::controller::cycles::CycleData;
+    use crate::controller::keys::CycleSlot;
+    use crate::data::item_cache::ItemCache;
+
+    fn entry(form_spec: &str, count: u32) -> InventoryEntry {
+        InventoryEntry {
+            form_spec: form_spec.to_string(),
+            count,
+        }
+    }
+
+    fn snapshot() -> InventorySnapshot {
+        // Deliberately out of order.
+        InventorySnapshot::new(vec![
+            entry("Skyrim.esm|0x00013982", 3),
+            entry("Dawnguard.esm|0x0001a3f5", 1),
+            entry("Skyrim.esm|0x00012eb7", 1),
+            entry("Skyrim.esm|0x0001397e", 0),
+        ])
+    }
+
+    #[test]
+    fn counts_come_from_the_snapshot() {
+        let inventory = snapshot();
+        assert_eq!(inventory.len(), 4);
+        assert_eq!(inventory.count("Skyrim.esm|0x00013982"), 3);
+        assert_eq!(inventory.count("Dawnguard.esm|0x0001a3f5"), 1);
+        assert!(inventory.has("Skyrim.esm|0x00012eb7"));
+        assert!(!inventory.has("Skyrim.esm|0x0001397e"));
+        assert!(!inventory.has("Skyrim.esm|0x00000001"));
+        assert!(!InventorySnapshot::default().has("Skyrim.esm|0x00012eb7"));
+    }
+
+    #[test]
+    fn validation_drops_what_the_player_lost() {
+        let mut cache = ItemCache::default();
+        let mut cycles = CycleData::default();
+        for spec in [
+            "Skyrim.esm|0x00012eb7",
+            "Skyrim.esm|0x0001397e",
+            "Skyrim.esm|0x00000001",
+        ] {
+            let item = cache.get(&spec.to_string());
+            cycles.add_item(CycleSlot::Right, &item);
+        }
+        let mace = cache.get(&"Skyrim.esm|0x00013982".to_string());
+        cycles.add_item(CycleSlot::Left, &mace);
+        let potions = cache.get(&"health_proxy".to_string());
+        cycles.add_item(CycleSlot::Utility, &potions);
+
+        cycles.validate(&mut cache, &snapshot());
+        assert_eq!(
+            cycles.formids(&CycleSlot::Right),
+            vec!["Skyrim.esm|0x00012eb7".to_string()]
+        );
+        assert_eq!(
+            cycles.formids(&CycleSlot::Left),
+            vec!["Skyrim.esm|0x00013982".to_string()]
+        );
+
+        cycles.validate(&mut cache, &InventorySnapshot::default());
+        assert!(cycles.formids(&CycleSlot::Right).is_empty());
+        assert!(cycles.formids(&CycleSlot::Left).is_empty());
+        assert_eq!(
+            cycles.formids(&CycleSlot::Utility),
+            vec!["health_proxy".to_string()],
+            "proxies stay even when the player has no potions"
+        );
+    }
+}
@@ -2,15 +2,20 @@
 //! There are too many enums here and a substantial rework is called for.
 
 use std::fmt::Display;
-use std::time::{Duration, Instant};
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::time::Duration;
 
 use enumset::{EnumSet, EnumSetType};
 use eyre::eyre;
 use strum::Display;
 
 use super::control::RequestedAction;
-use super::settings::{settings, ActivationMethod, UnarmedMethod};
-use crate::plugin::{hasRangedEquipped, Action, ButtonEvent, HudElement};
+use super::settings::{settings, ActivationMethod, UnarmedMethod, UserSettings};
+#[cfg(test)]
+use super::simulated::hasRangedEquipped;
+#[cfg(not(test))]
+use crate::plugin::hasRangedEquipped;
+use crate::plugin::{Action, ButtonEvent, ButtonPress, HudElement};
 
 #[derive(Debug, Clone, Hash, PartialEq, Eq, Display)]
 pub enum CycleSlot {
@@ -29,8 +34,8 @@ pub enum Modifier {
 }
 
 impl Modifier {
-    pub fn key_for(&self) -> i32 {
-        let options = settings();
+    /// The key code for this modifier under the given settings; negative if unset.
+    pub fn key_with(&self, options: &UserSettings) -> i32 {
         match self {
             Modifier::Unequip => options.unequip_modifier(),
             Modifier::Cycle => options.cycle_modifier(),
@@ -58,7 +63,14 @@ pub enum Hotkey {
 
 impl From<u32> for Hotkey {
     fn from(v: u32) -> Self {
-        let options = settings();
+        Hotkey::for_key(v, &settings())
+    }
+}
+
+impl Hotkey {
+    /// What a key code means under the given settings. This is the slow,
+    /// authoritative answer; the controller asks its `KeyMap` instead.
+    pub fn for_key(v: u32, options: &UserSettings) -> Self {
         let mut set: EnumSet<Modifier> = EnumSet::new();
 
         if options.activate_modifier().is_positive()
@@ -102,12 +114,9 @@ impl From<u32> for Hotkey {
             Hotkey::None
         }
     }
-}
-
-impl Hotkey {
-    pub fn key_for(&self) -> i32 {
-        let options = settings();
 
+    /// The key code bound to this hotkey under the given settings; negative if unset.
+    pub fn key_with(&self, options: &UserSettings) -> i32 {
         match self {
             Hotkey::Power => options.power() as i32,
             Hotkey::Utility => options.utility() as i32,
@@ -121,7 +130,7 @@ impl Hotkey {
             Hotkey::Modifier(meanings) => {
                 // This is going to map to a single re-used key.
                 if let Some(meaning) = meanings.iter().find_map(Some) {
-                    meaning.key_for()
+                    meaning.key_with(options)
                 } else {
                     -1
                 }
@@ -213,11 +222,11 @@ pub enum KeyState {
     Down,
 }
 
-impl From<&ButtonEvent> for KeyState {
-    fn from(event: &ButtonEvent) -> Self {
-        if event.IsDown() {
+impl From<&ButtonPress> for KeyState {
+    fn from(event: &ButtonPress) -> Self {
+        if event.is_down() {
             KeyState::Down
-        } else if event.IsPressed() {
+        } else if event.is_pressed() {
             KeyState::Pressed
         } else {
             KeyState::Up
@@ -225,6 +234,34 @@ impl From<&ButtonEvent> for KeyState {
     }
 }
 
+/// These match CommonLibSE's `ButtonEvent` methods of the same names.
+impl ButtonPress {
+    pub fn from_button(key: u32, event: &ButtonEvent) -> Self {
+        Self {
+            key,
+            value: event.Value(),
+            held_secs: event.HeldDuration(),
+        }
+    }
+
+    pub fn is_pressed(&self) -> bool {
+        self.value > 0.0
+    }
+
+    pub fn is_down(&self) -> bool {
+        self.is_pressed() && self.held_secs == 0.0
+    }
+
+    pub fn is_up(&self) -> bool {
+        self.value == 0.0 && self.held_secs > 0.0
+    }
+
+    /// How long the button has been held, as the game counts it.
+    pub fn held(&self) -> Duration {
+        Duration::try_from_secs_f32(self.held_secs).unwrap_or_default()
+    }
+}
+
 /// An input event tracked by the controller.
 #[derive(Debug, Clone, Hash, PartialEq, Eq)]
 pub struct TrackedKey {
@@ -234,21 +271,18 @@ pub struct TrackedKey {
     hotkey: Hotkey,
     /// The current statue of the key.
     pub state: KeyState,
-    /// When we started tracking this key.
-    pub press_start: Option<Instant>,
+    /// How long the game says the key has been held. We use the game's clock
+    /// rather than ours so a replayed session sees the same long presses.
+    pub held: Duration,
 }
 
 impl TrackedKey {
-    pub fn new(key: u32, event: &ButtonEvent) -> Self {
-        let press_start = Some(Instant::now());
-        let state = KeyState::from(event);
-        let hotkey = Hotkey::from(key);
-
+    pub fn new(key: u32, hotkey: Hotkey, event: &ButtonPress) -> Self {
         Self {
             key,
             hotkey,
-            state,
-            press_start,
+            state: KeyState::from(event),
+            held: event.held(),
         }
     }
 
@@ -271,30 +305,15 @@ impl TrackedKey {
         )
     }
 
-    pub fn update(&mut self, event: &ButtonEvent) {
+    pub fn update(&mut self, event: &ButtonPress) {
         self.state = KeyState::from(event);
-        match self.state {
-            KeyState::Up => {
-                // nothing?
-            }
-            KeyState::Pressed => {
-                if self.press_start.is_none() {
-                    self.press_start = Some(Instant::now());
-                }
-            }
-            KeyState::Down => {
-                self.press_start = Some(Instant::now());
-            }
-        }
+        // A key-up carries the length of the whole press.
+        self.held = event.held();
     }
 
-    pub fn is_long_press(&self) -> bool {
-        if let Some(start) = self.press_start {
-            let elapsed_time = start.elapsed();
-            elapsed_time > Duration::from_millis(settings().long_press_ms().into())
-        } else {
-            false
-        }
+    /// True if this key has been held for longer than the given threshold.
+    pub fn is_long_press(&self, threshold: Duration) -> bool {
+        self.held > threshold
     }
 
     pub fn is_up(&self) -> bool {
@@ -312,7 +331,7 @@ impl Default for TrackedKey {
             key: 0,
             hotkey: Hotkey::None,
             state: KeyState::Up,
-            press_start: None,
+            held: Duration::ZERO,
         }
     }
 }
@@ -323,6 +342,201 @@ impl Display for TrackedKey {
     }
 }
 
+/// How many key codes get a slot in the dispatch table: keyboard scan codes,
+/// then mouse buttons from 256, then gamepad buttons from 266. Anything
+/// higher is looked up in a short overflow list.
+const KEYMAP_SIZE: usize = 512;
+
+/// One bit per key code in the table, set if the key is bound to anything.
+/// C++ checks this before sending us key events, so it's read without locks.
+static BOUND_KEYS: [AtomicU64; KEYMAP_SIZE / 64] = [NO_KEYS_BOUND; KEYMAP_SIZE / 64];
+#[allow(clippy::declare_interior_mutable_const)]
+const NO_KEYS_BOUND: AtomicU64 = AtomicU64::new(0);
+/// True if any key code past the end of the table is bound.
+static BOUND_OVERFLOW: AtomicBool = AtomicBool::new(false);
+/// False until the first key map is published; until then, every key might matter.
+static BOUND_PUBLISHED: AtomicBool = AtomicBool::new(false);
+
+/// True if this key code means anything under the most recently published key map.
+pub fn key_is_bound(key: u32) -> bool {
+    if !BOUND_PUBLISHED.load(Ordering::Acquire) {
+        return true;
+    }
+    let index = key as usize;
+    if index >= KEYMAP_SIZE {
+        return BOUND_OVERFLOW.load(Ordering::Relaxed);
+    }
+    BOUND_KEYS[index / 64].load(Ordering::Relaxed) & (1 << (index % 64)) != 0
+}
+
+/// Everything we need to know about one key code when it arrives.
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct KeyBinding {
+    pub hotkey: Hotkey,
+    /// True if pressing this key should start a long-press timer.
+    pub long_press_timer: bool,
+}
+
+impl KeyBinding {
+    fn new(key: u32, options: &UserSettings) -> Self {
+        Self {
+            hotkey: Hotkey::for_key(key, options),
+            long_press_timer: options.should_start_long_press_timer(key),
+        }
+    }
+}
+
+/// The key bindings from the user's settings, worked out ahead of time. The
+/// controller rebuilds this whenever settings are applied, so handling a key
+/// event is a table lookup instead of a settings clone and a dozen compares.
+#[derive(Debug, Clone)]
+pub struct KeyMap {
+    table: Vec<KeyBinding>,
+    overflow: Vec<(u32, KeyBinding)>,
+    hotkey_codes: Vec<(Hotkey, i32)>,
+    unequip_modifier: i32,
+    cycle_modifier: i32,
+    activate_modifier: i32,
+    menu_modifier: i32,
+    long_press_ms: u32,
+}
+
+impl KeyMap {
+    pub fn new(options: &UserSettings) -> Self {
+        let table = (0..KEYMAP_SIZE as u32)
+            .map(|key| KeyBinding::new(key, options))
+            .collect();
+
+        let hotkey_codes: Vec<(Hotkey, i32)> = [
+            Hotkey::Power,
+            Hotkey::Utility,
+            Hotkey::Left,
+            Hotkey::Right,
+            Hotkey::Equipment,
+            Hotkey::Activate,
+            Hotkey::UnequipHands,
+            Hotkey::Refresh,
+            Hotkey::ShowHide,
+        ]
+        .into_iter()
+        .map(|hotkey| {
+            let code = hotkey.key_with(options);
+            (hotkey, code)
+        })
+        .collect();
+
+        // Codes too big for the table. These are compared as u32, exactly as
+        // Hotkey::for_key() compares them, negative settings included.
+        let mut overflow: Vec<(u32, KeyBinding)> = Vec::new();
+        let candidates = hotkey_codes.iter().map(|(_, code)| *code as u32).chain(
+            [
+                options.unequip_modifier(),
+                options.cycle_modifier(),
+                options.activate_modifier(),
+                options.menu_modifier(),
+            ]
+            .into_iter()
+            .filter(|code| code.is_positive())
+            .map(|code| code.unsigned_abs()),
+        );
+        for key in candidates {
+            if key as usize >= KEYMAP_SIZE && !overflow.iter().any(|(code, _)| *code == key) {
+                overflow.push((key, KeyBinding::new(key, options)));
+            }
+        }
+
+        Self {
+            table,
+            overflow,
+            hotkey_codes,
+            unequip_modifier: options.unequip_modifier(),
+            cycle_modifier: options.cycle_modifier(),
+            activate_modifier: options.activate_modifier(),
+            menu_modifier: options.menu_modifier(),
+            long_press_ms: options.long_press_ms(),
+        }
+    }
+
+    /// Publish which keys are bound, for `key_is_bound()`.
+    pub fn publish(&self) {
+        for (word, bits) in self.table.chunks(64).zip(BOUND_KEYS.iter()) {
+            let mask = word
+                .iter()
+                .enumerate()
+                .filter(|(_, binding)| !matches!(binding.hotkey, Hotkey::None))
+                .fold(0u64, |mask, (bit, _)| mask | (1 << bit));
+            bits.store(mask, Ordering::Relaxed);
+        }
+        let overflow = self
+            .overflow
+            .iter()
+            .any(|(_, binding)| !matches!(binding.hotkey, Hotkey::None));
+        BOUND_OVERFLOW.store(overflow, Ordering::Relaxed);
+        BOUND_PUBLISHED.store(true, Ordering::Release);
+    }
+
+    /// Everything we know about this key code.
+    pub fn binding(&self, key: u32) -> &KeyBinding {
+        static UNBOUND: KeyBinding = KeyBinding {
+            hotkey: Hotkey::None,
+            long_press_timer: false,
+        };
+
+        if let Some(binding) = self.table.get(key as usize) {
+            return binding;
+        }
+        self.overflow
+            .iter()
+            .find(|(code, _)| *code == key)
+            .map(|(_, binding)| binding)
+            .unwrap_or(&UNBOUND)
+    }
+
+    /// What this key code means. The same answer as `Hotkey::for_key()`.
+    pub fn hotkey(&self, key: u32) -> &Hotkey {
+        &self.binding(key).hotkey
+    }
+
+    /// The key code bound to this hotkey; negative if unset.
+    pub fn key_for(&self, hotkey: &Hotkey) -> i32 {
+        match hotkey {
+            Hotkey::Modifier(meanings) => {
+                if let Some(meaning) = meanings.iter().find_map(Some) {
+                    self.modifier_key(&meaning)
+                } else {
+                    -1
+                }
+            }
+            Hotkey::None => -1,
+            _ => self
+                .hotkey_codes
+                .iter()
+                .find(|(candidate, _)| candidate == hotkey)
+                .map(|(_, code)| *code)
+                .unwrap_or(-1),
+        }
+    }
+
+    /// The key code for a modifier; negative if unset.
+    pub fn modifier_key(&self, modifier: &Modifier) -> i32 {
+        match modifier {
+            Modifier::Unequip => self.unequip_modifier,
+            Modifier::Cycle => self.cycle_modifier,
+            Modifier::Activate => self.activate_modifier,
+            Modifier::Menu => self.menu_modifier,
+        }
+    }
+
+    /// How long a key must be held to count as a long press, in milliseconds.
+    pub fn long_press_ms(&self) -> u32 {
+        self.long_press_ms
+    }
+
+    pub fn long_press(&self) -> Duration {
+        Duration::from_millis(self.long_press_ms.into())
+    }
+}
+
 impl From<&Hotkey> for Action {
     fn from(value: &Hotkey) -> Self {
         match value {
@@ -401,3 +615,111 @@ impl From<CycleSlot> for Action {
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Every settings file in the fixtures directory, so new ones are checked too.
+    fn settings_fixtures() -> Vec<String> {
+        let mut paths: Vec<_> = std::fs::read_dir("tests/fixtures")
+            .expect("the fixtures directory exists")
+            .filter_map(|entry| entry.ok().map(|entry| entry.path()))
+            .filter(|path| path.extension().is_some_and(|ext| ext == "ini"))
+            .map(|path| path.to_string_lossy().to_string())
+            .collect();
+        paths.sort();
+        paths
+    }
+
+    fn check_keymap(options: &UserSettings, source: &str) {
+        let keys = KeyMap::new(options);
+
+        for key in 0..(KEYMAP_SIZE as u32 + 64) {
+            assert_eq!(
+                *keys.hotkey(key),
+                Hotkey::for_key(key, options),
+                "{source}: key {key}"
+            );
+            assert_eq!(
+                keys.binding(key).long_press_timer,
+                options.should_start_long_press_timer(key),
+                "{source}: key {key}"
+            );
+        }
+        // The codes nobody ever sends, which unset settings can still match.
+        for key in [u32::MAX, u32::MAX - 1, i32::MAX as u32, 1 << 31] {
+            assert_eq!(*keys.hotkey(key), Hotkey::for_key(key, options), "{source}");
+        }
+
+        for hotkey in [
+            Hotkey::Power,
+            Hotkey::Utility,
+            Hotkey::Left,
+            Hotkey::Right,
+            Hotkey::Equipment,
+            Hotkey::Activate,
+            Hotkey::UnequipHands,
+            Hotkey::Refresh,
+            Hotkey::ShowHide,
+            Hotkey::None,
+        ] {
+            assert_eq!(keys.key_for(&hotkey), hotkey.key_with(options), "{source}");
+        }
+        for modifier in EnumSet::<Modifier>::all() {
+            assert_eq!(
+                keys.modifier_key(&modifier),
+                modifier.key_with(options),
+                "{source}"
+            );
+            let overloaded = Hotkey::Modifier(EnumSet::only(modifier));
+            assert_eq!(keys.key_for(&overloaded), overloaded.key_with(options));
+        }
+        assert_eq!(keys.long_press_ms(), options.long_press_ms());
+    }
+
+    #[test]
+    fn keymap_matches_hotkey_for_every_fixture() {
+        let fixtures = settings_fixtures();
+        assert!(!fixtures.is_empty(), "no settings fixtures found");
+        for fixture in fixtures.iter() {
+            let mut options = UserSettings::default();
+            options
+                .read_from_file(fixture)
+                .unwrap_or_else(|e| panic!("{fixture} should load: {e:#}"));
+            check_keymap(&options, fixture);
+        }
+        check_keymap(&UserSettings::default(), "defaults");
+    }
+
+    #[test]
+    fn out_of_range_bindings_still_dispatch() {
+        let fixture = "tests/fixtures/test-settings.ini";
+        let mut options = UserSettings::default();
+        options.read_from_file(fixture).expect("fixture loads");
+        let keys = KeyMap::new(&options);
+
+        // Nothing in a fixture binds a code this high, so nothing should match.
+        assert_eq!(*keys.hotkey(100_000), Hotkey::None);
+        assert_eq!(*keys.binding(100_000), KeyBinding::default());
+    }
+
+    #[test]
+    fn published_bitmap_never_hides_a_bound_key() {
+        let mut options = UserSettings::default();
+        options
+            .read_from_file("tests/fixtures/test-settings.ini")
+            .expect("fixture loads");
+        let keys = KeyMap::new(&options);
+        keys.publish();
+
+        for key in 0..KEYMAP_SIZE as u32 {
+            let bound = !matches!(keys.hotkey(key), Hotkey::None);
+            assert_eq!(key_is_bound(key), bound, "key {key}");
+        }
+        for key in [KEYMAP_SIZE as u32, 100_000, u32::MAX] {
+            assert!(key_is_bound(key) || matches!(keys.hotkey(key), Hotkey::None));
+        }
+        assert!(key_is_bound(184), "modifiers are bound too");
+    }
+}
@@ -25,6 +25,7 @@ pub fn initialize_rust_logging(_logdir: &cxx::CxxVector<u16>) {
     #[cfg(target_os = "windows")]
     let chonky_path = OsString::from_wide(_logdir.as_slice());
     let path = Path::new(chonky_path.as_os_str()).with_file_name("SoulsyHUD.log");
+    super::recorder::set_session_path(path.with_file_name(super::recorder::SESSION_FILE));
 
     let Ok(logfile) = File::create(path) else {
         // Welp, we failed and I have nowhere to write the darn error. Ha ha.
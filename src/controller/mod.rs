@@ -7,16 +7,30 @@
 //!
 //! There is little defined in this module file, but everything it re-exports
 //! is available to be bridged to C++ in the `plugin` module.
+pub mod commands;
 pub mod control;
 pub mod cycleentries;
 pub mod cycles;
 pub mod facade;
+pub mod glyphs;
+pub mod inventory;
 pub mod keys;
 pub mod logs;
+pub mod plan;
+pub mod recorder;
+pub mod redraw;
 pub mod settings;
+#[cfg(test)]
+pub mod simulated;
 pub mod strings;
+pub mod timers;
 
 pub use facade::*;
+pub use glyphs::{font_glyph_ranges, font_glyphs_generation};
+pub use keys::key_is_bound;
 pub use logs::*;
+pub use plan::hud_draw_plan;
+pub use redraw::hud_needs_rebuild;
 pub use settings::UserSettings;
 pub use strings::*;
+pub use timers::advance_timers;
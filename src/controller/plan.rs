@@ -0,0 +1,854 @@
+//! The HUD as a flat list of things to draw, worked out in Rust.
+//!
+//! The renderer used to walk the layout itself every frame, asking across the
+//! bridge for each slot's item, name, icon, color, and label text, and making
+//! the same decisions about what to show each time. Now we make those
+//! decisions here and hand it a list of images, strips, and text runs with
+//! their positions and colors resolved. It loads the images, measures the
+//! text, and draws.
+//!
+//! The plan is kept between frames in parts: one for the HUD background and
+//! one for each slot. Each part remembers what it was built from, and only the
+//! parts whose inputs changed get built again. Any rebuild bumps the plan's
+//! version, which is how the renderer knows to fetch a new one.
+//!
+//! Running animations are a part of their own, drawn over the slots. It's
+//! rebuilt whenever one of them moves to a new frame or fades a step.
+//!
+//! Colors are not faded. The renderer applies the HUD's alpha as it draws, so
+//! a fade doesn't rebuild anything here.
+
+use std::sync::Mutex;
+use std::time::Instant;
+
+use once_cell::sync::Lazy;
+
+use super::commands::HudSnapshot;
+use super::control;
+use super::glyphs::note_glyphs;
+use super::redraw::Generations;
+use super::settings::{settings, UserSettings};
+use crate::data::huditem::HudItem;
+use crate::images::animation::{current_animation_frames, AnimationFrame};
+use crate::layouts::geometry::{arc_fill_strip, clip_quad};
+use crate::layouts::hud_layout;
+use crate::plugin::{
+    Align, Color, DrawCommand, DrawKind, HudElement, ImageSource, LayoutFlattened, MeterKind,
+    Point, SlotFlattened,
+};
+
+static PLAN: Lazy<Mutex<DrawPlan>> = Lazy::new(|| Mutex::new(DrawPlan::default()));
+
+/// Everything a frame's plan is built from.
+pub struct PlanInputs<'a> {
+    pub layout: &'a LayoutFlattened,
+    pub generations: Generations,
+    pub snapshot: &'a HudSnapshot,
+    /// The game's resolution. The HUD background is kept on screen.
+    pub screen: Point,
+    pub ranged_equipped: bool,
+    pub now: Instant,
+    /// What the running animations show right now.
+    pub animations: Vec<AnimationFrame>,
+}
+
+/// What the HUD background part was built from.
+#[derive(Debug, Clone, PartialEq)]
+struct BackgroundKey {
+    layout: u64,
+    screen: Point,
+}
+
+/// What a slot part was built from. Items are compared whole; the meter is
+/// kept separately because a running cooldown moves it with no new item.
+#[derive(Debug, Clone, PartialEq)]
+struct SlotKey {
+    layout: u64,
+    settings: u64,
+    shown: bool,
+    item: Option<HudItem>,
+    show_meter: bool,
+    meter_level: f32,
+}
+
+/// A slot's key as of this frame, borrowing the item from the snapshot. It's
+/// compared against the stored key every frame, and only copied into one
+/// when the slot is rebuilt, so an unchanged slot costs no allocation.
+#[derive(Debug, Clone, Copy)]
+struct SlotKeyRef<'a> {
+    layout: u64,
+    settings: u64,
+    shown: bool,
+    item: Option<&'a HudItem>,
+    show_meter: bool,
+    meter_level: f32,
+}
+
+impl SlotKeyRef<'_> {
+    fn matches(&self, key: &SlotKey) -> bool {
+        self.layout == key.layout
+            && self.settings == key.settings
+            && self.shown == key.shown
+            && self.item == key.item.as_ref()
+            && self.show_meter == key.show_meter
+            && self.meter_level == key.meter_level
+    }
+
+    fn to_key(self) -> SlotKey {
+        SlotKey {
+            layout: self.layout,
+            settings: self.settings,
+            shown: self.shown,
+            item: self.item.cloned(),
+            show_meter: self.show_meter,
+            meter_level: self.meter_level,
+        }
+    }
+}
+
+#[derive(Debug)]
+struct Part<K> {
+    key: Option<K>,
+    commands: Vec<DrawCommand>,
+}
+
+impl<K> Default for Part<K> {
+    fn default() -> Self {
+        Self {
+            key: None,
+            commands: Vec::new(),
+        }
+    }
+}
+
+impl<K> Part<K> {
+    /// Rebuild unless `is_current` accepts the stored key. The new key is
+    /// made only for a rebuild. Returns true if there was one.
+    fn refresh_with(
+        &mut self,
+        is_current: impl FnOnce(&K) -> bool,
+        key: impl FnOnce() -> K,
+        build: impl FnOnce() -> Vec<DrawCommand>,
+    ) -> bool {
+        if self.key.as_ref().is_some_and(is_current) {
+            return false;
+        }
+        self.commands = build();
+        self.key = Some(key());
+        true
+    }
+}
+
+impl<K: PartialEq> Part<K> {
+    /// Rebuild if the key changed. Returns true if it did.
+    fn refresh(&mut self, key: K, build: impl FnOnce() -> Vec<DrawCommand>) -> bool {
+        if self.key.as_ref() == Some(&key) {
+            return false;
+        }
+        self.commands = build();
+        self.key = Some(key);
+        true
+    }
+}
+
+/// The HUD's draw plan, kept between frames.
+#[derive(Debug, Default)]
+pub struct DrawPlan {
+    version: u64,
+    background: Part<BackgroundKey>,
+    slots: Vec<Part<SlotKey>>,
+    animations: Part<Vec<AnimationFrame>>,
+}
+
+impl DrawPlan {
+    /// Bumped every time any part of the plan changes.
+    pub fn version(&self) -> u64 {
+        self.version
+    }
+
+    /// Bring the plan up to date, rebuilding only what changed. Settings are
+    /// only fetched if a slot needs them. Returns true if anything changed.
+    pub fn update(
+        &mut self,
+        inputs: &PlanInputs,
+        fetch_settings: impl FnOnce() -> UserSettings,
+    ) -> bool {
+        let layout = inputs.layout;
+        let mut changed = self.background.refresh(
+            BackgroundKey {
+                layout: inputs.generations.layout,
+                screen: inputs.screen.clone(),
+            },
+            || background(layout, &inputs.screen),
+        );
+
+        if self.slots.len() != layout.slots.len() {
+            self.slots.resize_with(layout.slots.len(), Part::default);
+            changed = true;
+        }
+
+        let mut fetch_settings = Some(fetch_settings);
+        let mut user_settings: Option<UserSettings> = None;
+        for (slot, part) in layout.slots.iter().zip(self.slots.iter_mut()) {
+            let shown = slot_shown(layout, slot.element, inputs.ranged_equipped);
+            let item = inputs.snapshot.visible.get(&slot.element);
+            let key = SlotKeyRef {
+                layout: inputs.generations.layout,
+                settings: inputs.generations.settings,
+                shown,
+                item,
+                show_meter: item.is_some_and(|item| item.show_meter_at(inputs.now)),
+                meter_level: item.map_or(0.0, |item| item.meter_level_at(inputs.now)),
+            };
+            changed |= part.refresh_with(
+                |stored| key.matches(stored),
+                || key.to_key(),
+                || {
+                    if !shown {
+                        return Vec::new();
+                    }
+                    let user_settings = user_settings.get_or_insert_with(|| {
+                        let fetch = fetch_settings
+                            .take()
+                            .expect("settings are fetched only once");
+                        fetch()
+                    });
+                    let empty = HudItem::default();
+                    slot_commands(slot, item.unwrap_or(&empty), user_settings, inputs.now)
+                },
+            );
+        }
+
+        changed |= self.animations.refresh_with(
+            |stored| *stored == inputs.animations,
+            || inputs.animations.clone(),
+            || inputs.animations.iter().map(sprite).collect(),
+        );
+
+        if changed {
+            self.version += 1;
+        }
+        changed
+    }
+
+    /// The text of every text run in the plan.
+    pub fn texts(&self) -> impl Iterator<Item = &str> {
+        self.slots
+            .iter()
+            .flat_map(|part| part.commands.iter())
+            .filter(|command| command.kind == DrawKind::Text)
+            .map(|command| command.text.as_str())
+    }
+
+    /// The whole plan, in drawing order.
+    pub fn commands(&self) -> Vec<DrawCommand> {
+        let count = self.background.commands.len()
+            + self
+                .slots
+                .iter()
+                .map(|part| part.commands.len())
+                .sum::<usize>()
+            + self.animations.commands.len();
+        let mut commands = Vec::with_capacity(count);
+        commands.extend_from_slice(&self.background.commands);
+        for part in self.slots.iter() {
+            commands.extend_from_slice(&part.commands);
+        }
+        commands.extend_from_slice(&self.animations.commands);
+        commands
+    }
+}
+
+/// Bring the HUD's plan up to date for this frame and return its version.
+pub fn refresh_draw_plan(screen: Point, ranged_equipped: bool) -> u64 {
+    let layout = hud_layout();
+    let snapshot = control::snapshot();
+    let now = Instant::now();
+    let inputs = PlanInputs {
+        layout: &layout,
+        generations: Generations::current(),
+        snapshot: &snapshot,
+        screen,
+        ranged_equipped,
+        now,
+        animations: current_animation_frames(now),
+    };
+    let mut plan = draw_plan();
+    if plan.update(&inputs, settings) {
+        note_glyphs(plan.texts());
+    }
+    plan.version()
+}
+
+/// The current plan, for the renderer to draw.
+pub fn hud_draw_plan() -> Vec<DrawCommand> {
+    draw_plan().commands()
+}
+
+fn draw_plan() -> std::sync::MutexGuard<'static, DrawPlan> {
+    PLAN.lock()
+        .expect("Unrecoverable runtime problem: cannot acquire draw plan lock.")
+}
+
+/// The left hand and ammo slots come and go with a ranged weapon, if the
+/// layout asks for that.
+fn slot_shown(layout: &LayoutFlattened, element: HudElement, ranged_equipped: bool) -> bool {
+    match element {
+        HudElement::Left => !(layout.hide_left_when_irrelevant && ranged_equipped),
+        HudElement::Ammo => !(layout.hide_ammo_when_irrelevant && !ranged_equipped),
+        _ => true,
+    }
+}
+
+fn background(layout: &LayoutFlattened, screen: &Point) -> Vec<DrawCommand> {
+    if layout.bg_color.a == 0 || layout.bg_image.is_empty() {
+        return Vec::new();
+    }
+    // If the layout is larger than the HUD, restrict it to one quarter screen size.
+    let size = Point {
+        x: layout.bg_size.x.min(screen.x / 4.0),
+        y: layout.bg_size.y.min(screen.y / 4.0),
+    };
+    // If the layout is trying to draw the HUD offscreen, clamp it to an edge.
+    let center = Point {
+        x: layout
+            .anchor
+            .x
+            .max(size.x / 2.0)
+            .min(screen.x - size.x / 2.0),
+        y: layout
+            .anchor
+            .y
+            .max(size.y / 2.0)
+            .min(screen.y - size.y / 2.0),
+    };
+    vec![image(
+        ImageSource::Hud,
+        &layout.bg_image,
+        center,
+        size,
+        &layout.bg_color,
+    )]
+}
+
+/// Everything one slot draws, in the order the renderer always drew it.
+fn slot_commands(
+    slot: &SlotFlattened,
+    item: &HudItem,
+    user_settings: &UserSettings,
+    now: Instant,
+) -> Vec<DrawCommand> {
+    let name = item.name();
+    // Empty equipsets draw nothing at all.
+    if slot.element == HudElement::EquipSet && name.is_empty() {
+        return Vec::new();
+    }
+    let icon_key = item.icon_key();
+    let skip_item = (name.is_empty() && icon_key.is_empty()) || item.form_string().is_empty();
+    let mut commands = Vec::new();
+
+    if slot.bg_color.a > 0 && !slot.bg_image.is_empty() {
+        commands.push(image(
+            ImageSource::Hud,
+            &slot.bg_image,
+            slot.center.clone(),
+            slot.bg_size.clone(),
+            &slot.bg_color,
+        ));
+    }
+
+    if slot.icon_color.a > 0 && !skip_item {
+        let color = if user_settings.colorize_icons() {
+            item.color()
+        } else {
+            slot.icon_color.clone()
+        };
+        let mut icon = image(
+            ImageSource::Icon,
+            &icon_key,
+            slot.icon_center.clone(),
+            slot.icon_size.clone(),
+            &color,
+        );
+        icon.fit = true;
+        commands.push(icon);
+    }
+
+    if !skip_item {
+        for label in slot.text.iter().filter(|label| label.color.a > 0) {
+            let text = item.fmtstr_at(label.contents.clone(), now);
+            if text.is_empty() {
+                continue;
+            }
+            let mut run = command(DrawKind::Text, label.anchor.clone(), &label.color);
+            run.text = text;
+            run.font_size = label.font_size;
+            run.alignment = label.alignment;
+            run.wrap_width = label.wrap_width;
+            run.truncate = label.truncate;
+            commands.push(run);
+        }
+    }
+
+    if slot.hotkey_color.a > 0 {
+        if slot.hotkey_bg_color.a > 0 && !slot.hotkey_bg_image.is_empty() {
+            commands.push(image(
+                ImageSource::Hud,
+                &slot.hotkey_bg_image,
+                slot.hotkey_center.clone(),
+                slot.hotkey_size.clone(),
+                &slot.hotkey_bg_color,
+            ));
+        }
+        let size = Point {
+            x: slot.hotkey_size.x - 2.0,
+            y: slot.hotkey_size.y - 2.0,
+        };
+        let mut glyph = image(
+            ImageSource::Hotkey,
+            "",
+            slot.hotkey_center.clone(),
+            size,
+            &slot.hotkey_color,
+        );
+        glyph.hotkey = user_settings.hotkey_for(slot.element);
+        commands.push(glyph);
+    }
+
+    if slot.meter_kind != MeterKind::None && item.show_meter_at(now) {
+        let level = item.meter_level_at(now);
+        if slot.meter_kind == MeterKind::CircleArc {
+            meter_arc(slot, level, &mut commands);
+        } else if slot.meter_kind == MeterKind::Rectangular {
+            meter_rectangle(slot, level, &mut commands);
+        }
+    }
+
+    if slot.poison_color.a > 0 && item.is_poisoned() && !slot.poison_image.is_empty() {
+        commands.push(image(
+            ImageSource::Hud,
+            &slot.poison_image,
+            slot.poison_center.clone(),
+            slot.poison_size.clone(),
+            &slot.poison_color,
+        ));
+    }
+
+    commands
+}
+
+fn meter_arc(slot: &SlotFlattened, level: f32, commands: &mut Vec<DrawCommand>) {
+    if !slot.meter_empty_image.is_empty() {
+        commands.push(image(
+            ImageSource::Hud,
+            &slot.meter_empty_image,
+            slot.meter_center.clone(),
+            slot.meter_size.clone(),
+            &slot.meter_empty_color,
+        ));
+    }
+    let strip = arc_fill_strip(&slot.meter_arc_outer, &slot.meter_arc_inner, level);
+    if !strip.is_empty() {
+        let mut fill = command(
+            DrawKind::Strip,
+            slot.meter_center.clone(),
+            &slot.meter_fill_color,
+        );
+        fill.points = strip;
+        commands.push(fill);
+    }
+}
+
+/// A rectangular meter draws its background and fill images over rotated
+/// quads. With only one of the two images, that one does double duty.
+fn meter_rectangle(slot: &SlotFlattened, level: f32, commands: &mut Vec<DrawCommand>) {
+    if slot.meter_empty_quad.len() != 4 || slot.meter_fill_quad.len() != 4 {
+        return;
+    }
+    let (empty_image, fill_image) = match (
+        slot.meter_empty_image.is_empty(),
+        slot.meter_fill_image.is_empty(),
+    ) {
+        (false, false) => (&slot.meter_empty_image, &slot.meter_fill_image),
+        (false, true) => (&slot.meter_empty_image, &slot.meter_empty_image),
+        (true, false) => (&slot.meter_fill_image, &slot.meter_fill_image),
+        (true, true) => return,
+    };
+
+    let mut empty = image(
+        ImageSource::Hud,
+        empty_image,
+        slot.meter_center.clone(),
+        slot.meter_size.clone(),
+        &slot.meter_empty_color,
+    );
+    empty.kind = DrawKind::ImageQuad;
+    empty.points = slot.meter_empty_quad.clone();
+    commands.push(empty);
+
+    let mut fill = image(
+        ImageSource::Hud,
+        fill_image,
+        slot.meter_center.clone(),
+        slot.meter_fill_size.clone(),
+        &slot.meter_fill_color,
+    );
+    fill.kind = DrawKind::ImageQuad;
+    fill.points = clip_quad(&slot.meter_fill_quad, level);
+    commands.push(fill);
+}
+
+fn sprite(frame: &AnimationFrame) -> DrawCommand {
+    let mut sprite = image(
+        ImageSource::Sprite,
+        &frame.strip,
+        frame.center.clone(),
+        frame.size.clone(),
+        &frame.color,
+    );
+    sprite.frame = frame.frame;
+    sprite
+}
+
+fn command(kind: DrawKind, center: Point, color: &Color) -> DrawCommand {
+    DrawCommand {
+        kind,
+        source: ImageSource::None,
+        image: String::new(),
+        hotkey: 0,
+        frame: 0,
+        center,
+        size: Point::default(),
+        fit: false,
+        points: Vec::new(),
+        color: color.clone(),
+        text: String::new(),
+        font_size: 0.0,
+        alignment: Align::Left,
+        wrap_width: 0.0,
+        truncate: false,
+    }
+}
+
+fn image(
+    source: ImageSource,
+    name: &str,
+    center: Point,
+    size: Point,
+    color: &Color,
+) -> DrawCommand {
+    let mut image = command(DrawKind::Image, center, color);
+    image.source = source;
+    image.image = name.to_string();
+    image.size = size;
+    image
+}
+
+#[cfg(test)]
+mod tests {
+    use std::collections::HashMap;
+    use std::time::Duration;
+
+    use super::*;
+    use crate::data::base::BaseType;
+    use crate::data::huditem::RelevantExtraData;
+    use crate::data::power::PowerType;
+    use crate::layouts::source::parse;
+
+    fn layout() -> LayoutFlattened {
+        let buf = include_str!("../../tests/fixtures/layout-v2.toml");
+        parse(buf).expect("the fixture parses").flatten()
+    }
+
+    fn item(name: &str, kind: BaseType) -> HudItem {
+        HudItem::preclassified(name.to_string(), format!("Skyrim.esm|{name}"), 1, kind)
+    }
+
+    fn snapshot(items: &[(HudElement, HudItem)]) -> HudSnapshot {
+        HudSnapshot {
+            visible: items.iter().cloned().collect::<HashMap<_, _>>(),
+            hud_visible: true,
+        }
+    }
+
+    fn inputs<'a>(
+        layout: &'a LayoutFlattened,
+        snapshot: &'a HudSnapshot,
+        now: Instant,
+    ) -> PlanInputs<'a> {
+        PlanInputs {
+            layout,
+            generations: Generations::default(),
+            snapshot,
+            screen: Point {
+                x: 1920.0,
+                y: 1080.0,
+            },
+            ranged_equipped: false,
+            now,
+            animations: Vec::new(),
+        }
+    }
+
+    /// Which slot parts hold which commands, to see what got rebuilt.
+    fn parts(plan: &DrawPlan) -> Vec<Vec<DrawCommand>> {
+        plan.slots
+            .iter()
+            .map(|part| part.commands.clone())
+            .collect()
+    }
+
+    fn slot_index(layout: &LayoutFlattened, element: HudElement) -> usize {
+        layout
+            .slots
+            .iter()
+            .position(|slot| slot.element == element)
+            .expect("the fixture has this slot")
+    }
+
+    fn texts(commands: &[DrawCommand]) -> Vec<String> {
+        commands
+            .iter()
+            .filter(|command| command.kind == DrawKind::Text)
+            .map(|command| command.text.clone())
+            .collect()
+    }
+
+    #[test]
+    fn unchanged_state_keeps_the_plan() {
+        let layout = layout();
+        let now = Instant::now();
+        let shown = snapshot(&[(HudElement::Right, item("Iron Sword", BaseType::Empty))]);
+        let mut plan = DrawPlan::default();
+        assert!(plan.update(&inputs(&layout, &shown, now), UserSettings::default));
+        let version = plan.version();
+        let commands = plan.commands();
+        assert!(!commands.is_empty());
+
+        let later = now + Duration::from_secs(5);
+        assert!(!plan.update(&inputs(&layout, &shown, later), || {
+            panic!("nothing changed, so nothing needs settings")
+        }));
+        assert_eq!(plan.version(), version);
+        assert_eq!(plan.commands().len(), commands.len());
+    }
+
+    #[test]
+    fn a_new_item_rebuilds_only_its_slot() {
+        let layout = layout();
+        let now = Instant::now();
+        let right = slot_index(&layout, HudElement::Right);
+        let mut plan = DrawPlan::default();
+        let before = snapshot(&[
+            (HudElement::Right, item("Iron Sword", BaseType::Empty)),
+            (
+                HudElement::Power,
+                item("Unrelenting Force", BaseType::Empty),
+            ),
+        ]);
+        plan.update(&inputs(&layout, &before, now), UserSettings::default);
+        let version = plan.version();
+        let old = parts(&plan);
+
+        let after = snapshot(&[
+            (HudElement::Right, item("Steel Sword", BaseType::Empty)),
+            (
+                HudElement::Power,
+                item("Unrelenting Force", BaseType::Empty),
+            ),
+        ]);
+        assert!(plan.update(&inputs(&layout, &after, now), UserSettings::default));
+        assert!(plan.version() > version);
+        let new = parts(&plan);
+        for (index, (old, new)) in old.iter().zip(new.iter()).enumerate() {
+            if index == right {
+                assert_ne!(texts(old), texts(new), "the right hand slot was rebuilt");
+            } else {
+                assert_eq!(texts(old), texts(new), "slot {index} was left alone");
+            }
+        }
+    }
+
+    #[test]
+    fn every_input_invalidates() {
+        let layout = layout();
+        let now = Instant::now();
+        let shown = snapshot(&[(HudElement::Right, item("Iron Sword", BaseType::Empty))]);
+        let base = inputs(&layout, &shown, now);
+
+        let mut bumped_layout = base.generations;
+        bumped_layout.layout += 1;
+        let mut bumped_settings = base.generations;
+        bumped_settings.settings += 1;
+        let changes: Vec<(&str, PlanInputs)> = vec![
+            (
+                "layout",
+                PlanInputs {
+                    generations: bumped_layout,
+                    ..inputs(&layout, &shown, now)
+                },
+            ),
+            (
+                "settings",
+                PlanInputs {
+                    generations: bumped_settings,
+                    ..inputs(&layout, &shown, now)
+                },
+            ),
+            (
+                "screen size",
+                PlanInputs {
+                    screen: Point { x: 800.0, y: 600.0 },
+                    ..inputs(&layout, &shown, now)
+                },
+            ),
+        ];
+        for (what, changed) in changes {
+            let mut plan = DrawPlan::default();
+            plan.update(&base, UserSettings::default);
+            assert!(
+                plan.update(&changed, UserSettings::default),
+                "a change to the {what} must rebuild"
+            );
+        }
+
+        // Picking up a bow hides the left hand in this layout, if it says so.
+        let mut plan = DrawPlan::default();
+        plan.update(&base, UserSettings::default);
+        let ranged = PlanInputs {
+            ranged_equipped: true,
+            ..inputs(&layout, &shown, now)
+        };
+        let hides = layout.hide_left_when_irrelevant || layout.hide_ammo_when_irrelevant;
+        assert_eq!(plan.update(&ranged, UserSettings::default), hides);
+    }
+
+    #[test]
+    fn cooldowns_rebuild_until_done() {
+        let layout = layout();
+        let power = slot_index(&layout, HudElement::Power);
+        let start = Instant::now();
+        let mut shout = item("Unrelenting Force", BaseType::Power(PowerType::default()));
+        shout.apply_extra_data(
+            RelevantExtraData::new(false, 0.0, 0.0, false, true, 0.0, 20.0),
+            start,
+        );
+        let shown = snapshot(&[(HudElement::Power, shout)]);
+        let at = |seconds: f32| inputs(&layout, &shown, start + Duration::from_secs_f32(seconds));
+
+        let mut plan = DrawPlan::default();
+        plan.update(&at(0.0), UserSettings::default);
+        for frame in 1..10 {
+            assert!(
+                plan.update(&at(frame as f32 * 0.016), UserSettings::default),
+                "frame {frame} of a cooldown must rebuild"
+            );
+        }
+        let has_meter = |plan: &DrawPlan| {
+            plan.slots[power].commands.iter().any(|command| {
+                command.kind == DrawKind::Strip || command.kind == DrawKind::ImageQuad
+            })
+        };
+        if layout.slots[power].meter_kind != MeterKind::None {
+            assert!(has_meter(&plan), "the power slot shows its cooldown");
+        }
+
+        // Once it's over, the meter is gone and stays gone.
+        assert!(plan.update(&at(21.0), UserSettings::default));
+        assert!(!has_meter(&plan));
+        assert!(!plan.update(&at(25.0), UserSettings::default));
+    }
+
+    #[test]
+    fn animations_draw_over_the_slots() {
+        let layout = layout();
+        let now = Instant::now();
+        let shown = snapshot(&[(HudElement::Right, item("Iron Sword", BaseType::Empty))]);
+        let mut plan = DrawPlan::default();
+        plan.update(&inputs(&layout, &shown, now), UserSettings::default);
+        let version = plan.version();
+
+        let highlight = AnimationFrame {
+            strip: "highlight".to_string(),
+            frame: 1,
+            center: Point { x: 10.0, y: 20.0 },
+            size: Point { x: 30.0, y: 30.0 },
+            color: Color::default(),
+        };
+        let playing = PlanInputs {
+            animations: vec![highlight.clone()],
+            ..inputs(&layout, &shown, now)
+        };
+        assert!(plan.update(&playing, || panic!("animations don't need settings")));
+        assert!(plan.version() > version);
+        let last = plan.commands().pop().expect("the plan has commands");
+        assert_eq!(last.source, ImageSource::Sprite);
+        assert_eq!(last.image, "highlight");
+        assert_eq!(last.frame, 1);
+        assert_eq!(last.center, highlight.center);
+
+        // The same frame again is no change; the next frame is.
+        assert!(!plan.update(&playing, UserSettings::default));
+        let next = PlanInputs {
+            animations: vec![AnimationFrame {
+                frame: 2,
+                ..highlight
+            }],
+            ..inputs(&layout, &shown, now)
+        };
+        assert!(plan.update(&next, UserSettings::default));
+        assert!(plan.update(&inputs(&layout, &shown, now), UserSettings::default));
+        assert!(plan
+            .commands()
+            .iter()
+            .all(|command| command.source != ImageSource::Sprite));
+    }
+
+    #[test]
+    fn slots_resolve_what_the_renderer_draws() {
+        let layout = layout();
+        let now = Instant::now();
+        let right = slot_index(&layout, HudElement::Right);
+        let shown = snapshot(&[(HudElement::Right, item("Iron Sword", BaseType::Empty))]);
+        let mut plan = DrawPlan::default();
+        plan.update(&inputs(&layout, &shown, now), UserSettings::default);
+
+        let slot = &layout.slots[right];
+        let commands = &plan.slots[right].commands;
+        let icon = commands
+            .iter()
+            .find(|command| command.source == ImageSource::Icon);
+        if slot.icon_color.a > 0 {
+            let icon = icon.expect("the right hand draws its icon");
+            assert!(icon.fit);
+            assert_eq!(icon.center, slot.icon_center);
+            assert_eq!(icon.image, item("Iron Sword", BaseType::Empty).icon_key());
+        }
+        for (run, label) in commands
+            .iter()
+            .filter(|command| command.kind == DrawKind::Text)
+            .zip(slot.text.iter().filter(|label| label.color.a > 0))
+        {
+            assert_eq!(run.center, label.anchor);
+            assert_eq!(run.color, label.color);
+            assert!(!run.text.contains('{'), "{} is fully formatted", run.text);
+        }
+        if slot.hotkey_color.a > 0 {
+            let glyph = commands
+                .iter()
+                .find(|command| command.source == ImageSource::Hotkey)
+                .expect("the hotkey is drawn");
+            assert_eq!(
+                glyph.hotkey,
+                UserSettings::default().hotkey_for(HudElement::Right)
+            );
+        }
+
+        // An empty equipset slot draws nothing, not even its background.
+        let mut equipset = slot.clone();
+        equipset.element = HudElement::EquipSet;
+        let settings = UserSettings::default();
+        assert!(slot_commands(&equipset, &HudItem::default(), &settings, now).is_empty());
+        assert!(!slot_commands(slot, &HudItem::default(), &settings, now).is_empty());
+    }
+}
@@ -0,0 +1,630 @@
+//! Session recording: a log of what crossed the bridge into the controller.
+//!
+//! When `bRecordSession` is on, we write every key batch, equip event, queued
+//! command, and item lookup to `SoulsyHUD-session.bin` next to the log file,
+//! along with the answers the controller gave. The tests in `simulated` can
+//! replay such a file against a stand-in for the game, so a mis-equip that a
+//! player ran into can be reproduced without Skyrim.
+//!
+//! The file is a short header followed by bincode-encoded `SessionEvent`s,
+//! one after another. Recording an event only appends it to a buffer in
+//! memory; a background thread moves the buffer to disk every second, and
+//! again when recording stops. A session cut short by a crash is still
+//! readable up to the last complete event written.
+
+use std::fs::File;
+use std::io::Write;
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::Mutex;
+use std::time::Duration;
+
+use bincode::{Decode, Encode};
+use eyre::{eyre, Result};
+use once_cell::sync::{Lazy, OnceCell};
+
+use super::commands::Command;
+use super::control::Controller;
+use super::cycles::CycleData;
+use super::settings::SETTINGS_PATH;
+use crate::data::base::LightType;
+use crate::data::{BaseType, HudItem};
+use crate::plugin::{Action, ButtonPress, ExtraDataEvent, ItemCategory, KeyEventResponse};
+
+/// The first bytes of every session file.
+pub const SESSION_MAGIC: &[u8; 7] = b"SOULREC";
+/// Bump this if `SessionEvent` changes shape.
+pub const SESSION_VERSION: u8 = 2;
+/// The name of the session file, which lives next to the log.
+pub const SESSION_FILE: &str = "SoulsyHUD-session.bin";
+
+/// One thing that happened during a recorded session.
+#[derive(Debug, Clone, PartialEq, Encode, Decode)]
+pub enum SessionEvent {
+    /// The text of the settings file, when recording starts and whenever it's re-read.
+    Settings(String),
+    /// What the player had equipped and carried at that moment.
+    Player(PlayerState),
+    /// The game described an item to us.
+    Item(RecordedItem),
+    /// Cycle data in cosave format, when recording starts and after each cosave load.
+    Cycles { version: u32, bytes: Vec<u8> },
+    /// A batch of key events, and what we answered for each.
+    Keys {
+        presses: Vec<RecordedPress>,
+        responses: Vec<RecordedResponse>,
+    },
+    /// The game told us something was equipped or unequipped; we said whether the HUD changed.
+    Equipped {
+        equipped: bool,
+        form_spec: String,
+        right: String,
+        left: String,
+        changed: bool,
+    },
+    /// Work queued for the controller.
+    Command(RecordedCommand),
+}
+
+/// The slice of player state the controller asks the game about.
+#[derive(Debug, Clone, Default, PartialEq, Encode, Decode)]
+pub struct PlayerState {
+    pub right: String,
+    pub left: String,
+    pub power: String,
+    pub ammo: String,
+    pub ranged_equipped: bool,
+    pub ammo_inventory: Vec<String>,
+    pub health_potions: u32,
+    pub magicka_potions: u32,
+    pub stamina_potions: u32,
+    pub werewolf: bool,
+    pub vampire_lord: bool,
+    /// Everything the player carried or knew, as (form spec, count).
+    pub inventory: Vec<(String, u32)>,
+}
+
+/// Enough about an item to rebuild one that behaves the same in the controller.
+/// Keywords aren't kept, so icons and colors come back as the defaults for the category.
+#[derive(Debug, Clone, PartialEq, Encode, Decode)]
+pub struct RecordedItem {
+    pub form_spec: String,
+    pub name: String,
+    pub count: u32,
+    /// `ItemCategory` as its underlying value.
+    pub category: u8,
+    pub two_handed: bool,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Encode, Decode)]
+pub struct RecordedPress {
+    pub key: u32,
+    pub value: f32,
+    pub held_secs: f32,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Encode, Decode)]
+pub struct RecordedResponse {
+    pub handled: bool,
+    /// `Action` as its underlying value.
+    pub start_timer: u8,
+    /// `Action` as its underlying value.
+    pub stop_timer: u8,
+}
+
+/// `Command`, with the bridged enums stored as their underlying values.
+#[derive(Debug, Clone, PartialEq, Eq, Encode, Decode)]
+pub enum RecordedCommand {
+    RefreshHudItems,
+    InventoryChanged { form_spec: String, count: u32 },
+    ExtraData { event: u8, form_spec: String },
+    GripChange(bool),
+    TimerExpired(u8),
+}
+
+impl From<&ButtonPress> for RecordedPress {
+    fn from(press: &ButtonPress) -> Self {
+        Self {
+            key: press.key,
+            value: press.value,
+            held_secs: press.held_secs,
+        }
+    }
+}
+
+impl From<&RecordedPress> for ButtonPress {
+    fn from(press: &RecordedPress) -> Self {
+        Self {
+            key: press.key,
+            value: press.value,
+            held_secs: press.held_secs,
+        }
+    }
+}
+
+impl From<&KeyEventResponse> for RecordedResponse {
+    fn from(response: &KeyEventResponse) -> Self {
+        Self {
+            handled: response.handled,
+            start_timer: response.start_timer.repr,
+            stop_timer: response.stop_timer.repr,
+        }
+    }
+}
+
+impl From<&Command> for RecordedCommand {
+    fn from(command: &Command) -> Self {
+        match command {
+            Command::RefreshHudItems => Self::RefreshHudItems,
+            Command::InventoryChanged { form_spec, count } => Self::InventoryChanged {
+                form_spec: form_spec.clone(),
+                count: *count,
+            },
+            Command::ExtraData { event, form_spec } => Self::ExtraData {
+                event: event.repr,
+                form_spec: form_spec.clone(),
+            },
+            Command::GripChange(use_alt_grip) => Self::GripChange(*use_alt_grip),
+            Command::TimerExpired(which) => Self::TimerExpired(which.repr),
+        }
+    }
+}
+
+impl From<&RecordedCommand> for Command {
+    fn from(command: &RecordedCommand) -> Self {
+        match command {
+            RecordedCommand::RefreshHudItems => Self::RefreshHudItems,
+            RecordedCommand::InventoryChanged { form_spec, count } => Self::InventoryChanged {
+                form_spec: form_spec.clone(),
+                count: *count,
+            },
+            RecordedCommand::ExtraData { event, form_spec } => Self::ExtraData {
+                event: ExtraDataEvent { repr: *event },
+                form_spec: form_spec.clone(),
+            },
+            RecordedCommand::GripChange(use_alt_grip) => Self::GripChange(*use_alt_grip),
+            RecordedCommand::TimerExpired(which) => Self::TimerExpired(Action { repr: *which }),
+        }
+    }
+}
+
+impl From<&HudItem> for RecordedItem {
+    fn from(item: &HudItem) -> Self {
+        let category = match item.kind() {
+            BaseType::Ammo(_) => ItemCategory::Ammo,
+            BaseType::Armor(_) => ItemCategory::Armor,
+            BaseType::Book => ItemCategory::Book,
+            BaseType::Food(_) => ItemCategory::Food,
+            BaseType::HandToHand => ItemCategory::HandToHand,
+            BaseType::Light(LightType::Lantern) => ItemCategory::Lantern,
+            BaseType::Light(LightType::Torch) => ItemCategory::Torch,
+            BaseType::Potion(_) => ItemCategory::Potion,
+            BaseType::Power(_) => ItemCategory::Power,
+            BaseType::Scroll(_) => ItemCategory::Scroll,
+            BaseType::Shout(_) => ItemCategory::Shout,
+            BaseType::Spell(_) => ItemCategory::Spell,
+            BaseType::Weapon(_) => ItemCategory::Weapon,
+            _ => ItemCategory::Empty,
+        };
+        Self {
+            form_spec: item.form_string(),
+            name: item.name(),
+            count: item.count(),
+            category: category.repr,
+            two_handed: item.two_handed(),
+        }
+    }
+}
+
+impl From<&RecordedItem> for HudItem {
+    fn from(item: &RecordedItem) -> Self {
+        HudItem::from_keywords(
+            ItemCategory {
+                repr: item.category,
+            },
+            Vec::new(),
+            item.name.clone(),
+            item.form_spec.clone(),
+            item.count,
+            item.two_handed,
+        )
+    }
+}
+
+/// Writes session events to anything that takes bytes.
+pub struct SessionWriter<W: Write> {
+    out: W,
+}
+
+impl<W: Write> SessionWriter<W> {
+    /// Write the header and get ready for events.
+    pub fn new(mut out: W) -> Result<Self> {
+        out.write_all(SESSION_MAGIC)?;
+        out.write_all(&[SESSION_VERSION])?;
+        Ok(Self { out })
+    }
+
+    pub fn write(&mut self, event: &SessionEvent) -> Result<()> {
+        bincode::encode_into_std_write(event, &mut self.out, bincode::config::standard())?;
+        Ok(())
+    }
+
+    pub fn flush(&mut self) -> Result<()> {
+        self.out.flush()?;
+        Ok(())
+    }
+
+    pub fn into_inner(self) -> W {
+        self.out
+    }
+}
+
+impl SessionWriter<Vec<u8>> {
+    /// Hand over everything written so far, leaving the buffer empty.
+    pub fn take_bytes(&mut self) -> Vec<u8> {
+        std::mem::take(&mut self.out)
+    }
+}
+
+/// Read every complete event in a session file. Stops quietly at a damaged
+/// or truncated event, since the interesting part is usually just before it.
+pub fn read_session(bytes: &[u8]) -> Result<Vec<SessionEvent>> {
+    let header_len = SESSION_MAGIC.len() + 1;
+    if bytes.len() < header_len || &bytes[..SESSION_MAGIC.len()] != SESSION_MAGIC {
+        return Err(eyre!("not a SoulsyHUD session recording"));
+    }
+    let version = bytes[SESSION_MAGIC.len()];
+    if version != SESSION_VERSION {
+        return Err(eyre!(
+            "session recording is version {version}; we read version {SESSION_VERSION}"
+        ));
+    }
+
+    let config = bincode::config::standard();
+    let mut events = Vec::new();
+    let mut rest = &bytes[header_len..];
+    while !rest.is_empty() {
+        match bincode::decode_from_slice::<SessionEvent, _>(rest, config) {
+            Ok((event, used)) => {
+                events.push(event);
+                rest = &rest[used..];
+            }
+            Err(e) => {
+                log::warn!(
+                    "session recording ends with {} undecodable bytes; {e:#}",
+                    rest.len()
+                );
+                break;
+            }
+        }
+    }
+    Ok(events)
+}
+
+// ---------- the recorder used by the plugin
+
+/// Checked before doing any work at all, so recording costs one load when it's off.
+static RECORDING: AtomicBool = AtomicBool::new(false);
+/// Events not yet on disk. Held only long enough to append to or empty it, since
+/// some events are recorded under the controller lock.
+static RECORDER: Lazy<Mutex<Option<SessionWriter<Vec<u8>>>>> = Lazy::new(|| Mutex::new(None));
+/// The session file. Only the flusher and `stop()` write to it.
+static SESSION_OUT: Lazy<Mutex<Option<File>>> = Lazy::new(|| Mutex::new(None));
+static FLUSHER_RUNNING: AtomicBool = AtomicBool::new(false);
+static SESSION_PATH: OnceCell<PathBuf> = OnceCell::new();
+
+/// How often buffered events go to disk while recording.
+const FLUSH_INTERVAL: Duration = Duration::from_secs(1);
+
+/// Where to write session recordings. Set once, when logging starts.
+pub fn set_session_path(path: PathBuf) {
+    let _ = SESSION_PATH.set(path);
+}
+
+pub fn is_recording() -> bool {
+    RECORDING.load(Ordering::Relaxed)
+}
+
+/// Add an event to the recording, if we're recording. Errors stop the
+/// recording rather than bother the player.
+pub fn record(event: SessionEvent) {
+    if !is_recording() {
+        return;
+    }
+    let Ok(mut recorder) = RECORDER.lock() else {
+        return;
+    };
+    let Some(writer) = recorder.as_mut() else {
+        return;
+    };
+    if let Err(e) = writer.write(&event) {
+        log::warn!("Stopping the session recording because we couldn't encode an event; {e:#}");
+        *recorder = None;
+        drop(recorder);
+        stop();
+    }
+}
+
+pub fn record_keys(presses: &[ButtonPress], responses: &[KeyEventResponse]) {
+    if is_recording() {
+        record(SessionEvent::Keys {
+            presses: presses.iter().map(RecordedPress::from).collect(),
+            responses: responses.iter().map(RecordedResponse::from).collect(),
+        });
+    }
+}
+
+pub fn record_command(command: &Command) {
+    if is_recording() {
+        record(SessionEvent::Command(command.into()));
+    }
+}
+
+pub fn record_item(item: &HudItem) {
+    if is_recording() {
+        record(SessionEvent::Item(item.into()));
+    }
+}
+
+pub fn record_cycles(cycles: &CycleData) {
+    if is_recording() {
+        record(SessionEvent::Cycles {
+            version: CycleData::serialize_version(),
+            bytes: cycles.serialize(),
+        });
+    }
+}
+
+/// Ask the game what the player has right now.
+pub fn record_player() {
+    if !is_recording() {
+        return;
+    }
+    let state = PlayerState {
+        right: crate::plugin::specEquippedRight(),
+        left: crate::plugin::specEquippedLeft(),
+        power: crate::plugin::specEquippedPower(),
+        ammo: crate::plugin::specEquippedAmmo(),
+        ranged_equipped: crate::plugin::hasRangedEquipped(),
+        ammo_inventory: crate::plugin::getAmmoInventory(),
+        health_potions: crate::plugin::healthPotionCount(),
+        magicka_potions: crate::plugin::magickaPotionCount(),
+        stamina_potions: crate::plugin::staminaPotionCount(),
+        werewolf: crate::plugin::isWerewolf(),
+        vampire_lord: crate::plugin::isVampireLord(),
+        inventory: crate::plugin::inventorySnapshot()
+            .into_iter()
+            .map(|xs| (xs.form_spec, xs.count))
+            .collect(),
+    };
+    record(SessionEvent::Player(state));
+}
+
+/// Start or stop recording to match the settings, then note the settings in
+/// the recording. A fresh recording begins with everything a replay needs to
+/// pick up from here: the player, the items the controller already knows
+/// about, and the cycles.
+pub fn settings_changed(enabled: bool, ctrl: &Controller) {
+    if enabled && !is_recording() {
+        if let Err(e) = start() {
+            log::warn!("Unable to start recording this session; {e:#}");
+            return;
+        }
+        record_settings();
+        record_player();
+        for item in ctrl.cache.iter() {
+            record_item(item);
+        }
+        record_cycles(&ctrl.cycles);
+    } else if enabled {
+        record_settings();
+    } else if is_recording() {
+        stop();
+    }
+}
+
+fn record_settings() {
+    match std::fs::read_to_string(SETTINGS_PATH) {
+        Ok(text) => record(SessionEvent::Settings(text)),
+        Err(e) => log::debug!("no settings file to record; {e:#}"),
+    }
+}
+
+fn start() -> Result<()> {
+    let path = SESSION_PATH
+        .get()
+        .cloned()
+        .unwrap_or_else(|| PathBuf::from(SESSION_FILE));
+    let file = File::create(&path)?;
+    let writer = SessionWriter::new(Vec::new())?;
+    *SESSION_OUT
+        .lock()
+        .map_err(|_| eyre!("the session file lock is poisoned"))? = Some(file);
+    *RECORDER
+        .lock()
+        .map_err(|_| eyre!("the recorder lock is poisoned"))? = Some(writer);
+    RECORDING.store(true, Ordering::SeqCst);
+    start_flusher();
+    log::info!("Recording this session to {}", path.display());
+    Ok(())
+}
+
+/// Stop recording, write out whatever is still buffered, and close the file.
+fn stop() {
+    RECORDING.store(false, Ordering::SeqCst);
+    if let Ok(mut out) = SESSION_OUT.lock() {
+        let rest = match RECORDER.lock() {
+            Ok(mut recorder) => recorder.take().map(SessionWriter::into_inner),
+            Err(_) => None,
+        };
+        if let (Some(file), Some(bytes)) = (out.as_mut(), rest) {
+            if let Err(e) = file.write_all(&bytes).and_then(|_| file.flush()) {
+                log::warn!("The end of the session recording was lost; {e:#}");
+            }
+        }
+        *out = None;
+    }
+    log::info!("Stopped recording this session.");
+}
+
+/// Move the buffered events to the session file. The recorder lock is held
+/// only to take the buffer; the file lock keeps the writes in order.
+fn write_pending() -> Result<()> {
+    let mut out = SESSION_OUT
+        .lock()
+        .map_err(|_| eyre!("the session file lock is poisoned"))?;
+    let Some(file) = out.as_mut() else {
+        return Ok(());
+    };
+    let bytes = RECORDER
+        .lock()
+        .map_err(|_| eyre!("the recorder lock is poisoned"))?
+        .as_mut()
+        .map(SessionWriter::take_bytes)
+        .unwrap_or_default();
+    if !bytes.is_empty() {
+        file.write_all(&bytes)?;
+    }
+    Ok(())
+}
+
+/// Write buffered events to disk every `FLUSH_INTERVAL` for as long as we're
+/// recording. One flusher at most; it leaves when recording stops.
+fn start_flusher() {
+    if FLUSHER_RUNNING.swap(true, Ordering::SeqCst) {
+        return;
+    }
+    let spawned = std::thread::Builder::new()
+        .name("SoulsyHUD session recorder".to_string())
+        .spawn(|| loop {
+            std::thread::sleep(FLUSH_INTERVAL);
+            if RECORDING.load(Ordering::SeqCst) {
+                if let Err(e) = write_pending() {
+                    log::warn!(
+                        "Stopping the session recording because we couldn't write to it; {e:#}"
+                    );
+                    stop();
+                }
+                continue;
+            }
+            // Recording stopped. If it starts again while we're leaving,
+            // either we see it here or `start()` sees we've gone.
+            FLUSHER_RUNNING.store(false, Ordering::SeqCst);
+            if !RECORDING.load(Ordering::SeqCst) || FLUSHER_RUNNING.swap(true, Ordering::SeqCst) {
+                break;
+            }
+        });
+    if let Err(e) = spawned {
+        FLUSHER_RUNNING.store(false, Ordering::SeqCst);
+        log::warn!("The session recording will be written only when it stops; {e:#}");
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn sample_events() -> Vec<SessionEvent> {
+        vec![
+            SessionEvent::Settings("[Controls]\nuLeftCycleKey = 5\n".to_string()),
+            SessionEvent::Player(PlayerState {
+                right: "Skyrim.esm|0x00012eb7".to_string(),
+                ..Default::default()
+            }),
+            SessionEvent::Item(RecordedItem {
+                form_spec: "Skyrim.esm|0x00012eb7".to_string(),
+                name: "Iron Sword".to_string(),
+                count: 1,
+                category: ItemCategory::Weapon.repr,
+                two_handed: false,
+            }),
+            SessionEvent::Keys {
+                presses: vec![RecordedPress {
+                    key: 5,
+                    value: 1.0,
+                    held_secs: 0.0,
+                }],
+                responses: vec![RecordedResponse {
+                    handled: true,
+                    start_timer: Action::LongPressLeft.repr,
+                    stop_timer: Action::None.repr,
+                }],
+            },
+            SessionEvent::Command(RecordedCommand::InventoryChanged {
+                form_spec: "Skyrim.esm|0x0001397d".to_string(),
+                count: 3,
+            }),
+        ]
+    }
+
+    #[test]
+    fn sessions_round_trip() {
+        let events = sample_events();
+        let mut writer = SessionWriter::new(Vec::new()).expect("vectors take bytes");
+        for event in &events {
+            writer.write(event).expect("events encode");
+        }
+        let bytes = writer.into_inner();
+        assert!(bytes.starts_with(SESSION_MAGIC));
+        assert_eq!(read_session(&bytes).expect("we read what we write"), events);
+    }
+
+    #[test]
+    fn truncated_sessions_keep_complete_events() {
+        let events = sample_events();
+        let mut writer = SessionWriter::new(Vec::new()).expect("vectors take bytes");
+        for event in &events {
+            writer.write(event).expect("events encode");
+        }
+        let mut bytes = writer.into_inner();
+        bytes.truncate(bytes.len() - 3);
+        let read = read_session(&bytes).expect("the header is intact");
+        assert_eq!(read[..], events[..events.len() - 1]);
+
+        assert!(read_session(b"not a session").is_err());
+        let mut wrong_version = SESSION_MAGIC.to_vec();
+        wrong_version.push(SESSION_VERSION + 1);
+        assert!(read_session(&wrong_version).is_err());
+    }
+
+    #[test]
+    fn buffered_sessions_read_back_in_pieces() {
+        let events = sample_events();
+        let mut writer = SessionWriter::new(Vec::new()).expect("vectors take bytes");
+        let mut file = Vec::new();
+        for event in &events {
+            writer.write(event).expect("events encode");
+            file.extend(writer.take_bytes());
+            assert!(writer.take_bytes().is_empty());
+            assert_eq!(
+                read_session(&file)
+                    .expect("each flush leaves a whole file")
+                    .last(),
+                Some(event)
+            );
+        }
+        file.extend(writer.into_inner());
+        assert_eq!(read_session(&file).expect("we read what we write"), events);
+    }
+
+    #[test]
+    fn commands_survive_recording() {
+        let commands = [
+            Command::RefreshHudItems,
+            Command::InventoryChanged {
+                form_spec: "Skyrim.esm|0x0001397d".to_string(),
+                count: 0,
+            },
+            Command::ExtraData {
+                event: ExtraDataEvent::PoisonApplied,
+                form_spec: "Skyrim.esm|0x00012eb7".to_string(),
+            },
+            Command::GripChange(true),
+            Command::TimerExpired(Action::Right),
+        ];
+        for command in commands {
+            let recorded = RecordedCommand::from(&command);
+            assert_eq!(Command::from(&recorded), command);
+        }
+    }
+}
@@ -0,0 +1,181 @@
+//! Does the HUD need to be built again this frame?
+//!
+//! Most frames the HUD looks exactly like it did the frame before. Building it
+//! with ImGui means looking up every image, measuring every label, and
+//! tessellating every meter, all to get the same vertices we already had. So each frame the
+//! renderer asks us first. We boil everything that decides what the HUD looks
+//! like down to one key, and if it matches last frame's key, the renderer
+//! submits the draw data it kept instead of building new.
+//!
+//! Items, meters, the layout, and the settings all go through the draw plan,
+//! whose version moves whenever any of them changes what's drawn; see the plan
+//! module. The layout and the settings are tracked there with generation
+//! counters bumped by whoever publishes a change. The rest of the key is the
+//! few things only the renderer knows, like how faded the HUD is.
+
+use std::collections::hash_map::DefaultHasher;
+use std::hash::{Hash, Hasher};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::Mutex;
+
+use super::plan::refresh_draw_plan;
+use crate::plugin::{FrameInputs, Point};
+
+/// Things that bump a generation counter when they change.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Published {
+    Layout,
+    Settings,
+}
+
+static GENERATIONS: [AtomicU64; 2] = [AtomicU64::new(0), AtomicU64::new(0)];
+/// The key of the last frame the renderer built or reused.
+static LAST_KEY: Mutex<Option<u64>> = Mutex::new(None);
+
+/// Note that something the HUD draws from has changed.
+pub fn published(what: Published) {
+    GENERATIONS[what as usize].fetch_add(1, Ordering::Relaxed);
+}
+
+/// The generation counters at one moment.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq, Hash)]
+pub struct Generations {
+    pub layout: u64,
+    pub settings: u64,
+}
+
+impl Generations {
+    pub fn current() -> Self {
+        let read = |what: Published| GENERATIONS[what as usize].load(Ordering::Relaxed);
+        Self {
+            layout: read(Published::Layout),
+            settings: read(Published::Settings),
+        }
+    }
+}
+
+/// Everything that decides what a frame of the HUD looks like, hashed.
+pub fn frame_key(inputs: &FrameInputs, plan_version: u64) -> u64 {
+    let mut hasher = DefaultHasher::new();
+    inputs.alpha.to_bits().hash(&mut hasher);
+    inputs.width.to_bits().hash(&mut hasher);
+    inputs.height.to_bits().hash(&mut hasher);
+    inputs.ranged_equipped.hash(&mut hasher);
+    inputs.textures.hash(&mut hasher);
+    plan_version.hash(&mut hasher);
+    hasher.finish()
+}
+
+/// Remember this frame's key. Returns true if it differs from the last one.
+fn remember(last: &mut Option<u64>, key: u64) -> bool {
+    let changed = *last != Some(key);
+    *last = Some(key);
+    changed
+}
+
+/// Once a frame, before building the HUD. False means the HUD would come out
+/// the same as last frame, so the renderer can reuse what it built then.
+pub fn hud_needs_rebuild(inputs: &FrameInputs) -> bool {
+    let screen = Point {
+        x: inputs.width,
+        y: inputs.height,
+    };
+    let version = refresh_draw_plan(screen, inputs.ranged_equipped);
+    let key = frame_key(inputs, version);
+    let mut last = LAST_KEY
+        .lock()
+        .expect("Unrecoverable runtime problem: cannot acquire redraw lock.");
+    remember(&mut last, key)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn inputs() -> FrameInputs {
+        FrameInputs {
+            alpha: 1.0,
+            width: 1920.0,
+            height: 1080.0,
+            ranged_equipped: false,
+            textures: 0,
+        }
+    }
+
+    #[test]
+    fn same_state_same_key() {
+        let first = frame_key(&inputs(), 7);
+        assert_eq!(first, frame_key(&inputs(), 7));
+
+        let mut last = None;
+        assert!(
+            remember(&mut last, first),
+            "the first frame is always built"
+        );
+        assert!(!remember(&mut last, first));
+        assert!(!remember(&mut last, first));
+    }
+
+    #[test]
+    fn every_change_invalidates() {
+        let base = frame_key(&inputs(), 7);
+        let changed_inputs: Vec<(&str, FrameInputs)> = vec![
+            (
+                "alpha",
+                FrameInputs {
+                    alpha: 0.5,
+                    ..inputs()
+                },
+            ),
+            (
+                "width",
+                FrameInputs {
+                    width: 2560.0,
+                    ..inputs()
+                },
+            ),
+            (
+                "height",
+                FrameInputs {
+                    height: 1440.0,
+                    ..inputs()
+                },
+            ),
+            (
+                "ranged",
+                FrameInputs {
+                    ranged_equipped: true,
+                    ..inputs()
+                },
+            ),
+            (
+                "textures",
+                FrameInputs {
+                    textures: 1,
+                    ..inputs()
+                },
+            ),
+        ];
+        for (what, changed) in changed_inputs {
+            let mut last = Some(base);
+            assert!(
+                remember(&mut last, frame_key(&changed, 7)),
+                "a change to {what} must rebuild"
+            );
+        }
+
+        let mut last = Some(base);
+        assert!(
+            remember(&mut last, frame_key(&inputs(), 8)),
+            "a new draw plan must rebuild"
+        );
+    }
+
+    #[test]
+    fn publishing_bumps_a_generation() {
+        let before = Generations::current();
+        published(Published::Settings);
+        // Other tests may publish too, so only check that this one moved.
+        assert!(Generations::current().settings > before.settings);
+    }
+}
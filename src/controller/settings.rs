@@ -5,6 +5,7 @@
 
 use std::{path::Path, sync::Mutex};
 
+use enumset::{EnumSet, EnumSetType};
 use eyre::Result;
 use ini::Ini;
 use log::Level;
@@ -15,7 +16,7 @@ use super::keys::Hotkey;
 use crate::{layouts::shared::NamedAnchor, plugin::HudElement};
 
 /// This is the path to players's modified settings.
-static SETTINGS_PATH: &str = "./data/MCM/Settings/SoulsyHUD.ini";
+pub static SETTINGS_PATH: &str = "./data/MCM/Settings/SoulsyHUD.ini";
 
 /// This is the path to the mod settings definition file.
 /// static INI_PATH: &str = "./data/MCM/Config/SoulsyHUD/settings.ini";
@@ -25,12 +26,31 @@ static SETTINGS: Lazy<Mutex<UserSettings>> =
     Lazy::new(|| Mutex::new(UserSettings::new_from_file(SETTINGS_PATH)));
 
 pub fn settings() -> UserSettings {
+    #[cfg(test)]
+    if let Some(overridden) = THREAD_SETTINGS.with(|xs| xs.borrow().clone()) {
+        return overridden;
+    }
     let settings = SETTINGS
         .lock()
         .expect("Unrecoverable runtime problem: cannot acquire settings lock.");
     settings.clone()
 }
 
+#[cfg(test)]
+thread_local! {
+    /// Settings seen by `settings()` on this thread only, so a test can change
+    /// them without disturbing tests running alongside it.
+    static THREAD_SETTINGS: std::cell::RefCell<Option<UserSettings>> =
+        std::cell::RefCell::new(None);
+}
+
+/// Make `settings()` return these settings on the calling thread. Pass None
+/// to go back to the shared settings.
+#[cfg(test)]
+pub fn use_settings_on_this_thread(options: Option<UserSettings>) {
+    THREAD_SETTINGS.with(|xs| *xs.borrow_mut() = options);
+}
+
 /// Wrapper for C++ convenience; logs errors but does no more
 pub fn refresh_user_settings() {
     match UserSettings::refresh() {
@@ -133,6 +153,13 @@ pub struct UserSettings {
     equip_sets_unequip: bool,
     /// The identifier for the mod in SKSE cosaves. Defaults to SOLS.
     skse_identifier: String,
+    /// Record what crosses the bridge to a file, for replaying later. bRecordSession
+    record_session: bool,
+    /// Notice edits to the layout file without waiting for the refresh hotkey. bWatchLayout
+    watch_layout: bool,
+    /// How much video memory HUD images may use, in megabytes, not counting the
+    /// button images loaded at startup. uTextureBudgetMB
+    texture_budget_mb: u32,
 
     /// Settings we need from DisplayTweaks, if it exists
     display_tweaks: DisplayTweaks,
@@ -178,6 +205,9 @@ impl Default for UserSettings {
             colorize_icons: true,
             equip_sets_unequip: true,
             skse_identifier: "SOLS".to_string(),
+            record_session: false,
+            watch_layout: false,
+            texture_budget_mb: 64,
             display_tweaks: DisplayTweaks::default(),
         }
     }
@@ -208,6 +238,19 @@ impl UserSettings {
     pub fn read_from_file(&mut self, fpath: &str) -> Result<()> {
         // We'll fall back to defaults at a different level.
         let conf = Ini::load_from_file(fpath)?;
+        self.apply_ini(&conf);
+        Ok(())
+    }
+
+    /// Refresh ourselves from the text of a settings file, e.g. one saved in
+    /// a session recording.
+    pub fn read_from_str(&mut self, text: &str) -> Result<()> {
+        let conf = Ini::load_from_str(text.trim_start_matches('\u{feff}'))?;
+        self.apply_ini(&conf);
+        Ok(())
+    }
+
+    fn apply_ini(&mut self, conf: &Ini) {
         let empty = ini::Properties::new();
 
         // This is the sound of my brain going clonk.
@@ -264,7 +307,7 @@ impl UserSettings {
             0,
             2500,
         );
-        self.long_press_ms = read_from_ini(self.equip_delay_ms, "uLongPressMillis", options);
+        self.long_press_ms = read_from_ini(self.long_press_ms, "uLongPressMillis", options);
         if self.long_press_ms < self.equip_delay_ms {
             self.long_press_ms = self.equip_delay_ms + 100;
         }
@@ -294,9 +337,15 @@ impl UserSettings {
         self.equip_sets_unequip =
             read_from_ini(self.equip_sets_unequip, "bEquipSetsUnequip", options);
 
-        self.display_tweaks.read_ini();
+        self.record_session = read_from_ini(self.record_session, "bRecordSession", options);
+        self.watch_layout = read_from_ini(self.watch_layout, "bWatchLayout", options);
+        self.texture_budget_mb = u32::clamp(
+            read_from_ini(self.texture_budget_mb, "uTextureBudgetMB", options),
+            16,
+            4096,
+        );
 
-        Ok(())
+        self.display_tweaks.read_ini();
     }
 
     pub fn log_level(&self) -> Level {
@@ -329,7 +378,7 @@ impl UserSettings {
     }
 
     pub fn should_start_long_press_timer(&self, key: u32) -> bool {
-        let hotkey = Hotkey::from(key);
+        let hotkey = Hotkey::for_key(key, self);
         let is_hand_cycle = matches!(hotkey, Hotkey::Left | Hotkey::Right);
         let can_be_unequipped = matches!(hotkey, Hotkey::Left | Hotkey::Power | Hotkey::Right);
 
@@ -472,6 +521,18 @@ impl UserSettings {
         self.colorize_icons
     }
 
+    pub fn record_session(&self) -> bool {
+        self.record_session
+    }
+
+    pub fn watch_layout(&self) -> bool {
+        self.watch_layout
+    }
+
+    pub fn texture_budget_mb(&self) -> u32 {
+        self.texture_budget_mb
+    }
+
     pub fn skse_identifier(&self) -> u32 {
         let exactly_four = format!("{:4}", self.skse_identifier);
         let slice: [u8; 4] = exactly_four
@@ -522,6 +583,76 @@ fn read_from_ini<T: FromIniStr>(default: T, key: &str, section: &ini::Properties
     }
 }
 
+/// The kinds of work a settings change can call for. Settings not covered
+/// here are read fresh whenever they're needed, so changing them needs no work.
+#[derive(Debug, EnumSetType)]
+pub enum SettingsChange {
+    /// A hotkey, a modifier, or what a long press means changed; rebuild the key map.
+    Keys,
+    /// The unarmed proxy joins or leaves the hand cycles.
+    Unarmed,
+    /// Potions are grouped into proxies in the utility cycle, or ungrouped.
+    PotionGrouping,
+    /// Autofade or the alpha limits changed.
+    Alpha,
+    /// The anchor or scale override changed; flatten the layout again.
+    LayoutGeometry,
+}
+
+impl UserSettings {
+    /// Work out what has to be redone to go from these settings to `newer`.
+    pub fn changes_to(&self, newer: &UserSettings) -> EnumSet<SettingsChange> {
+        let mut changes = EnumSet::new();
+        if self.key_settings() != newer.key_settings() {
+            changes |= SettingsChange::Keys;
+        }
+        if self.unarmed_handling != newer.unarmed_handling {
+            changes |= SettingsChange::Unarmed;
+        }
+        if self.group_potions != newer.group_potions {
+            changes |= SettingsChange::PotionGrouping;
+        }
+        if (self.autofade, self.max_alpha, self.min_alpha)
+            != (newer.autofade, newer.max_alpha, newer.min_alpha)
+        {
+            changes |= SettingsChange::Alpha;
+        }
+        if self.anchor_loc != newer.anchor_loc || self.scale_override != newer.scale_override {
+            changes |= SettingsChange::LayoutGeometry;
+        }
+        changes
+    }
+
+    /// Everything `KeyMap::new()` reads.
+    fn key_settings(&self) -> ([u32; 7], [i32; 6], (u32, ActivationMethod, bool, bool)) {
+        (
+            [
+                self.power,
+                self.utility,
+                self.left,
+                self.right,
+                self.activate,
+                self.refresh_layout,
+                self.showhide,
+            ],
+            [
+                self.equipset,
+                self.unequip_hotkey(),
+                self.unequip_modifier,
+                self.cycle_modifier,
+                self.activate_modifier,
+                self.menu_modifier,
+            ],
+            (
+                self.long_press_ms,
+                self.how_to_activate,
+                matches!(self.unarmed_handling, UnarmedMethod::LongPress),
+                self.long_press_matches,
+            ),
+        )
+    }
+}
+
 /// Trait and implementations for reading from the ini file
 trait FromIniStr {
     fn from_ini(value: &str) -> Option<Self>
@@ -530,7 +661,7 @@ trait FromIniStr {
 }
 
 /// General-purpose enum for how to activate things.
-#[derive(Debug, Clone, strum::Display, Copy)]
+#[derive(Debug, Clone, strum::Display, Copy, PartialEq, Eq)]
 pub enum ActivationMethod {
     /// Tap the hotkey.
     Hotkey,
@@ -569,7 +700,7 @@ impl FromIniStr for Level {
 }
 
 /// How the player wants to handle unarmed combat.
-#[derive(Debug, Clone, Display, Copy)]
+#[derive(Debug, Clone, Display, Copy, PartialEq, Eq)]
 pub enum UnarmedMethod {
     /// No support from the HUD.
     None,
@@ -728,7 +859,10 @@ impl std::fmt::Display for UserSettings {
                   cycle_ammo: {}
               colorize_icons: {}
           equip_sets_unequip: {}
-             skse_identifier: {}"#,
+             skse_identifier: {}
+              record_session: {}
+                watch_layout: {}
+              texture budget: {} MB"#,
             self.log_level,
             self.showhide,
             self.power,
@@ -764,7 +898,10 @@ impl std::fmt::Display for UserSettings {
             self.cycle_ammo,
             self.colorize_icons,
             self.equip_sets_unequip,
-            self.skse_identifier
+            self.skse_identifier,
+            self.record_session,
+            self.watch_layout,
+            self.texture_budget_mb
         )
     }
 }
@@ -869,6 +1006,51 @@ mod tests {
         assert_eq!(missing_field.as_str(), "default");
     }
 
+    #[test]
+    fn settings_changes_name_the_work_to_do() {
+        let before = UserSettings::default();
+        assert!(before.changes_to(&before.clone()).is_empty());
+
+        let mut after = before.clone();
+        after.right = 42;
+        after.menu_modifier = 29;
+        assert_eq!(before.changes_to(&after), SettingsChange::Keys);
+
+        let mut after = before.clone();
+        after.unarmed_handling = UnarmedMethod::AddToCycles;
+        assert_eq!(before.changes_to(&after), SettingsChange::Unarmed);
+        // Long presses mean something new when they unequip.
+        after.unarmed_handling = UnarmedMethod::LongPress;
+        assert_eq!(
+            before.changes_to(&after),
+            SettingsChange::Unarmed | SettingsChange::Keys
+        );
+
+        let mut after = before.clone();
+        after.group_potions = true;
+        assert_eq!(before.changes_to(&after), SettingsChange::PotionGrouping);
+
+        let mut after = before.clone();
+        after.max_alpha = 0.5;
+        assert_eq!(before.changes_to(&after), SettingsChange::Alpha);
+        after.max_alpha = before.max_alpha;
+        after.autofade = !before.autofade;
+        assert_eq!(before.changes_to(&after), SettingsChange::Alpha);
+
+        let mut after = before.clone();
+        after.scale_override = 1.5;
+        assert_eq!(before.changes_to(&after), SettingsChange::LayoutGeometry);
+        after.anchor_loc = NamedAnchor::TopRight;
+        assert_eq!(before.changes_to(&after), SettingsChange::LayoutGeometry);
+
+        // Settings read at the moment they're needed call for no work at all.
+        let mut after = before.clone();
+        after.colorize_icons = !before.colorize_icons;
+        after.equip_delay_ms = 100;
+        after.how_to_cycle = ActivationMethod::Modifier;
+        assert!(before.changes_to(&after).is_empty());
+    }
+
     #[test]
     fn can_read_example_ini() {
         let le_options = UserSettings::new_from_file("./tests/fixtures/SoulsyHUD.ini");
@@ -0,0 +1,601 @@
+//! A stand-in for the game, for tests.
+//!
+//! The controller asks the game what the player has equipped and tells it
+//! what to equip. Under test, those calls land here instead of in C++: each
+//! function below has the same name and signature as its counterpart in the
+//! bridge, and works on a small model of the player kept per test thread.
+//! That's enough to run the controller end to end, and to replay a session
+//! recorded in game by the `recorder` module.
+//!
+//! To replay a recording from a player's machine:
+//!
+//! ```text
+//! SOULSY_REPLAY=/path/to/SoulsyHUD-session.bin cargo test replay_recorded_session -- --ignored --nocapture
+//! ```
+#![allow(non_snake_case)]
+
+use std::cell::RefCell;
+use std::collections::HashMap;
+use std::time::{Duration, Instant};
+
+use cxx::CxxString;
+use eyre::{eyre, Result};
+
+use super::commands::Command;
+use super::control::Controller;
+use super::cycles::CycleData;
+use super::recorder::{PlayerState, RecordedCommand, RecordedItem, RecordedResponse, SessionEvent};
+use super::settings::{use_settings_on_this_thread, UserSettings};
+use crate::data::HudItem;
+use crate::plugin::{Action, ButtonPress, InventoryEntry};
+
+/// The game, as far as the controller can tell.
+#[derive(Debug, Default)]
+pub struct SimulatedGame {
+    pub player: PlayerState,
+    /// Items the game can describe, by form spec.
+    pub items: HashMap<String, RecordedItem>,
+    pub cgo_alt_grip: bool,
+    /// Timers started (true) and stopped (false), in order.
+    pub timers: Vec<(bool, Action)>,
+    /// Every request the controller made to change the player's gear or the
+    /// HUD's transparency, in order.
+    pub calls: Vec<String>,
+}
+
+thread_local! {
+    static GAME: RefCell<SimulatedGame> = RefCell::new(SimulatedGame::default());
+}
+
+/// Do something with this thread's simulated game.
+pub fn with_game<T>(f: impl FnOnce(&mut SimulatedGame) -> T) -> T {
+    GAME.with(|game| f(&mut game.borrow_mut()))
+}
+
+/// Start over with an empty game.
+pub fn reset() {
+    with_game(|game| *game = SimulatedGame::default());
+}
+
+pub fn timers() -> Vec<(bool, Action)> {
+    with_game(|game| game.timers.clone())
+}
+
+pub fn calls() -> Vec<String> {
+    with_game(|game| game.calls.clone())
+}
+
+/// The item the game would describe for this form spec, if it knows it.
+pub fn item(form_spec: &str) -> Option<HudItem> {
+    with_game(|game| game.items.get(form_spec).map(HudItem::from))
+}
+
+fn equip_in_hand(which: Action, form_spec: String) {
+    with_game(|game| {
+        let two_handed = game
+            .items
+            .get(&form_spec)
+            .map(|xs| xs.two_handed)
+            .unwrap_or(false);
+        if which == Action::Left {
+            game.player.left = form_spec;
+        } else {
+            if two_handed {
+                game.player.left.clear();
+            }
+            game.player.right = form_spec;
+        }
+    });
+}
+
+fn call(description: String) {
+    with_game(|game| game.calls.push(description));
+}
+
+// ---------- the game's side of the bridge
+
+pub fn specEquippedRight() -> String {
+    with_game(|game| game.player.right.clone())
+}
+
+pub fn specEquippedLeft() -> String {
+    with_game(|game| game.player.left.clone())
+}
+
+pub fn specEquippedPower() -> String {
+    with_game(|game| game.player.power.clone())
+}
+
+pub fn specEquippedAmmo() -> String {
+    with_game(|game| game.player.ammo.clone())
+}
+
+pub fn hasRangedEquipped() -> bool {
+    with_game(|game| game.player.ranged_equipped)
+}
+
+pub fn getAmmoInventory() -> Vec<String> {
+    with_game(|game| game.player.ammo_inventory.clone())
+}
+
+/// What the player carried when the session was recorded, updated by what
+/// the game has since said about items. In no particular order.
+pub fn inventorySnapshot() -> Vec<InventoryEntry> {
+    with_game(|game| {
+        let mut counts: HashMap<&str, u32> = game
+            .player
+            .inventory
+            .iter()
+            .map(|(spec, count)| (spec.as_str(), *count))
+            .collect();
+        for item in game.items.values() {
+            counts.insert(item.form_spec.as_str(), item.count);
+        }
+        counts
+            .into_iter()
+            .filter(|(_, count)| *count > 0)
+            .map(|(spec, count)| InventoryEntry {
+                form_spec: spec.to_string(),
+                count,
+            })
+            .collect()
+    })
+}
+
+pub fn healthPotionCount() -> u32 {
+    with_game(|game| game.player.health_potions)
+}
+
+pub fn magickaPotionCount() -> u32 {
+    with_game(|game| game.player.magicka_potions)
+}
+
+pub fn staminaPotionCount() -> u32 {
+    with_game(|game| game.player.stamina_potions)
+}
+
+pub fn isWerewolf() -> bool {
+    with_game(|game| game.player.werewolf)
+}
+
+pub fn isVampireLord() -> bool {
+    with_game(|game| game.player.vampire_lord)
+}
+
+pub fn useCGOAltGrip() -> bool {
+    with_game(|game| game.cgo_alt_grip)
+}
+
+pub fn equipWeapon(form_spec: &CxxString, which: Action, _name: &CxxString) {
+    call(format!("equipWeapon {which:?} {form_spec}"));
+    equip_in_hand(which, form_spec.to_string());
+}
+
+pub fn reequipHand(which: Action, form_spec: &CxxString, _name: &CxxString) {
+    call(format!("reequipHand {which:?} {form_spec}"));
+    equip_in_hand(which, form_spec.to_string());
+}
+
+pub fn unequipSlot(which: Action) {
+    call(format!("unequipSlot {which:?}"));
+    with_game(|game| match which {
+        Action::Left => game.player.left.clear(),
+        Action::Right => game.player.right.clear(),
+        Action::Power => game.player.power.clear(),
+        _ => {}
+    });
+}
+
+pub fn unequipSlotByShift(shift: u8) {
+    call(format!("unequipSlotByShift {shift}"));
+}
+
+pub fn equipShout(form_spec: &CxxString) {
+    call(format!("equipShout {form_spec}"));
+    with_game(|game| game.player.power = form_spec.to_string());
+}
+
+pub fn equipAmmo(form_spec: &CxxString) {
+    call(format!("equipAmmo {form_spec}"));
+    with_game(|game| game.player.ammo = form_spec.to_string());
+}
+
+pub fn equipArmor(form_spec: &CxxString, _name: &CxxString) {
+    call(format!("equipArmor {form_spec}"));
+}
+
+pub fn toggleArmor(form_spec: &CxxString, _name: &CxxString) {
+    call(format!("toggleArmor {form_spec}"));
+}
+
+pub fn consumePotion(form_spec: &CxxString) {
+    call(format!("consumePotion {form_spec}"));
+    let spec = form_spec.to_string();
+    with_game(|game| {
+        if let Some(item) = game.items.get_mut(&spec) {
+            item.count = item.count.saturating_sub(1);
+        }
+    });
+}
+
+pub fn chooseHealthPotion() {
+    call("chooseHealthPotion".to_string());
+    with_game(|game| game.player.health_potions = game.player.health_potions.saturating_sub(1));
+}
+
+pub fn chooseMagickaPotion() {
+    call("chooseMagickaPotion".to_string());
+    with_game(|game| game.player.magicka_potions = game.player.magicka_potions.saturating_sub(1));
+}
+
+pub fn chooseStaminaPotion() {
+    call("chooseStaminaPotion".to_string());
+    with_game(|game| game.player.stamina_potions = game.player.stamina_potions.saturating_sub(1));
+}
+
+// The timers live on the Rust side, but they call back into the game, so
+// these two stand in for the timers module rather than for the bridge.
+pub fn start_timer(which: Action, _duration: u32) {
+    with_game(|game| game.timers.push((true, which)));
+}
+
+pub fn stop_timer(which: Action) {
+    with_game(|game| game.timers.push((false, which)));
+}
+
+pub fn showBriefly() -> bool {
+    false
+}
+
+pub fn startAlphaTransition(_fade_in: bool, _alpha: f32) {}
+
+pub fn setMaxAlpha(max: f32) {
+    with_game(|game| game.calls.push(format!("setMaxAlpha {max}")));
+}
+
+pub fn setMinAlpha(min: f32) {
+    with_game(|game| game.calls.push(format!("setMinAlpha {min}")));
+}
+
+pub fn honk() {}
+
+// ---------- replaying recorded sessions
+
+/// What happened when we replayed a session.
+#[derive(Debug, Default)]
+pub struct ReplayReport {
+    pub events: usize,
+    /// Places where the controller answered differently than it did in game.
+    pub mismatches: Vec<String>,
+    /// Everything the controller asked the game to do, in order.
+    pub calls: Vec<String>,
+    pub elapsed: Duration,
+}
+
+/// A fresh controller on this thread, hooked up to a simulated game that
+/// starts out empty and learns about the player from recorded events.
+pub struct Replay {
+    ctrl: Controller,
+}
+
+impl Replay {
+    pub fn new() -> Self {
+        reset();
+        use_settings_on_this_thread(Some(UserSettings::default()));
+        Self {
+            ctrl: Controller::new(),
+        }
+    }
+
+    /// Play one event. Returns the event as it would be recorded now, with
+    /// this controller's answers in place of the recorded ones.
+    pub fn play(&mut self, event: &SessionEvent) -> Result<SessionEvent> {
+        let ctrl = &mut self.ctrl;
+        match event {
+            SessionEvent::Settings(text) => {
+                let mut options = UserSettings::default();
+                options.read_from_str(text)?;
+                use_settings_on_this_thread(Some(options));
+                ctrl.apply_settings();
+            }
+            SessionEvent::Player(state) => with_game(|game| game.player = state.clone()),
+            SessionEvent::Item(item) => {
+                with_game(|game| game.items.insert(item.form_spec.clone(), item.clone()));
+            }
+            SessionEvent::Cycles { version, bytes } => {
+                let Some(cycles) = CycleData::from_bytes(bytes, *version) else {
+                    return Err(eyre!("cycle data version {version} won't decode"));
+                };
+                ctrl.cycles = cycles;
+                ctrl.refresh_after_load();
+            }
+            SessionEvent::Keys { presses, .. } => {
+                let batch: Vec<ButtonPress> = presses.iter().map(ButtonPress::from).collect();
+                let answered = ctrl.handle_key_events(&batch);
+                return Ok(SessionEvent::Keys {
+                    presses: presses.clone(),
+                    responses: answered.iter().map(RecordedResponse::from).collect(),
+                });
+            }
+            SessionEvent::Equipped {
+                equipped,
+                form_spec,
+                right,
+                left,
+                ..
+            } => {
+                with_game(|game| {
+                    game.player.right = right.clone();
+                    game.player.left = left.clone();
+                });
+                let changed = ctrl.handle_item_equipped(*equipped, form_spec, right, left);
+                return Ok(SessionEvent::Equipped {
+                    equipped: *equipped,
+                    form_spec: form_spec.clone(),
+                    right: right.clone(),
+                    left: left.clone(),
+                    changed,
+                });
+            }
+            SessionEvent::Command(command) => {
+                with_game(|game| match command {
+                    RecordedCommand::InventoryChanged { form_spec, count } => {
+                        if let Some(item) = game.items.get_mut(form_spec) {
+                            item.count = *count;
+                        }
+                    }
+                    RecordedCommand::GripChange(use_alt_grip) => game.cgo_alt_grip = *use_alt_grip,
+                    _ => {}
+                });
+                Command::from(command).apply(ctrl);
+            }
+        }
+        Ok(event.clone())
+    }
+}
+
+impl Default for Replay {
+    fn default() -> Self {
+        Replay::new()
+    }
+}
+
+impl Drop for Replay {
+    fn drop(&mut self) {
+        use_settings_on_this_thread(None);
+    }
+}
+
+/// Run a recorded session through a fresh controller and say where its
+/// answers differ from the recorded ones.
+pub fn replay(events: &[SessionEvent]) -> ReplayReport {
+    let mut session = Replay::new();
+    let mut mismatches = Vec::new();
+
+    let start = Instant::now();
+    for (index, event) in events.iter().enumerate() {
+        match session.play(event) {
+            Ok(now) if now == *event => {}
+            Ok(now) => mismatches.extend(describe_mismatch(index, event, &now)),
+            Err(e) => mismatches.push(format!("event {index}: {e:#}")),
+        }
+    }
+    let elapsed = start.elapsed();
+
+    ReplayReport {
+        events: events.len(),
+        mismatches,
+        calls: calls(),
+        elapsed,
+    }
+}
+
+fn describe_mismatch(index: usize, then: &SessionEvent, now: &SessionEvent) -> Vec<String> {
+    match (then, now) {
+        (
+            SessionEvent::Keys {
+                presses,
+                responses: recorded,
+            },
+            SessionEvent::Keys {
+                responses: answered,
+                ..
+            },
+        ) => presses
+            .iter()
+            .zip(recorded.iter().zip(answered))
+            .filter(|(_, (then, now))| then != now)
+            .map(|(press, (then, now))| {
+                format!(
+                    "event {index}: key {} answered {now:?}; recorded {then:?}",
+                    press.key
+                )
+            })
+            .collect(),
+        _ => vec![format!("event {index}: now {now:?}; recorded {then:?}")],
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::controller::keys::CycleSlot;
+    use crate::controller::recorder::{read_session, RecordedPress, SessionWriter};
+    use crate::plugin::ItemCategory;
+
+    const SWORD: &str = "Skyrim.esm|0x00012eb7";
+    const DAGGER: &str = "Skyrim.esm|0x0001397e";
+    const GREATSWORD: &str = "Skyrim.esm|0x0001359d";
+    const MACE: &str = "Skyrim.esm|0x00013982";
+
+    fn weapon(form_spec: &str, name: &str, two_handed: bool) -> RecordedItem {
+        RecordedItem {
+            form_spec: form_spec.to_string(),
+            name: name.to_string(),
+            count: 1,
+            category: ItemCategory::Weapon.repr,
+            two_handed,
+        }
+    }
+
+    fn keys(presses: &[(f32, f32)]) -> SessionEvent {
+        // Right is key 7 in test-settings.ini.
+        SessionEvent::Keys {
+            presses: presses
+                .iter()
+                .map(|(value, held_secs)| RecordedPress {
+                    key: 7,
+                    value: *value,
+                    held_secs: *held_secs,
+                })
+                .collect(),
+            responses: Vec::new(),
+        }
+    }
+
+    /// A short session: a sword in the right hand and a dagger in the left,
+    /// then two taps of the right-hand key, each followed by its equip delay
+    /// running out.
+    fn session() -> Vec<SessionEvent> {
+        let items = [
+            weapon(SWORD, "Iron Sword", false),
+            weapon(DAGGER, "Iron Dagger", false),
+            weapon(GREATSWORD, "Iron Greatsword", true),
+            weapon(MACE, "Iron Mace", false),
+        ];
+
+        // Build the cycles from the same items so the cosave bytes are real.
+        reset();
+        with_game(|game| {
+            for item in &items {
+                game.items.insert(item.form_spec.clone(), item.clone());
+            }
+        });
+        let mut cycles = CycleData::default();
+        for spec in [SWORD, GREATSWORD, MACE] {
+            cycles.add_item(CycleSlot::Right, &item(spec).expect("a known item"));
+        }
+        cycles.add_item(CycleSlot::Left, &item(DAGGER).expect("a known item"));
+
+        let mut events = vec![
+            SessionEvent::Settings(
+                std::fs::read_to_string("tests/fixtures/test-settings.ini")
+                    .expect("fixture is readable"),
+            ),
+            SessionEvent::Player(PlayerState {
+                right: SWORD.to_string(),
+                left: DAGGER.to_string(),
+                ..Default::default()
+            }),
+        ];
+        events.extend(items.into_iter().map(SessionEvent::Item));
+        events.push(SessionEvent::Cycles {
+            version: CycleData::serialize_version(),
+            bytes: cycles.serialize(),
+        });
+        for _ in 0..2 {
+            events.push(keys(&[(1.0, 0.0)]));
+            events.push(keys(&[(1.0, 0.1), (0.0, 0.15)]));
+            events.push(SessionEvent::Command(RecordedCommand::TimerExpired(
+                Action::Right.repr,
+            )));
+        }
+        events
+    }
+
+    /// Play the player's part: run the session live and keep the answers,
+    /// the way the recorder does in game.
+    fn record(inputs: &[SessionEvent]) -> Vec<SessionEvent> {
+        let mut live = Replay::new();
+        inputs
+            .iter()
+            .map(|event| live.play(event).expect("the session plays"))
+            .collect()
+    }
+
+    #[test]
+    fn replays_match_what_was_recorded() {
+        let events = record(&session());
+        let first = replay(&events);
+        assert!(first.mismatches.is_empty(), "{:?}", first.mismatches);
+        assert_eq!(first.events, events.len());
+        assert!(!first.calls.is_empty(), "the taps equipped something");
+
+        // Replays are deterministic, down to what the controller asked of the game.
+        let second = replay(&events);
+        assert!(second.mismatches.is_empty(), "{:?}", second.mismatches);
+        assert_eq!(first.calls, second.calls);
+    }
+
+    #[test]
+    fn replays_survive_the_file_format() {
+        let events = record(&session());
+        let mut writer = SessionWriter::new(Vec::new()).expect("vectors take bytes");
+        for event in &events {
+            writer.write(event).expect("events encode");
+        }
+        let read = read_session(&writer.into_inner()).expect("we read what we write");
+        assert_eq!(read, events);
+        assert!(replay(&read).mismatches.is_empty());
+    }
+
+    #[test]
+    fn replays_report_different_answers() {
+        let mut events = record(&session());
+        let Some(SessionEvent::Keys { responses, .. }) = events
+            .iter_mut()
+            .rev()
+            .find(|xs| matches!(xs, SessionEvent::Keys { .. }))
+        else {
+            panic!("the session has key batches");
+        };
+        responses[0].handled = !responses[0].handled;
+        let report = replay(&events);
+        assert_eq!(report.mismatches.len(), 1, "{:?}", report.mismatches);
+    }
+
+    #[test]
+    fn equipping_a_two_hander_empties_the_left_hand() {
+        reset();
+        with_game(|game| {
+            game.items.insert(
+                GREATSWORD.to_string(),
+                weapon(GREATSWORD, "Iron Greatsword", true),
+            );
+            game.player.left = DAGGER.to_string();
+        });
+        cxx::let_cxx_string!(spec = GREATSWORD);
+        cxx::let_cxx_string!(name = "Iron Greatsword");
+        equipWeapon(&spec, Action::Right, &name);
+        assert_eq!(specEquippedRight(), GREATSWORD);
+        assert!(specEquippedLeft().is_empty());
+        assert_eq!(calls(), vec![format!("equipWeapon Right {GREATSWORD}")]);
+        assert!(item(GREATSWORD).is_some_and(|xs| xs.two_handed()));
+    }
+
+    /// Replay a session recorded in game. Set SOULSY_REPLAY to the file's path.
+    #[test]
+    #[ignore]
+    fn replay_recorded_session() {
+        let Ok(path) = std::env::var("SOULSY_REPLAY") else {
+            eprintln!("set SOULSY_REPLAY to the path of a session recording");
+            return;
+        };
+        let bytes = std::fs::read(&path).expect("the session file is readable");
+        let events = read_session(&bytes).expect("the session file is a recording");
+        let report = replay(&events);
+        println!(
+            "replayed {} events in {:?}; {} mismatches",
+            report.events,
+            report.elapsed,
+            report.mismatches.len()
+        );
+        for mismatch in &report.mismatches {
+            println!("    {mismatch}");
+        }
+        for call in &report.calls {
+            println!("  > {call}");
+        }
+        assert!(report.mismatches.is_empty());
+    }
+}
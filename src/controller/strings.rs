@@ -1,68 +1,126 @@
 //! Character encoding shenanigans. Bethesda is very bad at utf-8, I am told.
+//!
+//! Nearly every name we see is already valid utf-8, and most are plain ascii,
+//! so we check for that first and only run the statistical detector on names
+//! that fail. Plugins are written in one encoding, so once we've detected a
+//! legacy encoding for a plugin we reuse it for the rest of that plugin's names.
+//! Forms made at runtime have no plugin, and their names can come from
+//! anywhere, so those are always detected one by one.
+use std::collections::HashMap;
+use std::sync::Mutex;
+
 use cxx::CxxVector;
 use encoding::label::encoding_from_whatwg_label;
-use encoding::DecoderTrap;
+use encoding::{DecoderTrap, EncodingRef};
+use once_cell::sync::Lazy;
+
+use crate::data::form_spec::DYNAMIC_PLUGIN;
 
 // To test in game: install daegon
 // player.additem 4c2b15f4 1
 // Sacrÿfev Tëliimi
 
+/// How sure chardet must be before we believe it.
+const CONFIDENCE_THRESHOLD: f32 = 0.75;
+
+/// Legacy encodings we've detected, by plugin file name.
+static PLUGIN_ENCODINGS: Lazy<Mutex<HashMap<Vec<u8>, EncodingRef>>> =
+    Lazy::new(|| Mutex::new(HashMap::new()));
+
 /// C++ should use this for std::string conversions.
 pub fn string_to_utf8(bytes_ffi: &CxxVector<u8>) -> String {
-    let bytes: Vec<u8> = bytes_ffi.iter().copied().collect();
-    convert_to_utf8(bytes)
+    convert_to_utf8(bytes_ffi.as_slice())
 }
 
 /// Use this for null-terminated C strings.
 pub fn cstr_to_utf8(bytes_ffi: &CxxVector<u8>) -> String {
-    let bytes: Vec<u8> = bytes_ffi.iter().copied().collect();
-    let bytes = if bytes.ends_with(&[0]) {
-        let chopped = bytes.len() - 1;
-        let mut tmp = bytes.clone();
-        tmp.truncate(chopped);
-        tmp
-    } else {
-        bytes
-    };
-    convert_to_utf8(bytes)
+    convert_to_utf8(without_nul(bytes_ffi.as_slice()))
 }
 
-/// Get a valid Rust representation of this Windows codepage string data by hook or by crook.
-pub fn convert_to_utf8(bytes: Vec<u8>) -> String {
-    if bytes.is_empty() {
-        return String::new();
+/// Decode a form's name, using what we know about the encoding of the plugin
+/// the form came from. Neither slice needs a null terminator.
+pub fn name_to_utf8(plugin: &[u8], name: &[u8]) -> String {
+    let name = without_nul(name);
+    if let Ok(valid) = std::str::from_utf8(name) {
+        return valid.to_string();
+    }
+    if plugin == DYNAMIC_PLUGIN.as_bytes() {
+        return convert_to_utf8(name);
     }
 
-    let (encoding, confidence, _language) = chardet::detect(&bytes);
-    let encoding = if confidence < 0.75 {
-        "iso-8859-1".to_string() // yeah, well.
-    } else {
-        encoding
-    };
-    if let Some(coder) = encoding_from_whatwg_label(chardet::charset2encoding(&encoding)) {
-        if let Ok(utf8string) = coder.decode(&bytes, DecoderTrap::Replace) {
-            return utf8string.to_string();
+    let known = PLUGIN_ENCODINGS
+        .lock()
+        .ok()
+        .and_then(|cache| cache.get(plugin).copied());
+    if let Some(coder) = known {
+        return decode_with(coder, name);
+    }
+
+    match detect_encoding(name) {
+        Some(coder) => {
+            if let Ok(mut cache) = PLUGIN_ENCODINGS.lock() {
+                cache.insert(plugin.to_vec(), coder);
+            }
+            decode_with(coder, name)
         }
+        None => decode_with(fallback_encoding(), name),
+    }
+}
+
+/// Get a valid Rust representation of this Windows codepage string data by hook or by crook.
+pub fn convert_to_utf8(bytes: &[u8]) -> String {
+    // from_utf8() already skips through ascii a word at a time.
+    if let Ok(valid) = std::str::from_utf8(bytes) {
+        return valid.to_string();
     }
 
-    String::from_utf8_lossy(&bytes).to_string()
+    let coder = detect_encoding(bytes).unwrap_or_else(fallback_encoding);
+    decode_with(coder, bytes)
+}
+
+fn without_nul(bytes: &[u8]) -> &[u8] {
+    bytes.strip_suffix(&[0]).unwrap_or(bytes)
+}
+
+/// Ask chardet what this is. None if it isn't sure or names something we can't decode.
+fn detect_encoding(bytes: &[u8]) -> Option<EncodingRef> {
+    let (encoding, confidence, _language) = chardet::detect(bytes);
+    if confidence < CONFIDENCE_THRESHOLD {
+        return None;
+    }
+    encoding_from_whatwg_label(chardet::charset2encoding(&encoding))
+}
+
+fn fallback_encoding() -> EncodingRef {
+    encoding::all::ISO_8859_1 // yeah, well.
+}
+
+fn decode_with(coder: EncodingRef, bytes: &[u8]) -> String {
+    match coder.decode(bytes, DecoderTrap::Replace) {
+        Ok(utf8string) => utf8string,
+        Err(_) => String::from_utf8_lossy(bytes).to_string(),
+    }
 }
 
 #[cfg(test)]
 mod tests {
+    use encoding::{EncoderTrap, Encoding};
+
     use super::*;
 
     #[test]
     fn utf8_data_is_untouched() {
         let example = "Sacrÿfev Tëliimi";
-        let converted = convert_to_utf8(example.as_bytes().to_vec());
+        let converted = convert_to_utf8(example.as_bytes());
         assert_eq!(converted, example);
         let ex2 = "おはよう";
-        let convert2 = convert_to_utf8(ex2.as_bytes().to_vec());
+        let convert2 = convert_to_utf8(ex2.as_bytes());
         assert_eq!(convert2, ex2);
         let ex3 = "Zażółć gęślą jaźń";
-        let convert3 = convert_to_utf8(ex3.as_bytes().to_vec());
+        let convert3 = convert_to_utf8(ex3.as_bytes());
         assert_eq!(convert3, ex3);
+        assert_eq!(convert_to_utf8(b""), "");
+        assert_eq!(convert_to_utf8(b"Iron Sword"), "Iron Sword");
     }
 
     #[test]
@@ -76,7 +134,7 @@ mod tests {
         ];
         assert!(String::from_utf8(bytes.clone()).is_err());
         let utf8_version = "Sacrÿfev Tëliimi".to_string();
-        let converted = convert_to_utf8(bytes.clone());
+        let converted = convert_to_utf8(&bytes);
         assert_eq!(converted, utf8_version);
     }
 
@@ -93,8 +151,93 @@ mod tests {
         let utf8_version =
             "ÀÁÂÃÄÅÆÇÈÉÊËÌÍÎÏÐÑÒÓÔÕÖ×ØÙÚÛÜÝÞßàáâãäåæçèéêëìíîïðñòóôõö÷øùúûüýþÿ".to_string();
         assert!(String::from_utf8(bytes.clone()).is_err());
-        let converted = convert_to_utf8(bytes.clone());
+        let converted = convert_to_utf8(&bytes);
         assert_eq!(converted.len(), utf8_version.len());
         assert_eq!(converted, utf8_version);
     }
+
+    #[test]
+    fn names_strip_one_null_terminator() {
+        assert_eq!(name_to_utf8(b"Skyrim.esm", b"Iron Sword\0"), "Iron Sword");
+        assert_eq!(name_to_utf8(b"Skyrim.esm", b"\0"), "");
+        assert_eq!(name_to_utf8(b"Skyrim.esm", b""), "");
+    }
+
+    fn cached_encoding(plugin: &[u8]) -> Option<&'static str> {
+        PLUGIN_ENCODINGS
+            .lock()
+            .unwrap()
+            .get(plugin)
+            .map(|coder| coder.name())
+    }
+
+    #[test]
+    fn plugin_encodings_are_detected_once_and_reused() {
+        // A plugin's encoding is learned from whichever of its names is long
+        // enough to detect, and then used for its short names, which aren't.
+        let cyrillic_plugin = b"test-cp1251.esp".as_slice();
+        let japanese_plugin = b"test-shiftjis.esp".as_slice();
+        assert_eq!(cached_encoding(cyrillic_plugin), None);
+        assert_eq!(cached_encoding(japanese_plugin), None);
+
+        let cases = [
+            (
+                cyrillic_plugin,
+                encoding::all::WINDOWS_1251 as EncodingRef,
+                "Стальной кинжал с рукоятью из драконьей кости, выкованный кузнецом Вайтрана для ярла",
+                ["Меч", "Стальной кинжал", "Зелье лечения"],
+            ),
+            (
+                japanese_plugin,
+                encoding::all::WINDOWS_31J as EncodingRef,
+                "ドラゴンの骨で作られた弓は、ホワイトランの鍛冶屋が首長のために鍛えたものです",
+                ["鋼鉄の剣", "回復薬", "ドラゴンの骨の弓"],
+            ),
+        ];
+        for (plugin, coder, long_name, short_names) in cases {
+            let bytes = coder
+                .encode(long_name, EncoderTrap::Strict)
+                .expect("the test encoding can encode this");
+            assert!(std::str::from_utf8(&bytes).is_err());
+            assert_eq!(name_to_utf8(plugin, &bytes), long_name);
+            assert!(
+                cached_encoding(plugin).is_some(),
+                "detecting a name remembers its plugin's encoding"
+            );
+
+            for name in short_names {
+                let bytes = coder
+                    .encode(name, EncoderTrap::Strict)
+                    .expect("the test encoding can encode this");
+                assert!(std::str::from_utf8(&bytes).is_err());
+                assert_eq!(name_to_utf8(plugin, &bytes), name);
+            }
+        }
+
+        // Names that are already utf-8 never consult the cache.
+        assert_eq!(name_to_utf8(japanese_plugin, "鋼鉄の剣".as_bytes()), "鋼鉄の剣");
+        assert_eq!(name_to_utf8(cyrillic_plugin, b"Ebony Blade"), "Ebony Blade");
+    }
+
+    #[test]
+    fn dynamic_forms_share_no_encoding() {
+        // Two runtime forms from different places: one's name mustn't decide
+        // how the other's is read.
+        let dynamic = DYNAMIC_PLUGIN.as_bytes();
+        let bytes = encoding::all::WINDOWS_1251
+            .encode(
+                "Стальной кинжал с рукоятью из драконьей кости, выкованный кузнецом Вайтрана",
+                EncoderTrap::Strict,
+            )
+            .expect("cp1251 can encode this");
+        name_to_utf8(dynamic, &bytes);
+        assert_eq!(cached_encoding(dynamic), None);
+
+        let latin = vec![
+            0x53, 0x61, 0x63, 0x72, 0xff, 0x66, 0x65, 0x76, 0x20, 0x54, 0xeb, 0x6c, 0x69, 0x69,
+            0x6d, 0x69,
+        ];
+        assert_eq!(name_to_utf8(dynamic, &latin), convert_to_utf8(&latin));
+        assert_eq!(cached_encoding(dynamic), None);
+    }
 }
@@ -0,0 +1,385 @@
+//! Timers for equip delays and long presses.
+//!
+//! Cycling a slot starts a short timer, and the item is equipped when it
+//! runs out; holding a key starts another, and the long-press action happens
+//! when that one does. These used to be counted down in the renderer, which
+//! walked every running timer each frame. Now they live here in a timer
+//! wheel, and the renderer only tells us how much time went by.
+//!
+//! The wheel is hierarchical: four levels of 64 slots, with millisecond ticks
+//! on the first level and each level's slots 64 times wider than the one
+//! below. A timer goes in the slot for its deadline on the lowest level that
+//! reaches that far, and moves down a level each time the wheel comes round
+//! to its slot, so a tick only ever looks at one slot per level. That's
+//! enough for a few hours, far more than any delay the HUD needs.
+//!
+//! The wheel has no clock of its own. Its time is the sum of the frame deltas
+//! it's been given, which makes everything here exact to test.
+
+use std::collections::HashMap;
+use std::hash::Hash;
+use std::sync::Mutex;
+use std::time::Duration;
+
+use once_cell::sync::Lazy;
+
+use super::facade::timer_expired;
+use super::settings::settings;
+use crate::plugin::{enterSlowMotion, exitSlowMotion, isInCombat, Action};
+
+const SLOT_BITS: u32 = 6;
+const SLOTS: usize = 1 << SLOT_BITS;
+const SLOT_MASK: u64 = (SLOTS as u64) - 1;
+const LEVELS: usize = 4;
+/// The longest a timer can run, in ticks. One top-level slot short of a
+/// full turn, so a timer always lands in a slot the wheel is coming to.
+const MAX_TICKS: u64 =
+    (1 << (SLOT_BITS as usize * LEVELS)) - (1 << (SLOT_BITS as usize * (LEVELS - 1)));
+
+static TIMERS: Lazy<Mutex<Timers>> = Lazy::new(|| Mutex::new(Timers::default()));
+
+#[derive(Debug, Clone)]
+struct Entry<K> {
+    key: K,
+    deadline: u64,
+    /// Restarting or stopping a timer leaves its old entry in the wheel. It's
+    /// ignored because its generation is no longer the live one.
+    generation: u64,
+}
+
+/// A hierarchical timer wheel, keyed so each key has at most one timer.
+#[derive(Debug)]
+pub struct TimerWheel<K> {
+    /// Whole ticks since the wheel was made.
+    now: u64,
+    /// Time given to us that doesn't yet add up to a tick.
+    carry: Duration,
+    /// LEVELS rows of SLOTS slots each.
+    slots: Vec<Vec<Entry<K>>>,
+    /// The generation of each running timer.
+    live: HashMap<K, u64>,
+    generation: u64,
+}
+
+impl<K: Copy + Eq + Hash> Default for TimerWheel<K> {
+    fn default() -> Self {
+        Self {
+            now: 0,
+            carry: Duration::ZERO,
+            slots: vec![Vec::new(); LEVELS * SLOTS],
+            live: HashMap::new(),
+            generation: 0,
+        }
+    }
+}
+
+impl<K: Copy + Eq + Hash> TimerWheel<K> {
+    /// How long a tick is.
+    pub const TICK: Duration = Duration::from_millis(1);
+
+    /// Start a timer, replacing any this key already has. It expires on the
+    /// first advance that takes the wheel at least `after` past now, and never
+    /// sooner.
+    pub fn start(&mut self, key: K, after: Duration) {
+        let since_tick = self.carry + after;
+        let mut ticks = since_tick.as_millis() as u64;
+        if since_tick > Duration::from_millis(ticks) {
+            ticks += 1;
+        }
+        let deadline = self.now + ticks.clamp(1, MAX_TICKS);
+        self.generation += 1;
+        self.live.insert(key, self.generation);
+        self.place(Entry {
+            key,
+            deadline,
+            generation: self.generation,
+        });
+    }
+
+    /// Stop a timer. Returns true if it was running.
+    pub fn cancel(&mut self, key: &K) -> bool {
+        self.live.remove(key).is_some()
+    }
+
+    pub fn is_running(&self, key: &K) -> bool {
+        self.live.contains_key(key)
+    }
+
+    pub fn len(&self) -> usize {
+        self.live.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.live.is_empty()
+    }
+
+    /// How much time the wheel has been given, to the tick.
+    pub fn elapsed(&self) -> Duration {
+        Duration::from_millis(self.now)
+    }
+
+    /// Move time forward, adding the timers that ran out to `expired` in the
+    /// order they ran out. The buffer is not cleared first.
+    pub fn advance(&mut self, delta: Duration, expired: &mut Vec<K>) {
+        let total = self.carry + delta;
+        let ticks = total.as_millis() as u64;
+        self.carry = total - Duration::from_millis(ticks);
+
+        if self.live.is_empty() {
+            // Nothing to fire, so skip ahead. What's left in the slots is stale.
+            self.slots.iter_mut().for_each(Vec::clear);
+            self.now += ticks;
+            return;
+        }
+        for _ in 0..ticks {
+            self.tick(expired);
+            if self.live.is_empty() {
+                self.slots.iter_mut().for_each(Vec::clear);
+            }
+        }
+    }
+
+    fn tick(&mut self, expired: &mut Vec<K>) {
+        self.now += 1;
+        // Bring down the timers in any higher slot the wheel just came to,
+        // highest first so each lands in a slot we haven't passed yet.
+        for level in (1..LEVELS).rev() {
+            let shift = SLOT_BITS as usize * level;
+            if self.now & ((1 << shift) - 1) != 0 {
+                continue;
+            }
+            let index = level * SLOTS + ((self.now >> shift) & SLOT_MASK) as usize;
+            for entry in std::mem::take(&mut self.slots[index]) {
+                if self.live.get(&entry.key) == Some(&entry.generation) {
+                    self.place(entry);
+                }
+            }
+        }
+
+        let index = (self.now & SLOT_MASK) as usize;
+        if self.slots[index].is_empty() {
+            return;
+        }
+        for entry in std::mem::take(&mut self.slots[index]) {
+            if self.live.get(&entry.key) == Some(&entry.generation) {
+                self.live.remove(&entry.key);
+                expired.push(entry.key);
+            }
+        }
+    }
+
+    /// File a timer on the lowest level whose slots reach its deadline.
+    fn place(&mut self, entry: Entry<K>) {
+        let differs = (entry.deadline ^ self.now) | 1;
+        let highest_bit = u64::BITS - 1 - differs.leading_zeros();
+        let level = ((highest_bit / SLOT_BITS) as usize).min(LEVELS - 1);
+        let slot = ((entry.deadline >> (SLOT_BITS as usize * level)) & SLOT_MASK) as usize;
+        self.slots[level * SLOTS + slot].push(entry);
+    }
+}
+
+/// The HUD's timers, and a buffer for what expires each frame.
+#[derive(Debug)]
+struct Timers {
+    wheel: TimerWheel<Action>,
+    expired: Vec<Action>,
+}
+
+impl Default for Timers {
+    fn default() -> Self {
+        Self {
+            wheel: TimerWheel::default(),
+            expired: Vec::with_capacity(8),
+        }
+    }
+}
+
+fn timers() -> std::sync::MutexGuard<'static, Timers> {
+    TIMERS
+        .lock()
+        .expect("Unrecoverable runtime problem: cannot acquire timers lock.")
+}
+
+/// Start the named timer, replacing it if it's already running. Duration is in
+/// milliseconds. Cycling in combat slows time, if the player asked for that.
+pub fn start_timer(which: Action, duration: u32) {
+    timers()
+        .wheel
+        .start(which, Duration::from_millis(duration as u64));
+    log::debug!("Started timer; which={which:?}; duration={duration} ms;");
+    if settings().cycling_slows_time() && isInCombat() {
+        enterSlowMotion();
+    }
+}
+
+/// Stop the named timer, if it's running.
+pub fn stop_timer(which: Action) {
+    let mut timers = timers();
+    timers.wheel.cancel(&which);
+    if timers.wheel.is_empty() {
+        exitSlowMotion();
+    }
+}
+
+/// Once a frame, with the time since the last one in seconds. Timers that ran
+/// out are handed to the controller. Time goes back to normal once none are left.
+pub fn advance_timers(delta: f32) {
+    let delta = Duration::try_from_secs_f32(delta).unwrap_or_default();
+    let mut expired = {
+        let mut timers = timers();
+        let Timers { wheel, expired } = &mut *timers;
+        wheel.advance(delta, expired);
+        if wheel.is_empty() {
+            exitSlowMotion();
+        }
+        if expired.is_empty() {
+            return;
+        }
+        std::mem::take(expired)
+    };
+    // The controller may start timers of its own, so we've let go of ours.
+    for which in expired.drain(..) {
+        timer_expired(which);
+    }
+    timers().expired = expired;
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn ms(millis: u64) -> Duration {
+        Duration::from_millis(millis)
+    }
+
+    /// Advance by `step` until `total` has gone by, noting when each key expired.
+    fn run(wheel: &mut TimerWheel<u32>, step: Duration, total: Duration) -> Vec<(u32, Duration)> {
+        let mut fired = Vec::new();
+        let mut expired = Vec::new();
+        let mut elapsed = Duration::ZERO;
+        while elapsed < total {
+            wheel.advance(step, &mut expired);
+            elapsed += step;
+            fired.extend(expired.drain(..).map(|key| (key, elapsed)));
+        }
+        fired
+    }
+
+    #[test]
+    fn timers_fire_on_the_first_frame_past_their_duration() {
+        let mut wheel = TimerWheel::default();
+        wheel.start(1, ms(750));
+        wheel.start(2, ms(100));
+        wheel.start(3, ms(1250));
+        // 60 fps frames don't divide evenly into milliseconds.
+        let frame = Duration::from_secs_f64(1.0 / 60.0);
+        let fired = run(&mut wheel, frame, ms(2000));
+
+        let keys: Vec<u32> = fired.iter().map(|(key, _)| *key).collect();
+        assert_eq!(keys, vec![2, 1, 3]);
+        for ((key, at), after) in fired.iter().zip([100, 750, 1250]) {
+            assert!(*at >= ms(after), "timer {key} fired early at {at:?}");
+            assert!(*at < ms(after) + frame, "timer {key} fired late at {at:?}");
+        }
+        assert!(wheel.is_empty());
+    }
+
+    #[test]
+    fn timers_cross_every_level() {
+        let mut wheel = TimerWheel::default();
+        // Short enough for the first level, and long enough for each of the others.
+        let durations = [5, 63, 64, 65, 4095, 4096, 4097, 262_143, 262_144, 3_600_000];
+        for (key, after) in durations.iter().enumerate() {
+            wheel.start(key as u32, ms(*after));
+        }
+        let fired = run(&mut wheel, ms(7), ms(3_600_007));
+        assert_eq!(fired.len(), durations.len());
+        for (key, at) in fired {
+            let after = ms(durations[key as usize]);
+            assert!(
+                at >= after && at < after + ms(7),
+                "timer {key} fired at {at:?}"
+            );
+        }
+    }
+
+    #[test]
+    fn restarting_and_stopping_replace_the_old_timer() {
+        let mut wheel = TimerWheel::default();
+        let mut expired = Vec::new();
+        wheel.start(1, ms(100));
+        wheel.start(2, ms(100));
+        wheel.advance(ms(60), &mut expired);
+
+        // Restarting pushes the deadline out from now.
+        wheel.start(1, ms(100));
+        assert!(wheel.cancel(&2));
+        assert!(!wheel.cancel(&2));
+        wheel.advance(ms(60), &mut expired);
+        assert!(expired.is_empty(), "nothing is due yet");
+        assert!(wheel.is_running(&1));
+        wheel.advance(ms(40), &mut expired);
+        assert_eq!(expired, vec![1]);
+        assert!(wheel.is_empty());
+    }
+
+    #[test]
+    fn long_frames_fire_everything_due_in_order() {
+        let mut wheel = TimerWheel::default();
+        let mut expired = Vec::new();
+        wheel.start(1, ms(300));
+        wheel.start(2, ms(200));
+        wheel.start(3, ms(5000));
+        // A hitch, or a menu, covers both short timers at once.
+        wheel.advance(ms(1000), &mut expired);
+        assert_eq!(expired, vec![2, 1]);
+        assert_eq!(wheel.len(), 1);
+        assert_eq!(wheel.elapsed(), ms(1000));
+    }
+
+    #[test]
+    fn idle_wheels_skip_ahead() {
+        let mut wheel: TimerWheel<u32> = TimerWheel::default();
+        let mut expired = Vec::new();
+        wheel.start(1, ms(10));
+        wheel.cancel(&1);
+        wheel.advance(Duration::from_secs(3600), &mut expired);
+        assert!(expired.is_empty());
+        assert_eq!(wheel.elapsed(), Duration::from_secs(3600));
+
+        // A timer started after the jump still counts from the new now.
+        wheel.start(2, ms(10));
+        wheel.advance(ms(9), &mut expired);
+        assert!(expired.is_empty());
+        wheel.advance(ms(1), &mut expired);
+        assert_eq!(expired, vec![2]);
+    }
+
+    #[test]
+    fn leftover_time_carries_between_frames() {
+        let mut wheel = TimerWheel::default();
+        let mut expired = Vec::new();
+        for _ in 0..10 {
+            wheel.advance(Duration::from_micros(350), &mut expired);
+        }
+        assert_eq!(wheel.elapsed(), ms(3));
+
+        // Starting partway into a tick doesn't shorten the timer.
+        wheel.start(1, ms(2));
+        wheel.advance(Duration::from_micros(1900), &mut expired);
+        assert!(expired.is_empty());
+        wheel.advance(Duration::from_micros(600), &mut expired);
+        assert_eq!(expired, vec![1]);
+    }
+
+    #[test]
+    fn zero_length_timers_wait_for_the_next_tick() {
+        let mut wheel = TimerWheel::default();
+        let mut expired = Vec::new();
+        wheel.start(1, Duration::ZERO);
+        wheel.advance(Duration::ZERO, &mut expired);
+        assert!(expired.is_empty());
+        wheel.advance(ms(1), &mut expired);
+        assert_eq!(expired, vec![1]);
+    }
+}
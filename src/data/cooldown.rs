@@ -0,0 +1,224 @@
+//! Shout cooldowns. Once a shout is used, the game counts its cooldown down
+//! on a known schedule, so we record when the cooldown will end and compute
+//! the meter level and time remaining from that each frame. We only ask the
+//! game again to catch changes in the player's shout recovery rate.
+
+use std::time::{Duration, Instant};
+
+/// How far our predicted time remaining may drift from the game's before we
+/// believe the game and re-anchor the cooldown. In seconds.
+const DRIFT_TOLERANCE: f32 = 0.25;
+
+/// A running cooldown.
+#[derive(Debug, Clone, PartialEq)]
+pub struct Cooldown {
+    /// When the cooldown will be done.
+    ends_at: Instant,
+    /// The full length of the cooldown, in seconds.
+    duration: f32,
+}
+
+impl Cooldown {
+    /// Start a cooldown with the given number of seconds remaining. We take
+    /// the first reading after a shout as the full length of its cooldown.
+    pub fn new(now: Instant, remaining: f32) -> Self {
+        let remaining = remaining.max(0.0);
+        Self {
+            ends_at: now + Duration::from_secs_f32(remaining),
+            duration: remaining,
+        }
+    }
+
+    /// Reconcile a cooldown with a fresh reading of the time remaining from
+    /// the game, returning the cooldown we should track from now on. A
+    /// reading of zero means no cooldown is running.
+    pub fn resync(current: Option<&Cooldown>, now: Instant, reported: f32) -> Option<Cooldown> {
+        if reported <= 0.0 {
+            return None;
+        }
+
+        match current.filter(|xs| !xs.is_finished(now)) {
+            None => Some(Cooldown::new(now, reported)),
+            Some(running) => {
+                if (running.remaining(now) - reported).abs() <= DRIFT_TOLERANCE {
+                    Some(running.clone())
+                } else {
+                    // The recovery rate changed, or a longer cooldown started.
+                    Some(Cooldown {
+                        ends_at: now + Duration::from_secs_f32(reported),
+                        duration: running.duration.max(reported),
+                    })
+                }
+            }
+        }
+    }
+
+    /// The full length of this cooldown, in seconds.
+    pub fn duration(&self) -> f32 {
+        self.duration
+    }
+
+    /// Seconds remaining as of `now`; never negative.
+    pub fn remaining(&self, now: Instant) -> f32 {
+        self.ends_at.saturating_duration_since(now).as_secs_f32()
+    }
+
+    /// True if the cooldown is over as of `now`.
+    pub fn is_finished(&self, now: Instant) -> bool {
+        now >= self.ends_at
+    }
+
+    /// The meter level: the percentage of the cooldown left to run.
+    pub fn percent_remaining(&self, now: Instant) -> f32 {
+        if self.duration <= 0.0 {
+            return 0.0;
+        }
+        (self.remaining(now) * 100.0 / self.duration).clamp(0.0, 100.0)
+    }
+}
+
+/// Format seconds remaining for display. We round up, so the HUD shows "1"
+/// right until the cooldown is over instead of showing "0" for half a second.
+pub fn format_seconds(seconds: f32) -> String {
+    format!("{:.0}", seconds.max(0.0).ceil())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::data::huditem::RelevantExtraData;
+    use crate::data::power::PowerType;
+    use crate::data::{BaseType, HudItem};
+
+    fn later(start: Instant, seconds: f32) -> Instant {
+        start + Duration::from_secs_f32(seconds)
+    }
+
+    #[test]
+    fn interpolates_linearly() {
+        let start = Instant::now();
+        let cooldown = Cooldown::new(start, 20.0);
+        assert_eq!(cooldown.duration(), 20.0);
+        assert_eq!(cooldown.remaining(start), 20.0);
+        assert_eq!(cooldown.percent_remaining(start), 100.0);
+
+        let quarter = later(start, 5.0);
+        assert!((cooldown.remaining(quarter) - 15.0).abs() < 0.001);
+        assert!((cooldown.percent_remaining(quarter) - 75.0).abs() < 0.01);
+
+        let half = later(start, 10.0);
+        assert!((cooldown.percent_remaining(half) - 50.0).abs() < 0.01);
+        assert!(!cooldown.is_finished(half));
+    }
+
+    #[test]
+    fn finishes_and_clamps() {
+        let start = Instant::now();
+        let cooldown = Cooldown::new(start, 3.0);
+        let done = later(start, 3.0);
+        assert!(cooldown.is_finished(done));
+        assert_eq!(cooldown.remaining(done), 0.0);
+        assert_eq!(cooldown.percent_remaining(done), 0.0);
+
+        let long_after = later(start, 300.0);
+        assert_eq!(cooldown.remaining(long_after), 0.0);
+        assert_eq!(cooldown.percent_remaining(long_after), 0.0);
+
+        let empty = Cooldown::new(start, -1.0);
+        assert_eq!(empty.duration(), 0.0);
+        assert!(empty.is_finished(start));
+        assert_eq!(empty.percent_remaining(start), 0.0);
+    }
+
+    #[test]
+    fn resync_keeps_an_accurate_prediction() {
+        let start = Instant::now();
+        let cooldown = Cooldown::new(start, 30.0);
+        let now = later(start, 10.0);
+        let kept = Cooldown::resync(Some(&cooldown), now, 20.1).expect("still running");
+        assert_eq!(kept, cooldown);
+    }
+
+    #[test]
+    fn resync_reanchors_on_recovery_change() {
+        let start = Instant::now();
+        let cooldown = Cooldown::new(start, 30.0);
+        let now = later(start, 10.0);
+
+        // The player put on an amulet of Talos: the cooldown got shorter.
+        let faster = Cooldown::resync(Some(&cooldown), now, 12.0).expect("still running");
+        assert_eq!(faster.duration(), 30.0);
+        assert!((faster.remaining(now) - 12.0).abs() < 0.001);
+        assert!((faster.percent_remaining(now) - 40.0).abs() < 0.01);
+
+        // A longer cooldown than the one we knew about takes over the duration.
+        let longer = Cooldown::resync(Some(&cooldown), now, 45.0).expect("running");
+        assert_eq!(longer.duration(), 45.0);
+        assert_eq!(longer.percent_remaining(now), 100.0);
+    }
+
+    #[test]
+    fn resync_starts_and_stops() {
+        let start = Instant::now();
+        assert!(Cooldown::resync(None, start, 0.0).is_none());
+
+        let fresh = Cooldown::resync(None, start, 8.0).expect("a new cooldown");
+        assert_eq!(fresh.duration(), 8.0);
+
+        let ended = Cooldown::resync(Some(&fresh), later(start, 4.0), 0.0);
+        assert!(ended.is_none());
+
+        // A finished cooldown is replaced by the next shout's, not merged with it.
+        let next = Cooldown::resync(Some(&fresh), later(start, 9.0), 5.0).expect("a new cooldown");
+        assert_eq!(next.duration(), 5.0);
+    }
+
+    #[test]
+    fn formats_seconds_rounding_up() {
+        assert_eq!(format_seconds(0.0), "0");
+        assert_eq!(format_seconds(-3.0), "0");
+        assert_eq!(format_seconds(0.2), "1");
+        assert_eq!(format_seconds(1.0), "1");
+        assert_eq!(format_seconds(1.01), "2");
+        assert_eq!(format_seconds(44.5), "45");
+    }
+
+    #[test]
+    fn shout_items_interpolate_without_refreshing() {
+        let mut shout = HudItem::preclassified(
+            "Unrelenting Force".to_string(),
+            "Skyrim.esm|0x13e07".to_string(),
+            1,
+            BaseType::Power(PowerType::default()),
+        );
+        let start = Instant::now();
+        let extra = RelevantExtraData::new(false, 0.0, 0.0, false, true, 0.0, 20.0);
+        shout.apply_extra_data(extra, start);
+
+        let now = later(start, 5.0);
+        assert!((shout.meter_level_at(now) - 75.0).abs() < 0.01);
+        assert!((shout.time_left_at(now) - 15.0).abs() < 0.001);
+        assert!(shout.show_meter_at(now));
+        assert_eq!(shout.fmtstr_at("{time_left}/{time_max}".to_string(), now), "15/20");
+        assert_eq!(
+            shout.fmtstr_at("{name}: {meter_level}".to_string(), now),
+            "Unrelenting Force: 75"
+        );
+        assert_eq!(shout.fmtstr_at("{nonsense}".to_string(), now), "");
+
+        let done = later(start, 20.0);
+        assert_eq!(shout.meter_level_at(done), 0.0);
+        assert!(!shout.show_meter_at(done));
+        assert_eq!(shout.fmtstr_at("{time_left}".to_string(), done), "0");
+
+        // Once it's over, the cooldown is dropped and the item stops interpolating.
+        assert!(!shout.end_finished_cooldown(now));
+        assert!(shout.end_finished_cooldown(done));
+        assert!(!shout.end_finished_cooldown(done));
+        assert_eq!(
+            shout.fmtstr_at("{time_left}/{time_max}/{meter_level}".to_string(), done),
+            "0/20/0"
+        );
+        assert!(!shout.show_meter_at(done));
+    }
+}
@@ -0,0 +1,151 @@
+//! Form specs are how we name game items across the bridge and in the
+//! cosave: a plugin name and a form id local to that plugin, written as
+//! `Plugin.esp|0xdeadbeef`. Forms created at runtime use the plugin name
+//! `dynamic` and their full form id.
+//!
+//! C++ parses these in `src/util/form_spec.h` with the same grammar; keep the
+//! two in sync. The strictness matters because specs arrive from cosaves,
+//! which can be damaged or written by older versions of the mod.
+
+use std::fmt::Display;
+
+/// The plugin name used for forms created at runtime.
+pub const DYNAMIC_PLUGIN: &str = "dynamic";
+
+/// A parsed form spec, borrowing its plugin name from the original string.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct FormSpec<'a> {
+    pub plugin: &'a str,
+    pub id: u32,
+}
+
+impl<'a> FormSpec<'a> {
+    /// Parse a form spec without allocating. Returns None for anything that
+    /// isn't exactly a non-empty plugin name, a `|`, and one to eight hex
+    /// digits with an optional `0x` prefix. Proxy names like `health_proxy`
+    /// are not form specs.
+    pub fn parse(spec: &'a str) -> Option<Self> {
+        let (plugin, digits) = spec.split_once('|')?;
+        if plugin.is_empty() {
+            return None;
+        }
+        let digits = digits
+            .strip_prefix("0x")
+            .or_else(|| digits.strip_prefix("0X"))
+            .unwrap_or(digits);
+        if digits.is_empty() || digits.len() > 8 {
+            return None;
+        }
+
+        let mut id = 0u32;
+        for c in digits.bytes() {
+            let nibble = (c as char).to_digit(16)?;
+            id = (id << 4) | nibble;
+        }
+        Some(Self { plugin, id })
+    }
+
+    /// True if this names a form created at runtime rather than one from a plugin.
+    pub fn is_dynamic(&self) -> bool {
+        self.plugin == DYNAMIC_PLUGIN
+    }
+}
+
+impl Display for FormSpec<'_> {
+    /// The same format C++ uses when it makes form specs.
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        write!(f, "{}|0x{:08x}", self.plugin, self.id)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use rand::Rng;
+
+    use super::*;
+
+    #[test]
+    fn parses_specs_we_write() {
+        let spec = FormSpec::parse("Skyrim.esm|0x00012eb7").expect("a normal form spec");
+        assert_eq!(spec.plugin, "Skyrim.esm");
+        assert_eq!(spec.id, 0x12eb7);
+        assert!(!spec.is_dynamic());
+
+        let spec = FormSpec::parse("dynamic|0xff000d2a").expect("a dynamic form spec");
+        assert!(spec.is_dynamic());
+        assert_eq!(spec.id, 0xff000d2a);
+
+        let spec = FormSpec::parse("Unofficial Skyrim Special Edition Patch.esp|0x0A1B2C")
+            .expect("spaces and upper case are fine");
+        assert_eq!(spec.id, 0xa1b2c);
+        assert_eq!(FormSpec::parse("Mod.esl|800").map(|xs| xs.id), Some(0x800));
+    }
+
+    #[test]
+    fn rejects_malformed_specs() {
+        let bad = [
+            "",
+            "|",
+            "|0x800",
+            "Skyrim.esm",
+            "Skyrim.esm|",
+            "Skyrim.esm|0x",
+            "Skyrim.esm|0x123456789",
+            "Skyrim.esm|0xdefg",
+            "Skyrim.esm|0x12 ",
+            "Skyrim.esm| 0x12",
+            "Skyrim.esm|0x12|0x13",
+            "Skyrim.esm|-12",
+            "Skyrim.esm|+12",
+            "health_proxy",
+            "unarmed_proxy",
+            "equipset_3",
+        ];
+        for spec in bad {
+            assert!(FormSpec::parse(spec).is_none(), "'{spec}' should not parse");
+        }
+    }
+
+    #[test]
+    fn round_trips_random_specs() {
+        let mut rng = rand::thread_rng();
+        let plugins = ["Skyrim.esm", "Dawnguard.esm", "dynamic", "ÄÖÜ mod.esp", "a"];
+        for _ in 0..10_000 {
+            let plugin = plugins[rng.gen_range(0..plugins.len())];
+            let id: u32 = rng.gen();
+            let written = FormSpec { plugin, id }.to_string();
+            let parsed = FormSpec::parse(&written).expect("we can read what we write");
+            assert_eq!(parsed, FormSpec { plugin, id });
+
+            let short = format!("{plugin}|{id:x}");
+            assert_eq!(FormSpec::parse(&short), Some(parsed));
+        }
+    }
+
+    #[test]
+    fn fuzzed_input_never_panics() {
+        let mut rng = rand::thread_rng();
+        let alphabet = b"|0xX19afAFgz. \t\n";
+        for _ in 0..50_000 {
+            let len = rng.gen_range(0..24);
+            let bytes: Vec<u8> = (0..len)
+                .map(|_| alphabet[rng.gen_range(0..alphabet.len())])
+                .collect();
+            let input = String::from_utf8_lossy(&bytes);
+            // Anything accepted must be a plugin name and a valid id that we
+            // can write back out and read again.
+            if let Some(parsed) = FormSpec::parse(&input) {
+                assert!(!parsed.plugin.is_empty());
+                assert!(!parsed.plugin.contains('|'));
+                let rewritten = parsed.to_string();
+                assert_eq!(FormSpec::parse(&rewritten), Some(parsed));
+            }
+        }
+
+        for _ in 0..10_000 {
+            let len = rng.gen_range(0..32);
+            let bytes: Vec<u8> = (0..len).map(|_| rng.gen()).collect();
+            let _ = FormSpec::parse(&String::from_utf8_lossy(&bytes));
+        }
+    }
+}
@@ -1,9 +1,11 @@
 use std::collections::HashMap;
 use std::fmt::Display;
+use std::time::Instant;
 
-use strfmt::strfmt;
+use strfmt::{strfmt, strfmt_map, FmtError, Formatter};
 
 use super::base::BaseType;
+use super::cooldown::{format_seconds, Cooldown};
 use super::HasIcon;
 use crate::images::icons::Icon;
 #[cfg(not(test))]
@@ -28,10 +30,30 @@ pub struct HudItem {
     extra: RelevantExtraData,
     /// record the max cooldown time we've seen for this shout
     shout_cooldown: f32,
+    /// The shout cooldown running right now, if any. Interpolated each frame.
+    cooldown: Option<Cooldown>,
     /// Meter level, if relevant. As a percentage.
     meter_level: f32,
 }
 
+/// An item's format variables with a running cooldown's `time_left` and
+/// `meter_level` laid over them, so rendering doesn't copy the whole map.
+struct CooldownVars<'a> {
+    time_left: String,
+    meter_level: String,
+    rest: &'a HashMap<String, String>,
+}
+
+impl CooldownVars<'_> {
+    fn get(&self, key: &str) -> Option<&str> {
+        match key {
+            "time_left" => Some(&self.time_left),
+            "meter_level" => Some(&self.meter_level),
+            _ => self.rest.get(key).map(String::as_str),
+        }
+    }
+}
+
 /// This is the item extra data the hud cares about and displays (full name
 /// not included).
 #[derive(Debug, Clone, PartialEq)]
@@ -222,7 +244,25 @@ impl HudItem {
     }
 
     pub fn fmtstr(&self, fmt: String) -> String {
-        match strfmt(&fmt, &self.format_vars) {
+        self.fmtstr_at(fmt, Instant::now())
+    }
+
+    /// Render a format string, with any running cooldown interpolated to `now`.
+    pub fn fmtstr_at(&self, fmt: String, now: Instant) -> String {
+        let rendered = if let Some(cooldown) = self.cooldown.as_ref() {
+            let vars = CooldownVars {
+                time_left: format_seconds(cooldown.remaining(now)),
+                meter_level: format!("{:.0}", cooldown.percent_remaining(now)),
+                rest: &self.format_vars,
+            };
+            strfmt_map(&fmt, |mut f: Formatter| match vars.get(f.key) {
+                Some(value) => f.str(value),
+                None => Err(FmtError::KeyError(f.key.to_string())),
+            })
+        } else {
+            strfmt(&fmt, &self.format_vars)
+        };
+        match rendered {
             Ok(v) => v,
             Err(e) => {
                 log::debug!(
@@ -280,8 +320,18 @@ impl HudItem {
     /// Return true if this item has something to display in a meter.
     /// Does not update local flags; okay to use in tight loops.
     pub fn show_meter(&self) -> bool {
+        self.show_meter_at(Instant::now())
+    }
+
+    /// Check for a meter as of `now`. Shout cooldown meters vanish when the
+    /// cooldown ends, without waiting for the game to tell us.
+    pub fn show_meter_at(&self, now: Instant) -> bool {
         if self.is_weapon() {
             self.extra.has_charge
+        } else if self.is_power() {
+            self.cooldown
+                .as_ref()
+                .is_some_and(|cooldown| !cooldown.is_finished(now))
         } else {
             self.extra.has_time_left
         }
@@ -290,7 +340,16 @@ impl HudItem {
     /// Returns meter/time left percentage level.
     /// Does not update the object; okay to use in tight loops.
     pub fn meter_level(&self) -> f32 {
-        self.meter_level
+        self.meter_level_at(Instant::now())
+    }
+
+    /// The meter level as of `now`, interpolating any running cooldown.
+    pub fn meter_level_at(&self, now: Instant) -> f32 {
+        if let Some(cooldown) = self.cooldown.as_ref() {
+            cooldown.percent_remaining(now)
+        } else {
+            self.meter_level
+        }
     }
 
     /// Return true if this item is enchanted.
@@ -311,7 +370,16 @@ impl HudItem {
 
     /// Cooldown remaining; okay to use in tight loops.
     pub fn time_left(&self) -> f32 {
-        self.extra.time_left
+        self.time_left_at(Instant::now())
+    }
+
+    /// Cooldown or duration remaining as of `now`.
+    pub fn time_left_at(&self, now: Instant) -> f32 {
+        if let Some(cooldown) = self.cooldown.as_ref() {
+            cooldown.remaining(now)
+        } else {
+            self.extra.time_left
+        }
     }
 
     pub fn refresh_extra_data(&mut self) {
@@ -324,19 +392,49 @@ impl HudItem {
             *relevantExtraData(&form_spec)
         };
 
+        self.apply_extra_data(extra, Instant::now());
+    }
+
+    /// True if a shout cooldown ran out by `now` and hasn't been forgotten yet.
+    pub fn cooldown_finished(&self, now: Instant) -> bool {
+        self.cooldown
+            .as_ref()
+            .is_some_and(|cooldown| cooldown.is_finished(now))
+    }
+
+    /// Forget a shout cooldown that has run out by `now`, so the item stops
+    /// interpolating it. Returns true if there was one to forget.
+    pub fn end_finished_cooldown(&mut self, now: Instant) -> bool {
+        if !self.cooldown_finished(now) {
+            return false;
+        }
+        self.cooldown = None;
+        self.meter_level = 0.0;
+        self.extra.time_left = 0.0;
+        self.make_format_vars();
+        true
+    }
+
+    /// Record freshly-read extra data. Shout cooldowns are anchored to `now`
+    /// and interpolated from then on; see the cooldown module.
+    pub fn apply_extra_data(&mut self, extra: RelevantExtraData, now: Instant) {
         if extra.has_charge {
             self.meter_level = extra.charge * 100.0 / extra.max_charge;
+        } else if self.is_power() {
+            let reported = if extra.has_time_left {
+                extra.time_left
+            } else {
+                0.0
+            };
+            self.cooldown = Cooldown::resync(self.cooldown.as_ref(), now, reported);
+            if let Some(cooldown) = self.cooldown.as_ref() {
+                self.shout_cooldown = cooldown.duration();
+                self.meter_level = cooldown.percent_remaining(now);
+            } else {
+                self.meter_level = 0.0;
+            }
         } else if self.extra.has_time_left {
-            if self.is_power() {
-                if self.shout_cooldown <= extra.time_left {
-                    self.shout_cooldown = extra.time_left;
-                    self.meter_level = 0.0;
-                } else if self.shout_cooldown == 0.0 {
-                    self.meter_level = 0.0;
-                } else {
-                    self.meter_level = extra.time_left * 100.0 / self.shout_cooldown;
-                }
-            } else if extra.max_time == 0.0 {
+            if extra.max_time == 0.0 {
                 self.meter_level = 0.0;
             } else {
                 self.meter_level = extra.time_left * 100.0 / extra.max_time;
@@ -51,6 +51,11 @@ impl ItemCache {
         self.lru.is_empty()
     }
 
+    /// Every cached item, most recently used first. Doesn't count as a use.
+    pub fn iter(&self) -> impl Iterator<Item = &HudItem> {
+        self.lru.iter().map(|(_, item)| item)
+    }
+
     /// On load from save, we do not bother attempting to reconcile what
     /// we have cached with what the save state is. We merely enjoy the
     /// eternal sunshine of the spotless mind.
@@ -137,17 +142,23 @@ pub fn fetch_game_item(form_string: &str) -> HudItem {
     let boxed = formSpecToHudItem(&form_spec);
     let mut item = *boxed;
     item.refresh_extra_data();
+    crate::controller::recorder::record_item(&item);
     item
 }
 
 // This implementation is used by tests to generate random items without
-// attempting to communicate with a running game.
+// attempting to communicate with a running game. Items the simulated game
+// knows about, e.g. from a replayed session, come from there instead.
 #[cfg(test)]
 pub fn fetch_game_item(form_string: &str) -> HudItem {
     use super::color::random_color;
     use super::weapon::{WeaponEquipType, WeaponType};
     use crate::images::random_icon;
 
+    if let Some(item) = crate::controller::simulated::item(form_string) {
+        return item;
+    }
+
     let name = petname::petname(2, " ");
     let mut item = HudItem::preclassified(
         name,
@@ -6,7 +6,9 @@ pub mod ammo;
 pub mod armor;
 pub mod base;
 pub mod color;
+pub mod cooldown;
 pub mod food;
+pub mod form_spec;
 pub mod game_enums;
 pub mod huditem;
 pub mod item_cache;
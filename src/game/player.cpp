@@ -231,13 +231,6 @@ namespace player
 		return a_player->GetInventory([a_type](const RE::TESBoundObject& a_object) { return a_object.Is(a_type); });
 	}
 
-	uint32_t itemCount(const std::string& form_spec)
-	{
-		auto* form = helpers::formSpecToFormItem(form_spec);
-		if (!form) { return 0; }
-		return getInventoryCountByForm(form);
-	}
-
 	uint32_t getInventoryCountByForm(const RE::TESForm* form)
 	{
 		if (!form) { return 0; }
@@ -249,34 +242,39 @@ namespace player
 		return count;
 	}
 
-	bool hasItemOrSpell(const std::string& form_spec)
+	rust::Vec<InventoryEntry> inventorySnapshot()
 	{
-		if (form_spec.find(std::string("_proxy")) != std::string::npos) { return true; }
-		auto* form = helpers::formSpecToFormItem(form_spec);
-		if (!form)
-		{
-			rlog::warn("unable to turn string formspec into valid form in-game: {}"sv, form_spec);
-			return false;
-		}
-
+		rust::Vec<InventoryEntry> snapshot;
 		auto* thePlayer = RE::PlayerCharacter::GetSingleton();
-		auto has_it     = false;
-		auto formType   = form->GetFormType();
-		if (RE::FormType::Spell == formType)
-		{
-			auto* spell = form->As<RE::SpellItem>();
-			has_it      = thePlayer->HasSpell(spell);
-		}
-		else if (RE::FormType::Shout == formType)
+		if (!thePlayer) { return snapshot; }
+
+		std::vector<std::pair<std::string, uint32_t>> found;
+		const auto addForm = [&found](RE::TESForm* form, uint32_t count) {
+			if (form && count > 0) { found.emplace_back(helpers::makeFormSpecString(form), count); }
+		};
+		const auto addSpellList = [&addForm](RE::TESSpellList::SpellData* effects) {
+			if (!effects || !effects->spells) { return; }
+			for (uint32_t i = 0; i < effects->numSpells; ++i) { addForm(effects->spells[i], 1); }
+		};
+
+		for (const auto& [item, inv_data] : thePlayer->GetInventory())
 		{
-			const auto shout = form->As<RE::TESShout>();
-			has_it           = shouts::has_shout(thePlayer, shout);
+			const auto& [num_items, entry] = inv_data;
+			if (num_items > 0) { addForm(item, static_cast<uint32_t>(num_items)); }
 		}
-		else { has_it = inventoryCount(form, formType, thePlayer) > 0; }
-
-		rlog::trace("player has: {}; name='{}'; formID={};"sv, has_it, helpers::nameAsUtf8(form), form_spec);
-
-		return has_it;
+		for (auto* spell : thePlayer->addedSpells) { addForm(spell, 1); }
+		if (auto* base = thePlayer->GetActorBase()) { addSpellList(base->actorEffects); }
+		if (auto* race = thePlayer->GetRace()) { addSpellList(race->actorEffects); }
+		// Knowing a shout is more than having it in a spell list, so the game has to tell us.
+		for (auto* shout : shouts::knownShouts(thePlayer)) { addForm(shout, 1); }
+
+		// Rust looks entries up by binary search, so the order must match Rust's string order.
+		std::sort(found.begin(), found.end());
+		snapshot.reserve(found.size());
+		for (const auto& [spec, count] : found) { snapshot.push_back(InventoryEntry{ rust::String(spec), count }); }
+
+		rlog::debug("inventory snapshot has {} entries"sv, snapshot.size());
+		return snapshot;
 	}
 
 	void reequipHand(Action which, const std::string& form_spec, const std::string& nameToMatch)
@@ -44,8 +44,7 @@ namespace player
 
 	void consumePotion(const std::string& form_spec);
 
-	bool hasItemOrSpell(const std::string& form_spec);
-	uint32_t itemCount(const std::string& form_spec);
+	rust::Vec<InventoryEntry> inventorySnapshot();
 	uint32_t staminaPotionCount();
 	uint32_t healthPotionCount();
 	uint32_t magickaPotionCount();
@@ -15,6 +15,53 @@ namespace shouts
 		return func(a_actor, a_shout);
 	}
 
+	// Asking the game about every shout form is a walk over the whole form array, far
+	// too much for each inventory snapshot. Shouts are learned rarely, so we remember.
+	static std::vector<RE::TESShout*> knownShoutForms;
+	static bool knownShoutsFound = false;
+	static std::mutex knownShoutsLock;
+
+	std::vector<RE::TESShout*> knownShouts(RE::PlayerCharacter* player)
+	{
+		std::lock_guard<std::mutex> guard(knownShoutsLock);
+		if (knownShoutsFound || !player) { return knownShoutForms; }
+
+		auto* data_handler = RE::TESDataHandler::GetSingleton();
+		if (!data_handler) { return knownShoutForms; }
+		for (auto* shout : data_handler->GetFormArray<RE::TESShout>())
+		{
+			if (shout && has_shout(player, shout)) { knownShoutForms.push_back(shout); }
+		}
+		knownShoutsFound = true;
+		rlog::debug("player knows {} shouts"sv, knownShoutForms.size());
+		return knownShoutForms;
+	}
+
+	void recheckKnownShout(RE::TESShout* shout)
+	{
+		auto* player = RE::PlayerCharacter::GetSingleton();
+		if (!shout || !player) { return; }
+
+		std::lock_guard<std::mutex> guard(knownShoutsLock);
+		// Not looked for yet, so the first lookup will ask about this one too.
+		if (!knownShoutsFound) { return; }
+		const auto found = std::find(knownShoutForms.begin(), knownShoutForms.end(), shout);
+		const auto known = has_shout(player, shout);
+		if (known && found == knownShoutForms.end())
+		{
+			rlog::debug("player learned a shout; name='{}';"sv, helpers::nameAsUtf8(shout));
+			knownShoutForms.push_back(shout);
+		}
+		else if (!known && found != knownShoutForms.end()) { knownShoutForms.erase(found); }
+	}
+
+	void forgetKnownShouts()
+	{
+		std::lock_guard<std::mutex> guard(knownShoutsLock);
+		knownShoutForms.clear();
+		knownShoutsFound = false;
+	}
+
 	void unequip_spell(RE::BSScript::IVirtualMachine* a_vm,
 		RE::VMStackID a_stack_id,
 		RE::Actor* a_actor,
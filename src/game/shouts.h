@@ -3,6 +3,12 @@
 namespace shouts
 {
 	bool has_shout(RE::Actor* a_actor, RE::TESShout* a_shout);
+	// The shouts the player knows. Found by asking about every shout once, then kept up to date.
+	std::vector<RE::TESShout*> knownShouts(RE::PlayerCharacter* a_player);
+	// Ask the game again about one shout, after something may have taught it to the player.
+	void recheckKnownShout(RE::TESShout* a_shout);
+	// Called on load and new game, since the next player may know other shouts.
+	void forgetKnownShouts();
 	void equipShoutByForm(RE::TESForm* a_form, RE::PlayerCharacter*& a_player);
 	void unequipShoutSlot(RE::PlayerCharacter*& a_player);
 
@@ -0,0 +1,600 @@
+//! Frame animations for the HUD, such as the highlight drawn over a slot.
+//!
+//! An animation is a strip of SVG frames in a directory of its own, played
+//! once over a duration and optionally faded out as it goes. Running
+//! animations are kept as columns of plain data, one entry per animation in
+//! each, so advancing them is a loop over a few arrays and nothing more. The
+//! draw plan asks for the frames to draw each frame and hands them to the
+//! renderer like any other image.
+//!
+//! Each strip is rasterized into one sprite sheet, so an animation is one
+//! texture instead of one per frame. The first time a strip is played, a
+//! worker thread rasterizes its sheet; the renderer skips the animation until
+//! it can take the finished sheet, so playing a strip never waits on it.
+
+use std::collections::HashMap;
+use std::path::PathBuf;
+use std::sync::{Mutex, MutexGuard};
+use std::time::Instant;
+
+use once_cell::sync::Lazy;
+
+use super::batch::rasterize_batch;
+use crate::plugin::{Color, LoadedImage, Point, RasterRequest, SpriteSheet};
+
+/// Path for animation strips relative to the game dir. One directory per strip.
+#[cfg(not(test))]
+const ANIMATIONS_PATH: &str = "data/SKSE/plugins/resources/animations/";
+#[cfg(test)]
+const ANIMATIONS_PATH: &str = "installer/core/SKSE/plugins/resources/animations/";
+
+static ANIMATIONS: Lazy<Mutex<Animations>> = Lazy::new(|| Mutex::new(Animations::default()));
+/// Empty pixels around every frame on a sprite sheet. Bilinear filtering at a
+/// frame's edge samples past it, and would otherwise pick up the next frame.
+const SHEET_GUTTER: u32 = 2;
+
+/// Frame counts for the strips we've played, by strip name.
+static STRIP_FRAMES: Lazy<Mutex<HashMap<String, u32>>> = Lazy::new(|| Mutex::new(HashMap::new()));
+/// How far along each played strip's sprite sheet is, by strip name.
+static SHEETS: Lazy<Mutex<HashMap<String, SheetLoad>>> = Lazy::new(|| Mutex::new(HashMap::new()));
+
+/// Where a strip's sprite sheet is on its way to the renderer.
+#[derive(Debug)]
+enum SheetLoad {
+    /// A worker is rasterizing it.
+    Rasterizing,
+    /// Rasterized, waiting for the renderer to take it.
+    Ready(SpriteSheet),
+    /// The renderer has it.
+    Taken,
+    /// It couldn't be rasterized. We don't try again.
+    Failed,
+}
+
+/// How an animation's progress is bent over its duration.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub enum Easing {
+    #[default]
+    Linear,
+    /// Starts slow, ends fast.
+    InCubic,
+    /// Starts fast, ends slow.
+    OutCubic,
+}
+
+impl Easing {
+    /// Map progress from 0 to 1 onto the curve. Clamped, so callers needn't.
+    pub fn apply(&self, progress: f32) -> f32 {
+        let t = progress.clamp(0.0, 1.0);
+        match self {
+            Easing::Linear => t,
+            Easing::InCubic => t * t * t,
+            Easing::OutCubic => 1.0 - (1.0 - t).powi(3),
+        }
+    }
+}
+
+/// Everything needed to start an animation.
+#[derive(Debug, Clone)]
+pub struct AnimationSpec {
+    /// The strip's directory name, e.g. "highlight".
+    pub strip: String,
+    pub frames: u32,
+    pub center: Point,
+    pub size: Point,
+    pub color: Color,
+    /// Seconds.
+    pub duration: f32,
+    /// How the frames advance.
+    pub easing: Easing,
+    /// Fade from the color's alpha to nothing over the duration.
+    pub fade_out: bool,
+}
+
+/// One running animation's frame, ready to draw.
+#[derive(Debug, Clone, PartialEq)]
+pub struct AnimationFrame {
+    pub strip: String,
+    pub frame: u32,
+    pub center: Point,
+    pub size: Point,
+    /// The alpha is faded already, if the animation fades.
+    pub color: Color,
+}
+
+/// Running animations, one column per field.
+#[derive(Debug, Default)]
+pub struct Animations {
+    strip: Vec<String>,
+    frames: Vec<u32>,
+    started: Vec<Instant>,
+    duration: Vec<f32>,
+    easing: Vec<Easing>,
+    fade_out: Vec<bool>,
+    center: Vec<Point>,
+    size: Vec<Point>,
+    color: Vec<Color>,
+}
+
+impl Animations {
+    pub fn start(&mut self, spec: AnimationSpec, now: Instant) {
+        if spec.frames == 0 || spec.color.a == 0 {
+            return;
+        }
+        self.strip.push(spec.strip);
+        self.frames.push(spec.frames);
+        self.started.push(now);
+        // A zero duration would never show a frame; show the first one once.
+        self.duration.push(spec.duration.max(f32::EPSILON));
+        self.easing.push(spec.easing);
+        self.fade_out.push(spec.fade_out);
+        self.center.push(spec.center);
+        self.size.push(spec.size);
+        self.color.push(spec.color);
+    }
+
+    pub fn len(&self) -> usize {
+        self.strip.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.strip.is_empty()
+    }
+
+    /// How far along an animation is, from 0 to 1 and beyond once it's over.
+    fn progress(&self, index: usize, now: Instant) -> f32 {
+        now.saturating_duration_since(self.started[index])
+            .as_secs_f32()
+            / self.duration[index]
+    }
+
+    /// Drop the animations that have played out. Order isn't kept.
+    pub fn retire(&mut self, now: Instant) {
+        let mut index = 0;
+        while index < self.len() {
+            if self.progress(index, now) >= 1.0 {
+                self.strip.swap_remove(index);
+                self.frames.swap_remove(index);
+                self.started.swap_remove(index);
+                self.duration.swap_remove(index);
+                self.easing.swap_remove(index);
+                self.fade_out.swap_remove(index);
+                self.center.swap_remove(index);
+                self.size.swap_remove(index);
+                self.color.swap_remove(index);
+            } else {
+                index += 1;
+            }
+        }
+    }
+
+    /// The frame each running animation shows at `now`.
+    pub fn frames_at(&self, now: Instant) -> Vec<AnimationFrame> {
+        (0..self.len())
+            .filter_map(|index| {
+                let progress = self.progress(index, now);
+                if progress >= 1.0 {
+                    return None;
+                }
+                let frames = self.frames[index];
+                let eased = self.easing[index].apply(progress);
+                let frame = ((eased * frames as f32) as u32).min(frames - 1);
+                let mut color = self.color[index].clone();
+                if self.fade_out[index] {
+                    color.a = (color.a as f32 * (1.0 - progress)).round() as u8;
+                }
+                Some(AnimationFrame {
+                    strip: self.strip[index].clone(),
+                    frame,
+                    center: self.center[index].clone(),
+                    size: self.size[index].clone(),
+                    color,
+                })
+            })
+            .collect()
+    }
+}
+
+/// Start playing a strip. Its frames are counted the first time it's played.
+pub fn start_animation(strip: String, center: Point, size: Point, color: Color, duration: f32) {
+    let frames = strip_frames(&strip);
+    if frames == 0 {
+        log::warn!("Animation strip '{strip}' has no frames; not playing it.");
+        return;
+    }
+    let spec = AnimationSpec {
+        strip,
+        frames,
+        center,
+        size,
+        color,
+        duration,
+        easing: Easing::Linear,
+        fade_out: true,
+    };
+    {
+        let mut sheets = sheets();
+        if !sheets.contains_key(&spec.strip) {
+            rasterize_in_background(spec.strip.clone(), &mut sheets);
+        }
+    }
+    animations().start(spec, Instant::now());
+}
+
+/// Hand the renderer a strip's sheet if it's ready. Until then the sheet is
+/// empty, and the renderer skips the strip's frames. A renderer asking for a
+/// sheet it already took has had it evicted, so we rasterize it again.
+pub fn take_sprite_sheet(strip: String) -> SpriteSheet {
+    let mut sheets = sheets();
+    match sheets.remove(&strip) {
+        Some(SheetLoad::Ready(sheet)) => {
+            sheets.insert(strip, SheetLoad::Taken);
+            sheet
+        }
+        Some(SheetLoad::Taken) | None => {
+            rasterize_in_background(strip, &mut sheets);
+            SpriteSheet::default()
+        }
+        Some(load) => {
+            sheets.insert(strip, load);
+            SpriteSheet::default()
+        }
+    }
+}
+
+/// Rasterize a strip's sheet on a worker thread, so neither the game nor the
+/// renderer waits for it.
+fn rasterize_in_background(strip: String, loads: &mut HashMap<String, SheetLoad>) {
+    loads.insert(strip.clone(), SheetLoad::Rasterizing);
+    let worker_strip = strip.clone();
+    let spawned = std::thread::Builder::new()
+        .name("SoulsyHUD sprite sheet".to_string())
+        .spawn(move || {
+            let sheet = rasterize_sprite_sheet(worker_strip.clone());
+            let load = if sheet.frames == 0 {
+                log::warn!("Failed to load animation '{worker_strip}'; it won't be drawn.");
+                SheetLoad::Failed
+            } else {
+                SheetLoad::Ready(sheet)
+            };
+            sheets().insert(worker_strip, load);
+        });
+    if let Err(e) = spawned {
+        log::warn!("Unable to start loading animation '{strip}'; {e:#}");
+        loads.insert(strip, SheetLoad::Failed);
+    }
+}
+
+fn sheets() -> MutexGuard<'static, HashMap<String, SheetLoad>> {
+    SHEETS
+        .lock()
+        .expect("Unrecoverable runtime problem: cannot acquire animations lock.")
+}
+
+/// The frames to draw right now. Finished animations are dropped first.
+pub fn current_animation_frames(now: Instant) -> Vec<AnimationFrame> {
+    let mut animations = animations();
+    if animations.is_empty() {
+        return Vec::new();
+    }
+    animations.retire(now);
+    animations.frames_at(now)
+}
+
+fn animations() -> MutexGuard<'static, Animations> {
+    ANIMATIONS
+        .lock()
+        .expect("Unrecoverable runtime problem: cannot acquire animations lock.")
+}
+
+/// The svg files in a strip's directory, in frame order. Frames are numbered,
+/// so "frame10" sorts after "frame9".
+fn strip_files(strip: &str) -> Vec<PathBuf> {
+    let directory: PathBuf = [ANIMATIONS_PATH, strip].iter().collect();
+    let Ok(entries) = std::fs::read_dir(&directory) else {
+        return Vec::new();
+    };
+    let mut files: Vec<PathBuf> = entries
+        .filter_map(|entry| entry.ok().map(|entry| entry.path()))
+        .filter(|path| path.extension().is_some_and(|ext| ext == "svg"))
+        .collect();
+    files.sort_by_key(|path| {
+        let name = path
+            .file_name()
+            .unwrap_or_default()
+            .to_string_lossy()
+            .to_string();
+        (name.len(), name)
+    });
+    files
+}
+
+fn strip_frames(strip: &str) -> u32 {
+    let mut counts = STRIP_FRAMES
+        .lock()
+        .expect("Unrecoverable runtime problem: cannot acquire animations lock.");
+    *counts
+        .entry(strip.to_string())
+        .or_insert_with(|| strip_files(strip).len() as u32)
+}
+
+/// Lay frames out in a grid as close to square as we can, so big strips
+/// still fit on an atlas page. Every cell has a gutter of empty pixels on
+/// all sides. Frames smaller than the first are placed at the top left of
+/// their cell, inside the gutter.
+pub fn compose_sheet(frames: &[LoadedImage]) -> SpriteSheet {
+    let Some(first) = frames.first() else {
+        return SpriteSheet::default();
+    };
+    let frame_width = first.width;
+    let frame_height = first.height;
+    let cell_width = frame_width + 2 * SHEET_GUTTER;
+    let cell_height = frame_height + 2 * SHEET_GUTTER;
+    let count = frames.len() as u32;
+    let columns = (count as f32).sqrt().ceil() as u32;
+    let rows = (count + columns - 1) / columns;
+    let width = cell_width * columns;
+    let height = cell_height * rows;
+
+    let mut buffer = vec![0u8; (width * height * 4) as usize];
+    for (index, frame) in frames.iter().enumerate() {
+        let index = index as u32;
+        let left = (index % columns) * cell_width + SHEET_GUTTER;
+        let top = (index / columns) * cell_height + SHEET_GUTTER;
+        let copy_width = frame.width.min(frame_width) as usize * 4;
+        for row in 0..frame.height.min(frame_height) {
+            let from = (row * frame.width * 4) as usize;
+            let to = (((top + row) * width + left) * 4) as usize;
+            buffer[to..to + copy_width].copy_from_slice(&frame.buffer[from..from + copy_width]);
+        }
+    }
+
+    SpriteSheet {
+        image: LoadedImage {
+            width,
+            height,
+            buffer,
+        },
+        frames: count,
+        columns,
+        frame_width,
+        frame_height,
+        gutter: SHEET_GUTTER,
+    }
+}
+
+/// Rasterize every frame of a strip into one sprite sheet. An empty sheet
+/// means the strip couldn't be loaded.
+pub fn rasterize_sprite_sheet(strip: String) -> SpriteSheet {
+    let requests: Vec<RasterRequest> = strip_files(&strip)
+        .iter()
+        .map(|path| RasterRequest {
+            path: path.to_string_lossy().to_string(),
+            maxdim: 0,
+        })
+        .collect();
+    let frames = rasterize_batch(&requests);
+    if frames.iter().any(|frame| frame.buffer.is_empty()) {
+        return SpriteSheet::default();
+    }
+    let sheet = compose_sheet(&frames);
+    log::debug!(
+        "Built sprite sheet for animation '{strip}'; frames={}; size={}x{}",
+        sheet.frames,
+        sheet.image.width,
+        sheet.image.height
+    );
+    sheet
+}
+
+#[cfg(test)]
+mod tests {
+    use std::time::Duration;
+
+    use super::*;
+
+    fn spec(frames: u32, duration: f32) -> AnimationSpec {
+        AnimationSpec {
+            strip: "highlight".to_string(),
+            frames,
+            center: Point { x: 10.0, y: 10.0 },
+            size: Point { x: 20.0, y: 20.0 },
+            color: Color {
+                r: 255,
+                g: 255,
+                b: 255,
+                a: 200,
+            },
+            duration,
+            easing: Easing::Linear,
+            fade_out: false,
+        }
+    }
+
+    fn at(start: Instant, seconds: f32) -> Instant {
+        start + Duration::from_secs_f32(seconds)
+    }
+
+    #[test]
+    fn easing_curves_hit_their_ends() {
+        for easing in [Easing::Linear, Easing::InCubic, Easing::OutCubic] {
+            assert_eq!(easing.apply(0.0), 0.0);
+            assert_eq!(easing.apply(1.0), 1.0);
+            assert_eq!(easing.apply(-1.0), 0.0);
+            assert_eq!(easing.apply(3.0), 1.0);
+        }
+        assert!((Easing::InCubic.apply(0.5) - 0.125).abs() < 1e-6);
+        assert!((Easing::OutCubic.apply(0.5) - 0.875).abs() < 1e-6);
+        assert_eq!(Easing::Linear.apply(0.25), 0.25);
+    }
+
+    #[test]
+    fn frames_advance_with_time() {
+        let start = Instant::now();
+        let mut animations = Animations::default();
+        animations.start(spec(4, 1.0), start);
+
+        let frame_at = |seconds: f32| animations.frames_at(at(start, seconds))[0].frame;
+        assert_eq!(frame_at(0.0), 0);
+        assert_eq!(frame_at(0.24), 0);
+        assert_eq!(frame_at(0.26), 1);
+        assert_eq!(frame_at(0.6), 2);
+        assert_eq!(frame_at(0.99), 3);
+        assert!(animations.frames_at(at(start, 1.0)).is_empty());
+    }
+
+    #[test]
+    fn easing_bends_the_frame_timing() {
+        let start = Instant::now();
+        let mut animations = Animations::default();
+        animations.start(
+            AnimationSpec {
+                easing: Easing::InCubic,
+                ..spec(4, 1.0)
+            },
+            start,
+        );
+        // Halfway through, an ease-in has only covered an eighth of the frames.
+        assert_eq!(animations.frames_at(at(start, 0.5))[0].frame, 0);
+        assert_eq!(animations.frames_at(at(start, 0.9))[0].frame, 2);
+    }
+
+    #[test]
+    fn fading_animations_fade() {
+        let start = Instant::now();
+        let mut animations = Animations::default();
+        animations.start(
+            AnimationSpec {
+                fade_out: true,
+                ..spec(2, 2.0)
+            },
+            start,
+        );
+        assert_eq!(animations.frames_at(start)[0].color.a, 200);
+        assert_eq!(animations.frames_at(at(start, 1.0))[0].color.a, 100);
+        assert_eq!(animations.frames_at(at(start, 1.5))[0].color.a, 50);
+    }
+
+    #[test]
+    fn finished_animations_retire() {
+        let start = Instant::now();
+        let mut animations = Animations::default();
+        animations.start(spec(3, 1.0), start);
+        animations.start(spec(3, 3.0), start);
+        animations.start(spec(3, 2.0), at(start, 0.5));
+        // Nothing to draw means nothing to play.
+        animations.start(spec(0, 1.0), start);
+        assert_eq!(animations.len(), 3);
+
+        animations.retire(at(start, 1.5));
+        assert_eq!(animations.len(), 2);
+        animations.retire(at(start, 2.5));
+        assert_eq!(animations.len(), 1);
+        assert_eq!(animations.frames_at(at(start, 2.5)).len(), 1);
+        animations.retire(at(start, 3.0));
+        assert!(animations.is_empty());
+    }
+
+    #[test]
+    fn sheets_lay_frames_out_in_a_grid() {
+        let frame = |shade: u8| LoadedImage {
+            width: 2,
+            height: 2,
+            buffer: vec![shade; 16],
+        };
+        let frames: Vec<LoadedImage> = (1..=5).map(frame).collect();
+        let sheet = compose_sheet(&frames);
+        assert_eq!(sheet.frames, 5);
+        assert_eq!(sheet.columns, 3);
+        assert_eq!(sheet.gutter, SHEET_GUTTER);
+        // Cells are the frame plus a gutter on each side.
+        let cell = 2 + 2 * SHEET_GUTTER;
+        assert_eq!(
+            (sheet.image.width, sheet.image.height),
+            (3 * cell, 2 * cell)
+        );
+        assert_eq!(sheet.image.buffer.len(), (3 * cell * 2 * cell * 4) as usize);
+
+        let width = sheet.image.width;
+        let pixel = |x: u32, y: u32| sheet.image.buffer[((y * width + x) * 4) as usize];
+        let inside = |column: u32, row: u32, dx: u32, dy: u32| {
+            pixel(
+                column * cell + SHEET_GUTTER + dx,
+                row * cell + SHEET_GUTTER + dy,
+            )
+        };
+        assert_eq!(inside(0, 0, 0, 0), 1);
+        assert_eq!(inside(1, 0, 1, 1), 2);
+        assert_eq!(inside(2, 0, 1, 0), 3);
+        assert_eq!(inside(0, 1, 0, 1), 4);
+        assert_eq!(inside(1, 1, 1, 1), 5);
+        // The sixth cell is empty.
+        assert_eq!(inside(2, 1, 0, 0), 0);
+
+        // Nothing but the frames themselves is drawn, so no frame's edge
+        // filters into another.
+        for y in 0..sheet.image.height {
+            for x in 0..width {
+                let in_frame = (x % cell).wrapping_sub(SHEET_GUTTER) < 2
+                    && (y % cell).wrapping_sub(SHEET_GUTTER) < 2;
+                if !in_frame {
+                    assert_eq!(pixel(x, y), 0, "gutter pixel {x},{y}");
+                }
+            }
+        }
+
+        assert_eq!(compose_sheet(&[]).frames, 0);
+    }
+
+    #[test]
+    fn strips_are_found_in_frame_order() {
+        let files = strip_files("highlight");
+        assert!(!files.is_empty(), "the installer ships the highlight strip");
+        let names: Vec<String> = files
+            .iter()
+            .map(|path| path.file_name().unwrap().to_string_lossy().to_string())
+            .collect();
+        assert_eq!(names[0], "frame1.svg");
+        assert_eq!(strip_frames("highlight"), files.len() as u32);
+        assert!(strip_files("no such strip").is_empty());
+    }
+
+    /// Ask for a strip's sheet the way the renderer does, once a frame,
+    /// until it's ready.
+    fn wait_for_sheet(strip: &str) -> SpriteSheet {
+        let deadline = Instant::now() + Duration::from_secs(10);
+        loop {
+            let sheet = take_sprite_sheet(strip.to_string());
+            if sheet.frames > 0 {
+                return sheet;
+            }
+            assert!(
+                Instant::now() < deadline,
+                "the sheet for {strip} never came"
+            );
+            std::thread::sleep(Duration::from_millis(5));
+        }
+    }
+
+    #[test]
+    fn sheets_load_in_the_background_and_again_after_eviction() {
+        let sheet = wait_for_sheet("highlight");
+        assert_eq!(sheet.frames, strip_frames("highlight"));
+        assert!(!sheet.image.buffer.is_empty());
+
+        // Asking again means the renderer lost it; it comes back the same.
+        assert_eq!(take_sprite_sheet("highlight".to_string()).frames, 0);
+        assert_eq!(wait_for_sheet("highlight").image.buffer, sheet.image.buffer);
+
+        // A strip that can't load is never handed over, and not retried.
+        let missing = "no such strip".to_string();
+        assert_eq!(take_sprite_sheet(missing.clone()).frames, 0);
+        let deadline = Instant::now() + Duration::from_secs(10);
+        while !matches!(sheets().get(&missing), Some(SheetLoad::Failed)) {
+            assert!(Instant::now() < deadline, "the missing strip never failed");
+            std::thread::sleep(Duration::from_millis(5));
+        }
+        assert_eq!(take_sprite_sheet(missing.clone()).frames, 0);
+        assert!(matches!(sheets().get(&missing), Some(SheetLoad::Failed)));
+    }
+}
@@ -0,0 +1,736 @@
+//! Pack rasterized images onto a few large atlas pages, so the renderer
+//! binds one texture for most of the HUD instead of one per icon.
+//!
+//! This is a shelf packer. Each page is cut into horizontal shelves; an image
+//! goes on the shelf that fits it with the least wasted height, or on a new
+//! shelf below the others. HUD images are mostly icons of a handful of sizes,
+//! which shelves handle well.
+//!
+//! Pages, and images too big for a page, count against the player's texture
+//! budget (see budget.rs). Images are placed while the renderer builds a
+//! frame, and that frame may already be drawing from any page we have, so
+//! placing never takes anything away or writes over anything: when there's no
+//! room, we make a new page, even if that puts us over budget. Once the frame
+//! has been drawn, the renderer reports what it drew, and then we release the
+//! least recently drawn pages that weren't in it until we're back within
+//! budget. Nothing is ever moved, so there's no repacking and no texture
+//! copying. The keys of the images that went away are handed back to the
+//! caller, which forgets them and rasterizes them again if they're ever drawn
+//! again. Pinned images (the button glyphs, loaded once at startup) live on
+//! pages that are never released.
+//!
+//! This module only does the bookkeeping. C++ owns the textures themselves,
+//! uploads the pixels where it's told, reports once a frame which textures it
+//! drew, and then releases what it's told to release.
+
+use std::collections::HashMap;
+use std::sync::Mutex;
+
+use once_cell::sync::Lazy;
+
+use super::budget::TextureBudget;
+use crate::plugin::{AtlasPlacement, TextureEvictions};
+
+/// Width and height of an atlas page, in pixels. 16MB of RGBA.
+pub const PAGE_SIZE: u32 = 2048;
+/// Transparent pixels around each image, so filtering never bleeds in a neighbor.
+pub const PADDING: u32 = 2;
+/// The texture budget until settings say otherwise. Four pages.
+pub const DEFAULT_BUDGET: u64 = 64 * MEGABYTE;
+const MEGABYTE: u64 = 1024 * 1024;
+/// A shelf is a snug fit if the space wasted above the image is no more than
+/// 1/SNUG_FRACTION of the image's height.
+const SNUG_FRACTION: u32 = 3;
+/// Ids for images with their own textures start here; lower ids are pages.
+const FIRST_TEXTURE_ID: u32 = 1 << 16;
+
+static ATLAS: Lazy<Mutex<Atlas>> =
+    Lazy::new(|| Mutex::new(Atlas::new(PAGE_SIZE, PADDING, DEFAULT_BUDGET)));
+
+fn atlas() -> std::sync::MutexGuard<'static, Atlas> {
+    ATLAS
+        .lock()
+        .expect("Unrecoverable runtime problem: cannot acquire atlas lock. Exiting.")
+}
+
+/// Find room in the atlas for an image. Called by C++ when it loads an image.
+/// If `placed` is false, the image is too big for a page and C++ should give
+/// it a texture of its own.
+pub fn atlas_place(key: String, width: u32, height: u32, pinned: bool) -> AtlasPlacement {
+    let mut atlas = atlas();
+    let padding = atlas.padding;
+    let page_size = atlas.page_size;
+    match atlas.place(&key, width, height, pinned) {
+        Placement::Placed { slot, fresh } => AtlasPlacement {
+            placed: true,
+            fresh,
+            id: Unit::Page(slot.page).id(),
+            page: slot.page as u32,
+            page_size,
+            x: slot.x,
+            y: slot.y,
+            width: slot.width,
+            height: slot.height,
+            padding,
+        },
+        Placement::OwnTexture { id } => AtlasPlacement {
+            id,
+            width,
+            height,
+            ..Default::default()
+        },
+        Placement::Refused => AtlasPlacement::default(),
+    }
+}
+
+/// C++ tells us once a frame, after drawing it, which textures it drew, by
+/// the ids we gave it. We answer with what it should release to get back
+/// within budget. None of it was drawn this frame.
+pub fn textures_drawn(ids: &[u32]) -> TextureEvictions {
+    let mut atlas = atlas();
+    atlas.drawn(ids)
+}
+
+/// Apply the texture budget from the settings, in megabytes.
+pub fn set_texture_budget(megabytes: u32) {
+    let mut atlas = atlas();
+    let limit = megabytes as u64 * MEGABYTE;
+    if atlas.budget.limit() != limit {
+        atlas.set_budget(limit);
+        log::info!("{}", atlas.report());
+    }
+}
+
+/// A line about texture memory for the logs and crash reports. Doesn't wait
+/// for the lock, because a crash might have happened while it was held.
+pub fn texture_budget_report() -> String {
+    match ATLAS.try_lock() {
+        Ok(atlas) => atlas.report(),
+        Err(_) => "texture memory: unavailable; the atlas is busy".to_string(),
+    }
+}
+
+/// Where an image sits on a page. `x` and `y` are the image's top left
+/// corner; its padding lies outside this rectangle.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Slot {
+    pub page: usize,
+    pub x: u32,
+    pub y: u32,
+    pub width: u32,
+    pub height: u32,
+}
+
+/// What happened when we asked for room.
+#[derive(Debug, Clone)]
+pub enum Placement {
+    /// The image has a home on a page. It's `fresh` if its pixels need
+    /// uploading.
+    Placed { slot: Slot, fresh: bool },
+    /// The image is bigger than a page and gets a texture of its own, which
+    /// counts against the budget under this id.
+    OwnTexture { id: u32 },
+    /// The image has no pixels.
+    Refused,
+}
+
+/// What the budget counts: whole atlas pages, and images with textures of
+/// their own.
+#[derive(Debug, Clone, Copy, Hash, PartialEq, Eq)]
+enum Unit {
+    Page(usize),
+    Texture(u32),
+}
+
+impl Unit {
+    /// The id C++ hands back when it draws from this unit. Zero means untracked.
+    fn id(self) -> u32 {
+        match self {
+            Unit::Page(page) => page as u32 + 1,
+            Unit::Texture(texture) => FIRST_TEXTURE_ID + texture,
+        }
+    }
+
+    fn from_id(id: u32) -> Option<Self> {
+        match id {
+            0 => None,
+            id if id < FIRST_TEXTURE_ID => Some(Unit::Page(id as usize - 1)),
+            id => Some(Unit::Texture(id - FIRST_TEXTURE_ID)),
+        }
+    }
+}
+
+#[derive(Debug, Clone)]
+struct Shelf {
+    y: u32,
+    height: u32,
+    used: u32,
+}
+
+#[derive(Debug, Clone)]
+struct Page {
+    /// False once C++ has been told to release the page's texture.
+    resident: bool,
+    pinned: bool,
+    shelves: Vec<Shelf>,
+    /// The top of the unused space under the last shelf.
+    bottom: u32,
+    keys: Vec<String>,
+    /// Pixels covered by images and their padding.
+    area: u64,
+}
+
+impl Page {
+    fn new(pinned: bool) -> Self {
+        Self {
+            resident: true,
+            pinned,
+            shelves: Vec::new(),
+            bottom: 0,
+            keys: Vec::new(),
+            area: 0,
+        }
+    }
+}
+
+/// The atlas bookkeeping: pages, their shelves, what's on them, and what
+/// all of it costs.
+#[derive(Debug)]
+pub struct Atlas {
+    page_size: u32,
+    padding: u32,
+    pages: Vec<Page>,
+    entries: HashMap<String, Slot>,
+    /// Images with textures of their own, and their budget units.
+    own_textures: HashMap<String, u32>,
+    own_texture_keys: HashMap<u32, String>,
+    next_texture: u32,
+    budget: TextureBudget<Unit>,
+}
+
+impl Atlas {
+    pub fn new(page_size: u32, padding: u32, budget: u64) -> Self {
+        Self {
+            page_size,
+            padding,
+            pages: Vec::new(),
+            entries: HashMap::new(),
+            own_textures: HashMap::new(),
+            own_texture_keys: HashMap::new(),
+            next_texture: 0,
+            budget: TextureBudget::new(budget),
+        }
+    }
+
+    /// Find room for an image, making a new page if we must. Images already
+    /// in the atlas keep the room they have. Nothing is evicted here; see
+    /// `drawn()`.
+    pub fn place(&mut self, key: &str, width: u32, height: u32, pinned: bool) -> Placement {
+        if let Some(slot) = self.entries.get(key).copied() {
+            self.budget.touch(&Unit::Page(slot.page));
+            return Placement::Placed { slot, fresh: false };
+        }
+        if let Some(texture) = self.own_textures.get(key).copied() {
+            let unit = Unit::Texture(texture);
+            self.budget.touch(&unit);
+            return Placement::OwnTexture { id: unit.id() };
+        }
+
+        if width == 0 || height == 0 {
+            return Placement::Refused;
+        }
+        // The padded size, if it fits on a page. A side near u32::MAX would
+        // overflow once padded, so the sums are checked.
+        let on_page = |side: u32| {
+            self.padding
+                .checked_mul(2)
+                .and_then(|pad| side.checked_add(pad))
+                .filter(|outer| *outer <= self.page_size)
+        };
+        let (Some(outer_w), Some(outer_h)) = (on_page(width), on_page(height)) else {
+            let texture = self.next_texture;
+            self.next_texture += 1;
+            let unit = Unit::Texture(texture);
+            self.budget
+                .admit(unit, texture_bytes(width, height), pinned);
+            self.own_textures.insert(key.to_string(), texture);
+            self.own_texture_keys.insert(texture, key.to_string());
+            return Placement::OwnTexture { id: unit.id() };
+        };
+
+        let (page, shelf) = match self.find_room(outer_w, outer_h, pinned) {
+            Some(room) => room,
+            None => (self.new_page(pinned), None),
+        };
+        let slot = self.put(page, shelf, key, width, height);
+        self.budget.touch(&Unit::Page(page));
+        Placement::Placed { slot, fresh: true }
+    }
+
+    /// Note what a finished frame drew, by the ids `place()` handed out, then
+    /// evict what didn't make the cut until we're within budget. What was
+    /// drawn this frame is never evicted, even if that leaves us over.
+    pub fn drawn(&mut self, ids: &[u32]) -> TextureEvictions {
+        let units: Vec<Unit> = ids.iter().filter_map(|id| Unit::from_id(*id)).collect();
+        for unit in units.iter() {
+            self.budget.touch(unit);
+        }
+        let victims = self.budget.settle(|unit| units.contains(unit));
+        let mut evictions = TextureEvictions::default();
+        self.evict(victims, &mut evictions);
+        evictions
+    }
+
+    /// Change the budget. Anything that no longer fits is evicted after the
+    /// next frame is drawn.
+    pub fn set_budget(&mut self, limit: u64) {
+        self.budget.set_limit(limit);
+    }
+
+    /// Look up where an image is, if it's on a page.
+    pub fn get(&self, key: &str) -> Option<Slot> {
+        self.entries.get(key).copied()
+    }
+
+    /// How many pages have textures right now.
+    pub fn page_count(&self) -> usize {
+        self.pages.iter().filter(|p| p.resident).count()
+    }
+
+    /// The fraction of a page covered by images and their padding.
+    pub fn occupancy(&self, page: usize) -> f64 {
+        self.pages.get(page).map_or(0.0, |p| {
+            p.area as f64 / (self.page_size as f64 * self.page_size as f64)
+        })
+    }
+
+    /// Bytes of texture memory in use.
+    pub fn bytes_used(&self) -> u64 {
+        self.budget.used()
+    }
+
+    pub fn report(&self) -> String {
+        format!(
+            "texture memory: {}; {} atlas pages holding {} images, {} images in textures of their own",
+            self.budget,
+            self.page_count(),
+            self.entries.len(),
+            self.own_textures.len()
+        )
+    }
+
+    /// Find a page of the right kind with room, and the shelf to use on it;
+    /// `None` for the shelf means start a new one. We prefer a shelf the image
+    /// nearly fills, then a new shelf, then any shelf at all, so small images
+    /// don't strand the space above them on tall shelves while there's room
+    /// for shelves of their own.
+    fn find_room(
+        &self,
+        outer_w: u32,
+        outer_h: u32,
+        pinned: bool,
+    ) -> Option<(usize, Option<usize>)> {
+        let mut best: Option<(u32, usize, usize)> = None;
+        let mut new_shelf: Option<usize> = None;
+        for (page_idx, page) in self.pages.iter().enumerate() {
+            if !page.resident || page.pinned != pinned {
+                continue;
+            }
+            for (shelf_idx, shelf) in page.shelves.iter().enumerate() {
+                if shelf.height >= outer_h && self.page_size - shelf.used >= outer_w {
+                    let waste = shelf.height - outer_h;
+                    if best.map_or(true, |(least, _, _)| waste < least) {
+                        best = Some((waste, page_idx, shelf_idx));
+                    }
+                }
+            }
+            if new_shelf.is_none() && self.page_size - page.bottom >= outer_h {
+                new_shelf = Some(page_idx);
+            }
+        }
+
+        let snug = best.filter(|(waste, _, _)| *waste * SNUG_FRACTION <= outer_h);
+        snug.map(|(_, page, shelf)| (page, Some(shelf)))
+            .or(new_shelf.map(|page| (page, None)))
+            .or(best.map(|(_, page, shelf)| (page, Some(shelf))))
+    }
+
+    /// A new, empty page of the right kind. A page C++ has released is made
+    /// again in the same place, so page numbers stay small.
+    fn new_page(&mut self, pinned: bool) -> usize {
+        let idx = self
+            .pages
+            .iter()
+            .position(|p| !p.resident)
+            .unwrap_or(self.pages.len());
+        if idx == self.pages.len() {
+            self.pages.push(Page::new(pinned));
+        } else {
+            self.pages[idx] = Page::new(pinned);
+        }
+        let page_bytes = texture_bytes(self.page_size, self.page_size);
+        self.budget.admit(Unit::Page(idx), page_bytes, pinned);
+        log::debug!("made atlas page {idx}; {}", self.budget);
+        idx
+    }
+
+    /// Drop what the budget evicted and tell C++ what to release.
+    fn evict(&mut self, victims: Vec<Unit>, evictions: &mut TextureEvictions) {
+        for unit in victims {
+            match unit {
+                Unit::Page(idx) => {
+                    let page = std::mem::replace(&mut self.pages[idx], Page::new(false));
+                    for key in page.keys.iter() {
+                        self.entries.remove(key);
+                    }
+                    evictions.keys.extend(page.keys);
+                    self.pages[idx].resident = false;
+                    evictions.pages.push(idx as u32);
+                }
+                Unit::Texture(texture) => {
+                    if let Some(key) = self.own_texture_keys.remove(&texture) {
+                        self.own_textures.remove(&key);
+                        evictions.keys.push(key);
+                    }
+                }
+            }
+        }
+        if !evictions.keys.is_empty() {
+            log::debug!(
+                "evicted {} images and {} atlas pages; {}",
+                evictions.keys.len(),
+                evictions.pages.len(),
+                self.budget
+            );
+        }
+    }
+
+    /// Put an image where `find_room()` said there was room for it.
+    fn put(
+        &mut self,
+        idx: usize,
+        shelf: Option<usize>,
+        key: &str,
+        width: u32,
+        height: u32,
+    ) -> Slot {
+        let padding = self.padding;
+        let outer_w = width + 2 * padding;
+        let outer_h = height + 2 * padding;
+        let page = &mut self.pages[idx];
+
+        let shelf = match shelf {
+            Some(i) => &mut page.shelves[i],
+            None => {
+                page.shelves.push(Shelf {
+                    y: page.bottom,
+                    height: outer_h,
+                    used: 0,
+                });
+                page.bottom += outer_h;
+                page.shelves.last_mut().expect("we just pushed a shelf")
+            }
+        };
+
+        let slot = Slot {
+            page: idx,
+            x: shelf.used + padding,
+            y: shelf.y + padding,
+            width,
+            height,
+        };
+        shelf.used += outer_w;
+        page.area += outer_w as u64 * outer_h as u64;
+        page.keys.push(key.to_string());
+        self.entries.insert(key.to_string(), slot);
+        slot
+    }
+}
+
+/// What an RGBA texture of this size costs.
+fn texture_bytes(width: u32, height: u32) -> u64 {
+    width as u64 * height as u64 * 4
+}
+
+#[cfg(test)]
+mod tests {
+    use rand::rngs::StdRng;
+    use rand::{Rng, SeedableRng};
+
+    use super::*;
+
+    fn outer(slot: &Slot, padding: u32) -> (u32, u32, u32, u32) {
+        (
+            slot.x - padding,
+            slot.y - padding,
+            slot.x + slot.width + padding,
+            slot.y + slot.height + padding,
+        )
+    }
+
+    /// Check that every resident image is inside its page and that no two
+    /// images (padding included) overlap.
+    fn assert_no_overlaps(atlas: &Atlas) {
+        let slots: Vec<(&String, Slot)> = atlas.entries.iter().map(|(k, v)| (k, *v)).collect();
+        for (i, (key, slot)) in slots.iter().enumerate() {
+            let (left, top, right, bottom) = outer(slot, atlas.padding);
+            assert!(
+                right <= atlas.page_size && bottom <= atlas.page_size,
+                "{key} is off the page"
+            );
+            for (other_key, other) in slots.iter().skip(i + 1) {
+                if other.page != slot.page {
+                    continue;
+                }
+                let (o_left, o_top, o_right, o_bottom) = outer(other, atlas.padding);
+                let apart =
+                    right <= o_left || o_right <= left || bottom <= o_top || o_bottom <= top;
+                assert!(apart, "{key} {slot:?} overlaps {other_key} {other:?}");
+            }
+        }
+    }
+
+    /// A budget of this many pages of this size.
+    fn pages(count: u64, page_size: u32) -> u64 {
+        count * texture_bytes(page_size, page_size)
+    }
+
+    fn slot_of(placement: Placement) -> Slot {
+        match placement {
+            Placement::Placed { slot, .. } => slot,
+            other => panic!("expected the image on a page: {other:?}"),
+        }
+    }
+
+    fn page_id(page: usize) -> u32 {
+        Unit::Page(page).id()
+    }
+
+    #[test]
+    fn same_sized_icons_fill_a_grid() {
+        let mut atlas = Atlas::new(PAGE_SIZE, PADDING, pages(1, PAGE_SIZE));
+        let per_row = PAGE_SIZE / (300 + 2 * PADDING);
+        let fits = per_row * per_row;
+        for i in 0..fits {
+            let placed = atlas.place(&format!("icon{i}"), 300, 300, false);
+            assert!(matches!(placed, Placement::Placed { fresh: true, .. }));
+        }
+        assert_eq!(atlas.page_count(), 1);
+        assert_eq!(atlas.bytes_used(), pages(1, PAGE_SIZE));
+        assert!(atlas.occupancy(0) > 0.75, "{}", atlas.occupancy(0));
+        assert_no_overlaps(&atlas);
+
+        // Asking again gives the same answer and nothing to upload.
+        let resident = atlas.get("icon3").expect("icon3 is resident");
+        let again = atlas.place("icon3", 300, 300, false);
+        assert!(
+            matches!(again, Placement::Placed { slot, fresh: false } if slot == resident),
+            "{again:?}"
+        );
+    }
+
+    #[test]
+    fn mixed_sizes_share_a_page() {
+        let mut rng = StdRng::seed_from_u64(2048);
+        let mut atlas = Atlas::new(1024, PADDING, pages(1, 1024));
+        // Mostly icon-ish squares with some wide meter and background images,
+        // adding up to half a page. All of them should fit on it. (Packing
+        // online like this, shelves run out somewhere past 60%.)
+        let page_area = 1024.0 * 1024.0;
+        let mut area = 0.0;
+        let mut count = 0;
+        while area < 0.5 * page_area {
+            let (w, h) = if rng.gen_bool(0.8) {
+                let side = [32, 48, 64, 96, 128][rng.gen_range(0..5)];
+                (side, side)
+            } else {
+                (rng.gen_range(100..400), rng.gen_range(16..64))
+            };
+            atlas.place(&format!("image{count}"), w, h, false);
+            assert_eq!(
+                atlas.page_count(),
+                1,
+                "ran out of room after {count} images covering {:.2} of the page",
+                area / page_area
+            );
+            area += ((w + 2 * PADDING) * (h + 2 * PADDING)) as f64;
+            count += 1;
+        }
+        assert_no_overlaps(&atlas);
+        assert!((atlas.occupancy(0) - area / page_area).abs() < 1e-9);
+    }
+
+    #[test]
+    fn big_images_get_textures_of_their_own() {
+        let mut atlas = Atlas::new(256, PADDING, pages(2, 256));
+        let Placement::OwnTexture { id } = atlas.place("huge", 256, 10, false) else {
+            panic!("an image wider than a page can't go on one");
+        };
+        assert!(id >= FIRST_TEXTURE_ID);
+        assert_eq!(atlas.bytes_used(), texture_bytes(256, 10));
+        assert!(matches!(
+            atlas.place("huge", 256, 10, false),
+            Placement::OwnTexture { id: again } if again == id
+        ));
+        assert!(matches!(
+            atlas.place("empty", 0, 10, false),
+            Placement::Refused
+        ));
+        // Padding a side this long would overflow.
+        assert!(matches!(
+            atlas.place("vast", u32::MAX, 10, false),
+            Placement::OwnTexture { .. }
+        ));
+
+        // A texture that big crowds out a page once a frame draws without it.
+        let mut atlas = Atlas::new(256, PADDING, pages(2, 256));
+        atlas.place("bigger", 300, 300, false);
+        let slot = slot_of(atlas.place("icon", 124, 124, false));
+        let evicted = atlas.drawn(&[page_id(slot.page)]);
+        assert_eq!(evicted.keys, vec!["bigger"]);
+        assert!(evicted.pages.is_empty());
+        assert_eq!(atlas.bytes_used(), pages(1, 256));
+    }
+
+    #[test]
+    fn full_atlases_release_the_least_recently_drawn_page() {
+        let mut atlas = Atlas::new(256, PADDING, pages(2, 256));
+        // Four 124x124 (128 padded) images fill a 256 page.
+        for i in 0..8 {
+            atlas.place(&format!("a{i}"), 124, 124, false);
+        }
+        assert_eq!(atlas.page_count(), 2);
+        let first = atlas.get("a0").expect("a0 is resident").page;
+        let second = atlas.get("a4").expect("a4 is resident").page;
+        assert_ne!(first, second);
+
+        // Drawing the first page makes the second one the one to go, but only
+        // once the frame that needed a third page has been drawn.
+        assert!(atlas.drawn(&[page_id(first)]).keys.is_empty());
+        let third = slot_of(atlas.place("b0", 124, 124, false)).page;
+        assert!(third != first && third != second);
+        assert_eq!(
+            atlas.page_count(),
+            3,
+            "over budget until the frame is drawn"
+        );
+        assert!(atlas.get("a4").is_some());
+
+        let evictions = atlas.drawn(&[page_id(first), page_id(third)]);
+        assert_eq!(evictions.pages, vec![second as u32]);
+        let mut evicted = evictions.keys;
+        evicted.sort();
+        assert_eq!(evicted, vec!["a4", "a5", "a6", "a7"]);
+        for key in evicted.iter() {
+            assert!(atlas.get(key).is_none(), "{key} should be gone");
+        }
+        for i in 0..4 {
+            assert!(atlas.get(&format!("a{i}")).is_some());
+        }
+        assert_eq!(atlas.page_count(), 2);
+        assert_eq!(atlas.bytes_used(), pages(2, 256));
+
+        // The released page is made again for the next image that needs one.
+        for i in 1..4 {
+            atlas.place(&format!("b{i}"), 124, 124, false);
+        }
+        assert_eq!(slot_of(atlas.place("c0", 124, 124, false)).page, second);
+        assert_no_overlaps(&atlas);
+    }
+
+    #[test]
+    fn nothing_drawn_this_frame_is_evicted() {
+        let mut atlas = Atlas::new(256, PADDING, pages(1, 256));
+        for i in 0..4 {
+            atlas.place(&format!("a{i}"), 124, 124, false);
+        }
+        let first = atlas.get("a0").expect("a0 is resident").page;
+        assert!(atlas.drawn(&[page_id(first)]).keys.is_empty());
+
+        // A frame draws a0, then loads an image that needs another page. The
+        // page it's drawing from stays, and so does every image on it.
+        let slot = slot_of(atlas.place("a0", 124, 124, false));
+        let second = slot_of(atlas.place("b0", 124, 124, false)).page;
+        assert_ne!(second, first);
+        assert_eq!(atlas.get("a0"), Some(slot));
+        let evictions = atlas.drawn(&[page_id(first), page_id(second)]);
+        assert!(evictions.keys.is_empty() && evictions.pages.is_empty());
+        assert_eq!(atlas.bytes_used(), pages(2, 256), "over budget, for now");
+
+        // The next frame doesn't draw a0's page, so now it goes.
+        let evictions = atlas.drawn(&[page_id(second)]);
+        assert_eq!(evictions.pages, vec![first as u32]);
+        assert_eq!(evictions.keys.len(), 4);
+        assert_eq!(atlas.bytes_used(), pages(1, 256));
+        // Drawing a0 again means loading it again.
+        assert!(matches!(
+            atlas.place("a0", 124, 124, false),
+            Placement::Placed { fresh: true, .. }
+        ));
+    }
+
+    #[test]
+    fn shrinking_the_budget_releases_pages_after_the_frame() {
+        let mut atlas = Atlas::new(256, PADDING, pages(3, 256));
+        for i in 0..12 {
+            atlas.place(&format!("a{i}"), 124, 124, false);
+        }
+        assert_eq!(atlas.page_count(), 3);
+        let page_of = |atlas: &Atlas, key: &str| atlas.get(key).expect("resident").page;
+        let (first, second, third) = (
+            page_of(&atlas, "a0"),
+            page_of(&atlas, "a4"),
+            page_of(&atlas, "a8"),
+        );
+
+        atlas.set_budget(pages(2, 256));
+        assert_eq!(atlas.page_count(), 3, "nothing goes mid-frame");
+        let evictions = atlas.drawn(&[page_id(third), page_id(first)]);
+        assert_eq!(evictions.pages, vec![second as u32]);
+        assert_eq!(evictions.keys.len(), 4);
+        assert_eq!(atlas.page_count(), 2);
+        assert_eq!(atlas.bytes_used(), pages(2, 256));
+
+        // Room in the budget again lets the released page come back and stay.
+        atlas.set_budget(pages(3, 256));
+        for i in 0..4 {
+            atlas.place(&format!("b{i}"), 124, 124, false);
+        }
+        assert_eq!(page_of(&atlas, "b3"), second);
+        assert!(atlas.drawn(&[page_id(second)]).keys.is_empty());
+        assert_eq!(atlas.page_count(), 3);
+        assert_no_overlaps(&atlas);
+    }
+
+    #[test]
+    fn pinned_images_are_never_evicted() {
+        let mut atlas = Atlas::new(256, PADDING, pages(1, 256));
+        for i in 0..8 {
+            atlas.place(&format!("button{i}"), 124, 124, true);
+        }
+        let pinned_pages = [
+            atlas.get("button0").expect("button0 is resident").page,
+            atlas.get("button7").expect("button7 is resident").page,
+        ];
+
+        // Pinned pages don't count against the budget, so unpinned images
+        // still have a page's worth of room, and keep to it.
+        let mut rng = StdRng::seed_from_u64(42);
+        for i in 0..200 {
+            let side = rng.gen_range(8..124);
+            let slot = slot_of(atlas.place(&format!("icon{i}"), side, side, false));
+            assert!(!pinned_pages.contains(&slot.page));
+            let evictions = atlas.drawn(&[page_id(slot.page)]);
+            assert!(evictions.keys.iter().all(|k| k.starts_with("icon")));
+            assert!(!evictions.pages.contains(&(slot.page as u32)));
+            for key in evictions.keys.iter() {
+                assert!(atlas.get(key).is_none());
+            }
+            assert!(atlas.page_count() <= 3);
+        }
+        for i in 0..8 {
+            assert!(atlas.get(&format!("button{i}")).is_some());
+        }
+        assert_no_overlaps(&atlas);
+    }
+}
@@ -0,0 +1,228 @@
+//! Rasterize many svgs at once, spread over a few worker threads.
+//!
+//! At startup the renderer loads every key and controller button image, a few
+//! hundred svgs, and each one is a resvg render. One after another on the
+//! thread that asked, that's a noticeable stall. Here the requests are shared
+//! out to a small pool of scoped threads that take the next one as they finish
+//! the last, and the results come back in the order they were asked for, so
+//! the caller has nothing left to do but upload them.
+
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::thread;
+
+use super::svg::load_and_rasterize;
+use crate::plugin::{LoadedImage, RasterRequest};
+
+/// The most threads a batch uses. Past this we'd only be fighting the game
+/// for cores, and parsing svgs shares a cache lock.
+const MAX_RASTER_WORKERS: usize = 8;
+
+/// Rasterize every request, in parallel. A failed request gets an empty
+/// image in its place, as `rasterize_by_path()` would give.
+pub fn rasterize_batch(requests: &[RasterRequest]) -> Vec<LoadedImage> {
+    let cores = thread::available_parallelism().map_or(1, |n| n.get());
+    rasterize_with_workers(requests, cores.min(MAX_RASTER_WORKERS))
+}
+
+/// The batch rasterizer with a chosen pool size, for the benchmarks.
+pub fn rasterize_with_workers(requests: &[RasterRequest], workers: usize) -> Vec<LoadedImage> {
+    rasterize_in_pool(requests, workers, rasterize_one)
+}
+
+/// Share the requests out to a pool of workers, each running `rasterize`.
+/// Split from the svg work so the pool can be tested on its own.
+fn rasterize_in_pool<F>(
+    requests: &[RasterRequest],
+    workers: usize,
+    rasterize: F,
+) -> Vec<LoadedImage>
+where
+    F: Fn(&RasterRequest) -> LoadedImage + Sync,
+{
+    let workers = workers.clamp(1, requests.len().max(1));
+    let next = AtomicUsize::new(0);
+    let started = std::time::Instant::now();
+
+    let mut results = vec![LoadedImage::default(); requests.len()];
+    thread::scope(|scope| {
+        let next = &next;
+        let rasterize = &rasterize;
+        let pool: Vec<_> = (0..workers)
+            .map(|_| {
+                scope.spawn(move || {
+                    let mut done = Vec::new();
+                    loop {
+                        let index = next.fetch_add(1, Ordering::Relaxed);
+                        let Some(request) = requests.get(index) else {
+                            break;
+                        };
+                        done.push((index, rasterize(request)));
+                    }
+                    done
+                })
+            })
+            .collect();
+        for worker in pool {
+            // A panicking render loses only that worker's images.
+            for (index, image) in worker.join().unwrap_or_default() {
+                results[index] = image;
+            }
+        }
+    });
+
+    log::debug!(
+        "Rasterized a batch of {} svgs on {workers} threads in {:?}",
+        requests.len(),
+        started.elapsed()
+    );
+    results
+}
+
+fn rasterize_one(request: &RasterRequest) -> LoadedImage {
+    let maxdim = (request.maxdim > 0).then_some(request.maxdim);
+    match load_and_rasterize(&PathBuf::from(&request.path), maxdim) {
+        Ok(v) => v,
+        Err(e) => {
+            log::error!(
+                "failed to load svg in batch; path={}; error={e:#}",
+                request.path
+            );
+            LoadedImage::default()
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const BUTTONS_PATH: &str = "installer/core/SKSE/plugins/resources/buttons/";
+
+    fn button_requests() -> Vec<RasterRequest> {
+        let mut paths: Vec<_> = std::fs::read_dir(BUTTONS_PATH)
+            .expect("the installer has buttons")
+            .filter_map(|entry| entry.ok().map(|entry| entry.path()))
+            .filter(|path| path.extension().is_some_and(|ext| ext == "svg"))
+            .collect();
+        paths.sort();
+        paths
+            .into_iter()
+            .take(24)
+            .enumerate()
+            .map(|(i, path)| RasterRequest {
+                path: path.to_string_lossy().to_string(),
+                maxdim: if i % 2 == 0 { 0 } else { 32 + i as u32 },
+            })
+            .collect()
+    }
+
+    #[test]
+    fn results_come_back_in_request_order() {
+        let requests = button_requests();
+        assert!(requests.len() > 4);
+        let serial = rasterize_with_workers(&requests, 1);
+        let parallel = rasterize_with_workers(&requests, 4);
+        assert_eq!(serial.len(), requests.len());
+        for ((request, one), other) in requests.iter().zip(serial.iter()).zip(parallel.iter()) {
+            assert!(!one.buffer.is_empty(), "{} rasterized", request.path);
+            assert_eq!(one.width, other.width);
+            assert_eq!(one.height, other.height);
+            assert_eq!(one.buffer, other.buffer);
+            if request.maxdim > 0 {
+                assert_eq!(one.width.max(one.height), request.maxdim);
+            }
+        }
+    }
+
+    #[test]
+    fn failures_leave_empty_images_in_place() {
+        let mut requests = button_requests();
+        requests.truncate(3);
+        requests.insert(
+            1,
+            RasterRequest {
+                path: format!("{BUTTONS_PATH}no_such_button.svg"),
+                maxdim: 0,
+            },
+        );
+        let results = rasterize_batch(&requests);
+        assert_eq!(results.len(), 4);
+        assert!(results[1].buffer.is_empty());
+        assert!(results
+            .iter()
+            .enumerate()
+            .all(|(i, image)| i == 1 || !image.buffer.is_empty()));
+        assert!(rasterize_batch(&[]).is_empty());
+    }
+
+    /// Stands in for resvg: the image's width is the number in the path, and
+    /// the render takes longer for lower numbers, so workers finish out of order.
+    fn stub_rasterize(request: &RasterRequest) -> LoadedImage {
+        let n: u32 = request.path.parse().expect("stub paths are numbers");
+        std::thread::sleep(std::time::Duration::from_micros(
+            u64::from(64 - n % 64) * 20,
+        ));
+        LoadedImage {
+            width: n,
+            height: request.maxdim,
+            buffer: vec![1; 4],
+        }
+    }
+
+    fn numbered_requests(count: u32) -> Vec<RasterRequest> {
+        (0..count)
+            .map(|n| RasterRequest {
+                path: n.to_string(),
+                maxdim: n * 2,
+            })
+            .collect()
+    }
+
+    #[test]
+    fn the_pool_hands_every_request_to_exactly_one_worker() {
+        let requests = numbered_requests(200);
+        for workers in [1, 3, 8, 500] {
+            let calls = AtomicUsize::new(0);
+            let results = rasterize_in_pool(&requests, workers, |request| {
+                calls.fetch_add(1, Ordering::Relaxed);
+                stub_rasterize(request)
+            });
+            assert_eq!(calls.load(Ordering::Relaxed), requests.len());
+            assert_eq!(results.len(), requests.len());
+            for (n, image) in results.iter().enumerate() {
+                assert_eq!(image.width, n as u32, "{workers} workers");
+                assert_eq!(image.height, n as u32 * 2);
+            }
+        }
+        assert!(rasterize_in_pool(&[], 4, stub_rasterize).is_empty());
+    }
+
+    #[test]
+    fn a_panicking_worker_loses_only_its_own_images() {
+        let requests = numbered_requests(64);
+        let results = rasterize_in_pool(&requests, 4, |request| {
+            if request.path == "17" {
+                panic!("a render went wrong");
+            }
+            stub_rasterize(request)
+        });
+        assert_eq!(results.len(), requests.len());
+        assert!(results[17].buffer.is_empty());
+        let kept = results
+            .iter()
+            .filter(|image| !image.buffer.is_empty())
+            .count();
+        // The panicking worker took at least the bad request; the others keep theirs.
+        assert!(kept < requests.len());
+        assert!(
+            kept >= requests.len() / 2,
+            "only {kept} of the images survived"
+        );
+        for (n, image) in results.iter().enumerate() {
+            if !image.buffer.is_empty() {
+                assert_eq!(image.width, n as u32);
+            }
+        }
+    }
+}
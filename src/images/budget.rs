@@ -0,0 +1,290 @@
+//! Texture memory accounting. Every texture we make counts against a budget,
+//! and when we're over it, the least recently drawn ones go first.
+//!
+//! This is policy only; it knows nothing about what a texture is. The atlas
+//! uses it with its pages and with the odd image too big for a page as the
+//! units, and turns its eviction decisions into work for the renderer.
+//!
+//! Nothing is evicted the moment a texture is admitted. The renderer admits
+//! textures while it builds a frame, and that frame may already draw from the
+//! ones that would go. So the budget can run over until the frame is done,
+//! when `settle()` evicts what wasn't drawn.
+//!
+//! Pinned textures are never evicted, and don't count against the limit:
+//! they're for images we load once at startup and draw all the time, and
+//! counting them would leave a small budget no room for anything else.
+
+use std::collections::HashMap;
+use std::fmt::Display;
+use std::hash::Hash;
+
+use lru::LruCache;
+
+/// A byte budget for textures, with least-recently-drawn eviction.
+#[derive(Debug)]
+pub struct TextureBudget<K: Hash + Eq> {
+    limit: u64,
+    /// Bytes in unpinned textures, which is what the limit applies to.
+    used: u64,
+    pinned_bytes: u64,
+    /// Unpinned textures and their sizes, in the order they were last drawn.
+    lru: LruCache<K, u64>,
+    pinned: HashMap<K, u64>,
+}
+
+impl<K: Hash + Eq + Clone> TextureBudget<K> {
+    pub fn new(limit: u64) -> Self {
+        Self {
+            limit,
+            used: 0,
+            pinned_bytes: 0,
+            lru: LruCache::unbounded(),
+            pinned: HashMap::new(),
+        }
+    }
+
+    /// Change the budget. If we're now over it, the next `settle()` evicts.
+    pub fn set_limit(&mut self, limit: u64) {
+        self.limit = limit;
+    }
+
+    /// Note that a texture was drawn. Unknown keys are ignored.
+    pub fn touch(&mut self, key: &K) {
+        self.lru.promote(key);
+    }
+
+    /// Start counting a new texture. It counts as just drawn. This may put
+    /// us over budget until the next `settle()`.
+    pub fn admit(&mut self, key: K, bytes: u64, pinned: bool) {
+        if self.contains(&key) {
+            self.touch(&key);
+            return;
+        }
+        if pinned {
+            self.pinned_bytes += bytes;
+            self.pinned.insert(key, bytes);
+        } else {
+            self.used += bytes;
+            self.lru.put(key, bytes);
+        }
+    }
+
+    /// Evict the least recently drawn textures until we're within budget,
+    /// skipping any that `spare` says are still in use. Returns what was
+    /// evicted, which the caller must release. If sparing leaves us over
+    /// budget, we stay over rather than take away something being drawn.
+    pub fn settle(&mut self, spare: impl Fn(&K) -> bool) -> Vec<K> {
+        if self.used <= self.limit {
+            return Vec::new();
+        }
+        let mut evicted = Vec::new();
+        let mut over = self.used - self.limit;
+        for (key, bytes) in self.lru.iter().rev() {
+            if over == 0 {
+                break;
+            }
+            if spare(key) {
+                continue;
+            }
+            evicted.push(key.clone());
+            over = over.saturating_sub(*bytes);
+        }
+        for key in evicted.iter() {
+            self.release(key);
+        }
+        evicted
+    }
+
+    /// Stop counting a texture the caller released on its own. Returns true if
+    /// we were counting it.
+    pub fn release(&mut self, key: &K) -> bool {
+        if let Some(bytes) = self.lru.pop(key) {
+            self.used -= bytes;
+            true
+        } else if let Some(bytes) = self.pinned.remove(key) {
+            self.pinned_bytes -= bytes;
+            true
+        } else {
+            false
+        }
+    }
+
+    /// True if `bytes` more unpinned texture would fit.
+    pub fn fits(&self, bytes: u64) -> bool {
+        self.used + bytes <= self.limit
+    }
+
+    pub fn contains(&self, key: &K) -> bool {
+        self.lru.contains(key) || self.pinned.contains_key(key)
+    }
+
+    /// The unpinned texture drawn longest ago, if there are any.
+    pub fn least_recent(&self) -> Option<&K> {
+        self.lru.peek_lru().map(|(key, _)| key)
+    }
+
+    /// Unpinned textures, least recently drawn first.
+    pub fn eviction_order(&self) -> impl Iterator<Item = &K> {
+        self.lru.iter().rev().map(|(key, _)| key)
+    }
+
+    /// Bytes in every texture we count, pinned ones included.
+    pub fn used(&self) -> u64 {
+        self.used + self.pinned_bytes
+    }
+
+    /// Bytes in the textures the limit applies to.
+    pub fn unpinned(&self) -> u64 {
+        self.used
+    }
+
+    pub fn limit(&self) -> u64 {
+        self.limit
+    }
+
+    /// How many textures we're counting, pinned ones included.
+    pub fn len(&self) -> usize {
+        self.lru.len() + self.pinned.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+}
+
+impl<K: Hash + Eq> Display for TextureBudget<K> {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        let megabytes = |bytes: u64| bytes as f64 / (1024.0 * 1024.0);
+        write!(
+            f,
+            "{:.1} MB of {:.1} MB texture budget in {} textures, plus {:.1} MB in {} pinned",
+            megabytes(self.used),
+            megabytes(self.limit),
+            self.lru.len(),
+            megabytes(self.pinned_bytes),
+            self.pinned.len()
+        )
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn least_recently_drawn_goes_first() {
+        let mut budget = TextureBudget::new(300);
+        budget.admit("a", 100, false);
+        budget.admit("b", 100, false);
+        budget.admit("c", 100, false);
+        assert_eq!(budget.used(), 300);
+        assert!(budget.settle(|_| false).is_empty());
+
+        // Drawing "a" makes "b" the oldest.
+        budget.touch(&"a");
+        assert_eq!(budget.least_recent(), Some(&"b"));
+        budget.admit("d", 100, false);
+        assert_eq!(budget.used(), 400, "admitting never evicts");
+        assert_eq!(budget.settle(|_| false), vec!["b"]);
+        assert_eq!(budget.used(), 300);
+
+        // A big one pushes out as many as it needs to, oldest first.
+        budget.admit("e", 200, false);
+        assert_eq!(budget.settle(|_| false), vec!["c", "a"]);
+        assert_eq!(
+            budget.eviction_order().collect::<Vec<_>>(),
+            vec![&"d", &"e"]
+        );
+        assert!(!budget.contains(&"a"));
+        assert_eq!(budget.used(), 300);
+    }
+
+    #[test]
+    fn textures_in_use_are_spared() {
+        let mut budget = TextureBudget::new(200);
+        budget.admit("drawn", 100, false);
+        budget.admit("old", 100, false);
+        budget.admit("new", 100, false);
+        // "drawn" is the oldest, but it's on screen, so "old" goes instead.
+        assert_eq!(budget.settle(|key| *key == "drawn"), vec!["old"]);
+
+        // If everything is in use, we stay over budget.
+        budget.admit("more", 100, false);
+        assert!(budget.settle(|_| true).is_empty());
+        assert_eq!(budget.used(), 300);
+        assert!(!budget.fits(0));
+    }
+
+    #[test]
+    fn accounting_stays_exact() {
+        let mut budget = TextureBudget::new(1000);
+        let mut live: HashMap<u32, u64> = HashMap::new();
+        for i in 0..200u32 {
+            let bytes = 50 + (i as u64 * 37) % 200;
+            if i % 7 == 0 {
+                if let Some(&key) = live.keys().next() {
+                    assert!(budget.release(&key));
+                    live.remove(&key);
+                }
+            }
+            if i % 3 == 0 {
+                if let Some(&key) = live.keys().max() {
+                    budget.touch(&key);
+                }
+            }
+            budget.admit(i, bytes, false);
+            live.insert(i, bytes);
+            for gone in budget.settle(|key| *key == i) {
+                assert!(live.remove(&gone).is_some(), "{gone} was evicted twice");
+            }
+            assert_eq!(budget.used(), live.values().sum::<u64>());
+            assert!(budget.used() <= budget.limit());
+            assert_eq!(budget.len(), live.len());
+        }
+    }
+
+    #[test]
+    fn pinned_textures_stay_and_do_not_count() {
+        let mut budget = TextureBudget::new(250);
+        budget.admit("buttons", 100, true);
+        budget.admit("a", 100, false);
+        budget.admit("b", 100, false);
+        assert!(
+            budget.settle(|_| false).is_empty(),
+            "pinned bytes are extra"
+        );
+        assert_eq!(budget.used(), 300);
+        assert_eq!(budget.unpinned(), 200);
+        budget.admit("c", 100, false);
+        assert_eq!(budget.settle(|_| false), vec!["a"]);
+        assert!(budget.contains(&"buttons"));
+
+        // Nothing unpinned left to evict, so we go over rather than fail.
+        budget.admit("huge", 500, false);
+        assert_eq!(budget.settle(|key| *key == "huge"), vec!["b", "c"]);
+        assert_eq!(budget.unpinned(), 500);
+        assert!(!budget.fits(1));
+
+        // Shrinking the budget evicts at the next settle.
+        budget.set_limit(150);
+        budget.admit("small", 50, false);
+        assert_eq!(budget.settle(|_| false), vec!["huge"]);
+        assert_eq!(budget.used(), 150);
+        assert!(budget.release(&"buttons"));
+        assert!(!budget.release(&"buttons"));
+        assert!(budget.release(&"small"));
+        assert!(budget.is_empty());
+    }
+
+    #[test]
+    fn admitting_twice_only_counts_once() {
+        let mut budget = TextureBudget::new(100);
+        budget.admit("a", 40, false);
+        budget.admit("b", 40, false);
+        budget.admit("a", 40, false);
+        assert_eq!(budget.used(), 80);
+        // That counted as drawing "a", so "b" goes next.
+        budget.admit("c", 40, false);
+        assert_eq!(budget.settle(|_| false), vec!["b"]);
+    }
+}
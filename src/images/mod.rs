@@ -1,6 +1,15 @@
 //! A smaller sub-module that handles icon and image data. This module has
-//! the functions for loading and rasterizing SVGs.
+//! the functions for loading and rasterizing SVGs, in batches or one at a
+//! time, for packing the results into texture atlases within a memory
+//! budget, and for playing animations.
+pub mod animation;
+pub mod atlas;
+pub mod batch;
+pub mod budget;
 pub mod icons;
 pub mod svg;
+pub use animation::{start_animation, take_sprite_sheet};
+pub use atlas::{atlas_place, set_texture_budget, texture_budget_report, textures_drawn};
+pub use batch::rasterize_batch;
 pub use icons::*;
 pub use svg::*;
@@ -3,13 +3,23 @@
 //! supports nearly all of the svg standard, with the notable exception of
 //! animation. This module also maintains a mapping of icon key to the icon file
 //! found for that path after fallbacks, so icon data is loaded at most once.
+//!
+//! Parsing an svg costs about as much as rasterizing it, and we often rasterize
+//! the same file more than once: key images at several sizes, icons again after
+//! the layout's scale changes. So parsed trees are kept in a small LRU cache,
+//! keyed by path and a hash of the file's contents so an edited file is parsed
+//! again. Fonts for svgs with text are loaded once, into one shared database.
 
+use std::collections::hash_map::DefaultHasher;
 use std::collections::HashMap;
-use std::path::PathBuf;
+use std::hash::{Hash, Hasher};
+use std::num::NonZeroUsize;
+use std::path::{Path, PathBuf};
 use std::str::FromStr;
-use std::sync::Mutex;
+use std::sync::{Arc, Mutex};
 
 use eyre::{eyre, Result};
+use lru::LruCache;
 use once_cell::sync::Lazy;
 use resvg::*;
 
@@ -25,6 +35,33 @@ pub fn icon_map() -> std::sync::MutexGuard<'static, HashMap<Icon, Icon>> {
         .expect("Unrecoverable runtime problem: cannot acquire icon hashmap lock. Exiting.")
 }
 
+/// How many parsed svgs to keep. Comfortably more than one HUD's worth.
+const PARSED_SVG_CAPACITY: usize = 64;
+
+/// Parsed svgs, by path and a hash of the file contents.
+static PARSED_SVGS: Lazy<Mutex<LruCache<(PathBuf, u64), Arc<usvg::Tree>>>> = Lazy::new(|| {
+    Mutex::new(LruCache::new(
+        NonZeroUsize::new(PARSED_SVG_CAPACITY).expect("the capacity is not zero"),
+    ))
+});
+
+/// None of our own svgs have text, so they parse against an empty database.
+static NO_FONTS: Lazy<usvg::fontdb::Database> = Lazy::new(usvg::fontdb::Database::new);
+
+/// System fonts for svgs that do have text, loaded the first time one turns up.
+static SYSTEM_FONTS: Lazy<usvg::fontdb::Database> = Lazy::new(|| {
+    let mut fonts = usvg::fontdb::Database::new();
+    fonts.load_system_fonts();
+    log::info!("loaded {} system font faces for svg text", fonts.len());
+    fonts
+});
+
+fn parsed_svgs() -> std::sync::MutexGuard<'static, LruCache<(PathBuf, u64), Arc<usvg::Tree>>> {
+    PARSED_SVGS
+        .lock()
+        .expect("Unrecoverable runtime problem: cannot acquire parsed svg cache lock.")
+}
+
 /// Path for icons relative to the game dir.
 #[cfg(not(test))]
 const ICON_SVG_PATH: &str = "data/SKSE/plugins/resources/icons/";
@@ -106,12 +143,37 @@ fn icon_to_path(icon: &Icon) -> PathBuf {
     [ICON_SVG_PATH, icon.icon_file().as_str()].iter().collect()
 }
 
-/// Internal shared implementation: do the real work.
-fn load_and_rasterize(file_path: &PathBuf, maxsize: Option<u32>) -> Result<LoadedImage> {
+/// Drop every parsed svg, so the next rasterization of each file parses it again.
+pub fn forget_parsed_svgs() {
+    parsed_svgs().clear();
+}
+
+/// Parse the svg at this path, or reuse the tree we parsed last time if the
+/// file hasn't changed. Reading and hashing the file is cheap next to parsing it.
+fn parsed_svg(file_path: &Path) -> Result<Arc<usvg::Tree>> {
     let buffer = std::fs::read(file_path)?;
+    let mut hasher = DefaultHasher::new();
+    buffer.hash(&mut hasher);
+    let key = (file_path.to_path_buf(), hasher.finish());
+    if let Some(tree) = parsed_svgs().get(&key) {
+        return Ok(tree.clone());
+    }
+
+    // Parse without holding the lock; at worst two callers parse the same file.
+    let fonts = if buffer.windows(5).any(|w| w == b"<text") {
+        &*SYSTEM_FONTS
+    } else {
+        &*NO_FONTS
+    };
     let opt = usvg::Options::default();
-    let fonts = usvg::fontdb::Database::new();
-    let rtree = usvg::Tree::from_data(&buffer, &opt, &fonts)?;
+    let tree = Arc::new(usvg::Tree::from_data(&buffer, &opt, fonts)?);
+    parsed_svgs().put(key, tree.clone());
+    Ok(tree)
+}
+
+/// Shared implementation: do the real work. Public for the benchmarks.
+pub fn load_and_rasterize(file_path: &PathBuf, maxsize: Option<u32>) -> Result<LoadedImage> {
+    let rtree = parsed_svg(file_path)?;
 
     let (size, transform) = if let Some(maxdim) = maxsize {
         let size = if rtree.size().width() > rtree.size().height() {
@@ -168,6 +230,18 @@ mod tests {
         assert_eq!(loaded.buffer.len(), 256 * 256 * 4); // expected size given dimensions & square image
     }
 
+    #[test]
+    fn parsed_svgs_are_reused_across_sizes() {
+        let path: PathBuf = [ICON_SVG_PATH, "potion_resist_frost.svg"].iter().collect();
+        let first = parsed_svg(&path).expect("this icon should exist");
+        let small = load_and_rasterize(&path, Some(32)).expect("this icon should exist");
+        let large = load_and_rasterize(&path, Some(200)).expect("this icon should exist");
+        assert_eq!(small.width.max(small.height), 32);
+        assert_eq!(large.width.max(large.height), 200);
+        let again = parsed_svg(&path).expect("this icon should exist");
+        assert!(Arc::ptr_eq(&first, &again));
+    }
+
     #[test]
     fn rasterize_unscaled() {
         let previous =
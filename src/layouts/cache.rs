@@ -0,0 +1,626 @@
+//! A compiled copy of the flattened layout, so that most launches don't parse
+//! toml or do any layout math at all.
+//!
+//! The cache holds exactly one flattened layout, plus the key it was made
+//! with: a hash of the layout file's text, the screen size, the settings
+//! that move or scale the HUD, and the plugin version that flattened it. If
+//! any of those differ, the cache is ignored and replaced after the next
+//! flatten. The version is there because a release can change how layouts
+//! are flattened without changing what a flattened layout looks like.
+//!
+//! Format, all little-endian:
+//!
+//! - `SOULLAY` magic and a format byte
+//! - the key: u64 content hash, f32 width, f32 height, f32 scale, anchor name,
+//!   plugin version
+//! - the flattened layout, field by field in declaration order; strings are a
+//!   u32 length and utf8, lists a u32 count and their elements
+//! - a u64 FNV-1a hash of everything before it
+
+use std::fs;
+
+use eyre::{eyre, Result};
+
+use crate::plugin::{Align, Color, HudElement, LayoutFlattened, MeterKind, Point};
+use crate::plugin::{SlotFlattened, TextFlattened};
+use crate::settings::settings;
+
+/// Where the cache lives, next to the layout file.
+pub static CACHE_PATH: &str = "./data/SKSE/Plugins/SoulsyHUD_Layout.bin";
+
+const MAGIC: &[u8; 7] = b"SOULLAY";
+/// Bump this if `LayoutFlattened` or anything in it changes shape.
+const FORMAT: u8 = 3;
+/// The plugin version, part of every cache key.
+const BUILD: &str = env!("CARGO_PKG_VERSION");
+
+/// 64-bit FNV-1a. Stable from run to run, unlike the std hashers, so it can
+/// be written to disk.
+pub fn content_hash(bytes: &[u8]) -> u64 {
+    bytes.iter().fold(0xcbf29ce484222325, |hash: u64, byte| {
+        (hash ^ *byte as u64).wrapping_mul(0x100000001b3)
+    })
+}
+
+/// Everything besides the layout itself that goes into a flattened layout.
+#[derive(Debug, Clone, PartialEq)]
+pub struct CacheKey {
+    pub content: u64,
+    pub width: f32,
+    pub height: f32,
+    pub scale: f32,
+    pub anchor: String,
+    /// The plugin version that flattened the layout.
+    pub build: String,
+}
+
+impl CacheKey {
+    /// The key for layout text with this hash, on this screen with these settings.
+    pub fn current(content: u64) -> Self {
+        let config = settings();
+        Self {
+            content,
+            width: super::displayWidth(),
+            height: super::displayHeight(),
+            scale: config.hud_scale(),
+            anchor: config.anchor_loc().to_string(),
+            build: BUILD.to_string(),
+        }
+    }
+}
+
+/// Read the cache file and hand back its layout if it was made with this key.
+pub fn load(pathstr: &str, key: &CacheKey) -> Option<LayoutFlattened> {
+    let bytes = fs::read(pathstr).ok()?;
+    match decode(&bytes, key) {
+        Ok(layout) => Some(layout),
+        Err(e) => {
+            log::debug!("Not using the layout cache; {e:#}");
+            None
+        }
+    }
+}
+
+/// Replace the cache file. Failing to write it only costs a parse next launch.
+pub fn store(pathstr: &str, key: &CacheKey, layout: &LayoutFlattened) {
+    if let Err(e) = fs::write(pathstr, encode(key, layout)) {
+        log::debug!("Unable to write the layout cache to {pathstr}; {e:#}");
+    }
+}
+
+pub fn encode(key: &CacheKey, layout: &LayoutFlattened) -> Vec<u8> {
+    let mut w = Writer::default();
+    w.bytes.extend_from_slice(MAGIC);
+    w.u8(FORMAT);
+    w.u64(key.content);
+    w.f32(key.width);
+    w.f32(key.height);
+    w.f32(key.scale);
+    w.str(&key.anchor);
+    w.str(&key.build);
+
+    w.f32(layout.global_scale);
+    w.point(&layout.anchor);
+    w.point(&layout.size);
+    w.bool(layout.hide_ammo_when_irrelevant);
+    w.bool(layout.hide_left_when_irrelevant);
+    w.str(&layout.font);
+    w.f32(layout.font_size);
+    for glyphs in [
+        layout.chinese_full_glyphs,
+        layout.simplified_chinese_glyphs,
+        layout.cyrillic_glyphs,
+        layout.japanese_glyphs,
+        layout.korean_glyphs,
+        layout.thai_glyphs,
+        layout.vietnamese_glyphs,
+    ] {
+        w.bool(glyphs);
+    }
+    w.point(&layout.bg_size);
+    w.color(&layout.bg_color);
+    w.str(&layout.bg_image);
+    w.u32(layout.slots.len() as u32);
+    for slot in layout.slots.iter() {
+        w.slot(slot);
+    }
+
+    let checksum = content_hash(&w.bytes);
+    w.u64(checksum);
+    w.bytes
+}
+
+pub fn decode(bytes: &[u8], key: &CacheKey) -> Result<LayoutFlattened> {
+    let Some(split) = bytes.len().checked_sub(8) else {
+        return Err(eyre!("the layout cache is too short"));
+    };
+    let (body, tail) = bytes.split_at(split);
+    let expected = u64::from_le_bytes(tail.try_into()?);
+    if content_hash(body) != expected {
+        return Err(eyre!("the layout cache is damaged"));
+    }
+
+    let mut r = Reader {
+        bytes: body,
+        pos: 0,
+    };
+    if r.take(MAGIC.len()) != Some(MAGIC.as_slice()) || r.u8() != Some(FORMAT) {
+        return Err(eyre!("the layout cache is from another version"));
+    }
+    let found = r
+        .key()
+        .ok_or_else(|| eyre!("the layout cache is truncated"))?;
+    if found != *key {
+        return Err(eyre!("the layout cache is stale; found={found:?}"));
+    }
+    let layout = r
+        .layout()
+        .ok_or_else(|| eyre!("the layout cache doesn't hold a layout"))?;
+    if r.pos != body.len() {
+        return Err(eyre!("the layout cache has trailing bytes"));
+    }
+    Ok(layout)
+}
+
+fn element_code(element: HudElement) -> u8 {
+    match element {
+        HudElement::Power => 0,
+        HudElement::Utility => 1,
+        HudElement::Left => 2,
+        HudElement::Right => 3,
+        HudElement::Ammo => 4,
+        HudElement::EquipSet => 5,
+        _ => 6,
+    }
+}
+
+fn element_from(code: u8) -> Option<HudElement> {
+    Some(match code {
+        0 => HudElement::Power,
+        1 => HudElement::Utility,
+        2 => HudElement::Left,
+        3 => HudElement::Right,
+        4 => HudElement::Ammo,
+        5 => HudElement::EquipSet,
+        6 => HudElement::None,
+        _ => return None,
+    })
+}
+
+fn align_code(align: Align) -> u8 {
+    match align {
+        Align::Right => 1,
+        Align::Center => 2,
+        _ => 0,
+    }
+}
+
+fn align_from(code: u8) -> Option<Align> {
+    Some(match code {
+        0 => Align::Left,
+        1 => Align::Right,
+        2 => Align::Center,
+        _ => return None,
+    })
+}
+
+fn meter_code(kind: MeterKind) -> u8 {
+    match kind {
+        MeterKind::Rectangular => 1,
+        MeterKind::CircleArc => 2,
+        _ => 0,
+    }
+}
+
+fn meter_from(code: u8) -> Option<MeterKind> {
+    Some(match code {
+        0 => MeterKind::None,
+        1 => MeterKind::Rectangular,
+        2 => MeterKind::CircleArc,
+        _ => return None,
+    })
+}
+
+#[derive(Default)]
+struct Writer {
+    bytes: Vec<u8>,
+}
+
+impl Writer {
+    fn u8(&mut self, value: u8) {
+        self.bytes.push(value);
+    }
+
+    fn bool(&mut self, value: bool) {
+        self.u8(value as u8);
+    }
+
+    fn u32(&mut self, value: u32) {
+        self.bytes.extend_from_slice(&value.to_le_bytes());
+    }
+
+    fn u64(&mut self, value: u64) {
+        self.bytes.extend_from_slice(&value.to_le_bytes());
+    }
+
+    fn f32(&mut self, value: f32) {
+        self.bytes.extend_from_slice(&value.to_le_bytes());
+    }
+
+    fn str(&mut self, value: &str) {
+        self.u32(value.len() as u32);
+        self.bytes.extend_from_slice(value.as_bytes());
+    }
+
+    fn point(&mut self, point: &Point) {
+        self.f32(point.x);
+        self.f32(point.y);
+    }
+
+    fn points(&mut self, points: &[Point]) {
+        self.u32(points.len() as u32);
+        for point in points {
+            self.point(point);
+        }
+    }
+
+    fn color(&mut self, color: &Color) {
+        self.bytes
+            .extend_from_slice(&[color.r, color.g, color.b, color.a]);
+    }
+
+    fn slot(&mut self, slot: &SlotFlattened) {
+        self.u8(element_code(slot.element));
+        self.point(&slot.center);
+        self.point(&slot.bg_size);
+        self.color(&slot.bg_color);
+        self.str(&slot.bg_image);
+
+        self.point(&slot.icon_size);
+        self.point(&slot.icon_center);
+        self.color(&slot.icon_color);
+
+        self.point(&slot.hotkey_size);
+        self.point(&slot.hotkey_center);
+        self.color(&slot.hotkey_color);
+        self.point(&slot.hotkey_bg_size);
+        self.color(&slot.hotkey_bg_color);
+        self.str(&slot.hotkey_bg_image);
+
+        self.point(&slot.poison_size);
+        self.point(&slot.poison_center);
+        self.color(&slot.poison_color);
+        self.str(&slot.poison_image);
+
+        self.u8(meter_code(slot.meter_kind));
+        self.point(&slot.meter_center);
+        self.point(&slot.meter_size);
+        self.str(&slot.meter_empty_image);
+        self.color(&slot.meter_empty_color);
+        self.str(&slot.meter_fill_image);
+        self.point(&slot.meter_fill_size);
+        self.color(&slot.meter_fill_color);
+        self.f32(slot.meter_start_angle);
+        self.f32(slot.meter_end_angle);
+        self.f32(slot.meter_arc_width);
+        self.points(&slot.meter_empty_quad);
+        self.points(&slot.meter_fill_quad);
+        self.points(&slot.meter_arc_outer);
+        self.points(&slot.meter_arc_inner);
+
+        self.u32(slot.text.len() as u32);
+        for text in slot.text.iter() {
+            self.point(&text.anchor);
+            self.color(&text.color);
+            self.u8(align_code(text.alignment));
+            self.str(&text.contents);
+            self.f32(text.font_size);
+            self.f32(text.wrap_width);
+            self.bool(text.truncate);
+        }
+    }
+}
+
+/// Bounds-checked reads; `None` means the cache ran out early or holds
+/// something that can't be right.
+struct Reader<'a> {
+    bytes: &'a [u8],
+    pos: usize,
+}
+
+impl<'a> Reader<'a> {
+    fn take(&mut self, len: usize) -> Option<&'a [u8]> {
+        let end = self.pos.checked_add(len)?;
+        let taken = self.bytes.get(self.pos..end)?;
+        self.pos = end;
+        Some(taken)
+    }
+
+    fn u8(&mut self) -> Option<u8> {
+        self.take(1).map(|xs| xs[0])
+    }
+
+    fn bool(&mut self) -> Option<bool> {
+        match self.u8()? {
+            0 => Some(false),
+            1 => Some(true),
+            _ => None,
+        }
+    }
+
+    fn u32(&mut self) -> Option<u32> {
+        self.take(4)?.try_into().ok().map(u32::from_le_bytes)
+    }
+
+    fn u64(&mut self) -> Option<u64> {
+        self.take(8)?.try_into().ok().map(u64::from_le_bytes)
+    }
+
+    fn f32(&mut self) -> Option<f32> {
+        self.take(4)?.try_into().ok().map(f32::from_le_bytes)
+    }
+
+    fn str(&mut self) -> Option<String> {
+        let len = self.u32()? as usize;
+        let bytes = self.take(len)?;
+        std::str::from_utf8(bytes).ok().map(str::to_string)
+    }
+
+    /// A count of things at least `min_len` bytes each; refuses counts the
+    /// rest of the buffer can't possibly hold.
+    fn count(&mut self, min_len: usize) -> Option<usize> {
+        let count = self.u32()? as usize;
+        (count.checked_mul(min_len)? <= self.bytes.len() - self.pos).then_some(count)
+    }
+
+    fn point(&mut self) -> Option<Point> {
+        Some(Point {
+            x: self.f32()?,
+            y: self.f32()?,
+        })
+    }
+
+    fn points(&mut self) -> Option<Vec<Point>> {
+        let count = self.count(8)?;
+        (0..count).map(|_| self.point()).collect()
+    }
+
+    fn color(&mut self) -> Option<Color> {
+        let rgba = self.take(4)?;
+        Some(Color {
+            r: rgba[0],
+            g: rgba[1],
+            b: rgba[2],
+            a: rgba[3],
+        })
+    }
+
+    fn key(&mut self) -> Option<CacheKey> {
+        Some(CacheKey {
+            content: self.u64()?,
+            width: self.f32()?,
+            height: self.f32()?,
+            scale: self.f32()?,
+            anchor: self.str()?,
+            build: self.str()?,
+        })
+    }
+
+    fn layout(&mut self) -> Option<LayoutFlattened> {
+        let global_scale = self.f32()?;
+        let anchor = self.point()?;
+        let size = self.point()?;
+        let hide_ammo_when_irrelevant = self.bool()?;
+        let hide_left_when_irrelevant = self.bool()?;
+        let font = self.str()?;
+        let font_size = self.f32()?;
+        let chinese_full_glyphs = self.bool()?;
+        let simplified_chinese_glyphs = self.bool()?;
+        let cyrillic_glyphs = self.bool()?;
+        let japanese_glyphs = self.bool()?;
+        let korean_glyphs = self.bool()?;
+        let thai_glyphs = self.bool()?;
+        let vietnamese_glyphs = self.bool()?;
+        let bg_size = self.point()?;
+        let bg_color = self.color()?;
+        let bg_image = self.str()?;
+        let count = self.count(1)?;
+        let mut slots = Vec::with_capacity(count);
+        for _ in 0..count {
+            slots.push(self.slot()?);
+        }
+        Some(LayoutFlattened {
+            global_scale,
+            anchor,
+            size,
+            hide_ammo_when_irrelevant,
+            hide_left_when_irrelevant,
+            font,
+            font_size,
+            chinese_full_glyphs,
+            simplified_chinese_glyphs,
+            cyrillic_glyphs,
+            japanese_glyphs,
+            korean_glyphs,
+            thai_glyphs,
+            vietnamese_glyphs,
+            bg_size,
+            bg_color,
+            bg_image,
+            slots,
+        })
+    }
+
+    fn slot(&mut self) -> Option<SlotFlattened> {
+        let element = element_from(self.u8()?)?;
+        let center = self.point()?;
+        let bg_size = self.point()?;
+        let bg_color = self.color()?;
+        let bg_image = self.str()?;
+        let icon_size = self.point()?;
+        let icon_center = self.point()?;
+        let icon_color = self.color()?;
+        let hotkey_size = self.point()?;
+        let hotkey_center = self.point()?;
+        let hotkey_color = self.color()?;
+        let hotkey_bg_size = self.point()?;
+        let hotkey_bg_color = self.color()?;
+        let hotkey_bg_image = self.str()?;
+        let poison_size = self.point()?;
+        let poison_center = self.point()?;
+        let poison_color = self.color()?;
+        let poison_image = self.str()?;
+        let meter_kind = meter_from(self.u8()?)?;
+        let meter_center = self.point()?;
+        let meter_size = self.point()?;
+        let meter_empty_image = self.str()?;
+        let meter_empty_color = self.color()?;
+        let meter_fill_image = self.str()?;
+        let meter_fill_size = self.point()?;
+        let meter_fill_color = self.color()?;
+        let meter_start_angle = self.f32()?;
+        let meter_end_angle = self.f32()?;
+        let meter_arc_width = self.f32()?;
+        let meter_empty_quad = self.points()?;
+        let meter_fill_quad = self.points()?;
+        let meter_arc_outer = self.points()?;
+        let meter_arc_inner = self.points()?;
+
+        let count = self.count(1)?;
+        let mut text = Vec::with_capacity(count);
+        for _ in 0..count {
+            text.push(TextFlattened {
+                anchor: self.point()?,
+                color: self.color()?,
+                alignment: align_from(self.u8()?)?,
+                contents: self.str()?,
+                font_size: self.f32()?,
+                wrap_width: self.f32()?,
+                truncate: self.bool()?,
+            });
+        }
+
+        Some(SlotFlattened {
+            element,
+            center,
+            bg_size,
+            bg_color,
+            bg_image,
+            icon_size,
+            icon_center,
+            icon_color,
+            hotkey_size,
+            hotkey_center,
+            hotkey_color,
+            hotkey_bg_size,
+            hotkey_bg_color,
+            hotkey_bg_image,
+            poison_size,
+            poison_center,
+            poison_color,
+            poison_image,
+            meter_kind,
+            meter_center,
+            meter_size,
+            meter_empty_image,
+            meter_empty_color,
+            meter_fill_image,
+            meter_fill_size,
+            meter_fill_color,
+            meter_start_angle,
+            meter_end_angle,
+            meter_arc_width,
+            meter_empty_quad,
+            meter_fill_quad,
+            meter_arc_outer,
+            meter_arc_inner,
+            text,
+        })
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::path::Path;
+
+    use super::*;
+    use crate::layouts::source::parse;
+
+    fn layout_files(dir: &Path, found: &mut Vec<String>) {
+        let entries = fs::read_dir(dir).expect("the layout directories exist");
+        for entry in entries.flatten() {
+            let path = entry.path();
+            if path.is_dir() {
+                layout_files(&path, found);
+            } else if path.extension().is_some_and(|xs| xs == "toml") {
+                found.push(path.to_string_lossy().to_string());
+            }
+        }
+    }
+
+    #[test]
+    fn cached_layouts_match_fresh_ones() {
+        let mut files = Vec::new();
+        for dir in [
+            "layouts",
+            "tests/fixtures",
+            "installer/core/SKSE/plugins/soulsy_layouts",
+        ] {
+            layout_files(Path::new(dir), &mut files);
+        }
+        assert!(files.len() > 8, "found only {files:?}");
+
+        for file in files {
+            let buf = fs::read_to_string(&file).expect("can read the layout");
+            let layout = parse(&buf).expect("every layout we ship parses");
+            let key = CacheKey::current(content_hash(buf.as_bytes()));
+            let fresh = layout.flatten();
+            let bytes = encode(&key, &fresh);
+            let cached = decode(&bytes, &key).expect("the cache holds what we put in it");
+            // The shared structs don't implement PartialEq, but their Debug
+            // output includes every field and prints floats exactly.
+            assert_eq!(format!("{cached:?}"), format!("{fresh:?}"), "{file}");
+            assert_eq!(encode(&key, &cached), bytes, "{file}");
+        }
+    }
+
+    #[test]
+    fn cache_rejects_other_keys_and_damage() {
+        let buf = include_str!("../../tests/fixtures/layout-v2.toml");
+        let layout = parse(buf).expect("the fixture parses");
+        let key = CacheKey::current(content_hash(buf.as_bytes()));
+        let bytes = encode(&key, &layout.flatten());
+        assert!(decode(&bytes, &key).is_ok());
+
+        let edited = CacheKey {
+            content: key.content ^ 1,
+            ..key.clone()
+        };
+        assert!(decode(&bytes, &edited).is_err());
+        let resized = CacheKey {
+            width: 1920.0,
+            ..key.clone()
+        };
+        assert!(decode(&bytes, &resized).is_err());
+        let moved = CacheKey {
+            anchor: "top_left".to_string(),
+            ..key.clone()
+        };
+        assert!(decode(&bytes, &moved).is_err());
+        // A new release may flatten the same layout differently.
+        let upgraded = CacheKey {
+            build: format!("{BUILD}-next"),
+            ..key.clone()
+        };
+        assert!(decode(&bytes, &upgraded).is_err());
+
+        for index in [0, 9, bytes.len() / 2, bytes.len() - 1] {
+            let mut damaged = bytes.clone();
+            damaged[index] ^= 0x40;
+            assert!(decode(&damaged, &key).is_err(), "flipped byte {index}");
+        }
+        for len in 0..bytes.len() {
+            assert!(decode(&bytes[..len], &key).is_err(), "cut at {len}");
+        }
+    }
+}
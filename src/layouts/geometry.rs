@@ -0,0 +1,302 @@
+//! Meter geometry, worked out once when the layout is flattened instead of
+//! every frame in the renderer.
+//!
+//! A meter's shape depends only on the layout: where it is, how big it is, and
+//! its angles. Only how full it is changes from frame to frame. So we emit the
+//! shape of a full meter here, and the draw plan cuts it short at the current
+//! fill level, which needs no trigonometry.
+//!
+//! Rotated rectangles use the same corner order and math as the renderer's
+//! `rotateRect()`: top left, top right, bottom right, bottom left before
+//! rotation.
+
+use crate::plugin::{MeterKind, Point, SlotFlattened};
+
+/// Segments in a full circular meter's fill. The renderer used 20 per arc.
+pub const ARC_SEGMENTS: usize = 20;
+
+/// Rotate a vector about the origin by an angle in radians.
+pub fn rotate_vector(vector: &Point, angle: f32) -> Point {
+    let (sin_a, cos_a) = angle.sin_cos();
+    Point {
+        x: cos_a * vector.x - sin_a * vector.y,
+        y: sin_a * vector.x + cos_a * vector.y,
+    }
+}
+
+/// The corners of a rectangle of the given size, rotated about its center by
+/// an angle in radians, then moved to `center`.
+pub fn rotated_rect(center: &Point, size: &Point, angle: f32) -> Vec<Point> {
+    let (sin_a, cos_a) = angle.sin_cos();
+    let sin_x = sin_a * size.x * 0.5;
+    let cos_x = cos_a * size.x * 0.5;
+    let sin_y = sin_a * size.y * 0.5;
+    let cos_y = cos_a * size.y * 0.5;
+    [
+        Point {
+            x: -cos_x + sin_y,
+            y: -sin_x - cos_y,
+        },
+        Point {
+            x: cos_x + sin_y,
+            y: sin_x - cos_y,
+        },
+        Point {
+            x: cos_x - sin_y,
+            y: sin_x + cos_y,
+        },
+        Point {
+            x: -cos_x - sin_y,
+            y: -sin_x + cos_y,
+        },
+    ]
+    .iter()
+    .map(|xs| xs.translate(center))
+    .collect()
+}
+
+/// Points along a circle from one angle to another, in radians, with
+/// `segments + 1` points. The same points ImGui's `PathArcTo()` makes.
+pub fn arc_polyline(
+    center: &Point,
+    radius: f32,
+    start: f32,
+    end: f32,
+    segments: usize,
+) -> Vec<Point> {
+    (0..=segments)
+        .map(|i| {
+            let angle = start + (i as f32 / segments as f32) * (end - start);
+            Point {
+                x: center.x + angle.cos() * radius,
+                y: center.y + angle.sin() * radius,
+            }
+        })
+        .collect()
+}
+
+/// A rectangular fill quad cut short at a fill level from 0 to 100: the left
+/// edge stays put and the right edge slides toward it.
+pub fn clip_quad(quad: &[Point], level: f32) -> Vec<Point> {
+    let fraction = level.clamp(0.0, 100.0) * 0.01;
+    let lerp = |from: &Point, to: &Point| Point {
+        x: from.x + (to.x - from.x) * fraction,
+        y: from.y + (to.y - from.y) * fraction,
+    };
+    vec![
+        quad[0].clone(),
+        lerp(&quad[0], &quad[1]),
+        lerp(&quad[3], &quad[2]),
+        quad[3].clone(),
+    ]
+}
+
+/// A circular meter's fill at a level from 0 to 100, as one strip running
+/// along the arc: points alternate outer and inner, so each pair and the next
+/// bound one segment. The last pair is cut short partway through its segment.
+/// Drawn as a single mesh, neighboring segments share their edges instead of
+/// overlapping. Empty if the arcs don't match up or the meter is empty.
+pub fn arc_fill_strip(outer: &[Point], inner: &[Point], level: f32) -> Vec<Point> {
+    if outer.len() < 2 || outer.len() != inner.len() {
+        return Vec::new();
+    }
+    let segments = (outer.len() - 1) as f32 * level.clamp(0.0, 100.0) / 100.0;
+    let whole = segments as usize;
+    let partial = segments - whole as f32;
+    let lerp = |from: &Point, to: &Point| Point {
+        x: from.x + (to.x - from.x) * partial,
+        y: from.y + (to.y - from.y) * partial,
+    };
+    let cut = partial > 0.0 && whole + 1 < outer.len();
+    if whole == 0 && !cut {
+        return Vec::new();
+    }
+
+    let mut strip = Vec::with_capacity((whole + 2) * 2);
+    for i in 0..=whole {
+        strip.push(outer[i].clone());
+        strip.push(inner[i].clone());
+    }
+    if cut {
+        strip.push(lerp(&outer[whole], &outer[whole + 1]));
+        strip.push(lerp(&inner[whole], &inner[whole + 1]));
+    }
+    strip
+}
+
+/// Fill in the ready-to-draw meter shapes for a flattened slot from its other
+/// meter fields.
+pub fn add_meter_geometry(slot: &mut SlotFlattened) {
+    match slot.meter_kind {
+        MeterKind::Rectangular => {
+            // The layout's angle goes counter-clockwise; screen y points down.
+            let angle = -slot.meter_start_angle;
+            slot.meter_empty_quad = rotated_rect(&slot.meter_center, &slot.meter_size, angle);
+            slot.meter_fill_quad = rotated_rect(&slot.meter_center, &slot.meter_fill_size, angle);
+        }
+        MeterKind::CircleArc => {
+            let radius = slot.meter_size.x / 2.0;
+            slot.meter_arc_outer = arc_polyline(
+                &slot.meter_center,
+                radius,
+                slot.meter_start_angle,
+                slot.meter_end_angle,
+                ARC_SEGMENTS,
+            );
+            slot.meter_arc_inner = arc_polyline(
+                &slot.meter_center,
+                radius - slot.meter_arc_width,
+                slot.meter_start_angle,
+                slot.meter_end_angle,
+                ARC_SEGMENTS,
+            );
+        }
+        _ => {}
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::layouts::source::parse;
+
+    fn close(left: &Point, right: &Point) -> bool {
+        (left.x - right.x).abs() < 0.01 && (left.y - right.y).abs() < 0.01
+    }
+
+    /// The renderer's per-frame rectangular meter math, as it was.
+    fn fill_quad_the_old_way(
+        center: &Point,
+        fill_size: &Point,
+        angle: f32,
+        level: f32,
+    ) -> Vec<Point> {
+        let fill_len = fill_size.x * level * 0.01;
+        let size = Point {
+            x: fill_len,
+            y: fill_size.y,
+        };
+        let offset = Point {
+            x: (fill_len - fill_size.x) * 0.5,
+            y: 0.0,
+        };
+        let fill_center = rotate_vector(&offset, angle).translate(center);
+        rotated_rect(&fill_center, &size, angle)
+    }
+
+    #[test]
+    fn rotation_matches_the_renderer() {
+        let center = Point { x: 100.0, y: 50.0 };
+        let size = Point { x: 40.0, y: 10.0 };
+        let flat = rotated_rect(&center, &size, 0.0);
+        assert_eq!(flat[0], Point { x: 80.0, y: 45.0 });
+        assert_eq!(flat[2], Point { x: 120.0, y: 55.0 });
+
+        // A quarter turn swaps width and height around the same center.
+        let turned = rotated_rect(&center, &size, std::f32::consts::FRAC_PI_2);
+        assert!(
+            close(&turned[0], &Point { x: 105.0, y: 30.0 }),
+            "{turned:?}"
+        );
+        assert!(close(&turned[2], &Point { x: 95.0, y: 70.0 }), "{turned:?}");
+
+        let vector = Point { x: 1.0, y: 0.0 };
+        assert!(close(
+            &rotate_vector(&vector, std::f32::consts::PI),
+            &Point { x: -1.0, y: 0.0 }
+        ));
+    }
+
+    #[test]
+    fn clipped_fill_matches_the_old_math() {
+        let center = Point { x: 640.0, y: 360.0 };
+        let fill_size = Point { x: 120.0, y: 12.0 };
+        for degrees in [0.0f32, 30.0, 90.0, 135.0, 270.0] {
+            let angle = -degrees.to_radians();
+            let full = rotated_rect(&center, &fill_size, angle);
+            for level in [0.0f32, 12.5, 50.0, 99.0, 100.0] {
+                let old = fill_quad_the_old_way(&center, &fill_size, angle, level);
+                let new = clip_quad(&full, level);
+                for (left, right) in old.iter().zip(new.iter()) {
+                    assert!(
+                        close(left, right),
+                        "{degrees} degrees at {level}%: {old:?} {new:?}"
+                    );
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn arcs_run_from_start_to_end() {
+        let center = Point { x: 10.0, y: 10.0 };
+        let arc = arc_polyline(&center, 5.0, 0.0, std::f32::consts::PI, 4);
+        assert_eq!(arc.len(), 5);
+        assert!(close(&arc[0], &Point { x: 15.0, y: 10.0 }));
+        assert!(close(&arc[2], &Point { x: 10.0, y: 15.0 }));
+        assert!(close(&arc[4], &Point { x: 5.0, y: 10.0 }));
+    }
+
+    #[test]
+    fn arc_fills_stop_partway_through_a_segment() {
+        let center = Point { x: 0.0, y: 0.0 };
+        let outer = arc_polyline(&center, 10.0, 0.0, std::f32::consts::PI, 4);
+        let inner = arc_polyline(&center, 8.0, 0.0, std::f32::consts::PI, 4);
+        assert!(arc_fill_strip(&outer, &inner, 0.0).is_empty());
+        assert_eq!(arc_fill_strip(&outer, &inner, 100.0).len(), 10);
+        assert_eq!(arc_fill_strip(&outer, &inner, 150.0).len(), 10);
+
+        // 5/8 of the way: two whole segments and half of the third.
+        let strip = arc_fill_strip(&outer, &inner, 62.5);
+        assert_eq!(strip.len(), 8);
+        assert!(close(&strip[4], &outer[2]));
+        assert!(close(&strip[5], &inner[2]));
+        let halfway = Point {
+            x: (outer[2].x + outer[3].x) / 2.0,
+            y: (outer[2].y + outer[3].y) / 2.0,
+        };
+        assert!(close(&strip[6], &halfway), "{strip:?}");
+
+        // Neighboring segments share an edge rather than each having its own.
+        let full = arc_fill_strip(&outer, &inner, 100.0);
+        for (i, pair) in full.chunks_exact(2).enumerate() {
+            assert!(close(&pair[0], &outer[i]) && close(&pair[1], &inner[i]));
+        }
+        assert!(arc_fill_strip(&outer, &inner[..3], 50.0).is_empty());
+    }
+
+    #[test]
+    fn flattened_meters_carry_their_geometry() {
+        let buf = include_str!("../../tests/fixtures/layout-v2.toml");
+        let flattened = parse(buf).expect("the fixture parses").flatten();
+        let mut kinds = Vec::new();
+        for slot in flattened.slots.iter() {
+            match slot.meter_kind {
+                MeterKind::Rectangular => {
+                    kinds.push("rect");
+                    assert_eq!(slot.meter_empty_quad.len(), 4);
+                    assert_eq!(slot.meter_fill_quad.len(), 4);
+                    assert!(slot.meter_arc_outer.is_empty());
+                }
+                MeterKind::CircleArc => {
+                    kinds.push("arc");
+                    assert_eq!(slot.meter_arc_outer.len(), ARC_SEGMENTS + 1);
+                    assert_eq!(slot.meter_arc_inner.len(), ARC_SEGMENTS + 1);
+                    assert!(slot.meter_fill_quad.is_empty());
+                }
+                _ => {
+                    assert!(slot.meter_empty_quad.is_empty());
+                    assert!(slot.meter_arc_outer.is_empty());
+                }
+            }
+        }
+        assert!(
+            kinds.contains(&"rect"),
+            "the v2 fixture has rectangular meters"
+        );
+        assert!(
+            kinds.contains(&"arc"),
+            "the v2 fixture has a circular meter"
+        );
+    }
+}
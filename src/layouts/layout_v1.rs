@@ -148,9 +148,7 @@ impl HudLayout1 {
         self.size.clone()
     }
 
-    fn flatten(&self, slot: &SlotLayout) -> SlotFlattened {
-        let factor = self.scale_for_display();
-        let anchor = self.anchor_point();
+    fn flatten(&self, slot: &SlotLayout, anchor: &Point, factor: f32) -> SlotFlattened {
         let center = anchor.translate(&slot.offset.scale(factor));
 
         let mut text = Vec::new();
@@ -212,6 +210,10 @@ impl HudLayout1 {
             meter_start_angle: 0.0f32,
             meter_end_angle: 0.0f32,
             meter_arc_width: 0.0f32,
+            meter_empty_quad: Vec::new(),
+            meter_fill_quad: Vec::new(),
+            meter_arc_outer: Vec::new(),
+            meter_arc_inner: Vec::new(),
 
             text,
         }
@@ -225,12 +227,18 @@ impl HudLayout1 {
 
 impl From<&HudLayout1> for LayoutFlattened {
     fn from(v: &HudLayout1) -> Self {
-        let slots = v.layouts.iter().map(|xs| v.flatten(xs)).collect();
+        // Both of these read the settings, so work them out once.
         let factor = v.scale_for_display();
+        let anchor = v.anchor_point();
+        let slots = v
+            .layouts
+            .iter()
+            .map(|xs| v.flatten(xs, &anchor, factor))
+            .collect();
 
         LayoutFlattened {
             global_scale: factor,
-            anchor: v.anchor_point(),
+            anchor,
             size: v.size.scale(factor),
             bg_size: Point {
                 x: v.size.x * factor,
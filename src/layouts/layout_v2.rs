@@ -8,6 +8,7 @@ use eyre::{Context, Result};
 use serde::de::{Deserializer, Error};
 use serde::{Deserialize, Serialize};
 
+use super::geometry::add_meter_geometry;
 use super::shared::*;
 use crate::plugin::{
     Align, Color, HudElement, LayoutFlattened, MeterKind, Point, SlotFlattened, TextFlattened,
@@ -17,6 +18,10 @@ use crate::settings::settings;
 /// Where to arrange the HUD elements and what color to draw them in.
 ///
 /// This data is serialized to the SoulsyHUD_HudLayout.toml file.
+///
+/// The `*_glyphs` flags are deprecated and change nothing: the font gets glyphs
+/// for the characters the HUD actually draws. They're still read so older
+/// layouts load.
 #[derive(Deserialize, Serialize, Debug, Clone, Default)]
 pub struct HudLayout2 {
     #[serde(default)]
@@ -45,25 +50,25 @@ pub struct HudLayout2 {
     font: String,
     /// The font size for most things; a hint to the font loader.
     font_size: f32,
-    /// Whether to buld glyphs for full Chinese text display.
+    /// Deprecated and ignored. Was: build glyphs for full Chinese text display.
     #[serde(default)]
     chinese_full_glyphs: bool,
-    /// Whether to build glyphs for simplified Chinese text display.
+    /// Deprecated and ignored. Was: build glyphs for simplified Chinese text display.
     #[serde(default)]
     simplified_chinese_glyphs: bool,
-    /// Whether to build glyphs for simplified Chinese text display.
+    /// Deprecated and ignored. Was: build glyphs for Cyrillic text display.
     #[serde(default)]
     cyrillic_glyphs: bool,
-    /// Whether to build glyphs for Cyrillic text display.
+    /// Deprecated and ignored. Was: build glyphs for Japanese text display.
     #[serde(default)]
     japanese_glyphs: bool,
-    /// Whether to build glyphs for Japanese text display.
+    /// Deprecated and ignored. Was: build glyphs for Korean text display.
     #[serde(default)]
     korean_glyphs: bool,
-    /// Whether to build glyphs for Thai text display.
+    /// Deprecated and ignored. Was: build glyphs for Thai text display.
     #[serde(default)]
     thai_glyphs: bool,
-    /// Whether to build glyphs for Vietnamese text display.
+    /// Deprecated and ignored. Was: build glyphs for Vietnamese text display.
     #[serde(default)]
     vietnamese_glyphs: bool,
 }
@@ -121,19 +126,22 @@ impl HudLayout2 {
         )
     }
 
-    fn flatten_slot(&self, slot: &SlotElement, element: HudElement) -> SlotFlattened {
-        let scale = self.scale_for_display();
-
+    fn flatten_slot(
+        &self,
+        slot: &SlotElement,
+        element: HudElement,
+        anchor: &Point,
+        scale: f32,
+    ) -> SlotFlattened {
         let bg = slot.background.clone().unwrap_or_default();
         let hotkey = slot.hotkey.clone().unwrap_or_default();
         let hkbg = hotkey.background.unwrap_or_default();
 
-        let anchor = self.anchor_point();
         let center = anchor.translate(&slot.offset.scale(scale));
         let text = slot
             .text
             .iter()
-            .map(|xs| self.flatten_text(xs, &center))
+            .map(|xs| Self::flatten_text(xs, &center, scale))
             .collect();
 
         let poison = slot.poison.clone().unwrap_or_default();
@@ -157,7 +165,7 @@ impl HudLayout2 {
             meter_arc_width,
         ) = meter.tuple_for_flattening(&center, scale);
 
-        SlotFlattened {
+        let mut flattened = SlotFlattened {
             element,
             center: center.clone(),
             bg_size: bg.size.scale(scale),
@@ -187,12 +195,17 @@ impl HudLayout2 {
             meter_start_angle,
             meter_end_angle,
             meter_arc_width,
+            meter_empty_quad: Vec::new(),
+            meter_fill_quad: Vec::new(),
+            meter_arc_outer: Vec::new(),
+            meter_arc_inner: Vec::new(),
             text,
-        }
+        };
+        add_meter_geometry(&mut flattened);
+        flattened
     }
 
-    fn flatten_text(&self, text: &TextElement, center: &Point) -> TextFlattened {
-        let scale = self.scale_for_display();
+    fn flatten_text(text: &TextElement, center: &Point, scale: f32) -> TextFlattened {
         TextFlattened {
             anchor: center.translate(&text.offset.scale(scale)),
             color: text.color.clone(),
@@ -485,22 +498,24 @@ impl Default for PoisonElement {
 
 impl From<&HudLayout2> for LayoutFlattened {
     fn from(v: &HudLayout2) -> Self {
+        // Both of these read the settings, so work them out once.
+        let scale = v.scale_for_display();
+        let anchor = v.anchor_point();
         let mut slots = vec![
-            v.flatten_slot(&v.power, HudElement::Power),
-            v.flatten_slot(&v.utility, HudElement::Utility),
-            v.flatten_slot(&v.left, HudElement::Left),
-            v.flatten_slot(&v.right, HudElement::Right),
-            v.flatten_slot(&v.ammo, HudElement::Ammo),
+            v.flatten_slot(&v.power, HudElement::Power, &anchor, scale),
+            v.flatten_slot(&v.utility, HudElement::Utility, &anchor, scale),
+            v.flatten_slot(&v.left, HudElement::Left, &anchor, scale),
+            v.flatten_slot(&v.right, HudElement::Right, &anchor, scale),
+            v.flatten_slot(&v.ammo, HudElement::Ammo, &anchor, scale),
         ];
         if let Some(equipset) = v.equipset.as_ref() {
-            slots.push(v.flatten_slot(equipset, HudElement::EquipSet));
+            slots.push(v.flatten_slot(equipset, HudElement::EquipSet, &anchor, scale));
         }
         let bg = v.background.clone().unwrap_or_default();
-        let scale = v.scale_for_display();
 
         LayoutFlattened {
             global_scale: scale,
-            anchor: v.anchor_point(),
+            anchor,
             size: v.size.scale(scale),
             bg_size: bg.size.scale(scale),
             bg_color: bg.color.clone(),
@@ -1,12 +1,15 @@
 //! Layouts: two schema versions and associated machinery.
 
+pub mod cache;
+pub mod geometry;
 pub mod layout_v1;
 pub mod layout_v2;
 pub mod shared;
+pub mod source;
 
-use std::fs;
-use std::io::Write;
-use std::sync::Mutex;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, Mutex, RwLock};
+use std::time::Duration;
 
 use eyre::{eyre, Context, Result};
 pub use layout_v1::HudLayout1;
@@ -15,25 +18,96 @@ use once_cell::sync::Lazy;
 use serde::{Deserialize, Serialize};
 
 use self::shared::NamedAnchor;
+use self::source::{LayoutSource, Reading};
 use crate::control::notify;
 use crate::controller::control::translated_key;
+use crate::controller::redraw::{self, Published};
 use crate::controller::user_settings;
-use crate::plugin::{LayoutFlattened, Point};
+use crate::plugin::{LayoutFlattened, LayoutFont, Point};
 
 static LAYOUT_PATH: &str = "./data/SKSE/Plugins/SoulsyHUD_Layout.toml";
 
-/// There can be only one. Not public because we want access managed.
-static LAYOUT: Lazy<Mutex<LayoutFlattened>> = Lazy::new(|| Mutex::new(Layout::initialize()));
+/// There can be only one. Not public because we want access managed. The
+/// renderer reads this every frame, so a new layout is flattened first and
+/// then swapped in whole.
+static LAYOUT: Lazy<RwLock<Arc<LayoutFlattened>>> =
+    Lazy::new(|| RwLock::new(Arc::new(Layout::initialize())));
+
+/// The layout file as we last read it, so unchanged files aren't parsed
+/// again and anchor or scale changes can be applied without reading it.
+static SOURCE: Lazy<Mutex<LayoutSource>> =
+    Lazy::new(|| Mutex::new(LayoutSource::with_cache(cache::CACHE_PATH)));
 
 /// Lazy parsing of the compile-time include of the default layout, as a fallback.
 static DEFAULT_LAYOUT: Lazy<HudLayout2> = Lazy::new(HudLayout2::fallback);
 
-/// The accessor for anybody who needs to use the layout.
-pub fn hud_layout() -> LayoutFlattened {
-    let layout = LAYOUT
+/// Whether the watcher thread should be looking at the layout file.
+static WATCHING: AtomicBool = AtomicBool::new(false);
+/// Whether there's a watcher thread. It exits once watching is turned off.
+static WATCHER_RUNNING: AtomicBool = AtomicBool::new(false);
+/// How often the watcher looks at the file. Edits don't need to show up instantly.
+const WATCH_INTERVAL: Duration = Duration::from_secs(2);
+
+/// The accessor for anybody who needs to use the layout. Cheap; the layout
+/// in use is shared, not copied.
+pub fn hud_layout() -> Arc<LayoutFlattened> {
+    match LAYOUT.read() {
+        Ok(layout) => Arc::clone(&layout),
+        Err(poisoned) => Arc::clone(&poisoned.into_inner()),
+    }
+}
+
+/// The font the layout in use asks for. The font loader needs only this, so
+/// C++ gets it without a copy of the whole layout.
+pub fn layout_font() -> LayoutFont {
+    let layout = hud_layout();
+    LayoutFont {
+        file: layout.font.clone(),
+        size: layout.font_size,
+    }
+}
+
+/// Start or stop watching the layout file for edits. bWatchLayout
+pub fn watch_layout_file(enabled: bool) {
+    WATCHING.store(enabled, Ordering::SeqCst);
+    if !enabled || WATCHER_RUNNING.swap(true, Ordering::SeqCst) {
+        return;
+    }
+    let spawned = std::thread::Builder::new()
+        .name("SoulsyHUD layout watcher".to_string())
+        .spawn(|| loop {
+            std::thread::sleep(WATCH_INTERVAL);
+            if WATCHING.load(Ordering::SeqCst) {
+                Layout::poll();
+                continue;
+            }
+            // Watching was turned off. If it's turned on again while we're
+            // leaving, either we see it here or the caller sees we've gone.
+            WATCHER_RUNNING.store(false, Ordering::SeqCst);
+            if !WATCHING.load(Ordering::SeqCst) || WATCHER_RUNNING.swap(true, Ordering::SeqCst) {
+                break;
+            }
+        });
+    if let Err(e) = spawned {
+        WATCHER_RUNNING.store(false, Ordering::SeqCst);
+        log::warn!("Unable to start watching the layout file; {e:#}");
+    }
+}
+
+fn layout_source() -> std::sync::MutexGuard<'static, LayoutSource> {
+    SOURCE
         .lock()
-        .expect("Unrecoverable runtime problem: cannot acquire layout lock.");
-    layout.clone()
+        .expect("Unrecoverable runtime problem: cannot acquire layout lock.")
+}
+
+/// Swap in a new layout. Readers holding the old one keep it until they're done.
+fn publish(flattened: LayoutFlattened) {
+    let fresh = Arc::new(flattened);
+    match LAYOUT.write() {
+        Ok(mut layout) => *layout = fresh,
+        Err(poisoned) => *poisoned.into_inner() = fresh,
+    }
+    redraw::published(Published::Layout);
 }
 
 #[derive(Serialize, Deserialize, Debug, Clone)]
@@ -52,69 +126,84 @@ impl Default for Layout {
 impl Layout {
     /// Read the layout at startup, falling back if necessary.
     pub fn initialize() -> LayoutFlattened {
-        let layout = match Layout::read_from_file(LAYOUT_PATH) {
-            Ok(v) => v,
+        let reading = layout_source().reflatten(LAYOUT_PATH);
+        match reading {
+            Ok(Reading::Changed(flattened)) => flattened,
+            Ok(Reading::Failed(e)) => {
+                log::warn!("Problem reading the enabled layout file! {e}");
+                Layout::default().flatten()
+            }
+            Ok(Reading::Unchanged) => Layout::default().flatten(),
             Err(e) => {
                 log::warn!("Problem reading the enabled layout file! {e:#}");
-                Layout::default()
+                Layout::default().flatten()
             }
-        };
-        layout.flatten()
+        }
     }
 
-    /// Read the layout from disk to pick up any changes to the file.
+    /// Read the layout from disk to pick up any changes to the file. Does
+    /// nothing if the file's contents haven't changed since the last read.
     pub fn refresh() {
-        match Layout::read_from_file(LAYOUT_PATH) {
-            Ok(v) => {
-                let mut hudl = LAYOUT
-                    .lock()
-                    .expect("Unrecoverable runtime problem: cannot acquire layout lock.");
-                *hudl = v.flatten();
+        // The source lock is let go before publishing, which might need to
+        // initialize the layout and take it again.
+        let reading = layout_source().refresh(LAYOUT_PATH);
+        match reading {
+            Ok(Reading::Unchanged) => log::debug!("The layout file hasn't changed."),
+            Ok(Reading::Changed(flattened)) => {
+                publish(flattened);
+                log::info!("Layout refreshed from {LAYOUT_PATH}.");
+            }
+            Ok(Reading::Failed(e)) => {
+                let msg = translated_key("$SoulsyHUD_Layout_Failed_Msg");
+                notify(&msg);
+                log::warn!("The toml file at '{LAYOUT_PATH}' is {e}");
+                log::warn!("In-game layout not updated.");
             }
             Err(e) => {
                 log::warn!("{e:#}");
-                log::warn!("In-game layout not updated.")
+                log::warn!("In-game layout not updated.");
             }
-        };
-    }
-
-    /// Read a layout object from a toml file.
-    pub fn read_from_file(pathstr: &str) -> Result<Self> {
-        let path = std::path::Path::new(pathstr);
-        if !path.exists() {
-            // No file? We write out defaults.
-            let layout = DEFAULT_LAYOUT.clone();
-            let buf = toml::to_string_pretty(&layout)?;
-            let mut fp = fs::File::create(path)?;
-            write!(fp, "{buf}")?;
-            return Ok(Layout::Version2(Box::new(layout)));
         }
+    }
 
-        let buf = fs::read_to_string(path)
-            .wrap_err_with(|| format!("Unable to read the layout file: {}", pathstr))?;
-        match toml::from_str::<Layout>(&buf) {
-            Ok(v) => {
-                // could notify here if we wanted with $SoulsyHUD_Layout_Refreshed_Msg
-                Ok(v)
+    /// What the watcher does: a cheaper check than `refresh()` that trusts
+    /// the file's modification time and size. Doesn't notify the player,
+    /// because this runs on the watcher's thread, and leaves a deleted file
+    /// deleted.
+    fn poll() {
+        let reading = layout_source().poll(LAYOUT_PATH);
+        match reading {
+            Ok(Reading::Unchanged) => {}
+            Ok(Reading::Changed(flattened)) => {
+                publish(flattened);
+                log::info!("The layout file changed; new layout in use.");
             }
-            Err(_) => {
-                let msg = translated_key("$SoulsyHUD_Layout_Failed_Msg");
-                notify(&msg);
-                // We know these are both errors or we wouldn't be here.
-                let v1err = HudLayout1::read_from_file(pathstr)
-                    .expect_err("Layout parsing failed but v1 succeeded? WAT.");
-                eprintln!("{v1err:#}");
-                let v2err = HudLayout2::read_from_file(pathstr)
-                    .expect_err("Layout parsing failed but v2 succeeded? WAT.");
-                eprintln!("{v2err:#}");
-                Err(eyre!(
-                    "The toml file at '{}' can't be parsed as a SoulsyHUD layout.",
-                    pathstr
-                ))
+            Ok(Reading::Failed(e)) => {
+                log::warn!("The layout file changed but is {e}");
             }
+            Err(e) => log::debug!("Unable to check the layout file; {e:#}"),
         }
     }
 
+    /// Flatten the layout we last read again, to pick up new anchor or scale
+    /// settings. Only reads the file if it hasn't been parsed yet.
+    pub fn reflatten() {
+        let reading = layout_source().reflatten(LAYOUT_PATH);
+        match reading {
+            Ok(Reading::Changed(flattened)) => publish(flattened),
+            Ok(Reading::Unchanged) => {}
+            Ok(Reading::Failed(e)) => log::warn!("The layout file is {e}"),
+            Err(e) => log::warn!("{e:#}"),
+        }
+    }
+
+    /// Read a layout object from a toml file.
+    pub fn read_from_file(pathstr: &str) -> Result<Self> {
+        let buf = std::fs::read_to_string(pathstr)
+            .wrap_err_with(|| format!("Unable to read the layout file: {}", pathstr))?;
+        source::parse(&buf).map_err(|e| eyre!("The toml file at '{}' is {}", pathstr, e))
+    }
+
     /// Convert the editable human-facing layout format to the format used by
     /// the renderer. This process scales all sizes and translates all locations
     /// from relative to absolute in screen space.
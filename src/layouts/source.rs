@@ -0,0 +1,367 @@
+//! The layout file on disk, and whether it has changed since we last read it.
+//!
+//! Layout authors edit the toml file and press the refresh hotkey over and
+//! over, and the optional watcher checks the file every couple of seconds.
+//! Most of those checks find nothing new. We remember the file's modification
+//! time, size, and a hash of its contents so we only parse text we haven't
+//! seen before, and text we've seen on an earlier launch usually comes out of
+//! the compiled cache without being parsed at all. When the text doesn't
+//! parse, the error (with its line and column) is worked out once and kept
+//! until the file changes again.
+
+use std::fmt::Display;
+use std::fs;
+use std::path::Path;
+use std::time::SystemTime;
+
+use eyre::{Context, Result};
+
+use super::cache::{self, content_hash, CacheKey};
+use super::{HudLayout1, HudLayout2, Layout, DEFAULT_LAYOUT};
+use crate::plugin::LayoutFlattened;
+
+/// Why a layout file couldn't be used. Lines and columns count from 1; zero
+/// means the parser couldn't say where the problem was.
+#[derive(Debug, Clone, PartialEq)]
+pub struct LayoutError {
+    /// Which layout schema we think the file was trying to be.
+    pub version: u8,
+    pub message: String,
+    pub line: usize,
+    pub column: usize,
+}
+
+impl LayoutError {
+    fn new(buf: &str, version: u8, err: &toml::de::Error) -> Self {
+        // toml's messages can run to several lines; keep them to one.
+        let message = err
+            .message()
+            .lines()
+            .map(str::trim)
+            .filter(|xs| !xs.is_empty())
+            .collect::<Vec<_>>()
+            .join("; ");
+        let Some(span) = err.span() else {
+            return Self {
+                version,
+                message,
+                line: 0,
+                column: 0,
+            };
+        };
+        let before = buf.get(..span.start).unwrap_or(buf);
+        let line = before.matches('\n').count() + 1;
+        let column = before
+            .rsplit('\n')
+            .next()
+            .map_or(0, |xs| xs.chars().count())
+            + 1;
+        Self {
+            version,
+            message,
+            line,
+            column,
+        }
+    }
+}
+
+impl Display for LayoutError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        if self.line > 0 {
+            write!(
+                f,
+                "not a valid v{} layout at line {}, column {}: {}",
+                self.version, self.line, self.column, self.message
+            )
+        } else {
+            write!(f, "not a valid v{} layout: {}", self.version, self.message)
+        }
+    }
+}
+
+impl std::error::Error for LayoutError {}
+
+/// Parse the text of a layout file. Tries the current schema first.
+pub fn parse(buf: &str) -> std::result::Result<Layout, LayoutError> {
+    let v2err = match toml::from_str::<HudLayout2>(buf) {
+        Ok(v) => return Ok(Layout::Version2(Box::new(v))),
+        Err(e) => e,
+    };
+    let v1err = match toml::from_str::<HudLayout1>(buf) {
+        Ok(v) => return Ok(Layout::Version1(Box::new(v))),
+        Err(e) => e,
+    };
+    // Whichever schema got further into the file before giving up is most
+    // likely the one the author was writing.
+    let start = |err: &toml::de::Error| err.span().map_or(0, |xs| xs.start);
+    if start(&v1err) > start(&v2err) {
+        Err(LayoutError::new(buf, 1, &v1err))
+    } else {
+        Err(LayoutError::new(buf, 2, &v2err))
+    }
+}
+
+/// What we found when we looked at the file.
+#[derive(Debug, Clone)]
+pub enum Reading {
+    /// Nothing new to do.
+    Unchanged,
+    /// The file changed or the settings did, and this is the layout to use now.
+    Changed(LayoutFlattened),
+    /// The file doesn't hold a layout we can use.
+    Failed(LayoutError),
+}
+
+/// The layout file as we last saw it.
+#[derive(Debug, Default)]
+pub struct LayoutSource {
+    modified: Option<SystemTime>,
+    len: Option<u64>,
+    hash: Option<u64>,
+    parsed: Option<Layout>,
+    error: Option<LayoutError>,
+    /// Where to keep the compiled layout, if anywhere.
+    cache: Option<String>,
+}
+
+impl LayoutSource {
+    pub fn with_cache(pathstr: &str) -> Self {
+        Self {
+            cache: Some(pathstr.to_string()),
+            ..Self::default()
+        }
+    }
+
+    /// Cheap check for the watcher: if the file's modification time and size
+    /// are what they were last time, don't even read it. A missing file is
+    /// no change; the layout in use stays, and the file isn't written out.
+    pub fn poll(&mut self, pathstr: &str) -> Result<Reading> {
+        let path = Path::new(pathstr);
+        if !path.exists() {
+            return Ok(Reading::Unchanged);
+        }
+        if self.hash.is_some() {
+            let meta = fs::metadata(path)?;
+            if meta.modified().ok() == self.modified && Some(meta.len()) == self.len {
+                return Ok(Reading::Unchanged);
+            }
+        }
+        self.refresh(pathstr)
+    }
+
+    /// Read the file and parse it if its contents changed. If the contents
+    /// are the same and didn't parse last time, hand back that error again.
+    /// A missing file is written out with the default layout.
+    pub fn refresh(&mut self, pathstr: &str) -> Result<Reading> {
+        let path = Path::new(pathstr);
+        if !path.exists() {
+            // No file? We write out defaults.
+            let buf = toml::to_string_pretty(&*DEFAULT_LAYOUT)?;
+            fs::write(path, buf)?;
+        }
+
+        let meta = fs::metadata(path)
+            .wrap_err_with(|| format!("Unable to read the layout file: {}", pathstr))?;
+        let buf = fs::read_to_string(path)
+            .wrap_err_with(|| format!("Unable to read the layout file: {}", pathstr))?;
+        self.modified = meta.modified().ok();
+        self.len = Some(meta.len());
+
+        let hash = content_hash(buf.as_bytes());
+        if self.hash == Some(hash) {
+            return Ok(match &self.error {
+                Some(e) => Reading::Failed(e.clone()),
+                None => Reading::Unchanged,
+            });
+        }
+        self.hash = Some(hash);
+
+        let key = CacheKey::current(hash);
+        if let Some(flattened) = self.cache.as_deref().and_then(|xs| cache::load(xs, &key)) {
+            log::debug!("Using the compiled layout cache.");
+            // We'll parse if the settings change and the cache doesn't match.
+            self.parsed = None;
+            self.error = None;
+            return Ok(Reading::Changed(flattened));
+        }
+
+        match parse(&buf) {
+            Ok(layout) => {
+                let flattened = layout.flatten();
+                self.parsed = Some(layout);
+                self.error = None;
+                self.store(&key, &flattened);
+                Ok(Reading::Changed(flattened))
+            }
+            Err(e) => {
+                self.error = Some(e.clone());
+                Ok(Reading::Failed(e))
+            }
+        }
+    }
+
+    /// Flatten the layout again for new anchor or scale settings. Parses the
+    /// file only if we don't have a parsed layout already.
+    pub fn reflatten(&mut self, pathstr: &str) -> Result<Reading> {
+        match (&self.parsed, self.hash) {
+            (Some(layout), Some(hash)) => {
+                let flattened = layout.flatten();
+                if self.error.is_none() {
+                    self.store(&CacheKey::current(hash), &flattened);
+                }
+                Ok(Reading::Changed(flattened))
+            }
+            _ => {
+                self.hash = None;
+                self.refresh(pathstr)
+            }
+        }
+    }
+
+    fn store(&self, key: &CacheKey, flattened: &LayoutFlattened) {
+        if let Some(pathstr) = self.cache.as_deref() {
+            cache::store(pathstr, key, flattened);
+        }
+    }
+
+    /// The last layout that parsed, even if the file has since been broken.
+    pub fn parsed(&self) -> Option<&Layout> {
+        self.parsed.as_ref()
+    }
+
+    /// Why the current contents of the file can't be used, if they can't.
+    pub fn error(&self) -> Option<&LayoutError> {
+        self.error.as_ref()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::path::PathBuf;
+
+    use super::*;
+    use crate::controller::settings::{use_settings_on_this_thread, UserSettings};
+
+    fn scratch_file(name: &str) -> PathBuf {
+        let path =
+            std::env::temp_dir().join(format!("soulsy-{}-{}.toml", name, std::process::id()));
+        let _ = fs::remove_file(&path);
+        path
+    }
+
+    #[test]
+    fn parse_errors_say_where() {
+        let square =
+            include_str!("../../installer/core/SKSE/plugins/soulsy_layouts/SoulsyHUD_square.toml");
+        assert!(matches!(parse(square), Ok(Layout::Version2(_))));
+        let original = include_str!("../../tests/fixtures/layout-v1.toml");
+        assert!(matches!(parse(original), Ok(Layout::Version1(_))));
+
+        let broken = "global_scale = 1.0\nanchor_name = \"center\"\nsize = { x = 300, y = }\n";
+        let err = parse(broken).expect_err("that is not toml");
+        assert_eq!(err.line, 3);
+        assert_eq!(err.column, 23);
+
+        // A typo deep inside a v2 layout is reported as a v2 problem, at the
+        // table missing what was misspelled.
+        let typo = square.replacen("[right.icon]", "[right.ikon]", 1);
+        let err = parse(&typo).expect_err("a v2 layout with a misspelled table");
+        assert_eq!(err.version, 2);
+        let right = square
+            .lines()
+            .position(|xs| xs.trim() == "[right]")
+            .expect("the square layout has a [right] table")
+            + 1;
+        assert_eq!(
+            err.line, right,
+            "the [right] table is on line {right}; {err}"
+        );
+        assert!(err.message.contains("icon"), "{err}");
+    }
+
+    #[test]
+    fn unchanged_files_are_not_parsed_again() {
+        let path = scratch_file("unchanged");
+        let pathstr = path.to_str().expect("temp paths are utf8 here");
+        let square =
+            include_str!("../../installer/core/SKSE/plugins/soulsy_layouts/SoulsyHUD_square.toml");
+        fs::write(&path, square).expect("can write to the temp dir");
+
+        let mut source = LayoutSource::default();
+        assert!(matches!(source.poll(pathstr), Ok(Reading::Changed(_))));
+        assert!(matches!(source.poll(pathstr), Ok(Reading::Unchanged)));
+        assert!(matches!(source.refresh(pathstr), Ok(Reading::Unchanged)));
+
+        // Same text written again: the stat check passes it on, the hash stops it.
+        fs::write(&path, format!("{square}\n")).expect("can write to the temp dir");
+        assert!(matches!(source.refresh(pathstr), Ok(Reading::Changed(_))));
+        fs::write(&path, format!("{square}\n")).expect("can write to the temp dir");
+        assert!(matches!(source.refresh(pathstr), Ok(Reading::Unchanged)));
+
+        fs::write(&path, "size = {").expect("can write to the temp dir");
+        let Ok(Reading::Failed(first)) = source.poll(pathstr) else {
+            panic!("a broken layout should fail");
+        };
+        assert!(source.parsed().is_some(), "the last good layout is kept");
+        assert_eq!(source.error(), Some(&first));
+        // Pressing refresh again shows the kept error without a re-parse.
+        let Ok(Reading::Failed(again)) = source.refresh(pathstr) else {
+            panic!("still broken");
+        };
+        assert_eq!(first, again);
+        assert!(matches!(source.poll(pathstr), Ok(Reading::Unchanged)));
+
+        fs::write(&path, square).expect("can write to the temp dir");
+        assert!(matches!(source.refresh(pathstr), Ok(Reading::Changed(_))));
+        assert!(source.error().is_none());
+
+        // The watcher leaves a deleted file deleted; only a refresh writes it out.
+        fs::remove_file(&path).expect("can remove from the temp dir");
+        assert!(matches!(source.poll(pathstr), Ok(Reading::Unchanged)));
+        assert!(!path.exists());
+        assert!(source.refresh(pathstr).is_ok());
+        assert!(path.exists());
+        let _ = fs::remove_file(&path);
+    }
+
+    #[test]
+    fn a_second_launch_uses_the_cache() {
+        // Other tests change the shared settings, which would change the cache key.
+        use_settings_on_this_thread(Some(UserSettings::default()));
+        let path = scratch_file("cached");
+        let pathstr = path.to_str().expect("temp paths are utf8 here");
+        let cache_path = path.with_extension("bin");
+        let cachestr = cache_path.to_str().expect("temp paths are utf8 here");
+        let _ = fs::remove_file(&cache_path);
+        let buf = include_str!("../../tests/fixtures/layout-v1.toml");
+        fs::write(&path, buf).expect("can write to the temp dir");
+
+        let mut first = LayoutSource::with_cache(cachestr);
+        let Ok(Reading::Changed(parsed)) = first.refresh(pathstr) else {
+            panic!("the fixture is a layout");
+        };
+        assert!(first.parsed().is_some());
+        assert!(cache_path.exists());
+
+        let mut second = LayoutSource::with_cache(cachestr);
+        let Ok(Reading::Changed(cached)) = second.refresh(pathstr) else {
+            panic!("the fixture is still a layout");
+        };
+        assert!(
+            second.parsed().is_none(),
+            "came from the cache, not the parser"
+        );
+        assert_eq!(format!("{cached:?}"), format!("{parsed:?}"));
+        // Without a parsed layout, a reflatten reads the file again.
+        assert!(matches!(second.reflatten(pathstr), Ok(Reading::Changed(_))));
+
+        // Edited text doesn't match the cache, so it gets parsed.
+        fs::write(&path, format!("{buf}\n# edited\n")).expect("can write to the temp dir");
+        assert!(matches!(second.refresh(pathstr), Ok(Reading::Changed(_))));
+        assert!(second.parsed().is_some());
+
+        let _ = fs::remove_file(&path);
+        let _ = fs::remove_file(&cache_path);
+        use_settings_on_this_thread(None);
+    }
+}
@@ -15,8 +15,11 @@ pub mod layouts;
 use controller::*;
 use data::huditem::{empty_extra_data, HudItem, RelevantExtraData};
 use data::{SpellData, *};
-use images::{get_icon_key, rasterize_by_path, rasterize_icon};
-use layouts::hud_layout;
+use images::{
+    atlas_place, get_icon_key, rasterize_batch, rasterize_by_path, rasterize_icon, start_animation,
+    take_sprite_sheet, texture_budget_report, textures_drawn,
+};
+use layouts::layout_font;
 
 /// Rust defines the bridge between it and C++ in the `plugin` mod, using the
 /// affordances of the `cxx` crate. At build time `cxx_build` generates the
@@ -156,6 +159,14 @@ pub mod plugin {
         meter_start_angle: f32,
         meter_end_angle: f32,
         meter_arc_width: f32,
+        /// Corners of a rectangular meter's background, rotated, in screen space.
+        meter_empty_quad: Vec<Point>,
+        /// Corners of a rectangular meter's fill when full. Cut short by the renderer.
+        meter_fill_quad: Vec<Point>,
+        /// The outer edge of a circular meter's fill when full, start to end angle.
+        meter_arc_outer: Vec<Point>,
+        /// The inner edge of a circular meter's fill, point for point with the outer.
+        meter_arc_inner: Vec<Point>,
 
         text: Vec<TextFlattened>,
     }
@@ -179,6 +190,13 @@ pub mod plugin {
         truncate: bool,
     }
 
+    /// The font a layout asks for: the ttf or otf file, and the size to load it at.
+    #[derive(Clone, Debug, Default)]
+    pub struct LayoutFont {
+        file: String,
+        size: f32,
+    }
+
     /// This enum maps key presses to the desired action. More like a C/java
     /// enum than a Rust sum type enum. It's also more like an event name than
     /// a key press map at this point.
@@ -238,10 +256,10 @@ pub mod plugin {
 
     /// What Rust did with a key event, so the C++ caller can present UI.
     ///
-    /// This struct passes data from controller to C++ to signal if it should
-    /// start or stop a timer, and if so which timer. For complicated reasons,
-    /// timers on the Rust side are impractical (they need to be async) and so I
-    /// am doing them on the  C++ side.
+    /// The controller also says which timer this key starts or stops, if any.
+    /// Those are applied on the Rust side before C++ sees the response, since
+    /// the timers live in the controller's timer wheel now; they stay here so
+    /// recorded sessions can check them.
     #[derive(Debug, Clone, PartialEq, Eq)]
     struct KeyEventResponse {
         /// Did we handle this keypress?
@@ -252,6 +270,33 @@ pub mod plugin {
         stop_timer: Action,
     }
 
+    /// One button event from the game's input sink, reduced to the parts we
+    /// use. C++ sends these in batches, one batch per input event list.
+    #[derive(Debug, Clone, Copy, PartialEq)]
+    struct ButtonPress {
+        /// The key code, adjusted for the device the event came from.
+        key: u32,
+        /// Greater than zero if the button is pressed.
+        value: f32,
+        /// How long the button has been held, in seconds. Zero on the first press.
+        held_secs: f32,
+    }
+
+    /// Game events that might change the enchantment charge, poison, or
+    /// cooldown data shown for an item. C++ sends these from its event sinks
+    /// so we refresh extra data only when something happened.
+    #[derive(Debug, Clone, Hash)]
+    enum ExtraDataEvent {
+        /// The player hit something with a weapon, possibly using charge or poison.
+        ChargeUsed,
+        /// The player used up a poison, probably by applying it to a weapon.
+        PoisonApplied,
+        /// The player used up a soul gem, probably to recharge a weapon.
+        Recharged,
+        /// The player shouted, so the shout cooldown has started.
+        ShoutCooldownStarted,
+    }
+
     /// What the player has equipped, and which armor slots are empty.
     #[derive(Debug, Clone, PartialEq, Eq)]
     struct EquippedData {
@@ -259,6 +304,15 @@ pub mod plugin {
         empty_slots: Vec<u8>,
     }
 
+    /// One thing the player has: an inventory item and how many of it, or a
+    /// spell or shout they know, which counts as one. C++ sends all of these
+    /// at once, sorted by form spec.
+    #[derive(Debug, Clone, PartialEq, Eq)]
+    struct InventoryEntry {
+        form_spec: String,
+        count: u32,
+    }
+
     /// Struct passing rasterized SVG data around.
     #[derive(Debug, Default, Clone)]
     struct LoadedImage {
@@ -267,6 +321,117 @@ pub mod plugin {
         buffer: Vec<u8>,
     }
 
+    /// One svg to rasterize as part of a batch. A `maxdim` of 0 means the
+    /// svg's own size; otherwise its longer side is scaled to `maxdim`.
+    #[derive(Debug, Default, Clone)]
+    struct RasterRequest {
+        path: String,
+        maxdim: u32,
+    }
+
+    /// Every frame of an animation strip in one image, laid out in a grid
+    /// left to right and top to bottom. Each frame sits `gutter` pixels
+    /// inside its cell. An empty sheet has no frames.
+    #[derive(Debug, Default, Clone)]
+    struct SpriteSheet {
+        image: LoadedImage,
+        frames: u32,
+        columns: u32,
+        frame_width: u32,
+        frame_height: u32,
+        gutter: u32,
+    }
+
+    /// Textures the renderer must let go of: images to forget, and whole atlas
+    /// pages to release. Forget the images first.
+    #[derive(Debug, Default, Clone)]
+    struct TextureEvictions {
+        keys: Vec<String>,
+        pages: Vec<u32>,
+    }
+
+    /// Where the texture atlas put an image, in pixels on one of its pages.
+    #[derive(Debug, Default, Clone)]
+    struct AtlasPlacement {
+        /// False if the image needs a texture of its own.
+        placed: bool,
+        /// True if the image is new to the atlas and its pixels need uploading.
+        fresh: bool,
+        /// Report this id when drawing the image, so the budget knows it's in use.
+        id: u32,
+        page: u32,
+        page_size: u32,
+        x: u32,
+        y: u32,
+        width: u32,
+        height: u32,
+        /// Clear pixels to upload around the image.
+        padding: u32,
+    }
+
+    /// What the renderer knows about this frame that the HUD's look depends on.
+    #[derive(Debug, Default, Clone)]
+    struct FrameInputs {
+        /// The HUD's alpha after this frame's fading.
+        alpha: f32,
+        /// The game's resolution, which may not be ImGui's display size.
+        width: f32,
+        height: f32,
+        ranged_equipped: bool,
+        /// Bumped whenever a texture the HUD might draw from is released.
+        textures: u32,
+    }
+
+    /// What a draw plan command draws.
+    #[derive(Debug, Clone)]
+    enum DrawKind {
+        /// An image centered on `center` and scaled to `size`.
+        Image,
+        /// An image stretched over the four corners in `points`.
+        ImageQuad,
+        /// An untextured band in the plain color, drawn as one mesh. `points`
+        /// alternate between its two edges; each pair and the next make a quad.
+        Strip,
+        /// A text run anchored at `center`.
+        Text,
+    }
+
+    /// Where a draw plan command's image comes from.
+    #[derive(Debug, Clone)]
+    enum ImageSource {
+        None,
+        /// A HUD image file, named by `image`.
+        Hud,
+        /// An item icon, named by its icon key in `image`.
+        Icon,
+        /// The button glyph for the key code in `hotkey`.
+        Hotkey,
+        /// Frame `frame` of the animation strip named by `image`.
+        Sprite,
+    }
+
+    /// One thing to draw, with everything resolved but the textures and the
+    /// text measurements. Colors are not yet faded by the HUD's alpha.
+    #[derive(Debug, Clone)]
+    struct DrawCommand {
+        kind: DrawKind,
+        source: ImageSource,
+        image: String,
+        hotkey: u32,
+        frame: u32,
+        center: Point,
+        size: Point,
+        /// Scale the image to fit inside `size` without stretching it.
+        fit: bool,
+        points: Vec<Point>,
+        color: Color,
+        text: String,
+        font_size: f32,
+        alignment: Align,
+        wrap_width: f32,
+        truncate: bool,
+    }
+
     extern "Rust" {
         /// Tell the rust side where to log.
         fn initialize_rust_logging(logdir: &CxxVector<u16>);
@@ -293,6 +458,9 @@ pub mod plugin {
         fn string_to_utf8(bytes: &CxxVector<u8>) -> String;
         /// Decode a null-terminated C string from whatever it is to utf-8.
         fn cstr_to_utf8(bytes_ffi: &CxxVector<u8>) -> String;
+        /// Decode a form name to utf-8, given the file name of the plugin it came from.
+        /// Neither needs a null terminator, and neither is copied.
+        fn name_to_utf8(plugin: &[u8], name: &[u8]) -> String;
 
         /// If we're registered with the trainwreck crash logger, and we're in
         /// the process of crashing, try to provide info for the Trainwreck section.
@@ -310,7 +478,27 @@ pub mod plugin {
         /// On save load or death restore, wipe the hud item cache.
         fn clear_cache();
         /// Refresh the enchant charge / time remaining / poisoned status of all visible items.
+        /// This is a slow-interval safety net; events drive most refreshes.
         fn refresh_hud_items();
+        /// Run commands queued by the render thread: timers that ran out and
+        /// slow refreshes. Call once a frame from the render thread.
+        fn drain_commands();
+        /// Refresh extra data only for visible items an event has marked out of date.
+        /// Cheap when nothing changed, so the renderer calls it every frame.
+        fn refresh_stale_hud_items();
+        /// Once a frame: false if the HUD would look the same as last frame, so
+        /// the renderer can submit what it built then instead of building again.
+        fn hud_needs_rebuild(inputs: &FrameInputs) -> bool;
+        /// The HUD's draw plan as of the last `hud_needs_rebuild()`, in drawing order.
+        fn hud_draw_plan() -> Vec<DrawCommand>;
+        /// Once a frame: move the equip delay and long-press timers on by this many
+        /// seconds, acting on any that run out.
+        fn advance_timers(delta: f32);
+        /// Moves whenever the HUD is about to draw characters its font has no glyphs for.
+        fn font_glyphs_generation() -> u32;
+        /// Glyph ranges covering every character the HUD has drawn, in ImGui's
+        /// first-last pairs. Add the terminating zero.
+        fn font_glyph_ranges() -> Vec<u32>;
 
         /// Give access to the settings to the C++ side.
         type UserSettings;
@@ -345,8 +533,8 @@ pub mod plugin {
 
         /// After an MCM-managed change, re-read our .ini file.
         fn refresh_user_settings();
-        /// Fetch a read-only copy of our current layout.
-        fn hud_layout() -> LayoutFlattened;
+        /// The font the current layout asks for.
+        fn layout_font() -> LayoutFont;
 
         /// Cached data for items displayed in cycles. This is opaque to C++.
         type HudItem;
@@ -441,19 +629,36 @@ pub mod plugin {
         fn rasterize_icon(key: String, maxdim: u32) -> LoadedImage;
         /// Rasterize an SVG by path.
         fn rasterize_by_path(fpath: String) -> LoadedImage;
+        /// Rasterize many SVGs in parallel. Results are in request order;
+        /// a failed request gets an empty image.
+        fn rasterize_batch(requests: &[RasterRequest]) -> Vec<LoadedImage>;
+        /// An animation strip's sprite sheet, if a worker has finished rasterizing
+        /// it; otherwise an empty sheet. Asking again for a sheet already taken
+        /// rasterizes it again, as for a sheet the atlas evicted.
+        fn take_sprite_sheet(strip: String) -> SpriteSheet;
+        /// Play an animation strip once over `duration` seconds, fading as it goes.
+        fn start_animation(strip: String, center: Point, size: Point, color: Color, duration: f32);
+        /// Find room in the texture atlas for an image of this size.
+        fn atlas_place(key: String, width: u32, height: u32, pinned: bool) -> AtlasPlacement;
+        /// Once a frame, after drawing: these textures were drawn. Returns what to
+        /// release to get back within the texture budget.
+        fn textures_drawn(ids: &[u32]) -> TextureEvictions;
+        /// How much texture memory is in use, for logs and crash reports.
+        fn texture_budget_report() -> String;
 
         // These are called by plugin hooks and sinks.
 
-        /// Handle an incoming key press event, responding with how it was handled.
-        fn handle_key_event(key: u32, button: &ButtonEvent) -> KeyEventResponse;
+        /// True if the given key code is bound to anything. Cheap; takes no locks.
+        /// C++ uses this to skip irrelevant keys before batching.
+        fn key_is_bound(key: u32) -> bool;
+        /// Handle a batch of button events in order, responding with how each was handled.
+        fn handle_key_events(events: &[ButtonPress]) -> Vec<KeyEventResponse>;
         /// Handle an in-menu event (which adds/removes items) from the game.
         fn handle_menu_event(key: u32, button: &ButtonEvent) -> bool;
         /// Toggle a menu item in the given cycle.
         fn toggle_item(key: u32, item: Box<HudItem>);
         /// Get the item readied in the given slot, if any.
         fn entry_to_show_in_slot(slot: HudElement) -> Box<HudItem>;
-        /// A cycle delay timer has expired. Time to equip!
-        fn timer_expired(slot: Action);
         /// Handle equipment-changed events from the game.
         fn handle_item_equipped(
             equipped: bool,
@@ -463,6 +668,8 @@ pub mod plugin {
         ) -> bool;
         /// Handle inventory-count changed events from the game.
         fn handle_inventory_changed(form_spec: &String, count: u32);
+        /// Handle events that change item charge, poison, or cooldown status.
+        fn handle_extra_data_event(event: ExtraDataEvent, form_spec: &String);
         /// Favoriting & unfavoriting.
         fn handle_favorite_event(_button: &ButtonEvent, is_favorite: bool, _item: Box<HudItem>);
         /// Handle CGO switching grip mode.
@@ -521,6 +728,10 @@ pub mod plugin {
         fn IsUp(self: &ButtonEvent) -> bool;
         /// Check if this button is pressed.
         fn IsPressed(self: &ButtonEvent) -> bool;
+        /// How far the button is pressed; zero when released.
+        fn Value(self: &ButtonEvent) -> f32;
+        /// How long the button has been held down, in seconds.
+        fn HeldDuration(self: &ButtonEvent) -> f32;
     }
 
     // Selected helpers.
@@ -544,6 +755,10 @@ pub mod plugin {
         fn chargeLevelByFormSpec(form_spec: &CxxString) -> f32;
         /// Get all of an item's relevant extra data in pass.
         fn relevantExtraData(form_spec: &CxxString) -> Box<RelevantExtraData>;
+        /// Slow time down while the player cycles. Does nothing if it's already slow.
+        fn enterSlowMotion();
+        /// Put time back to normal. Does nothing if it already is.
+        fn exitSlowMotion();
     }
 
     #[namespace = "ui"]
@@ -557,10 +772,6 @@ pub mod plugin {
         fn displayWidth() -> f32;
         fn displayHeight() -> f32;
 
-        /// Start the named timer. Duration is looked up from settings.
-        fn startTimer(which: Action, duration: u32);
-        /// Stop the named timer.
-        fn stopTimer(which: Action);
         /// Show the hud very briefly on a cycle change. Returns true if the HUD was invisible before.
         fn showBriefly() -> bool;
         /// Start the HUD widget fading in or out to the goal transparency.
@@ -590,8 +801,9 @@ pub mod plugin {
         /// Get the form id in spec format for the equipped ammo.
         fn specEquippedAmmo() -> String;
 
-        /// Check if the player still has items from this form in their inventory.
-        fn hasItemOrSpell(form_spec: &CxxString) -> bool;
+        /// Get every item the player carries and every spell and shout they
+        /// know, with counts, sorted by form spec. One inventory walk.
+        fn inventorySnapshot() -> Vec<InventoryEntry>;
 
         /// Does the player have a bow or crossbow equipped?
         fn hasRangedEquipped() -> bool;
@@ -635,8 +847,6 @@ pub mod plugin {
         fn healthPotionCount() -> u32;
         /// How many restore magicka potions the player has in inventory. For grouped potions.
         fn magickaPotionCount() -> u32;
-        /// Get a count for items with this form spec.
-        fn itemCount(form_spec: &CxxString) -> u32;
         /// Is the player using CGO's alt-grip mode? (Always false if not using CGO or compatible mod.)
         fn useCGOAltGrip() -> bool;
         /// Is the player a vampire lord?
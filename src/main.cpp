@@ -47,6 +47,7 @@ void message_callback(SKSE::MessagingInterface::Message* msg)
 			{
 				rlog::info("SKSE data loaded message received; about to install hooks."sv);
 				ui::ui_renderer::preloadImages();
+				ui::ui_renderer::loadFont();
 				MenuHook::install();
 				PlayerHook::install();
 				papyrus::registerPapyrusFunctions();
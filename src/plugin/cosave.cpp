@@ -1,11 +1,13 @@
 #include "cosave.h"
 
+#include "helpers.h"
+#include "shouts.h"
+
 #include "lib.rs.h"
 
 namespace cosave
 {
-	inline const auto CYCLE_RECORD   = _byteswap_ulong('CYCL');
-	inline const auto FORMAT_VERSION = 1;
+	inline const auto CYCLE_RECORD = _byteswap_ulong('CYCL');
 
 	void initializeCosaves()
 	{
@@ -23,6 +25,7 @@ namespace cosave
 	{
 		// The format is an ad-hoc bag of bytes that we interpret
 		// as we wish. So we serialize to a bag of bytes on the Rust side.
+		// The record version tells the Rust side which layout to decode.
 		const uint32_t version    = serialize_version();
 		rust::Vec<uint8_t> buffer = serialize_cycles();
 		uint32_t bufsize          = static_cast<uint32_t>(buffer.size());
@@ -48,9 +51,15 @@ namespace cosave
 			if (type == CYCLE_RECORD)
 			{
 				rlog::trace("reading cosave data version {}"sv, version);
-				uint32_t bufSize;
+				uint32_t bufSize = 0;
 				std::vector<uint8_t> buffer;
 				cosave->ReadRecordData(bufSize);
+				// A damaged length shouldn't make us allocate more than the record holds.
+				if (size < sizeof(bufSize) || bufSize > size - sizeof(bufSize))
+				{
+					rlog::error("Cosave record claims {} bytes but only holds {}; skipping it."sv, bufSize, size);
+					continue;
+				}
 				buffer.resize(bufSize);
 
 				const auto read = cosave->ReadRecordData(buffer.data(), bufSize);
@@ -62,5 +71,10 @@ namespace cosave
 		}
 	}
 
-	void revertHandler(SKSE::SerializationInterface*) { clear_cache(); }
+	void revertHandler(SKSE::SerializationInterface*)
+	{
+		helpers::forgetResolvedForms();
+		shouts::forgetKnownShouts();
+		clear_cache();
+	}
 }
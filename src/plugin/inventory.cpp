@@ -83,9 +83,23 @@ void PlayerHook::notifyInventoryChanged(RE::TESForm* item_form)
 {
 	if (!item_form) { return; }
 
+	// Poisons and soul gems are used up when applied to weapons, so changes
+	// to them mean the extra data for equipped weapons might be out of date.
+	const auto formtype = item_form->GetFormType();
+	if (formtype == RE::FormType::SoulGem)
+	{
+		std::string form_string = helpers::makeFormSpecString(item_form);
+		handle_extra_data_event(ExtraDataEvent::Recharged, form_string);
+		return;
+	}
+	if (const auto* alchemy = item_form->As<RE::AlchemyItem>(); alchemy && alchemy->IsPoison())
+	{
+		std::string form_string = helpers::makeFormSpecString(item_form);
+		handle_extra_data_event(ExtraDataEvent::PoisonApplied, form_string);
+	}
+
 	// We do not pass along all inventory changes to the HUD, only changes
 	// for the kinds of items the HUD is used to show.
-	const auto formtype = item_form->GetFormType();
 	if (!RELEVANT_FORMTYPES_INVENTORY.contains(formtype)) { return; }
 
 	auto count              = player::getInventoryCountByForm(item_form);
@@ -4,6 +4,7 @@
 #include "gear.h"
 #include "keycodes.h"
 #include "log.h"
+#include "shouts.h"
 
 #include "lib.rs.h"
 
@@ -83,6 +84,7 @@ RE::BSEventNotifyControl MenuHook::process_event(RE::InputEvent** eventPtr,
 					if (!RELEVANT_FORMTYPES_ALL.contains(selection->formType)) { continue; }
 					if (selection->form)
 					{
+						if (auto* shout = selection->form->As<RE::TESShout>()) { shouts::recheckKnownShout(shout); }
 						auto entry = equippable::hudItemFromForm(selection->form);
 						handle_favorite_event(*button, selection->favorite, std::move(entry));
 					}
@@ -100,6 +102,8 @@ RE::BSEventNotifyControl MenuHook::process_event(RE::InputEvent** eventPtr,
 
 			auto* item_form = selection->form;
 			if (!item_form) { continue; }
+			// The player may have learned this shout since we last asked.
+			if (auto* shout = item_form->As<RE::TESShout>()) { shouts::recheckKnownShout(shout); }
 
 			auto entry = equippable::hudItemFromForm(item_form);
 			toggle_item(key, std::move(entry));
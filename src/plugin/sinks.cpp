@@ -6,6 +6,7 @@
 #include "helpers.h"
 #include "keycodes.h"
 #include "player.h"
+#include "shouts.h"
 #include "ui_renderer.h"
 
 #include "lib.rs.h"
@@ -19,8 +20,14 @@ void registerAllListeners()
 	scriptEventSourceHolder->GetEventSource<RE::TESEquipEvent>()->AddEventSink(listener);
 	rlog::info("    equipment change events: {}", typeid(RE::TESEquipEvent).name());
 
-	// scriptEventSourceHolder->GetEventSource<RE::TESHitEvent>()->AddEventSink(listener);
-	// rlog::info("    hit events: {}"sv, typeid(RE::TESHitEvent).name());
+	scriptEventSourceHolder->GetEventSource<RE::TESHitEvent>()->AddEventSink(listener);
+	rlog::info("    hit events: {}"sv, typeid(RE::TESHitEvent).name());
+
+	scriptEventSourceHolder->GetEventSource<RE::TESSpellCastEvent>()->AddEventSink(listener);
+	rlog::info("    spell cast events: {}"sv, typeid(RE::TESSpellCastEvent).name());
+
+	RE::ShoutAttack::GetEventSource()->AddEventSink(listener);
+	rlog::info("    shout events: {}"sv, typeid(RE::ShoutAttack::Event).name());
 
 	RE::UI::GetSingleton()->AddEventSink<RE::MenuOpenCloseEvent>(listener);
 	rlog::info("    menu open/close events: {}"sv, typeid(RE::MenuOpenCloseEvent).name());
@@ -79,23 +86,49 @@ RE::BSEventNotifyControl TheListener::ProcessEvent(const RE::TESEquipEvent* even
 	return RE::BSEventNotifyControl::kContinue;
 }
 
+// We watch hits only to learn when the player might have used up enchantment
+// charge or poison. The controller decides if that matters to the HUD.
 RE::BSEventNotifyControl TheListener::ProcessEvent(const RE::TESHitEvent* event,
 	[[maybe_unused]] RE::BSTEventSource<RE::TESHitEvent>* source)
 {
-	// TODO; just logging for now
+	if (!event || !event->cause || !event->cause->IsPlayerRef()) { return RE::BSEventNotifyControl::kContinue; }
+
 	auto* sourceForm = RE::TESForm::LookupByID(event->source);
-	auto sourceName  = helpers::displayNameAsUtf8(sourceForm);
+	if (!sourceForm || !sourceForm->IsWeapon()) { return RE::BSEventNotifyControl::kContinue; }
 
-	auto target     = event->target->GetBaseObject();
-	auto targetName = helpers::displayNameAsUtf8(target);
+	std::string form_spec = helpers::makeFormSpecString(sourceForm);
+	handle_extra_data_event(ExtraDataEvent::ChargeUsed, form_spec);
 
-	rlog::info("hit event: '{}' 🗡️ {}",
-		sourceName.length() > 0 ? sourceName : rlog::formatAsHex(event->source),
-		targetName.length() > 0 ? targetName : rlog::formatAsHex(event->target->GetFormID()));
+	return RE::BSEventNotifyControl::kContinue;
+}
+
+// Shouting starts the voice recovery cooldown, which the power slot displays.
+RE::BSEventNotifyControl TheListener::ProcessEvent(const RE::TESSpellCastEvent* event,
+	[[maybe_unused]] RE::BSTEventSource<RE::TESSpellCastEvent>* source)
+{
+	if (!event || !event->object || !event->object->IsPlayerRef()) { return RE::BSEventNotifyControl::kContinue; }
+
+	auto* spell = RE::TESForm::LookupByID<RE::SpellItem>(event->spell);
+	if (!spell || spell->GetSpellType() != RE::MagicSystem::SpellType::kVoicePower)
+	{
+		return RE::BSEventNotifyControl::kContinue;
+	}
+
+	std::string form_spec = helpers::makeFormSpecString(spell);
+	handle_extra_data_event(ExtraDataEvent::ShoutCooldownStarted, form_spec);
 
 	return RE::BSEventNotifyControl::kContinue;
 }
 
+// Only the player's shouts reach this event. Shouting one proves the player knows it,
+// whatever taught it to them.
+RE::BSEventNotifyControl TheListener::ProcessEvent(const RE::ShoutAttack::Event* event,
+	[[maybe_unused]] RE::BSTEventSource<RE::ShoutAttack::Event>* source)
+{
+	if (event && event->shout) { shouts::recheckKnownShout(event->shout); }
+	return RE::BSEventNotifyControl::kContinue;
+}
+
 inline const std::set<std::string_view> NO_SHOW_MENUS{
 	RE::ContainerMenu::MENU_NAME,
 	RE::CursorMenu::MENU_NAME,
@@ -125,6 +158,26 @@ RE::BSEventNotifyControl TheListener::ProcessEvent(const RE::MenuOpenCloseEvent*
 	return RE::BSEventNotifyControl::kContinue;
 }
 
+// More than enough for one frame of chorded keys and stick wiggling.
+static constexpr size_t KEY_BATCH_SIZE = 16;
+
+// We need to be a little bit stateful to handle modifier keys, because we don't
+// get chording events, so all the logic is in the controller.
+static void handleKeyBatch(const ButtonPress* batch, RE::ButtonEvent** buttons, size_t count)
+{
+	const auto responses = handle_key_events(rust::Slice<const ButtonPress>(batch, count));
+	for (size_t i = 0; i < count && i < responses.size(); i++)
+	{
+		const auto& response = responses[i];
+		if (!response.handled) { continue; }
+
+		// Now wipe out the event data so nothing else acts on it.
+		// Is there a way to respond with `kStop` for just one event in the list?
+		buttons[i]->idCode    = keycodes::kInvalid;
+		buttons[i]->userEvent = "";
+	}
+}
+
 RE::BSEventNotifyControl TheListener::ProcessEvent(RE::InputEvent* const* event_list,
 	[[maybe_unused]] RE::BSTEventSource<RE::InputEvent*>* source)
 {
@@ -133,7 +186,12 @@ RE::BSEventNotifyControl TheListener::ProcessEvent(RE::InputEvent* const* event_
 
 	if (helpers::ignoreKeyEvents()) { return RE::BSEventNotifyControl::kContinue; }
 
-	// We might get a list of events to handle.
+	// Collect the relevant button events into small batches, so the controller
+	// sees a whole chord at once and we cross into Rust once per batch.
+	std::array<ButtonPress, KEY_BATCH_SIZE> batch;
+	std::array<RE::ButtonEvent*, KEY_BATCH_SIZE> buttons;
+	size_t count = 0;
+
 	for (auto* event = *event_list; event; event = event->next)
 	{
 		if (event->eventType != RE::INPUT_EVENT_TYPE::kButton) { continue; }
@@ -144,34 +202,20 @@ RE::BSEventNotifyControl TheListener::ProcessEvent(RE::InputEvent* const* event_
 		// event. This appears to be so that we can directly compare it to the hotkey numbers
 		// we have snagged from the MCM settings. ??
 		const uint32_t key = keycodes::keyID(button);
-		if (key == -1) { continue; }
+		if (key == keycodes::kInvalid || !key_is_bound(key)) { continue; }
 
-		// We need to be a little bit stateful to handle modifier keys, because we don't
-		// get chording events, so all the logic is now in the controller.
-		const KeyEventResponse response = handle_key_event(key, *button);
-		if (!response.handled) { continue; }
-		//rlog::info("mod handled key: {}", key);
-
-		if (response.stop_timer != Action::None)
-		{
-			// rlog::trace("hysteresis timer STOP; slot={}"sv, static_cast<uint8_t>(response.stop_timer));
-			ui::stopTimer(response.stop_timer);
-		}
-
-		if (response.start_timer != Action::None)
+		batch[count]   = ButtonPress{ key, button->Value(), button->HeldDuration() };
+		buttons[count] = button;
+		count++;
+		if (count == KEY_BATCH_SIZE)
 		{
-			// rlog::trace("hysteresis timer START; slot={}"sv, static_cast<uint8_t>(response.start_timer));
-			auto settings = user_settings();
-			auto duration = settings->equip_delay_ms();
-			ui::startTimer(response.start_timer, duration);
+			handleKeyBatch(batch.data(), buttons.data(), count);
+			count = 0;
 		}
-
-		// Now wipe out the event data so nothing else acts on it.
-		// Is there a way to respond with `kStop` for just one event in the list?
-		button->idCode    = keycodes::kInvalid;
-		button->userEvent = "";
 	}  // end event handling for loop
 
+	if (count > 0) { handleKeyBatch(batch.data(), buttons.data(), count); }
+
 	return RE::BSEventNotifyControl::kContinue;
 }
 
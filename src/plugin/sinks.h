@@ -14,8 +14,10 @@ class TheListener final
 	, public RE::BSTEventSink<RE::MenuOpenCloseEvent>
 	, public RE::BSTEventSink<RE::TESEquipEvent>
 	, public RE::BSTEventSink<RE::TESHitEvent>
+	, public RE::BSTEventSink<RE::TESSpellCastEvent>
 	, public RE::BSTEventSink<RE::TESMagicEffectApplyEvent>
 	, public RE::BSTEventSink<RE::TESActiveEffectApplyRemoveEvent>
+	, public RE::BSTEventSink<RE::ShoutAttack::Event>
 {
 	using event_result = RE::BSEventNotifyControl;
 
@@ -42,6 +44,9 @@ protected:
 	RE::BSEventNotifyControl ProcessEvent(const RE::TESHitEvent* event,
 		RE::BSTEventSource<RE::TESHitEvent>* source) override;
 
+	RE::BSEventNotifyControl ProcessEvent(const RE::TESSpellCastEvent* event,
+		RE::BSTEventSource<RE::TESSpellCastEvent>* source) override;
+
 	RE::BSEventNotifyControl ProcessEvent(const RE::BSAnimationGraphEvent* event,
 		RE::BSTEventSource<RE::BSAnimationGraphEvent>* source) override;
 
@@ -51,6 +56,9 @@ protected:
 	RE::BSEventNotifyControl ProcessEvent(const RE::TESActiveEffectApplyRemoveEvent* event,
 		RE::BSTEventSource<RE::TESActiveEffectApplyRemoveEvent>* source) override;
 
+	RE::BSEventNotifyControl ProcessEvent(const RE::ShoutAttack::Event* event,
+		RE::BSTEventSource<RE::ShoutAttack::Event>* source) override;
+
 private:
 	TheListener()           = default;
 	~TheListener() override = default;
@@ -7,7 +7,6 @@ namespace ui
 
 	static std::string icon_directory                = R"(.\Data\SKSE\Plugins\resources\icons)";
 	static std::string img_directory                 = R"(.\Data\SKSE\Plugins\resources\backgrounds)";
-	static std::string highlight_animation_directory = R"(.\Data\SKSE\Plugins\resources\animations\highlight)";
 
 	enum class image_type
 	{
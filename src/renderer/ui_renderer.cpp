@@ -1,5 +1,4 @@
 #include "ui_renderer.h"
-#include "animation_handler.h"
 #include "constant.h"
 #include "gear.h"
 #include "helpers.h"
@@ -27,43 +26,92 @@ namespace ui
 {
 	using Color = soulsy::Color;
 
-	static std::map<animation_type, std::vector<TextureData>> animation_frame_map = {};
-	static std::vector<std::pair<animation_type, std::unique_ptr<Animation>>> animation_list;
-
-	static std::map<uint8_t, float> cycle_timers = {};
-
 	static std::map<uint32_t, TextureData> key_struct;
 	static std::map<uint32_t, TextureData> default_key_struct;
 	static std::map<uint32_t, TextureData> PS5_BUTTON_MAP;
 	static std::map<uint32_t, TextureData> XBOX_BUTTON_MAP;
 	static std::map<std::string, TextureData> ICON_MAP;
 	static std::map<std::string, TextureData> HUD_IMAGES_MAP;
+	// Animation strips, each one sprite sheet, and how their frames are laid out on it.
+	// A strip whose sheet failed to upload keeps an empty grid and is never drawn.
+	struct SpriteGrid
+	{
+		uint32_t frames  = 0;
+		uint32_t columns = 0;
+		uint32_t gutter  = 0;
+	};
+	static std::map<std::string, TextureData> SPRITE_SHEETS;
+	static std::map<std::string, SpriteGrid> SPRITE_GRIDS;
+
+	// Atlas pages, indexed by the page numbers the Rust packer hands out.
+	static std::vector<ID3D11Texture2D*> ATLAS_PAGES;
+	static std::vector<ID3D11ShaderResourceView*> ATLAS_VIEWS;
+	// Atlas keys are prefixed so we know which map to forget an evicted image from.
+	static const std::string ICON_ATLAS_PREFIX   = "icon/";
+	static const std::string HUD_ATLAS_PREFIX    = "hud/";
+	static const std::string BUTTON_ATLAS_PREFIX = "button/";
+	static const std::string SPRITE_ATLAS_PREFIX = "sprite/";
+	// Budget ids of the textures drawn this frame; see reportDrawnTextures().
+	static std::vector<uint32_t> DRAWN_TEXTURES;
+	// Bumped whenever a texture is released, so a kept frame never draws from one.
+	static uint32_t TEXTURE_GENERATION = 0;
+
+	// The last HUD ImGui built. Frames where nothing changed submit this again
+	// instead of building it over; see controller/redraw.rs.
+	struct KeptFrame
+	{
+		ImDrawData drawData;
+		std::vector<ImDrawList*> lists;
+		bool valid = false;
+	};
+	static KeptFrame KEPT_FRAME;
 
-	static const auto REFRESH_DRAW_COUNT  = 50;
+	static const float EXTRA_DATA_POLL    = 2.0f;  // seconds; events drive most refreshes
 	static const float FADEOUT_HYSTERESIS = 0.5f;  // seconds
 	static const uint32_t MAX_ICON_DIM    = 300;   // rasterized at 96 dpi
-	static constexpr ImVec2 FLAT_UVS[4]   = { ImVec2(0.0f, 0.0f),
-		  ImVec2(1.0f, 0.0f),
-		  ImVec2(1.0f, 1.0f),
-		  ImVec2(0.0f, 1.0f) };
-
-
-	auto gHudAlpha          = 0.0f;  // this is the current alpha
-	auto gGoalAlpha         = 1.0f;  // our goal if we're fading
-	auto gMaxAlpha          = 1.0f;  // the least transparent we allow ourselves to be (user setting)
-	auto gMinAlpha          = 0.0f;  // the most transparent
-	auto doFadeIn           = true;
-	auto gFullFadeDuration  = 3.0f;  // seconds
-	auto gFadeDurRemaining  = 3.0f;  // seconds
-	auto gIsFading          = false;
-	auto delayBeforeFadeout = 0.33f;  // seconds
-	bool gDoingBriefPeek    = false;
-	auto drawCounter        = 0;
+
+
+	auto gHudAlpha           = 0.0f;  // this is the current alpha
+	auto gGoalAlpha          = 1.0f;  // our goal if we're fading
+	auto gMaxAlpha           = 1.0f;  // the least transparent we allow ourselves to be (user setting)
+	auto gMinAlpha           = 0.0f;  // the most transparent
+	auto doFadeIn            = true;
+	auto gFullFadeDuration   = 3.0f;  // seconds
+	auto gFadeDurRemaining   = 3.0f;  // seconds
+	auto gIsFading           = false;
+	auto delayBeforeFadeout  = 0.33f;  // seconds
+	bool gDoingBriefPeek     = false;
+	auto gSinceExtraDataPoll = 0.0f;  // seconds
 
 	// ID3D11BlendState* gBlendState = nullptr;
 
 	ImFont* imFont;
-	auto triedFontLoad = false;
+	// Written by whichever thread starts a font build, read every frame by Present.
+	std::atomic<bool> triedFontLoad = false;
+	// The font has glyphs only for text the HUD has shown; see controller/glyphs.rs.
+	// The font's config points at its ranges, so they live as long as the font does.
+	static std::vector<ImWchar> FONT_GLYPH_RANGES;
+	static std::atomic<uint32_t> FONT_GLYPHS_GENERATION = 0;
+	// The texture view for a font we built. The DX11 backend keeps the one it made
+	// for the first font, and releases it at shutdown.
+	static ID3D11ShaderResourceView* FONT_VIEW = nullptr;
+
+	// A font atlas built on a worker thread, waiting for the render thread to take it.
+	// The worker owns everything in here until it hands the whole thing over under
+	// the lock; after that only the render thread touches it.
+	struct FontBuild
+	{
+		ImFontAtlas* atlas = nullptr;
+		ImFont* font       = nullptr;
+		std::vector<ImWchar> ranges;
+		std::string path;
+		int width  = 0;
+		int height = 0;
+	};
+	static std::mutex FONT_BUILD_LOCK;
+	static FontBuild FINISHED_FONT;  // guarded by FONT_BUILD_LOCK
+	static std::atomic<bool> FONT_BUILD_READY   = false;
+	static std::atomic<bool> FONT_BUILD_RUNNING = false;
 
 	LRESULT ui_renderer::wnd_proc_hook::thunk(const HWND h_wnd,
 		const UINT u_msg,
@@ -158,30 +206,32 @@ namespace ui
 
 		if (!d_3d_init_hook::initialized.load()) { return; }
 
-		if (!imFont && !triedFontLoad) { loadFont(); }
+		// Fonts are built on another thread. Here we only take a finished one, and ask
+		// for another when the HUD has shown characters the font lacks.
+		adoptBuiltFont();
+		refreshFontGlyphs();
 
 		ImGui_ImplDX11_NewFrame();
 		ImGui_ImplWin32_NewFrame();
-		ImGui::NewFrame();
+
+		// Timers, fades, and item data move on every frame, whether or not we rebuild.
+		if (!advanceHud()) { return; }
 
 		// float blendFactor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
 		// UINT sampleMask = 0xffffffff;
 		// context_->OMSetBlendState(gBlendState, blendFactor, sampleMask);
 
-		drawHud();
-
-		ImGui::EndFrame();
-		ImGui::Render();
-		ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
-	}
+		if (hudNeedsRebuild())
+		{
+			ImGui::NewFrame();
+			drawHud();
+			ImGui::EndFrame();
+			ImGui::Render();
+			keepFrame(ImGui::GetDrawData());
+		}
 
-	bool ui_renderer::loadTextureFromFile(const char* filename,
-		ID3D11ShaderResourceView** out_srv,
-		int32_t& out_width,
-		int32_t& out_height)
-	{
-		auto loadedImg = rasterize_by_path(std::string(filename));
-		return d3dTextureFromBuffer(&loadedImg, out_srv, out_width, out_height);
+		ImGui_ImplDX11_RenderDrawData(&KEPT_FRAME.drawData);
+		reportDrawnTextures();
 	}
 
 	size_t rasterizedSVGCount() { return ICON_MAP.size(); }
@@ -193,7 +243,7 @@ namespace ui
 
 		LoadedImage loadedImg = rasterize_icon(key, MAX_ICON_DIM);
 		if (loadedImg.width == 0) { return false; }
-		if (d3dTextureFromBuffer(&loadedImg, &ICON_MAP[key].texture, ICON_MAP[key].width, ICON_MAP[key].height))
+		if (atlasTextureFromBuffer(ICON_ATLAS_PREFIX + key, &loadedImg, false, ICON_MAP[key]))
 		{
 			rlog::info(
 				"Lazy-loaded icon '{}.svg'; width={}; height={}", key, ICON_MAP[key].width, ICON_MAP[key].height);
@@ -263,126 +313,262 @@ namespace ui
 		return true;
 	}
 
-	ui_renderer::ui_renderer() = default;
+	void forgetImage(std::map<std::string, TextureData>& images, const std::string& key)
+	{
+		const auto found = images.find(key);
+		if (found == images.end()) { return; }
+		// Atlas pages are released whole; an image with a texture of its own releases it here.
+		auto* texture = found->second.texture;
+		if (texture && std::find(ATLAS_VIEWS.begin(), ATLAS_VIEWS.end(), texture) == ATLAS_VIEWS.end())
+		{
+			texture->Release();
+		}
+		images.erase(found);
+	}
 
-	void ui_renderer::drawAnimationFrame()
+	// The atlas hands back the images it pushed out to make room. Forget them here,
+	// and they'll be rasterized again the next time they're drawn.
+	void forgetAtlasImage(const std::string& key)
 	{
-		auto it = animation_list.begin();
-		while (it != animation_list.end())
+		if (key.starts_with(ICON_ATLAS_PREFIX)) { forgetImage(ICON_MAP, key.substr(ICON_ATLAS_PREFIX.size())); }
+		else if (key.starts_with(HUD_ATLAS_PREFIX))
 		{
-			if (!it->second->is_over())
-			{
-				auto* anim = it->second.get();
-
-				drawElementInner(animation_frame_map[it->first][anim->current_frame].texture,
-					anim->center,
-					anim->size,
-					anim->angle,
-					IM_COL32(anim->r_color, anim->g_color, anim->b_color, anim->alpha));
-				anim->animate_action(ImGui::GetIO().DeltaTime);
-				++it;
-			}
-			else { it = animation_list.erase(it); }
+			forgetImage(HUD_IMAGES_MAP, key.substr(HUD_ATLAS_PREFIX.size()));
+		}
+		else if (key.starts_with(SPRITE_ATLAS_PREFIX))
+		{
+			const auto strip = key.substr(SPRITE_ATLAS_PREFIX.size());
+			forgetImage(SPRITE_SHEETS, strip);
+			SPRITE_GRIDS.erase(strip);
 		}
 	}
 
-	void drawMeterCircleArc(float level, SlotFlattened slotLayout)
+	void releaseAtlasPage(uint32_t page)
 	{
-		// The flat structure has the same fields to support arc and
-		// rectangular meters, so some names might be surprising here.
-		const auto meter_center = ImVec2(slotLayout.meter_center.x, slotLayout.meter_center.y);
-		const auto meter_size   = ImVec2(slotLayout.meter_size.x, slotLayout.meter_size.y);
-		const auto bg_img_str   = std::string(slotLayout.meter_empty_image);
-		if (!bg_img_str.empty() && ui_renderer::lazyLoadHudImage(bg_img_str))
+		if (page >= ATLAS_PAGES.size() || !ATLAS_PAGES[page]) { return; }
+		ATLAS_VIEWS[page]->Release();
+		ATLAS_PAGES[page]->Release();
+		ATLAS_VIEWS[page] = nullptr;
+		ATLAS_PAGES[page] = nullptr;
+		rlog::debug("Released texture atlas page {}"sv, page);
+	}
+
+	// Only ever called between frames. Forget the images first: they point at the pages.
+	// The kept frame may draw from what we release, so it has to be built again.
+	void applyEvictions(const TextureEvictions& evictions)
+	{
+		if (evictions.keys.empty() && evictions.pages.empty()) { return; }
+		for (const auto& key : evictions.keys) { forgetAtlasImage(std::string(key)); }
+		for (const auto page : evictions.pages) { releaseAtlasPage(page); }
+		KEPT_FRAME.valid = false;
+		TEXTURE_GENERATION++;
+	}
+
+	inline void noteDrawn(const TextureData& image)
+	{
+		if (image.budgetId != 0 && (DRAWN_TEXTURES.empty() || DRAWN_TEXTURES.back() != image.budgetId))
 		{
-			const auto [texture, width, height] = HUD_IMAGES_MAP[bg_img_str];
-			drawElement(texture, meter_center, meter_size, 0.0f, slotLayout.meter_empty_color);
+			DRAWN_TEXTURES.push_back(image.budgetId);
 		}
+	}
+
+	// Once a frame, after the draw data has been rendered, tell the texture budget what
+	// we drew. It answers with what to release to get back within budget, which is the
+	// only time anything is released: loading images mid-frame never takes away a
+	// texture, or writes over pixels, that the frame is already drawing from. A kept
+	// frame draws what it drew when it was built, so the list is only cleared on rebuild.
+	void reportDrawnTextures()
+	{
+		const auto evictions =
+			textures_drawn(rust::Slice<const uint32_t>(DRAWN_TEXTURES.data(), DRAWN_TEXTURES.size()));
+		applyEvictions(evictions);
+	}
+
+	bool hudNeedsRebuild()
+	{
+		FrameInputs inputs;
+		inputs.alpha           = gHudAlpha;
+		inputs.width           = resolutionWidth();
+		inputs.height          = resolutionHeight();
+		inputs.ranged_equipped = player::hasRangedEquipped();
+		inputs.textures        = TEXTURE_GENERATION;
+		// Always ask, so the Rust side remembers this frame even when we have nothing kept.
+		const auto changed = hud_needs_rebuild(inputs);
+		return changed || !KEPT_FRAME.valid;
+	}
 
-		if (meter_size.x != meter_size.y)
+	// ImGui reuses its draw lists next frame, so keep copies of this frame's.
+	void keepFrame(const ImDrawData* drawData)
+	{
+		for (auto* list : KEPT_FRAME.lists) { IM_DELETE(list); }
+		KEPT_FRAME.lists.clear();
+		for (int i = 0; i < drawData->CmdListsCount; i++)
 		{
-			rlog::warn("Circular meter is not actually circular. {} != {}", meter_size.x, meter_size.y);
+			KEPT_FRAME.lists.push_back(drawData->CmdLists[i]->CloneOutput());
 		}
-		const auto radius = meter_size.x / 2.0f;
-		const auto width  = slotLayout.meter_arc_width;
-
-		ImVec2 start           = ImVec2(meter_center.x + radius * cosf(slotLayout.meter_start_angle),
-            meter_center.y + radius * sinf(slotLayout.meter_start_angle));
-		const float startAngle = slotLayout.meter_end_angle;
-		// level is a percentage
-		const float endAngle = (slotLayout.meter_end_angle - slotLayout.meter_start_angle) * level / 100.0f;
-		ImVec2 end = ImVec2(meter_center.x + radius * cosf(endAngle), meter_center.y + radius * sinf(endAngle));
-
-		const ImU32 fill_color = IM_COL32(slotLayout.meter_fill_color.r,
-			slotLayout.meter_fill_color.g,
-			slotLayout.meter_fill_color.b,
-			slotLayout.meter_fill_color.a * gHudAlpha);
-
-		// ImGui::GetWindowDrawList()->PathLineTo(meter_center);
-		ImGui::GetWindowDrawList()->PathClear();
-		ImGui::GetWindowDrawList()->PathLineTo(start);
-		// IMGUI_API void  PathArcTo(const ImVec2& center, float radius, float a_min, float a_max, int num_segments = 0);
-		ImGui::GetWindowDrawList()->PathArcTo(meter_center, radius, startAngle, endAngle, 20);
-		ImGui::GetWindowDrawList()->PathLineTo(ImVec2(end.x - width, end.y - width));
-		ImGui::GetWindowDrawList()->PathArcTo(meter_center, radius - width, endAngle, startAngle, 20);
-		ImGui::GetWindowDrawList()->PathLineToMergeDuplicate(start);
-		ImGui::GetWindowDrawList()->PathFillConvex(fill_color);
-		ImGui::GetWindowDrawList()->PathClear();
+		KEPT_FRAME.drawData               = *drawData;
+		KEPT_FRAME.drawData.CmdLists      = KEPT_FRAME.lists.data();
+		KEPT_FRAME.drawData.CmdListsCount = static_cast<int>(KEPT_FRAME.lists.size());
+		KEPT_FRAME.valid                  = true;
 	}
 
-	void drawMeterRectangular(float level, SlotFlattened slotLayout)
+	// Put an image on a shared atlas page so that most of the HUD draws from one texture,
+	// which lets ImGui merge its draw commands. Images too big for a page get a texture
+	// of their own, as before. See images/atlas.rs for the packing.
+	bool ui_renderer::atlasTextureFromBuffer(const std::string& key,
+		LoadedImage* loadedImg,
+		bool pinned,
+		TextureData& out)
 	{
-		const auto meterOffset = ImVec2(slotLayout.meter_center.x, slotLayout.meter_center.y);
-		const auto bgSize      = ImVec2(slotLayout.meter_size.x, slotLayout.meter_size.y);
-		const auto bg_img_str  = std::string(slotLayout.meter_empty_image);
-		const auto fg_img_str  = std::string(slotLayout.meter_fill_image);
+		if (loadedImg->buffer.empty()) { return false; }
 
-		auto angle = -slotLayout.meter_start_angle;
+		const auto placement = atlas_place(key, loadedImg->width, loadedImg->height, pinned);
+		out.budgetId = placement.id;
+		if (!placement.placed)
+		{
+			out.uv0 = ImVec2(0.0f, 0.0f);
+			out.uv1 = ImVec2(1.0f, 1.0f);
+			return d3dTextureFromBuffer(loadedImg, &out.texture, out.width, out.height);
+		}
 
-		const auto fillLen          = slotLayout.meter_fill_size.x * level * 0.01f;
-		const auto fillSize         = ImVec2(fillLen, slotLayout.meter_fill_size.y);
-		const auto fillCenterOffset = ImVec2((fillLen - slotLayout.meter_fill_size.x) * 0.5f, 0.0);
+		auto* page = atlasPage(placement.page, placement.page_size);
+		if (!page) { return false; }
 
-		const std::array<ImVec2, 4> bgRotated = rotateRectWithTranslation(meterOffset, bgSize, angle);
-		const ImVec2 fillOffset               = rotateVector(fillCenterOffset, angle) + meterOffset;
-		const std::array<ImVec2, 4> fgRotated = rotateRectWithTranslation(fillOffset, fillSize, angle);
+		if (placement.fresh)
+		{
+			// Upload the padding too, so filtering at the edges never picks up whatever
+			// was on the page before.
+			const auto pad          = placement.padding;
+			const auto paddedWidth  = placement.width + 2 * pad;
+			const auto paddedHeight = placement.height + 2 * pad;
+			const auto rowBytes     = placement.width * 4;
+			std::vector<uint8_t> pixels(static_cast<size_t>(paddedWidth) * paddedHeight * 4, 0);
+			for (uint32_t row = 0; row < placement.height; row++)
+			{
+				std::memcpy(pixels.data() + (static_cast<size_t>(row + pad) * paddedWidth + pad) * 4,
+					loadedImg->buffer.data() + static_cast<size_t>(row) * rowBytes,
+					rowBytes);
+			}
+
+			D3D11_BOX box;
+			box.left   = placement.x - pad;
+			box.top    = placement.y - pad;
+			box.front  = 0;
+			box.right  = placement.x + placement.width + pad;
+			box.bottom = placement.y + placement.height + pad;
+			box.back   = 1;
+			context_->UpdateSubresource(page, 0, &box, pixels.data(), paddedWidth * 4, 0);
+		}
 
-		bool haveBgImage = bg_img_str.empty() ? false : ui_renderer::lazyLoadHudImage(bg_img_str);
-		bool haveFgImage = fg_img_str.empty() ? false : ui_renderer::lazyLoadHudImage(fg_img_str);
+		const auto pageSize = static_cast<float>(placement.page_size);
+		out.texture         = ATLAS_VIEWS[placement.page];
+		out.width           = static_cast<int32_t>(placement.width);
+		out.height          = static_cast<int32_t>(placement.height);
+		out.uv0             = ImVec2(placement.x / pageSize, placement.y / pageSize);
+		out.uv1 = ImVec2((placement.x + placement.width) / pageSize, (placement.y + placement.height) / pageSize);
+		return true;
+	}
 
-		if (haveBgImage && haveFgImage)
+	// Atlas pages are made the first time the packer asks for them, and live until the
+	// budget releases them between frames. A released page may be made again later; a
+	// page is never written over in place.
+	ID3D11Texture2D* ui_renderer::atlasPage(uint32_t page, uint32_t pageSize)
+	{
+		if (page < ATLAS_PAGES.size() && ATLAS_PAGES[page]) { return ATLAS_PAGES[page]; }
+
+		const auto renderer = RE::BSGraphics::Renderer::GetSingleton();
+		if (!renderer)
 		{
-			const auto [bgtex, width, height]   = HUD_IMAGES_MAP[bg_img_str];
-			const auto [fgtex, fwidth, fheight] = HUD_IMAGES_MAP[fg_img_str];
+			rlog::error("Cannot find render manager. Unable to build atlas page."sv);
+			return nullptr;
+		}
+		const auto forwarder = renderer->GetRuntimeData().forwarder;
+
+		D3D11_TEXTURE2D_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.Width            = pageSize;
+		desc.Height           = pageSize;
+		desc.MipLevels        = 1;
+		desc.ArraySize        = 1;
+		desc.Format           = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.SampleDesc.Count = 1;
+		desc.Usage            = D3D11_USAGE_DEFAULT;
+		desc.BindFlags        = D3D11_BIND_SHADER_RESOURCE;
 
-			drawTextureQuad(bgtex, bgRotated, slotLayout.meter_empty_color);
-			drawTextureQuad(fgtex, fgRotated, slotLayout.meter_fill_color);
+		ID3D11Texture2D* texture = nullptr;
+		if (FAILED(device_->CreateTexture2D(&desc, nullptr, &texture)))
+		{
+			rlog::error("Failed to create atlas page {}; size={}"sv, page, pageSize);
+			return nullptr;
 		}
-		else if (haveBgImage && !haveFgImage)
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc;
+		ZeroMemory(&srv_desc, sizeof srv_desc);
+		srv_desc.Format                    = DXGI_FORMAT_R8G8B8A8_UNORM;
+		srv_desc.ViewDimension             = D3D11_SRV_DIMENSION_TEXTURE2D;
+		srv_desc.Texture2D.MipLevels       = desc.MipLevels;
+		srv_desc.Texture2D.MostDetailedMip = 0;
+		ID3D11ShaderResourceView* view     = nullptr;
+		forwarder->CreateShaderResourceView(texture, &srv_desc, &view);
+
+		if (ATLAS_PAGES.size() <= page)
 		{
-			// In this case, we use the background image twice, the second time with length scaled
-			// drawn with the fill color.
-			const auto [bgtex, width, height] = HUD_IMAGES_MAP[bg_img_str];
-			drawTextureQuad(bgtex, bgRotated, slotLayout.meter_empty_color);
-			drawTextureQuad(bgtex, fgRotated, slotLayout.meter_fill_color);
+			ATLAS_PAGES.resize(page + 1, nullptr);
+			ATLAS_VIEWS.resize(page + 1, nullptr);
 		}
-		else if (haveFgImage)
+		ATLAS_PAGES[page] = texture;
+		ATLAS_VIEWS[page] = view;
+		rlog::info("Created texture atlas page {}; size={}x{}; {}"sv,
+			page,
+			pageSize,
+			pageSize,
+			std::string(texture_budget_report()));
+		return texture;
+	}
+
+	ui_renderer::ui_renderer() = default;
+
+	inline ImVec2 toImVec2(const Point& point) { return ImVec2(point.x, point.y); }
+
+	// Meter fills come in the draw plan already cut to their level, four points to a quad.
+	// One mesh for the whole band, so neighboring segments share their edges. Separate
+	// quads each get their own antialiased fringe, and the overlaps show at low alpha.
+	void drawStrip(const rust::Vec<Point>& points, const Color color)
+	{
+		const auto pairs = points.size() / 2;
+		if (pairs < 2) { return; }
+		const ImU32 im_color = IM_COL32(color.r, color.g, color.b, color.a * gHudAlpha);
+		auto* drawList       = ImGui::GetWindowDrawList();
+		const ImVec2 uv      = ImGui::GetFontTexUvWhitePixel();
+		const auto quads     = static_cast<int>(pairs - 1);
+
+		drawList->PrimReserve(quads * 6, static_cast<int>(pairs * 2));
+		const auto base = drawList->_VtxCurrentIdx;
+		for (size_t i = 0; i < pairs * 2; i++) { drawList->PrimWriteVtx(toImVec2(points[i]), uv, im_color); }
+		for (int i = 0; i < quads; i++)
 		{
-			const auto [fgtex, fwidth, fheight] = HUD_IMAGES_MAP[fg_img_str];
-			drawTextureQuad(fgtex, bgRotated, slotLayout.meter_empty_color);
-			drawTextureQuad(fgtex, fgRotated, slotLayout.meter_fill_color);
+			const auto outer = static_cast<ImDrawIdx>(base + i * 2);
+			const auto inner = static_cast<ImDrawIdx>(outer + 1);
+			drawList->PrimWriteIdx(outer);
+			drawList->PrimWriteIdx(static_cast<ImDrawIdx>(outer + 2));
+			drawList->PrimWriteIdx(static_cast<ImDrawIdx>(inner + 2));
+			drawList->PrimWriteIdx(outer);
+			drawList->PrimWriteIdx(static_cast<ImDrawIdx>(inner + 2));
+			drawList->PrimWriteIdx(inner);
 		}
 	}
 
-	void drawText(const std::string text, const ImVec2 center, const TextFlattened* label)
+	void drawText(const DrawCommand& run)
 	{
-		if (!text.length() || label->color.a == 0) { return; }
-		const float wrapWidth = label->wrap_width;
-		const auto align      = label->alignment;
+		const auto text   = std::string(run.text);
+		const auto center = toImVec2(run.center);
+		if (!text.length() || run.color.a == 0) { return; }
+		const float wrapWidth = run.wrap_width;
+		const auto align      = run.alignment;
 
 		auto* font = imFont;
 		if (!font) { font = ImGui::GetDefaultFont(); }
-		const ImU32 textColor = IM_COL32(label->color.r, label->color.g, label->color.b, label->color.a * gHudAlpha);
+		const ImU32 textColor = IM_COL32(run.color.r, run.color.g, run.color.b, run.color.a * gHudAlpha);
 		ImVec2 lineLeftCorner = ImVec2(center.x, center.y);
 		const auto* cstr      = text.c_str();
 
@@ -391,32 +577,32 @@ namespace ui
 
 		// Simple fast case first: no truncation, left alignment. Imgui wraps the
 		// text for us if wrap width is non-zero.
-		if (!label->truncate && align == Align::Left)
+		if (!run.truncate && align == Align::Left)
 		{
 			ImGui::GetWindowDrawList()->AddText(
-				font, label->font_size, lineLeftCorner, textColor, cstr, nullptr, wrapWidth, nullptr);
+				font, run.font_size, lineLeftCorner, textColor, cstr, nullptr, wrapWidth, nullptr);
 			return;
 		}
 
 		// We're aligning, but not truncating or wrapping, so we can draw one location-adjusted line.
-		if (!label->truncate && wrapWidth == 0.0f)
+		if (!run.truncate && wrapWidth == 0.0f)
 		{
-			const ImVec2 bounds = font->CalcTextSizeA(label->font_size, 0.0f, 0.0f, cstr);
+			const ImVec2 bounds = font->CalcTextSizeA(run.font_size, 0.0f, 0.0f, cstr);
 			if (align == Align::Center) { lineLeftCorner.x = center.x + (wrapWidth - bounds.x) * 0.5f; }
 			else if (align == Align::Right) { lineLeftCorner.x = center.x + (wrapWidth - bounds.x); }
-			ImGui::GetWindowDrawList()->AddText(font, label->font_size, lineLeftCorner, textColor, cstr);
+			ImGui::GetWindowDrawList()->AddText(font, run.font_size, lineLeftCorner, textColor, cstr);
 			return;
 		}
 
 		// The next fastest cases are truncation cases. We find our truncation point,
 		// then align that single line by moving the draw location.
-		if (label->truncate && wrapWidth > 0.0f)
+		if (run.truncate && wrapWidth > 0.0f)
 		{
 			const char* remainder = nullptr;
-			const auto bounds     = font->CalcTextSizeA(label->font_size, wrapWidth, 0.0f, cstr, nullptr, &remainder);
+			const auto bounds     = font->CalcTextSizeA(run.font_size, wrapWidth, 0.0f, cstr, nullptr, &remainder);
 			if (align == Align::Center) { lineLeftCorner.x = center.x + (wrapWidth - bounds.x) * 0.5f; }
 			else if (align == Align::Right) { lineLeftCorner.x = center.x + (wrapWidth - bounds.x); }
-			ImGui::GetWindowDrawList()->AddText(font, label->font_size, lineLeftCorner, textColor, cstr, remainder);
+			ImGui::GetWindowDrawList()->AddText(font, run.font_size, lineLeftCorner, textColor, cstr, remainder);
 			return;
 		}
 
@@ -429,7 +615,7 @@ namespace ui
 
 		do {
 			const char* remainder = nullptr;
-			auto bounds = font->CalcTextSizeA(label->font_size, wrapWidth, 0.0f, lineToDraw, nullptr, &remainder);
+			auto bounds = font->CalcTextSizeA(run.font_size, wrapWidth, 0.0f, lineToDraw, nullptr, &remainder);
 			if ((remainder < cstr + length) && *remainder != ' ')
 			{
 				int adjust = 0;
@@ -439,72 +625,27 @@ namespace ui
 				if (*(remainder - adjust) == ' ')
 				{
 					remainder -= adjust;
-					bounds = font->CalcTextSizeA(label->font_size, wrapWidth, 0.0f, lineToDraw, remainder);
+					bounds = font->CalcTextSizeA(run.font_size, wrapWidth, 0.0f, lineToDraw, remainder);
 				}
 			}
 			if (*remainder == ' ') { remainder++; }
 
 			if (align == Align::Center) { lineLoc.x = center.x + (wrapWidth - bounds.x) * 0.5f; }
 			else if (align == Align::Right) { lineLoc.x = center.x + (wrapWidth - bounds.x); }
-			ImGui::GetWindowDrawList()->AddText(font, label->font_size, lineLoc, textColor, lineToDraw, remainder);
+			ImGui::GetWindowDrawList()->AddText(font, run.font_size, lineLoc, textColor, lineToDraw, remainder);
 			lineToDraw = remainder;
 			lineLoc.y += bounds.y;  // move down one line
 		} while (strlen(lineToDraw) > 0 && ++loops < 5);
 	}
 
-	void ui_renderer::initializeAnimation(const animation_type animation_type,
-		const float a_screen_x,
-		const float a_screen_y,
-		const float a_offset_x,
-		const float a_offset_y,
-		const float width,
-		const float height,
-		const uint32_t a_modify,
-		const uint32_t a_alpha,
-		float a_duration)
-	{
-		if (a_alpha == 0) { return; }
-
-		// rlog::trace("starting inited animation");
-		constexpr auto angle = 0.0f;
-
-		const auto size = static_cast<uint32_t>(animation_frame_map[animation_type].size());
-		// const auto width  = static_cast<uint32_t>(animation_frame_map[animation_type][0].width);
-		// const auto height = static_cast<uint32_t>(animation_frame_map[animation_type][0].height);
-
-		std::unique_ptr<Animation> anim =
-			std::make_unique<FadeFramedOutAnimation>(ImVec2(a_screen_x + a_offset_x, a_screen_y + a_offset_y),
-				ImVec2(width, height),
-				angle,
-				a_alpha,
-				a_modify,
-				a_modify,
-				a_modify,
-				a_duration,
-				size);
-		animation_list.emplace_back(static_cast<ui::animation_type>(animation_type), std::move(anim));
-	}
-
-	void drawElement(ID3D11ShaderResourceView* texture,
+	void drawElement(const TextureData& image,
 		const ImVec2 center,
 		const ImVec2 size,
 		const float angle,
 		const soulsy::Color color)
 	{
 		const ImU32 im_color = IM_COL32(color.r, color.g, color.b, color.a * gHudAlpha);
-		drawElementInner(texture, center, size, angle, im_color);
-	}
-
-	ImVec2 rotateVector(const ImVec2 vector, const float angle)
-	{
-		const float cos_a = cosf(angle);
-		const float sin_a = sinf(angle);
-		const float sin_x = sin_a * vector.x;
-		const float cos_x = cos_a * vector.x;
-		const float sin_y = sin_a * vector.y;
-		const float cos_y = cos_a * vector.y;
-
-		return ImVec2(cos_x - sin_y, sin_x + cos_y);
+		drawElementInner(image, center, size, angle, im_color);
 	}
 
 	std::array<ImVec2, 4> rotateRectWithTranslation(const ImVec2 center, const ImVec2 size, const float angle)
@@ -531,7 +672,7 @@ namespace ui
 		};
 	}
 
-	void drawElementInner(ID3D11ShaderResourceView* texture,
+	void drawElementInner(const TextureData& image,
 		const ImVec2 center,
 		const ImVec2 size,
 		const float angle,
@@ -544,170 +685,164 @@ namespace ui
 		// 	center + ImRotate(ImVec2(+size.x * 0.5f, +size.y * 0.5f), cos_a, sin_a),
 		// 	center + ImRotate(ImVec2(-size.x * 0.5f, +size.y * 0.5f), cos_a, sin_a)
 
+		// An image evicted from the atlas while we were loading another has no texture.
+		if (!image.texture) { return; }
+		noteDrawn(image);
+
+		// Almost everything is drawn unrotated; skip the trig for those.
+		if (angle == 0.0f)
+		{
+			const ImVec2 half = size * 0.5f;
+			ImGui::GetWindowDrawList()->AddImage(
+				image.texture, center - half, center + half, image.uv0, image.uv1, im_color);
+			return;
+		}
+
 		std::array<ImVec2, 4> pos = rotateRectWithTranslation(center, size, angle);
-		ImGui::GetWindowDrawList()->AddImageQuad(
-			texture, pos[0], pos[1], pos[2], pos[3], FLAT_UVS[0], FLAT_UVS[1], FLAT_UVS[2], FLAT_UVS[3], im_color);
+		ImGui::GetWindowDrawList()->AddImageQuad(image.texture,
+			pos[0],
+			pos[1],
+			pos[2],
+			pos[3],
+			image.uv0,
+			ImVec2(image.uv1.x, image.uv0.y),
+			image.uv1,
+			ImVec2(image.uv0.x, image.uv1.y),
+			im_color);
 	}
 
-	void drawTextureQuad(ID3D11ShaderResourceView* texture, const std::array<ImVec2, 4> bounds, const Color color)
+	void drawTextureQuad(const TextureData& image, const std::array<ImVec2, 4> bounds, const Color color)
 	{
+		if (!image.texture) { return; }
+		noteDrawn(image);
 		const ImU32 im_color = IM_COL32(color.r, color.g, color.b, color.a * gHudAlpha);
-		ImGui::GetWindowDrawList()->AddImageQuad(texture,
+		ImGui::GetWindowDrawList()->AddImageQuad(image.texture,
 			bounds[0],
 			bounds[1],
 			bounds[2],
 			bounds[3],
-			FLAT_UVS[0],
-			FLAT_UVS[1],
-			FLAT_UVS[2],
-			FLAT_UVS[3],
+			image.uv0,
+			ImVec2(image.uv1.x, image.uv0.y),
+			image.uv1,
+			ImVec2(image.uv0.x, image.uv1.y),
 			im_color);
 	}
 
-	void drawAllSlots()
+	// Cut one frame out of a strip's sprite sheet. Frames run left to right, then top to
+	// bottom, each inset in its cell by the sheet's gutter.
+	bool spriteFrame(const std::string& strip, const uint32_t frame, TextureData& out)
 	{
-		auto topLayout          = hud_layout();
-		auto anchor             = topLayout.anchor;
-		auto hudsize            = topLayout.bg_size;
-		bool rangedEquipped     = player::hasRangedEquipped();
-		const auto settings     = user_settings();
-		const auto screenWidth  = resolutionWidth();
-		const auto screenHeight = resolutionHeight();
-		bool colorizeIcons      = settings->colorize_icons();
-
-		// If the layout is larger than the HUD, restrict it to one quarter screen size.
-		hudsize.x = std::min(screenWidth / 4.0f, hudsize.x);
-		hudsize.y = std::min(screenHeight / 4.0f, hudsize.y);
-
-		// If the layout is trying to draw the HUD offscreen, clamp it to an edge.
-		anchor.x = std::clamp(anchor.x, hudsize.x / 2.0f, screenWidth - hudsize.x / 2.0f);
-		anchor.y = std::clamp(anchor.y, hudsize.y / 2.0f, screenHeight - hudsize.y / 2.0f);
-
-		// Draw the HUD background if requested.
-		const auto bgimg = std::string(topLayout.bg_image);
-		if (topLayout.bg_color.a > 0 && ui_renderer::lazyLoadHudImage(bgimg))
-		{
-			constexpr auto angle                = 0.f;
-			const auto center                   = ImVec2(anchor.x, anchor.y);
-			const auto [texture, width, height] = HUD_IMAGES_MAP[bgimg];
-			const auto size                     = ImVec2(hudsize.x, hudsize.y);
-			drawElement(texture, center, size, angle, topLayout.bg_color);
-		}
+		if (!ui_renderer::lazyLoadSprite(strip)) { return false; }
+		const auto grid = SPRITE_GRIDS[strip];
+		if (frame >= grid.frames) { return false; }
+
+		const auto& sheet     = SPRITE_SHEETS[strip];
+		const auto rows       = (grid.frames + grid.columns - 1) / grid.columns;
+		const auto cellWidth  = sheet.width / static_cast<int32_t>(grid.columns);
+		const auto cellHeight = sheet.height / static_cast<int32_t>(rows);
+		const auto gutter     = static_cast<int32_t>(grid.gutter);
+		const auto uPerPixel  = (sheet.uv1.x - sheet.uv0.x) / static_cast<float>(sheet.width);
+		const auto vPerPixel  = (sheet.uv1.y - sheet.uv0.y) / static_cast<float>(sheet.height);
+		const auto left       = static_cast<int32_t>(frame % grid.columns) * cellWidth + gutter;
+		const auto top        = static_cast<int32_t>(frame / grid.columns) * cellHeight + gutter;
+
+		out        = sheet;
+		out.width  = cellWidth - 2 * gutter;
+		out.height = cellHeight - 2 * gutter;
+		out.uv0    = ImVec2(sheet.uv0.x + left * uPerPixel, sheet.uv0.y + top * vPerPixel);
+		out.uv1    = ImVec2(out.uv0.x + out.width * uPerPixel, out.uv0.y + out.height * vPerPixel);
+		return true;
+	}
 
-		for (auto slotLayout : topLayout.slots)
+	// Find the texture for a plan command's image, loading it if this is its first use.
+	bool planImage(const DrawCommand& command, TextureData& out)
+	{
+		const auto name = std::string(command.image);
+		switch (command.source)
 		{
-			if ((slotLayout.element == HudElement::Left) && topLayout.hide_left_when_irrelevant && rangedEquipped)
-			{
-				continue;
-			}
-			if ((slotLayout.element == HudElement::Ammo) && topLayout.hide_ammo_when_irrelevant && !rangedEquipped)
-			{
-				continue;
-			}
-
-			rust::Box<HudItem> entry = entry_to_show_in_slot(slotLayout.element);
-			if ((slotLayout.element == HudElement::EquipSet) && entry->name().empty())
-			{
-				// Do nothing for empty equipsets. TODO draw as empty slot
-				continue;
-			}
-
-			auto entry_name        = std::string(entry->name());
-			const auto hotkey      = settings->hotkey_for(slotLayout.element);
-			const auto slot_center = ImVec2(slotLayout.center.x, slotLayout.center.y);
-			const bool skipItem    = (entry_name.empty() && entry->icon_key().empty()) || entry->form_string().empty();
-
-			const auto slotbg = std::string(slotLayout.bg_image);
-			if (slotLayout.bg_color.a > 0 && ui_renderer::lazyLoadHudImage(slotbg))
-			{
-				const auto [texture, width, height] = HUD_IMAGES_MAP[slotbg];
-				const auto size                     = ImVec2(slotLayout.bg_size.x, slotLayout.bg_size.y);
-				drawElement(texture, slot_center, size, 0.f, slotLayout.bg_color);
-			}
-
-			// now draw the icon over the background...
-			if (slotLayout.icon_color.a > 0 && !skipItem)
-			{
-				const auto iconColor = colorizeIcons ? entry->color() : slotLayout.icon_color;
-				auto iconkey         = std::string(entry->icon_key());
-				if (ui_renderer::lazyLoadIcon(iconkey))
+			case ImageSource::Hud:
+				if (!ui_renderer::lazyLoadHudImage(name)) { return false; }
+				out = HUD_IMAGES_MAP[name];
+				return true;
+			case ImageSource::Icon:
+				if (!ui_renderer::lazyLoadIcon(name))
 				{
-					const auto [texture, width, height] = ICON_MAP[iconkey];
-					const auto scale =
-						width > height ? (slotLayout.icon_size.x / width) : (slotLayout.icon_size.y / height);
-					const auto size     = ImVec2(width * scale, height * scale);
-					const auto icon_pos = ImVec2(slotLayout.icon_center.x, slotLayout.icon_center.y);
-
-					drawElement(texture, icon_pos, size, 0.f, iconColor);
+					rlog::debug("lazy load for icon key {} failed; not drawing icon.", name);
+					return false;
 				}
-				else { rlog::debug("lazy load for icon key {} failed; not drawing icon.", iconkey); }
-			}
+				out = ICON_MAP[name];
+				return true;
+			case ImageSource::Hotkey: out = ui_renderer::iconForHotkey(command.hotkey); return true;
+			case ImageSource::Sprite: return spriteFrame(name, command.frame, out);
+			default: return false;
+		}
+	}
 
-			// Loop through the text elements of this slot.
-			if (!skipItem)
-			{
-				for (auto label : slotLayout.text)
-				{
-					if (label.color.a == 0) { continue; }
-					const auto textPos = ImVec2(label.anchor.x, label.anchor.y);
-					auto entrytxt      = std::string(entry->fmtstr(label.contents));
-					if (!entrytxt.empty()) { drawText(entrytxt, textPos, &label); }
-				}
-			}
+	// The draw plan has already decided what goes where; see controller/plan.rs.
+	void drawPlanCommand(const DrawCommand& command)
+	{
+		if (command.kind == DrawKind::Text)
+		{
+			drawText(command);
+			return;
+		}
+		if (command.kind == DrawKind::Strip)
+		{
+			drawStrip(command.points, command.color);
+			return;
+		}
 
-			// Draw the hotkey reminder if asked.
-			if (slotLayout.hotkey_color.a > 0)
-			{
-				const auto hk_im_center = ImVec2(slotLayout.hotkey_center.x, slotLayout.hotkey_center.y);
+		TextureData image;
+		if (!planImage(command, image)) { return; }
+		if (command.kind == DrawKind::ImageQuad && command.points.size() == 4)
+		{
+			const std::array<ImVec2, 4> corners = { toImVec2(command.points[0]),
+				toImVec2(command.points[1]),
+				toImVec2(command.points[2]),
+				toImVec2(command.points[3]) };
+			drawTextureQuad(image, corners, command.color);
+			return;
+		}
 
-				const auto hotkeybg = std::string(slotLayout.hotkey_bg_image);
-				if (slotLayout.hotkey_bg_color.a > 0 && ui_renderer::lazyLoadHudImage(hotkeybg))
-				{
-					const auto [texture, width, height] = HUD_IMAGES_MAP[hotkeybg];
-					const auto size                     = ImVec2(slotLayout.hotkey_size.x, slotLayout.hotkey_size.y);
-					drawElement(texture, hk_im_center, size, 0.f, slotLayout.hotkey_bg_color);
-				}
+		auto size = ImVec2(command.size.x, command.size.y);
+		if (command.fit && image.width > 0 && image.height > 0)
+		{
+			const auto width  = static_cast<float>(image.width);
+			const auto height = static_cast<float>(image.height);
+			const auto scale  = width > height ? (size.x / width) : (size.y / height);
+			size              = ImVec2(width * scale, height * scale);
+		}
+		drawElement(image, toImVec2(command.center), size, 0.f, command.color);
+	}
 
-				const auto [texture, width, height] = ui_renderer::iconForHotkey(hotkey);
-				const auto size                     = ImVec2(static_cast<float>(slotLayout.hotkey_size.x - 2.0f),
-                    static_cast<float>(slotLayout.hotkey_size.y - 2.0f));
-				drawElement(texture, hk_im_center, size, 0.f, slotLayout.hotkey_color);
-			}
+	bool advanceHud()
+	{
+		const auto timeDelta = ImGui::GetIO().DeltaTime;
+		advance_timers(timeDelta);
+		// Timers that ran out queued their work; equips happen here, on our thread, even while the HUD is hidden.
+		drain_commands();
 
-			// Charge/fuel meter.
-			if (slotLayout.meter_kind != MeterKind::None && entry->show_meter())
-			{
-				auto level = entry->meter_level();
-				if (slotLayout.meter_kind == MeterKind::CircleArc) { drawMeterCircleArc(level, slotLayout); }
-				else if (slotLayout.meter_kind == MeterKind::Rectangular) { drawMeterRectangular(level, slotLayout); }
-			}
+		if (!helpers::hudAllowedOnScreen()) return false;
+		makeFadeDecision();
+		advanceTransition(timeDelta);
+		if (gHudAlpha == 0.0f) { return false; }
 
-			// Finally, the poisoned indicator.
-			if (slotLayout.poison_color.a > 0 && entry->is_poisoned())
-			{
-				const auto poison_img = std::string(slotLayout.poison_image);
-				if (ui_renderer::lazyLoadHudImage(poison_img))
-				{
-					const auto poison_center = ImVec2(slotLayout.poison_center.x, slotLayout.poison_center.y);
-					const auto [texture, width, height] = HUD_IMAGES_MAP[poison_img];
-					const auto size                     = ImVec2(slotLayout.poison_size.x, slotLayout.poison_size.y);
-					drawElement(texture, poison_center, size, 0.f, slotLayout.poison_color);
-				}
-			}
+		// Game events mark items as stale when their charge, poison, or cooldown
+		// changes. We poll everything only rarely, in case we missed an event.
+		gSinceExtraDataPoll += timeDelta;
+		if (gSinceExtraDataPoll >= EXTRA_DATA_POLL)
+		{
+			refresh_hud_items();
+			gSinceExtraDataPoll = 0.0f;
 		}
+		else { refresh_stale_hud_items(); }
 
-		// drawAnimationFrame();
+		return true;
 	}
 
 	void drawHud()
 	{
-		const auto timeDelta = ImGui::GetIO().DeltaTime;
-		advanceTimers(timeDelta);
-
-		if (!helpers::hudAllowedOnScreen()) return;
-		makeFadeDecision();
-		advanceTransition(timeDelta);
-		if (gHudAlpha == 0.0f) { return; }
+		DRAWN_TEXTURES.clear();
 
 		static constexpr ImGuiWindowFlags window_flags =
 			ImGuiWindowFlags_NoBackground | ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoInputs;
@@ -719,27 +854,18 @@ namespace ui
 		ImGui::GetStyle().Alpha = gHudAlpha;
 
 		ImGui::Begin(HUD_NAME, nullptr, window_flags);
-
-		if (drawCounter >= REFRESH_DRAW_COUNT)
-		{
-			refresh_hud_items();
-			drawCounter = 0;
-		}
-
-		drawAllSlots();
-
+		for (const auto& command : hud_draw_plan()) { drawPlanCommand(command); }
 		ImGui::End();
-		drawCounter++;
 	}
 
+	// Only collects what to rasterize; preloadImages() does all of them in one batch.
 	template <typename T>
-	void ui_renderer::loadImagesForMap(std::map<std::string, T>& imagesMap,
+	void ui_renderer::queueImagesForMap(std::map<std::string, T>& imagesMap,
 		std::map<uint32_t, TextureData>& textureCache,
-		std::string& imgDirectory)
+		std::string& imgDirectory,
+		rust::Vec<RasterRequest>& requests,
+		std::vector<PendingImage>& pending)
 	{
-		const auto settings        = user_settings();
-		const auto resolutionScale = settings->resolution_scale();
-
 		for (const auto& entry : std::filesystem::directory_iterator(imgDirectory))
 		{
 			if (imagesMap.contains(entry.path().filename().string()))
@@ -750,56 +876,13 @@ namespace ui
 						entry.path().filename().string().c_str());
 					continue;
 				}
-				const auto index = static_cast<int32_t>(imagesMap[entry.path().filename().string()]);
-				if (loadTextureFromFile(entry.path().string().c_str(),
-						&textureCache[index].texture,
-						textureCache[index].width,
-						textureCache[index].height))
-				{
-					/*
-					rlog::trace("loading texture {}, type: {}, width: {}, height: {}"sv,
-						entry.path().filename().string().c_str(),
-						entry.path().filename().extension().string().c_str(),
-						textureCache[index].width,
-						textureCache[index].height);
-					*/
-				}
-				else { rlog::error("failed to load texture {}"sv, entry.path().filename().string().c_str()); }
-
-				textureCache[index].width  = static_cast<int32_t>(textureCache[index].width * resolutionScale);
-				textureCache[index].height = static_cast<int32_t>(textureCache[index].height * resolutionScale);
+				const auto index = static_cast<uint32_t>(imagesMap[entry.path().filename().string()]);
+				requests.push_back(RasterRequest{ rust::String(entry.path().string()), 0 });
+				pending.push_back(PendingImage{ entry.path().filename().string(), &textureCache, index });
 			}
 		}
 	}
 
-	void ui_renderer::loadAnimationFrames(std::string& file_path, std::vector<TextureData>& frame_list)
-	{
-		// const auto settings        = user_settings();
-		// const auto resolutionScale = settings->resolution_scale();
-
-		for (const auto& entry : std::filesystem::directory_iterator(file_path))
-		{
-			ID3D11ShaderResourceView* texture = nullptr;
-			int32_t width                     = 0;
-			int32_t height                    = 0;
-			if (entry.path().filename().extension() != ".svg")
-			{
-				rlog::warn(
-					"file {}, does not match supported extension '.svg'"sv, entry.path().filename().string().c_str());
-				continue;
-			}
-
-			loadTextureFromFile(entry.path().string().c_str(), &texture, width, height);
-
-			// rlog::trace("loading animation frame: {}"sv, entry.path().string().c_str());
-			TextureData img;
-			img.texture = texture;
-			// img.width   = static_cast<int32_t>(width * resolutionScale);
-			// img.height  = static_cast<int32_t>(height * resolutionScale);
-			frame_list.push_back(img);
-		}
-	}
-
 	TextureData ui_renderer::iconForHotkey(const uint32_t a_key)
 	{
 		const auto settings = user_settings();
@@ -826,8 +909,7 @@ namespace ui
 		std::string path      = R"(Data\SKSE\Plugins\resources\backgrounds\)" + key;
 		LoadedImage loadedImg = rasterize_by_path(path);
 		if (loadedImg.width == 0) { return false; }
-		if (d3dTextureFromBuffer(
-				&loadedImg, &HUD_IMAGES_MAP[key].texture, HUD_IMAGES_MAP[key].width, HUD_IMAGES_MAP[key].height))
+		if (atlasTextureFromBuffer(HUD_ATLAS_PREFIX + key, &loadedImg, false, HUD_IMAGES_MAP[key]))
 		{
 			rlog::info("Lazy-loaded hud bg image '{}'; width={}; height={}",
 				key,
@@ -839,54 +921,229 @@ namespace ui
 		return false;
 	}
 
-	void ui_renderer::loadFont()
+	// A strip's sprite sheet is rasterized on a worker the first time the strip is played.
+	// Until it's ready we draw nothing for it. Sheets aren't pinned, so the texture budget
+	// can evict one; the next frame that wants it asks for it again.
+	bool ui_renderer::lazyLoadSprite(std::string strip)
 	{
-		auto hud         = hud_layout();
-		auto fontfile    = std::string(hud.font);
-		std::string path = R"(Data\SKSE\Plugins\resources\fonts\)" + fontfile;
-		auto file_path   = std::filesystem::path(path);
-
-		rlog::trace(
-			"about to try to load font; size={}; globalScale={}; path={}"sv, hud.font_size, hud.global_scale, path);
-		triedFontLoad = true;
+		const auto found = SPRITE_GRIDS.find(strip);
+		if (found != SPRITE_GRIDS.end()) { return found->second.columns > 0; }
+
+		auto sheet = take_sprite_sheet(strip);
+		if (sheet.frames == 0) { return false; }
+		if (!atlasTextureFromBuffer(SPRITE_ATLAS_PREFIX + strip, &sheet.image, false, SPRITE_SHEETS[strip]))
+		{
+			rlog::warn("Failed to upload animation '{}'; it won't be drawn."sv, strip);
+			SPRITE_SHEETS.erase(strip);
+			SPRITE_GRIDS[strip] = SpriteGrid();
+			return false;
+		}
+		SPRITE_GRIDS[strip] = SpriteGrid{ sheet.frames, sheet.columns, sheet.gutter };
+		rlog::info("Lazy-loaded animation '{}'; frames={}; width={}; height={}",
+			strip,
+			sheet.frames,
+			SPRITE_SHEETS[strip].width,
+			SPRITE_SHEETS[strip].height);
+		return true;
+	}
+
+	// Runs on its own thread. Building the atlas rasterizes every glyph, which for a
+	// large font is long enough to see as a hitch if it happened in Present. ImGui
+	// counts allocations in its context for the metrics window; that counter is the
+	// only thing this shares with the render thread, and nothing we draw reads it.
+	void buildFontAtlas(FontBuild build, float size)
+	{
+		const auto started = std::chrono::steady_clock::now();
+		auto file_path     = std::filesystem::path(build.path);
 		if (std::filesystem::is_regular_file(file_path) &&
 			((file_path.extension() == ".ttf") || (file_path.extension() == ".otf")))
 		{
-			ImGuiIO& io = ImGui::GetIO();
-			ImVector<ImWchar> ranges;
-			ImFontGlyphRangesBuilder builder;
-
-			builder.AddRanges(io.Fonts->GetGlyphRangesDefault());
-			if (hud.chinese_full_glyphs) { builder.AddRanges(io.Fonts->GetGlyphRangesChineseFull()); }
-			if (hud.simplified_chinese_glyphs) { builder.AddRanges(io.Fonts->GetGlyphRangesChineseSimplifiedCommon()); }
-			if (hud.cyrillic_glyphs) { builder.AddRanges(io.Fonts->GetGlyphRangesCyrillic()); }
-			if (hud.japanese_glyphs) { builder.AddRanges(io.Fonts->GetGlyphRangesJapanese()); }
-			if (hud.korean_glyphs) { builder.AddRanges(io.Fonts->GetGlyphRangesKorean()); }
-			if (hud.thai_glyphs) { builder.AddRanges(io.Fonts->GetGlyphRangesThai()); }
-			if (hud.vietnamese_glyphs) { builder.AddRanges(io.Fonts->GetGlyphRangesVietnamese()); }
-
-			builder.BuildRanges(&ranges);
-			auto scaledSize = hud.font_size;
-
-			imFont = io.Fonts->AddFontFromFileTTF(file_path.string().c_str(), scaledSize, nullptr, ranges.Data);
-			if (io.Fonts->Build())
+			build.atlas = IM_NEW(ImFontAtlas)();
+			build.font  = build.atlas->AddFontFromFileTTF(build.path.c_str(), size, nullptr, build.ranges.data());
+			unsigned char* pixels = nullptr;
+			// The DX11 backend uploads RGBA, so convert here rather than in Present.
+			if (build.font && build.atlas->Build())
 			{
-				ImGui_ImplDX11_CreateDeviceObjects();
-				rlog::info("font loaded; path={}"sv, path);
-				return;
+				build.atlas->GetTexDataAsRGBA32(&pixels, &build.width, &build.height);
 			}
+			if (!pixels)
+			{
+				IM_DELETE(build.atlas);
+				build.atlas = nullptr;
+				build.font  = nullptr;
+			}
+		}
+
+		const auto elapsed =
+			std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+		if (build.atlas)
+		{
+			rlog::info("font atlas built off the render thread; path={}; glyph ranges={}; texture={}x{}; took {} ms"sv,
+				build.path,
+				build.ranges.size() / 2,
+				build.width,
+				build.height,
+				elapsed.count());
+		}
+		else { rlog::warn("failed to build a font atlas; path={}; took {} ms"sv, build.path, elapsed.count()); }
+
+		{
+			std::lock_guard<std::mutex> lock(FONT_BUILD_LOCK);
+			// A build nobody took yet is stale now.
+			if (FINISHED_FONT.atlas) { IM_DELETE(FINISHED_FONT.atlas); }
+			FINISHED_FONT = std::move(build);
+			FONT_BUILD_READY.store(true);
 		}
+		FONT_BUILD_RUNNING.store(false);
 	}
 
+	// Start building the HUD font in the background. Called once data is loaded, and
+	// again whenever the HUD needs glyphs the font hasn't got. Only one build runs at
+	// a time; if one is under way this does nothing, and the next frame asks again.
+	void ui_renderer::loadFont()
+	{
+		if (FONT_BUILD_RUNNING.exchange(true)) { return; }
+
+		const auto font = layout_font();
+		auto build      = FontBuild();
+		build.path      = R"(Data\SKSE\Plugins\resources\fonts\)" + std::string(font.file);
+
+		rlog::trace("about to try to load font; size={}; path={}"sv, font.size, build.path);
+		triedFontLoad.store(true);
+		// Read before the ranges, so glyphs noted while we build trigger another build.
+		FONT_GLYPHS_GENERATION.store(font_glyphs_generation());
+		for (const auto codepoint : font_glyph_ranges()) { build.ranges.push_back(static_cast<ImWchar>(codepoint)); }
+		build.ranges.push_back(0);
+
+		std::thread(buildFontAtlas, std::move(build), font.size).detach();
+	}
+
+	// Upload a font atlas's pixels, the way the DX11 backend does for the first font.
+	// Only the texture is new; the backend's shaders, buffers, and sampler stay as they are.
+	ID3D11ShaderResourceView* ui_renderer::fontTextureView(unsigned char* pixels, int width, int height)
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.Width            = width;
+		desc.Height           = height;
+		desc.MipLevels        = 1;
+		desc.ArraySize        = 1;
+		desc.Format           = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.SampleDesc.Count = 1;
+		desc.Usage            = D3D11_USAGE_DEFAULT;
+		desc.BindFlags        = D3D11_BIND_SHADER_RESOURCE;
+
+		D3D11_SUBRESOURCE_DATA sub_resource;
+		sub_resource.pSysMem          = pixels;
+		sub_resource.SysMemPitch      = desc.Width * 4;
+		sub_resource.SysMemSlicePitch = 0;
+
+		ID3D11Texture2D* texture = nullptr;
+		if (FAILED(device_->CreateTexture2D(&desc, &sub_resource, &texture))) { return nullptr; }
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc;
+		ZeroMemory(&srv_desc, sizeof srv_desc);
+		srv_desc.Format                    = DXGI_FORMAT_R8G8B8A8_UNORM;
+		srv_desc.ViewDimension             = D3D11_SRV_DIMENSION_TEXTURE2D;
+		srv_desc.Texture2D.MipLevels       = desc.MipLevels;
+		srv_desc.Texture2D.MostDetailedMip = 0;
+		ID3D11ShaderResourceView* view     = nullptr;
+		device_->CreateShaderResourceView(texture, &srv_desc, &view);
+		texture->Release();
+		return view;
+	}
+
+	// Swap a finished font atlas in for the one ImGui has. Called between frames, when
+	// ImGui isn't using its atlas, so all that's left to do here is the upload.
+	void ui_renderer::adoptBuiltFont()
+	{
+		if (!FONT_BUILD_READY.load()) { return; }
+
+		auto build = FontBuild();
+		{
+			std::lock_guard<std::mutex> lock(FONT_BUILD_LOCK);
+			build         = std::move(FINISHED_FONT);
+			FINISHED_FONT = FontBuild();
+			FONT_BUILD_READY.store(false);
+		}
+		if (!build.atlas) { return; }
+
+		const auto started    = std::chrono::steady_clock::now();
+		unsigned char* pixels = nullptr;
+		build.atlas->GetTexDataAsRGBA32(&pixels, &build.width, &build.height);
+		auto* view = fontTextureView(pixels, build.width, build.height);
+		if (!view)
+		{
+			rlog::error("Failed to upload the font atlas; path={}; size={}x{}"sv, build.path, build.width, build.height);
+			IM_DELETE(build.atlas);
+			return;
+		}
+		build.atlas->SetTexID(static_cast<ImTextureID>(view));
+
+		ImGuiIO& io    = ImGui::GetIO();
+		auto* previous = io.Fonts;
+		io.Fonts       = build.atlas;
+		imFont         = build.font;
+		// ImGui made the first atlas with IM_NEW too, and owns whichever one io.Fonts holds.
+		IM_DELETE(previous);
+		// Nothing draws from the old view once the kept frame is gone, below.
+		if (FONT_VIEW) { FONT_VIEW->Release(); }
+		FONT_VIEW         = view;
+		FONT_GLYPH_RANGES = std::move(build.ranges);
+		// The kept frame's text came from the old texture.
+		KEPT_FRAME.valid = false;
+		TEXTURE_GENERATION++;
+
+		const auto elapsed =
+			std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+		rlog::info("font swapped in; path={}; glyph ranges={}; upload took {} us"sv,
+			build.path,
+			FONT_GLYPH_RANGES.size() / 2,
+			elapsed.count());
+	}
+
+	// Text with characters the font hasn't got glyphs for is about to be drawn, or no
+	// font was asked for yet. Until a new font lands those characters draw as '?'.
+	void refreshFontGlyphs()
+	{
+		if (triedFontLoad.load() && font_glyphs_generation() == FONT_GLYPHS_GENERATION.load()) { return; }
+		ui_renderer::loadFont();
+	}
+
+	// Every key and button image, rasterized in parallel on the Rust side; all we
+	// do here is upload the results.
 	void ui_renderer::preloadImages()
 	{
-		loadImagesForMap(key_icon_name_map, key_struct, key_directory);
-		loadImagesForMap(default_key_icon_name_map, default_key_struct, key_directory);
-		loadImagesForMap(gamepad_ps_icon_name_map, PS5_BUTTON_MAP, key_directory);
-		loadImagesForMap(gamepad_xbox_icon_name_map, XBOX_BUTTON_MAP, key_directory);
+		rust::Vec<RasterRequest> requests;
+		std::vector<PendingImage> pending;
+		queueImagesForMap(key_icon_name_map, key_struct, key_directory, requests, pending);
+		queueImagesForMap(default_key_icon_name_map, default_key_struct, key_directory, requests, pending);
+		queueImagesForMap(gamepad_ps_icon_name_map, PS5_BUTTON_MAP, key_directory, requests, pending);
+		queueImagesForMap(gamepad_xbox_icon_name_map, XBOX_BUTTON_MAP, key_directory, requests, pending);
+
+		const auto started = std::chrono::steady_clock::now();
+		auto images        = rasterize_batch(rust::Slice<const RasterRequest>(requests.data(), requests.size()));
+		const auto rasterized = std::chrono::steady_clock::now();
+
+		const auto settings        = user_settings();
+		const auto resolutionScale = settings->resolution_scale();
+		for (size_t i = 0; i < pending.size(); i++)
+		{
+			auto& texture = (*pending[i].textureCache)[pending[i].index];
+			// Button glyphs are pinned in the atlas; they're loaded once and drawn constantly.
+			if (!atlasTextureFromBuffer(BUTTON_ATLAS_PREFIX + pending[i].filename, &images[i], true, texture))
+			{
+				rlog::error("failed to load texture {}"sv, pending[i].filename);
+			}
+			texture.width  = static_cast<int32_t>(texture.width * resolutionScale);
+			texture.height = static_cast<int32_t>(texture.height * resolutionScale);
+		}
 
-		loadAnimationFrames(highlight_animation_directory, animation_frame_map[animation_type::highlight]);
-		rlog::trace("frame length is {}"sv, animation_frame_map[animation_type::highlight].size());
+		const auto done = std::chrono::steady_clock::now();
+		rlog::info("preloaded {} button images; rasterizing took {} ms; uploading took {} ms"sv,
+			pending.size(),
+			std::chrono::duration_cast<std::chrono::milliseconds>(rasterized - started).count(),
+			std::chrono::duration_cast<std::chrono::milliseconds>(done - rasterized).count());
 	}
 
 	float displayWidth() { return ImGui::GetIO().DisplaySize.x; }
@@ -1049,54 +1306,4 @@ namespace ui
 			}
 		}
 	}
-
-	// We implement timers using UI ticks. We don't need them to be
-	// particularly accurate, just good-feeling to humans. Because we only
-	// manage timers here, this is the right decision point for going into
-	// and out of slow motion.
-	void advanceTimers(float delta)
-	{
-		std::vector<uint8_t> to_remove;
-		std::map<uint8_t, float>::iterator iter;
-		for (iter = cycle_timers.begin(); iter != cycle_timers.end(); ++iter)
-		{
-			auto which     = iter->first;
-			auto remaining = iter->second;
-
-			remaining -= delta;
-			// rlog::trace("timer decremented; timer={}; delta={}; remaining={};"sv, which, delta, remaining);
-			if (remaining < 0.0f)
-			{
-				to_remove.push_back(which);
-				auto action = static_cast<Action>(which);
-				timer_expired(action);
-			}
-			else { cycle_timers[which] = remaining; }
-		}
-
-		for (const auto& xs : to_remove) { cycle_timers.erase(xs); }
-		if (cycle_timers.size() == 0) { helpers::exitSlowMotion(); }
-	}
-
-	void startTimer(Action which, uint32_t duration)
-	{
-		// We replace any existing timer for this slot.
-		// All incoming durations are in milliseconds, but our time deltas
-		// are floats where whole numbers are seconds. So we divide.
-		const auto settings = user_settings();
-		cycle_timers.insert_or_assign(static_cast<uint8_t>(which), static_cast<float>(duration) / 1000.0f);
-		rlog::debug("Started equip delay timer; which={}; duration={} ms;"sv, static_cast<uint8_t>(which), duration);
-		// TODO do not start slomo for long-presses???
-		if (settings->cycling_slows_time() && RE::PlayerCharacter::GetSingleton()->IsInCombat())
-		{
-			helpers::enterSlowMotion();
-		}
-	}
-
-	// remove timer from the map if it exists
-	void stopTimer(Action which)
-	{
-		cycle_timers.erase(static_cast<uint8_t>(which));
-		if (cycle_timers.size() == 0) { helpers::exitSlowMotion(); }
-	}
 }
@@ -1,6 +1,5 @@
 #pragma once
 
-#include "animation_handler.h"
 #include "image_path.h"
 #include "soulsy.h"
 
@@ -13,6 +12,19 @@ namespace ui
 		ID3D11ShaderResourceView* texture = nullptr;
 		int32_t width                     = 0;
 		int32_t height                    = 0;
+		// Where the image sits in its texture; most images share an atlas page.
+		ImVec2 uv0 = ImVec2(0.0f, 0.0f);
+		ImVec2 uv1 = ImVec2(1.0f, 1.0f);
+		// What the texture budget knows this image by; 0 for images it doesn't track.
+		uint32_t budgetId = 0;
+	};
+
+	// A preloaded image waiting for its rasterized pixels, and where its texture goes.
+	struct PendingImage
+	{
+		std::string filename;
+		std::map<uint32_t, TextureData>* textureCache = nullptr;
+		uint32_t index                                = 0;
 	};
 
 	// display-tweaks aware
@@ -22,39 +34,40 @@ namespace ui
 	float displayWidth();
 	float displayHeight();
 
+	// Each frame: advanceHud(), then drawHud() only if hudNeedsRebuild() says so.
+	bool advanceHud();
+	bool hudNeedsRebuild();
 	void drawHud();
+	void keepFrame(const ImDrawData* drawData);
+	void refreshFontGlyphs();
+	void reportDrawnTextures();
 
 	void makeFadeDecision();
 	bool showBriefly();
 	void setMaxAlpha(float max);
 	void setMinAlpha(float min);
 
-	void startTimer(Action which, uint32_t duration);
-	void stopTimer(Action which);
-	void advanceTimers(float delta);
 	void advanceTransition(float delta);
 	void startAlphaTransition(bool a_in, float a_value);
 	float easeInCubic(float progress);
 	float easeOutCubic(float progress);
 
-	void drawAllSlots();
-	void drawElement(ID3D11ShaderResourceView* texture,
+	void drawPlanCommand(const DrawCommand& command);
+	void drawElement(const TextureData& image,
 		const ImVec2 center,
 		const ImVec2 size,
 		const float angle,
 		const soulsy::Color color);
-	void drawElementInner(ID3D11ShaderResourceView* texture,
+	void drawElementInner(const TextureData& image,
 		const ImVec2 center,
 		const ImVec2 size,
 		const float angle,
 		const ImU32 im_color);  // retaining support for animations...
-	void drawText(const std::string text, const ImVec2 center, const TextFlattened* label);
-	void drawMeterCircleArc(float level, SlotFlattened slotLayout);
-	void drawMeterRectangular(float level, SlotFlattened slotLayout);
-	ImVec2 rotateVector(const ImVec2 vector, const float angle);
+	void drawText(const DrawCommand& run);
+	void drawStrip(const rust::Vec<Point>& points, const soulsy::Color color);
 	std::array<ImVec2, 4> rotateRectWithTranslation(const ImVec2 center, const ImVec2 size, const float angle);
 	std::array<ImVec2, 4> rotateRect(const ImVec2 size, const float angle);
-	void drawTextureQuad(ID3D11ShaderResourceView* texture,
+	void drawTextureQuad(const TextureData& image,
 		const std::array<ImVec2, 4> bounds,
 		const soulsy::Color color);
 	size_t rasterizedSVGCount();
@@ -72,43 +85,37 @@ namespace ui
 
 		ui_renderer();
 
-		static void initializeAnimation(animation_type animation_type,
-			float a_screen_x,
-			float a_screen_y,
-			float a_offset_x,
-			float a_offset_y,
-			float width,
-			float height,
-			uint32_t a_modify,
-			uint32_t a_alpha,
-			float a_duration);
-
-		static bool loadTextureFromFile(const char* filename,
-			ID3D11ShaderResourceView** out_srv,
-			std::int32_t& out_width,
-			std::int32_t& out_height);
 		static bool d3dTextureFromBuffer(LoadedImage* loadedImg,
 			ID3D11ShaderResourceView** out_srv,
 			int32_t& out_width,
 			int32_t& out_height);
+		static bool atlasTextureFromBuffer(const std::string& key,
+			LoadedImage* loadedImg,
+			bool pinned,
+			TextureData& out);
+		static ID3D11Texture2D* atlasPage(uint32_t page, uint32_t pageSize);
+		static ID3D11ShaderResourceView* fontTextureView(unsigned char* pixels, int width, int height);
+		// Swaps a font loadFont() built in for ImGui's; Present calls it between frames.
+		static void adoptBuiltFont();
 
 		static inline ID3D11Device* device_         = nullptr;
 		static inline ID3D11DeviceContext* context_ = nullptr;
 
 		template <typename T>
-		static void loadImagesForMap(std::map<std::string, T>& a_map,
+		static void queueImagesForMap(std::map<std::string, T>& a_map,
 			std::map<uint32_t, TextureData>& a_struct,
-			std::string& file_path);
-
-		static void loadAnimationFrames(std::string& file_path, std::vector<TextureData>& frame_list);
-		static void drawAnimationFrame();
+			std::string& file_path,
+			rust::Vec<RasterRequest>& requests,
+			std::vector<PendingImage>& pending);
 
 	public:
 		// This only loads key/controller hotkey images.
 		static void preloadImages();
+		// Builds the font on a worker thread; adoptBuiltFont() swaps it in.
 		static void loadFont();
 		static bool lazyLoadIcon(std::string name);
 		static bool lazyLoadHudImage(std::string fname);
+		static bool lazyLoadSprite(std::string strip);
 		static TextureData iconForHotkey(uint32_t a_key);
 
 		struct d_3d_init_hook
@@ -0,0 +1,75 @@
+#pragma once
+
+// Parsing and writing form spec strings, which look like `Plugin.esp|0xdeadbeef`.
+// This header deliberately depends on nothing from the game or from CommonLib,
+// so it stays a standalone unit. Nothing here allocates or throws: malformed
+// specs, e.g. from a damaged cosave, simply fail to parse.
+//
+// The Rust side has the same grammar in src/data/form_spec.rs. Change them
+// together. The C++ tests are in tests/cpp/form_spec_tests.cpp; run them with
+// `just test-cpp`.
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace util
+{
+	struct FormSpecParts
+	{
+		// Points into the string that was parsed.
+		std::string_view plugin;
+		uint32_t id;
+	};
+
+	// Plugin name, one delimiter, then one to eight hex digits with an optional 0x prefix.
+	// Nothing else may follow. The plugin name cannot be empty or contain the delimiter.
+	constexpr std::optional<FormSpecParts> parseFormSpec(std::string_view spec)
+	{
+		const auto split = spec.find('|');
+		if (split == std::string_view::npos || split == 0) { return std::nullopt; }
+
+		const auto plugin = spec.substr(0, split);
+		auto digits       = spec.substr(split + 1);
+		if (digits.size() >= 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X'))
+		{
+			digits.remove_prefix(2);
+		}
+		if (digits.empty() || digits.size() > 8) { return std::nullopt; }
+
+		uint32_t id = 0;
+		for (const char c : digits)
+		{
+			uint32_t nibble = 0;
+			if (c >= '0' && c <= '9') { nibble = static_cast<uint32_t>(c - '0'); }
+			else if (c >= 'a' && c <= 'f') { nibble = static_cast<uint32_t>(c - 'a' + 10); }
+			else if (c >= 'A' && c <= 'F') { nibble = static_cast<uint32_t>(c - 'A' + 10); }
+			else { return std::nullopt; }
+			id = (id << 4) | nibble;
+		}
+
+		return FormSpecParts{ plugin, id };
+	}
+
+	// Room for the longest plugin file name the game allows, the delimiter, and 0x12345678.
+	inline constexpr size_t FORM_SPEC_BUFFER_SIZE = 260 + 1 + 10;
+	using FormSpecBuffer                          = std::array<char, FORM_SPEC_BUFFER_SIZE>;
+
+	// Write `plugin|0x%08x` into the buffer, returning a view of what was written.
+	// The view is only good for as long as the buffer is.
+	constexpr std::string_view writeFormSpec(FormSpecBuffer& buffer, std::string_view plugin, uint32_t id)
+	{
+		constexpr auto digits = "0123456789abcdef";
+
+		const auto plugin_len = plugin.size() < 260 ? plugin.size() : 260;
+		size_t pos            = 0;
+		for (; pos < plugin_len; ++pos) { buffer[pos] = plugin[pos]; }
+		buffer[pos++] = '|';
+		buffer[pos++] = '0';
+		buffer[pos++] = 'x';
+		for (int shift = 28; shift >= 0; shift -= 4) { buffer[pos++] = digits[(id >> shift) & 0xf]; }
+
+		return std::string_view(buffer.data(), pos);
+	}
+}
@@ -2,6 +2,7 @@
 
 #include "constant.h"
 #include "equippable.h"
+#include "form_spec.h"
 #include "gear.h"
 #include "player.h"
 #include "ui_renderer.h"
@@ -32,23 +33,42 @@ namespace helpers
 	// How you know I've been replaced by a pod person: if I ever declare that
 	// I love dealing with strings in systems programming languages.
 
+	// Borrow the bytes of a C string without copying them; no null terminator.
+	static rust::Slice<const uint8_t> charsAsSlice(const char* input)
+	{
+		if (!input) { return rust::Slice<const uint8_t>(); }
+		return rust::Slice<const uint8_t>(reinterpret_cast<const uint8_t*>(input), strlen(input));
+	}
+
+	// Rust remembers the encoding of each plugin's names, so it wants to know where they came from.
+	static std::string_view pluginName(const RE::TESForm* form)
+	{
+		const auto* file = form->GetFile(0);
+		if (!file) { return util::dynamic_name; }
+		return file->fileName;
+	}
+
+	static std::string formNameToUtf8(const RE::TESForm* form, const char* name)
+	{
+		const auto plugin = pluginName(form);
+		const auto plugin_bytes =
+			rust::Slice<const uint8_t>(reinterpret_cast<const uint8_t*>(plugin.data()), plugin.size());
+		return std::string(name_to_utf8(plugin_bytes, charsAsSlice(name)));
+	}
+
 	std::string nameAsUtf8(const RE::TESForm* form)
 	{
 		// absolutely must never look for a bound object for this puppy.
 		// It is called by bound object finder functions.
-		auto name     = form->GetName();  // this use is required
-		auto chonker  = helpers::chars_to_vec(name);
-		auto safename = std::string(cstr_to_utf8(chonker));
-		return safename;
+		auto name = form->GetName();  // this use is required
+		return formNameToUtf8(form, name);
 	}
 
 	std::string displayNameAsUtf8(const RE::TESForm* form)
 	{
 		// Do not call this from bound object finder functions.
-		auto name     = gear::displayName(form);
-		auto chonker  = helpers::chars_to_vec(name);
-		auto safename = std::string(cstr_to_utf8(chonker));
-		return safename;
+		auto name = gear::displayName(form);
+		return formNameToUtf8(form, name);
 	}
 
 	std::vector<uint8_t> chars_to_vec(const char* input)
@@ -188,29 +208,60 @@ namespace helpers
 		return translated;
 	}
 
+	// Form specs for plugin forms never change during a session, and the
+	// equip and inventory hooks ask for the same few over and over.
+	static constexpr size_t MAX_MEMOIZED_SPECS = 4096;
+	static std::unordered_map<const RE::TESForm*, std::string> formSpecMemo;
+	static std::mutex formSpecMemoLock;
+
 	std::string makeFormSpecString(RE::TESForm* form)
 	{
-		std::string form_string;
-		if (!form) { return form_string; }
+		if (!form) { return std::string(); }
 
+		util::FormSpecBuffer buffer;
 		if (form->IsDynamicForm())
 		{
-			// rlog::trace("it is dynamic"sv);
-			form_string = fmt::format("{}{}{:#08x}", util::dynamic_name, util::delimiter, form->GetFormID());
+			// Dynamic forms can be deleted and their memory reused, so we never memoize these.
+			return std::string(util::writeFormSpec(buffer, util::dynamic_name, form->GetFormID()));
 		}
-		else
-		{
-			auto* source_file = form->sourceFiles.array->front()->fileName;
-			auto local_form   = form->GetLocalFormID();
 
-			const auto hexified = rlog::formatAsHex(local_form);
-			// rlog::trace("source file='{}'; local id={}'; hex={};"sv, source_file, local_form, hexified);
-			form_string = fmt::format("{}{}{}", source_file, util::delimiter, hexified);
+		{
+			std::lock_guard<std::mutex> guard(formSpecMemoLock);
+			if (const auto found = formSpecMemo.find(form); found != formSpecMemo.end()) { return found->second; }
 		}
 
+		auto* source_file = form->sourceFiles.array->front()->fileName;
+		auto form_string  = std::string(util::writeFormSpec(buffer, source_file, form->GetLocalFormID()));
+
+		std::lock_guard<std::mutex> guard(formSpecMemoLock);
+		if (formSpecMemo.size() >= MAX_MEMOIZED_SPECS) { formSpecMemo.clear(); }
+		formSpecMemo.insert_or_assign(form, form_string);
 		return form_string;
 	}
 
+	// Resolved forms for plugin form specs, keyed by a hash of the spec. Forms
+	// from plugins live for the whole session, so the pointers stay valid until
+	// a load reshuffles everything. Dynamic forms can be deleted by the game at
+	// any time, so we never cache those.
+	struct ResolvedForm
+	{
+		std::string spec;
+		RE::TESForm* form;
+	};
+	static constexpr size_t MAX_RESOLVED_FORMS = 2048;
+	static std::unordered_map<size_t, ResolvedForm> resolvedForms;
+	static std::mutex resolvedFormsLock;
+
+	void forgetResolvedForms()
+	{
+		{
+			std::lock_guard<std::mutex> guard(resolvedFormsLock);
+			resolvedForms.clear();
+		}
+		std::lock_guard<std::mutex> guard(formSpecMemoLock);
+		formSpecMemo.clear();
+	}
+
 	RE::TESForm* formSpecToFormItem(const std::string& a_str)
 	{
 		if (a_str.empty())
@@ -218,40 +269,35 @@ namespace helpers
 			// rlog::debug("formSpecToFormItem() got empty string; this can never return an item.");
 			return nullptr;
 		}
-		if (!a_str.find(util::delimiter)) { return nullptr; }
-		RE::TESForm* form;
-
-		std::istringstream string_stream{ a_str };
-		std::string plugin, id;
 
-		std::getline(string_stream, plugin, *util::delimiter);
-		std::getline(string_stream, id);
-		RE::FormID form_id;
-		// strip off 0x if present
-		auto formline = std::istringstream(id);
-		formline.ignore(2, 'x');
-		formline >> std::hex >> form_id;
-
-		if (plugin.empty())
+		const auto maybe_parts = util::parseFormSpec(a_str);
+		if (!maybe_parts)
 		{
-			rlog::warn("malformed form spec? spec={};"sv, a_str);
+			// Proxy items like "health_proxy" land here too, so this is not worth a warning.
+			rlog::trace("not a form spec: '{}'"sv, a_str);
 			return nullptr;
 		}
+		const auto& [plugin, form_id] = *maybe_parts;
+
+		if (plugin == util::dynamic_name) { return RE::TESForm::LookupByID(form_id); }
 
-		if (plugin == util::dynamic_name) { form = RE::TESForm::LookupByID(form_id); }
-		else
+		const auto key = std::hash<std::string_view>{}(a_str);
 		{
-			const auto data_handler = RE::TESDataHandler::GetSingleton();
-			form                    = data_handler->LookupForm(form_id, plugin);
+			std::lock_guard<std::mutex> guard(resolvedFormsLock);
+			if (const auto found = resolvedForms.find(key); found != resolvedForms.end() && found->second.spec == a_str)
+			{
+				return found->second.form;
+			}
 		}
 
-		// if (form != nullptr)
-		// {
-		// 	rlog::trace("found form id for form spec='{}'; name='{}'; formID={}",
-		// 		a_str,
-		// 		helpers::nameAsUtf8(form),
-		// 		rlog::formatAsHex(form->GetFormID()));
-		// }
+		const auto data_handler = RE::TESDataHandler::GetSingleton();
+		auto* form              = data_handler->LookupForm(form_id, plugin);
+		if (!form) { return nullptr; }
+
+		std::lock_guard<std::mutex> guard(resolvedFormsLock);
+		// The cache is bounded, but anything in it is cheap to look up again.
+		if (resolvedForms.size() >= MAX_RESOLVED_FORMS) { resolvedForms.clear(); }
+		resolvedForms.insert_or_assign(key, ResolvedForm{ a_str, form });
 
 		return form;
 	}
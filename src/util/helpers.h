@@ -10,6 +10,8 @@
 namespace helpers
 {
 	RE::TESForm* formSpecToFormItem(const std::string& spec);
+	// Drop cached lookups between form specs and forms. Call when a save is loaded.
+	void forgetResolvedForms();
 	rust::Box<HudItem> formSpecToHudItem(const std::string& spec);
 	std::string makeFormSpecString(RE::TESForm* form);
 	// uint32_t getSelectedFormFromMenu(RE::UI*& a_ui);
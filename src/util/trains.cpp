@@ -24,6 +24,7 @@ void register_with_trainwreck()
 				{
 					log.write_line(fmt::format("{} icons loaded", ui::rasterizedSVGCount()));
 					log.write_line(fmt::format("{} hud items in cache", cache_size()));
+					log.write_line(std::string(texture_budget_report()));
 				});
 		});
 
@@ -0,0 +1,198 @@
+// Tests for the standalone form spec parser and writer in src/util/form_spec.h.
+// Nothing here needs the game, so these build and run anywhere: `just test-cpp`.
+//
+// Examples are checked at compile time, since both functions are constexpr. The
+// property and fuzz tests run with fixed seeds, so a failure always reproduces.
+
+#include "form_spec.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+using util::FormSpecBuffer;
+using util::parseFormSpec;
+using util::writeFormSpec;
+
+static int failures = 0;
+
+#define CHECK(condition)                                                                       \
+	do {                                                                                       \
+		if (!(condition))                                                                      \
+		{                                                                                      \
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			failures++;                                                                        \
+		}                                                                                      \
+	} while (0)
+
+// ---------- examples, at compile time
+
+constexpr bool parsesTo(std::string_view spec, std::string_view plugin, uint32_t id)
+{
+	const auto parts = parseFormSpec(spec);
+	return parts && parts->plugin == plugin && parts->id == id;
+}
+
+static_assert(parsesTo("Skyrim.esm|0x12eb7", "Skyrim.esm", 0x12eb7));
+static_assert(parsesTo("Skyrim.esm|0X12EB7", "Skyrim.esm", 0x12eb7));
+static_assert(parsesTo("Skyrim.esm|12eb7", "Skyrim.esm", 0x12eb7));
+static_assert(parsesTo("dynamic|0xff000800", "dynamic", 0xff000800));
+static_assert(parsesTo("a|0", "a", 0));
+static_assert(parsesTo("ÄÖÜ mod.esp|0xffffffff", "ÄÖÜ mod.esp", 0xffffffff));
+
+static_assert(!parseFormSpec(""));
+static_assert(!parseFormSpec("|0x12"));
+static_assert(!parseFormSpec("Skyrim.esm"));
+static_assert(!parseFormSpec("Skyrim.esm|"));
+static_assert(!parseFormSpec("Skyrim.esm|0x"));
+static_assert(!parseFormSpec("Skyrim.esm|0x123456789"));
+static_assert(!parseFormSpec("Skyrim.esm|0x12g4"));
+static_assert(!parseFormSpec("Skyrim.esm|0x12 "));
+static_assert(!parseFormSpec("Skyrim.esm|-12"));
+static_assert(!parseFormSpec("Skyrim.esm|0x1|0x2"));
+
+constexpr bool writes(std::string_view plugin, uint32_t id, std::string_view expected)
+{
+	FormSpecBuffer buffer{};
+	return writeFormSpec(buffer, plugin, id) == expected;
+}
+
+static_assert(writes("Skyrim.esm", 0x12eb7, "Skyrim.esm|0x00012eb7"));
+static_assert(writes("dynamic", 0xff000800, "dynamic|0xff000800"));
+static_assert(writes("a", 0, "a|0x00000000"));
+
+// ---------- properties
+
+static std::string randomPlugin(std::mt19937& rng)
+{
+	// Anything but the delimiter, including bytes that aren't ascii.
+	std::uniform_int_distribution<int> length(1, 260);
+	std::uniform_int_distribution<int> byte(1, 255);
+	std::string plugin(static_cast<size_t>(length(rng)), 'x');
+	for (auto& c : plugin)
+	{
+		do {
+			c = static_cast<char>(byte(rng));
+		} while (c == '|');
+	}
+	return plugin;
+}
+
+// Whatever we write, we read back exactly.
+static void writtenSpecsRoundTrip()
+{
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<uint32_t> ids;
+	for (int i = 0; i < 20000; i++)
+	{
+		const auto plugin = randomPlugin(rng);
+		const auto id     = ids(rng);
+		FormSpecBuffer buffer{};
+		const auto spec  = writeFormSpec(buffer, plugin, id);
+		const auto parts = parseFormSpec(spec);
+		CHECK(spec.size() == plugin.size() + 11);
+		CHECK(parts.has_value());
+		if (!parts) { continue; }
+		CHECK(parts->plugin == plugin);
+		CHECK(parts->id == id);
+	}
+}
+
+// Any spelling of an id we accept, in any case, with or without the prefix, is
+// the same id, and writing it again gives the one canonical spelling.
+static void acceptedSpellingsAgree()
+{
+	std::mt19937 rng(2);
+	std::uniform_int_distribution<uint32_t> ids;
+	std::uniform_int_distribution<int> coin(0, 1);
+	for (int i = 0; i < 20000; i++)
+	{
+		const auto id = ids(rng);
+		char digits[9];
+		std::snprintf(digits, sizeof digits, coin(rng) ? "%x" : "%X", id);
+		const auto spec = std::string("Dawnguard.esm|") + (coin(rng) ? "0x" : "") + digits;
+
+		const auto parts = parseFormSpec(spec);
+		CHECK(parts.has_value());
+		if (!parts) { continue; }
+		CHECK(parts->id == id);
+
+		FormSpecBuffer buffer{};
+		char canonical[32];
+		std::snprintf(canonical, sizeof canonical, "Dawnguard.esm|0x%08x", id);
+		CHECK(writeFormSpec(buffer, parts->plugin, parts->id) == canonical);
+	}
+}
+
+// ---------- fuzzing
+
+// Whatever parses must survive a rewrite and a second parse unchanged.
+static void checkParsesConsistently(std::string_view input)
+{
+	const auto parts = parseFormSpec(input);
+	if (!parts) { return; }
+	CHECK(!parts->plugin.empty());
+	CHECK(parts->plugin.find('|') == std::string_view::npos);
+	CHECK(parts->plugin.data() == input.data());
+
+	FormSpecBuffer buffer{};
+	const auto again = parseFormSpec(writeFormSpec(buffer, parts->plugin.substr(0, 260), parts->id));
+	CHECK(again.has_value());
+	if (again) { CHECK(again->id == parts->id); }
+}
+
+// Random bytes, weighted towards the characters the grammar cares about.
+static void randomInputNeverMisparses()
+{
+	static constexpr char interesting[] = "|0xX19afAFgG \t-+";
+	std::mt19937 rng(3);
+	std::uniform_int_distribution<int> length(0, 40);
+	std::uniform_int_distribution<int> byte(0, 255);
+	std::uniform_int_distribution<size_t> pick(0, sizeof interesting - 2);
+	for (int i = 0; i < 200000; i++)
+	{
+		std::string input(static_cast<size_t>(length(rng)), '\0');
+		for (auto& c : input) { c = byte(rng) < 128 ? interesting[pick(rng)] : static_cast<char>(byte(rng)); }
+		checkParsesConsistently(input);
+	}
+}
+
+// Damage valid specs the way a bad cosave might: flipped, dropped, and repeated bytes.
+static void damagedSpecsNeverMisparse()
+{
+	std::mt19937 rng(4);
+	std::uniform_int_distribution<uint32_t> ids;
+	std::uniform_int_distribution<int> byte(0, 255);
+	std::uniform_int_distribution<int> damage(0, 2);
+	for (int i = 0; i < 50000; i++)
+	{
+		FormSpecBuffer buffer{};
+		auto spec = std::string(writeFormSpec(buffer, "Update.esm", ids(rng)));
+		std::uniform_int_distribution<size_t> where(0, spec.size() - 1);
+		const auto at = where(rng);
+		switch (damage(rng))
+		{
+			case 0: spec[at] = static_cast<char>(byte(rng)); break;
+			case 1: spec.erase(at, 1); break;
+			default: spec.insert(at, 1, spec[at]); break;
+		}
+		checkParsesConsistently(spec);
+	}
+}
+
+int main()
+{
+	writtenSpecsRoundTrip();
+	acceptedSpellingsAgree();
+	randomInputNeverMisparses();
+	damagedSpecsNeverMisparse();
+
+	if (failures > 0)
+	{
+		std::fprintf(stderr, "%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	std::printf("form spec tests passed\n");
+	return EXIT_SUCCESS;
+}